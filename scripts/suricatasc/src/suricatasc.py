@@ -76,7 +76,7 @@ class SuricataCompleter:
 
 class SuricataSC:
     def __init__(self, sck_path, verbose=False):
-        self.cmd_list=['shutdown','quit','pcap-file','pcap-file-number','pcap-file-list','iface-list','iface-stat']
+        self.cmd_list=['shutdown','quit','pcap-file','pcap-file-number','pcap-file-list','iface-list','iface-stat','rule-profile','rule-profile-reset']
         self.sck_path = sck_path
         self.verbose = verbose
 
@@ -188,6 +188,20 @@ class SuricataSC:
                         else:
                             arguments = {}
                             arguments["iface"] = iface
+                    elif command.split(' ', 1)[0] == "rule-profile":
+                        arguments = {}
+                        cmd = "rule-profile"
+                        try:
+                            top = command.split()[1:]
+                            if len(top) == 2 and top[0] == "top":
+                                top = top[1:]
+                            if len(top) == 1:
+                                arguments["top"] = int(top[0])
+                            elif len(top) != 0:
+                                raise ValueError
+                        except ValueError:
+                            print "Error: usage is 'rule-profile [top] N'"
+                            continue
                     elif "conf-get" in command:
                         try:
                             [cmd, variable] = command.split(' ', 1)
@@ -63,9 +63,95 @@
 
 #include "util-memcmp.h"
 
+/**
+ * \brief Get the data size for a new body chunk
+ *
+ * \param want bytes the chunk should hold
+ *
+ * \retval size power of 2 between the min and max chunk size
+ */
+static uint32_t HtpBodyChunkSize(uint64_t want)
+{
+    uint32_t size = HTP_BODY_CHUNK_MIN_SIZE;
+    while (size < want && size < HTP_BODY_CHUNK_MAX_SIZE)
+        size <<= 1;
+    return size;
+}
+
+/**
+ * \brief Get a body chunk, max sized chunks from the state's chunk cache
+ *        if possible
+ *
+ * \param hstate state to take the chunk from, may be NULL
+ * \param size data size of the chunk
+ *
+ * \retval bd empty chunk or NULL on error
+ */
+static HtpBodyChunk *HtpBodyChunkAlloc(HtpState *hstate, uint32_t size)
+{
+    HtpBodyChunk *bd = NULL;
+
+    if (size == HTP_BODY_CHUNK_MAX_SIZE &&
+            hstate != NULL && hstate->body_chunk_cache != NULL) {
+        bd = hstate->body_chunk_cache;
+        hstate->body_chunk_cache = bd->next;
+        hstate->body_chunk_cache_cnt--;
+    } else {
+        bd = (HtpBodyChunk *)HTPMalloc(sizeof(HtpBodyChunk) + size);
+        if (bd == NULL)
+            return NULL;
+        bd->size = size;
+    }
+
+    bd->data = (uint8_t *)bd + sizeof(HtpBodyChunk);
+    bd->next = NULL;
+    bd->stream_offset = 0;
+    bd->len = 0;
+    return bd;
+}
+
+/**
+ * \brief Release a body chunk to the state's chunk cache or free it
+ *
+ * \param hstate state to give the chunk to, may be NULL
+ */
+static void HtpBodyChunkRelease(HtpState *hstate, HtpBodyChunk *bd)
+{
+    if (bd->size == HTP_BODY_CHUNK_MAX_SIZE && hstate != NULL &&
+            hstate->body_chunk_cache_cnt < HTP_BODY_CHUNK_CACHE_SIZE) {
+        bd->next = hstate->body_chunk_cache;
+        hstate->body_chunk_cache = bd;
+        hstate->body_chunk_cache_cnt++;
+        return;
+    }
+
+    HTPFree(bd, sizeof(HtpBodyChunk) + bd->size);
+}
+
+/**
+ * \brief Free the chunks cached in a state
+ */
+void HtpBodyChunkCacheFree(HtpState *hstate)
+{
+    HtpBodyChunk *bd = hstate->body_chunk_cache;
+    while (bd != NULL) {
+        HtpBodyChunk *next = bd->next;
+        HTPFree(bd, sizeof(HtpBodyChunk) + bd->size);
+        bd = next;
+    }
+    hstate->body_chunk_cache = NULL;
+    hstate->body_chunk_cache_cnt = 0;
+}
+
 /**
  * \brief Append a chunk of body to the HtpBody struct
  *
+ * The data is added to the free space of the last chunk first. As long
+ * as the body is held by a single chunk, that chunk is grown, so small
+ * bodies stay contiguous. After that new chunks are sized to the body
+ * received so far.
+ *
+ * \param hstate state owning the chunk cache, may be NULL
  * \param body pointer to the HtpBody holding the list
  * \param data pointer to the data of the chunk
  * \param len length of the chunk pointed by data
@@ -73,67 +159,64 @@
  * \retval 0 ok
  * \retval -1 error
  */
-int HtpBodyAppendChunk(HtpTxUserData *htud, HtpBody *body, uint8_t *data, uint32_t len)
+int HtpBodyAppendChunk(HtpState *hstate, HtpBody *body, uint8_t *data, uint32_t len)
 {
     SCEnter();
 
-    HtpBodyChunk *bd = NULL;
-
     if (len == 0 || data == NULL) {
         SCReturnInt(0);
     }
 
-    if (body->first == NULL) {
-        /* New chunk */
-        bd = (HtpBodyChunk *)HTPMalloc(sizeof(HtpBodyChunk));
-        if (bd == NULL)
-            goto error;
-
-        bd->len = len;
-        bd->stream_offset = 0;
-        bd->next = NULL;
-
-        bd->data = HTPMalloc(len);
-        if (bd->data == NULL) {
-            goto error;
+    while (len > 0) {
+        HtpBodyChunk *bd = body->last;
+
+        if (bd != NULL && bd == body->first && bd->len + len > bd->size &&
+                bd->size < HTP_BODY_CHUNK_MAX_SIZE)
+        {
+            uint32_t size = HtpBodyChunkSize((uint64_t)bd->len + len);
+            HtpBodyChunk *nbd = HTPRealloc(bd, sizeof(HtpBodyChunk) + bd->size,
+                    sizeof(HtpBodyChunk) + size);
+            if (nbd == NULL)
+                SCReturnInt(-1);
+
+            nbd->data = (uint8_t *)nbd + sizeof(HtpBodyChunk);
+            nbd->size = size;
+            body->first = body->last = bd = nbd;
         }
-        memcpy(bd->data, data, len);
 
-        body->first = body->last = bd;
-
-        body->content_len_so_far = len;
-    } else {
-        bd = (HtpBodyChunk *)HTPMalloc(sizeof(HtpBodyChunk));
-        if (bd == NULL)
-            goto error;
+        if (bd == NULL || bd->len == bd->size) {
+            uint64_t want = len;
+            if (body->content_len_so_far > want)
+                want = body->content_len_so_far;
+
+            bd = HtpBodyChunkAlloc(hstate, HtpBodyChunkSize(want));
+            if (bd == NULL)
+                SCReturnInt(-1);
+
+            bd->stream_offset = body->content_len_so_far;
+            if (body->first == NULL) {
+                body->first = body->last = bd;
+            } else {
+                body->last->next = bd;
+                body->last = bd;
+            }
+        }
 
-        bd->len = len;
-        bd->stream_offset = body->content_len_so_far;
-        bd->next = NULL;
+        uint32_t copy = bd->size - bd->len;
+        if (copy > len)
+            copy = len;
 
-        bd->data = HTPMalloc(len);
-        if (bd->data == NULL) {
-            goto error;
-        }
-        memcpy(bd->data, data, len);
+        memcpy(bd->data + bd->len, data, copy);
+        bd->len += copy;
+        body->content_len_so_far += copy;
 
-        body->last->next = bd;
-        body->last = bd;
+        data += copy;
+        len -= copy;
 
-        body->content_len_so_far += len;
+        SCLogDebug("Body %p; data %p, len %"PRIu32, body, bd->data, (uint32_t)bd->len);
     }
-    SCLogDebug("Body %p; data %p, len %"PRIu32, body, bd->data, (uint32_t)bd->len);
 
     SCReturnInt(0);
-
-error:
-    if (bd != NULL) {
-        if (bd->data != NULL) {
-            HTPFree(bd->data, bd->len);
-        }
-        HTPFree(bd, sizeof(HtpBodyChunk));
-    }
-    SCReturnInt(-1);
 }
 
 /**
@@ -163,10 +246,11 @@ void HtpBodyPrint(HtpBody *body)
 
 /**
  * \brief Free the information held in the request body
+ * \param hstate state owning the chunk cache, may be NULL
  * \param body pointer to the HtpBody holding the list
  * \retval none
  */
-void HtpBodyFree(HtpBody *body)
+void HtpBodyFree(HtpState *hstate, HtpBody *body)
 {
     SCEnter();
 
@@ -182,9 +266,7 @@ void HtpBodyFree(HtpBody *body)
     prev = body->first;
     while (prev != NULL) {
         cur = prev->next;
-        if (prev->data != NULL)
-            HTPFree(prev->data, prev->len);
-        HTPFree(prev, sizeof(HtpBodyChunk));
+        HtpBodyChunkRelease(hstate, prev);
         prev = cur;
     }
     body->first = body->last = NULL;
@@ -193,11 +275,15 @@ void HtpBodyFree(HtpBody *body)
 /**
  * \brief Free request body chunks that are already fully parsed.
  *
- * \param htud pointer to the HtpTxUserData holding the body
+ * Only chunks that were inspected completely are removed, as the last
+ * chunk may still be filled up by later data.
+ *
+ * \param hstate state owning the chunk cache, may be NULL
+ * \param body pointer to the HtpBody holding the list
  *
  * \retval none
  */
-void HtpBodyPrune(HtpBody *body)
+void HtpBodyPrune(HtpState *hstate, HtpBody *body)
 {
     SCEnter();
 
@@ -220,7 +306,7 @@ void HtpBodyPrune(HtpBody *body)
                 "body->body_parsed %"PRIu64, cur->stream_offset, cur->len,
                 cur->stream_offset + cur->len, body->body_parsed);
 
-        if (cur->stream_offset >= body->body_inspected) {
+        if (cur->stream_offset + cur->len > body->body_inspected) {
             break;
         }
 
@@ -229,10 +315,7 @@ void HtpBodyPrune(HtpBody *body)
             body->last = next;
         }
 
-        if (cur->data != NULL) {
-            HTPFree(cur->data, cur->len);
-        }
-        HTPFree(cur, sizeof(HtpBodyChunk));
+        HtpBodyChunkRelease(hstate, cur);
 
         cur = next;
     }
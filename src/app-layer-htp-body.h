@@ -28,9 +28,10 @@
 #ifndef __APP_LAYER_HTP_BODY_H__
 #define __APP_LAYER_HTP_BODY_H__
 
-int HtpBodyAppendChunk(HtpTxUserData *, HtpBody *, uint8_t *, uint32_t);
+int HtpBodyAppendChunk(HtpState *, HtpBody *, uint8_t *, uint32_t);
 void HtpBodyPrint(HtpBody *);
-void HtpBodyFree(HtpBody *);
-void HtpBodyPrune(HtpBody *);
+void HtpBodyFree(HtpState *, HtpBody *);
+void HtpBodyPrune(HtpState *, HtpBody *);
+void HtpBodyChunkCacheFree(HtpState *);
 
 #endif /* __APP_LAYER_HTP_BODY_H__ */
@@ -303,10 +303,10 @@ error:
     SCReturnPtr(NULL, "void");
 }
 
-static void HtpTxUserDataFree(HtpTxUserData *htud) {
+static void HtpTxUserDataFree(HtpState *state, HtpTxUserData *htud) {
     if (htud) {
-        HtpBodyFree(&htud->request_body);
-        HtpBodyFree(&htud->response_body);
+        HtpBodyFree(state, &htud->request_body);
+        HtpBodyFree(state, &htud->response_body);
         bstr_free(htud->request_uri_normalized);
         if (htud->request_headers_raw)
             HTPFree(htud->request_headers_raw, htud->request_headers_raw_len);
@@ -347,7 +347,7 @@ void HTPStateFree(void *state)
                 if (tx != NULL) {
                     HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
                     if (htud != NULL) {
-                        HtpTxUserDataFree(htud);
+                        HtpTxUserDataFree(s, htud);
                         htp_tx_set_user_data(tx, NULL);
                     }
                 }
@@ -356,6 +356,7 @@ void HTPStateFree(void *state)
         htp_connp_destroy_all(s->connp);
     }
 
+    HtpBodyChunkCacheFree(s);
     FileContainerFree(s->files_ts);
     FileContainerFree(s->files_tc);
     HTPFree(s, sizeof(HtpState));
@@ -389,7 +390,7 @@ static void HTPStateTransactionFree(void *state, uint64_t id) {
         /* This will remove obsolete body chunks */
         HtpTxUserData *htud = (HtpTxUserData *) htp_tx_get_user_data(tx);
         if (htud != NULL) {
-            HtpTxUserDataFree(htud);
+            HtpTxUserDataFree(s, htud);
             htp_tx_set_user_data(tx, NULL);
         }
 
@@ -1790,7 +1791,7 @@ int HTPCallbackRequestBodyData(htp_tx_data_t *d)
         }
         SCLogDebug("len %u", len);
 
-        HtpBodyAppendChunk(tx_ud, &tx_ud->request_body, (uint8_t *)d->data, len);
+        HtpBodyAppendChunk(hstate, &tx_ud->request_body, (uint8_t *)d->data, len);
 
         uint8_t *chunks_buffer = NULL;
         uint32_t chunks_buffer_len = 0;
@@ -1826,7 +1827,7 @@ int HTPCallbackRequestBodyData(htp_tx_data_t *d)
 
 end:
     /* see if we can get rid of htp body chunks */
-    HtpBodyPrune(&tx_ud->request_body);
+    HtpBodyPrune(hstate, &tx_ud->request_body);
 
     /* set the new chunk flag */
     hstate->flags |= HTP_FLAG_NEW_BODY_SET;
@@ -1894,13 +1895,13 @@ int HTPCallbackResponseBodyData(htp_tx_data_t *d)
         }
         SCLogDebug("len %u", len);
 
-        HtpBodyAppendChunk(tx_ud, &tx_ud->response_body, (uint8_t *)d->data, len);
+        HtpBodyAppendChunk(hstate, &tx_ud->response_body, (uint8_t *)d->data, len);
 
         HtpResponseBodyHandle(hstate, tx_ud, d->tx, (uint8_t *)d->data, (uint32_t)d->len);
     }
 
     /* see if we can get rid of htp body chunks */
-    HtpBodyPrune(&tx_ud->response_body);
+    HtpBodyPrune(hstate, &tx_ud->response_body);
 
     /* set the new chunk flag */
     hstate->flags |= HTP_FLAG_NEW_BODY_SET;
@@ -2097,7 +2098,7 @@ static int HTPCallbackRequestHeaderData(htp_tx_data_t *tx_data)
         HTPFree(tx_ud->request_headers_raw, tx_ud->request_headers_raw_len);
         tx_ud->request_headers_raw = NULL;
         tx_ud->request_headers_raw_len = 0;
-        HtpTxUserDataFree(tx_ud);
+        HtpTxUserDataFree(htp_connp_get_user_data(tx_data->tx->connp), tx_ud);
         htp_tx_set_user_data(tx_data->tx, NULL);
         return HTP_OK;
     }
@@ -2135,7 +2136,7 @@ static int HTPCallbackResponseHeaderData(htp_tx_data_t *tx_data)
         HTPFree(tx_ud->response_headers_raw, tx_ud->response_headers_raw_len);
         tx_ud->response_headers_raw = NULL;
         tx_ud->response_headers_raw_len = 0;
-        HtpTxUserDataFree(tx_ud);
+        HtpTxUserDataFree(htp_connp_get_user_data(tx_data->tx->connp), tx_ud);
         htp_tx_set_user_data(tx_data->tx, NULL);
         return HTP_OK;
     }
@@ -5553,9 +5554,9 @@ static int HTPBodyReassemblyTest01(void)
     uint8_t chunk1[] = "--e5a320f21416a02493a0a6f561b1c494\r\nContent-Disposition: form-data; name=\"uploadfile\"; filename=\"D2GUef.jpg\"\r";
     uint8_t chunk2[] = "POST /uri HTTP/1.1\r\nHost: hostname.com\r\nKeep-Alive: 115\r\nAccept-Charset: utf-8\r\nUser-Agent: Mozilla/5.0 (X11; Linux i686; rv:9.0.1) Gecko/20100101 Firefox/9.0.1\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nConnection: keep-alive\r\nContent-length: 68102\r\nReferer: http://otherhost.com\r\nAccept-Encoding: gzip\r\nContent-Type: multipart/form-data; boundary=e5a320f21416a02493a0a6f561b1c494\r\nCookie: blah\r\nAccept-Language: us\r\n\r\n--e5a320f21416a02493a0a6f561b1c494\r\nContent-Disposition: form-data; name=\"uploadfile\"; filename=\"D2GUef.jpg\"\r";
 
-    int r = HtpBodyAppendChunk(&htud, &htud.request_body, (uint8_t *)chunk1, sizeof(chunk1)-1);
+    int r = HtpBodyAppendChunk(&hstate, &htud.request_body, (uint8_t *)chunk1, sizeof(chunk1)-1);
     BUG_ON(r != 0);
-    r = HtpBodyAppendChunk(&htud, &htud.request_body, (uint8_t *)chunk2, sizeof(chunk2)-1);
+    r = HtpBodyAppendChunk(&hstate, &htud.request_body, (uint8_t *)chunk2, sizeof(chunk2)-1);
     BUG_ON(r != 0);
 
     uint8_t *chunks_buffer = NULL;
@@ -5586,6 +5587,81 @@ end:
     return result;
 }
 
+/** \test body data is packed into chunks, pruned chunks are reused */
+static int HTPBodyChunkTest01(void)
+{
+    int result = 0;
+    HtpState hstate;
+    memset(&hstate, 0x00, sizeof(hstate));
+    HtpBody body;
+    memset(&body, 0x00, sizeof(body));
+    uint8_t data[3000];
+    uint8_t check[9000];
+    static uint8_t big[70000];
+    int i;
+
+    /* a small body is grown in a single chunk */
+    for (i = 0; i < 3; i++) {
+        memset(data, 'a' + i, sizeof(data));
+        memcpy(check + i * sizeof(data), data, sizeof(data));
+        if (HtpBodyAppendChunk(&hstate, &body, data, sizeof(data)) != 0)
+            goto end;
+        if (body.first == NULL || body.first != body.last)
+            goto end;
+    }
+    if (body.content_len_so_far != 9000 || body.first->len != 9000 ||
+        body.first->size != 16384 ||
+        memcmp(body.first->data, check, sizeof(check)) != 0)
+        goto end;
+
+    /* grown up to the max chunk size, then a new chunk */
+    memset(big, 'x', sizeof(big));
+    if (HtpBodyAppendChunk(&hstate, &body, big, sizeof(big)) != 0)
+        goto end;
+    if (body.content_len_so_far != 79000 || body.first->next != body.last ||
+        body.first->size != HTP_BODY_CHUNK_MAX_SIZE ||
+        body.first->len != HTP_BODY_CHUNK_MAX_SIZE ||
+        memcmp(body.first->data, check, sizeof(check)) != 0 ||
+        body.last->size != HTP_BODY_CHUNK_MAX_SIZE ||
+        body.last->stream_offset != HTP_BODY_CHUNK_MAX_SIZE ||
+        body.last->len != 79000 - HTP_BODY_CHUNK_MAX_SIZE ||
+        body.last->data[0] != 'x')
+        goto end;
+
+    /* first chunk inspected: goes to the cache */
+    body.body_parsed = 1;
+    body.body_inspected = HTP_BODY_CHUNK_MAX_SIZE;
+    HtpBodyPrune(&hstate, &body);
+    if (body.first != body.last || hstate.body_chunk_cache_cnt != 1)
+        goto end;
+
+    /* fills up the last chunk */
+    if (HtpBodyAppendChunk(&hstate, &body, big,
+                2 * HTP_BODY_CHUNK_MAX_SIZE - 79000) != 0)
+        goto end;
+    if (body.first != body.last || body.last->len != HTP_BODY_CHUNK_MAX_SIZE ||
+        hstate.body_chunk_cache_cnt != 1)
+        goto end;
+
+    /* needs a new chunk, taken from the cache */
+    if (HtpBodyAppendChunk(&hstate, &body, data, 10) != 0)
+        goto end;
+    if (hstate.body_chunk_cache_cnt != 0 || body.first == body.last ||
+        body.last->stream_offset != 2 * HTP_BODY_CHUNK_MAX_SIZE ||
+        body.last->len != 10 || body.last->data[0] != 'c')
+        goto end;
+
+    HtpBodyFree(&hstate, &body);
+    if (body.first != NULL || hstate.body_chunk_cache_cnt != 2)
+        goto end;
+
+    result = 1;
+end:
+    HtpBodyFree(&hstate, &body);
+    HtpBodyChunkCacheFree(&hstate);
+    return result;
+}
+
 /** \test BG crash */
 static int HTPSegvTest01(void) {
     int result = 0;
@@ -5978,6 +6054,7 @@ void HTPParserRegisterTests(void) {
     UtRegisterTest("HTPParserDecodingTest09", HTPParserDecodingTest09, 1);
 
     UtRegisterTest("HTPBodyReassemblyTest01", HTPBodyReassemblyTest01, 1);
+    UtRegisterTest("HTPBodyChunkTest01", HTPBodyChunkTest01, 1);
 
     UtRegisterTest("HTPSegvTest01", HTPSegvTest01, 1);
 
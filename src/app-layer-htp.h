@@ -155,12 +155,22 @@ typedef struct HTPCfgRec_ {
     int                 randomize_range;
 } HTPCfgRec;
 
-/** Struct used to hold chunks of a body on a request */
+/** min and max data size of a body chunk. Body data is packed into the
+ *  chunks, so a chunk usually holds several libhtp data callbacks. Chunk
+ *  sizes are powers of 2 that grow with the body. */
+#define HTP_BODY_CHUNK_MIN_SIZE     256
+#define HTP_BODY_CHUNK_MAX_SIZE     16384
+/** max number of free max sized body chunks a HtpState keeps for reuse */
+#define HTP_BODY_CHUNK_CACHE_SIZE   2
+
+/** Struct used to hold chunks of a body on a request. The chunk's data
+ *  follows the struct in the same allocation. */
 struct HtpBodyChunk_ {
     uint8_t *data;              /**< Pointer to the data of the chunk */
     struct HtpBodyChunk_ *next; /**< Pointer to the next chunk */
     uint64_t stream_offset;
     uint32_t len;               /**< Length of the chunk */
+    uint32_t size;              /**< Size of the chunk's data buffer */
 } __attribute__((__packed__));
 typedef struct HtpBodyChunk_ HtpBodyChunk;
 
@@ -244,6 +254,9 @@ typedef struct HtpState_ {
     uint16_t flags;
     uint16_t events;
     uint16_t htp_messages_offset; /**< offset into conn->messages list */
+    uint16_t body_chunk_cache_cnt;
+    /** free body chunks, reused by the bodies of the next txs */
+    HtpBodyChunk *body_chunk_cache;
 } HtpState;
 
 /** part of the engine needs the request body (e.g. http_client_body keyword) */
@@ -268,7 +281,6 @@ htp_tx_t *HTPTransactionMain(const HtpState *);
 int HTPCallbackRequestBodyData(htp_tx_data_t *);
 int HtpTransactionGetLoggableId(Flow *);
 void HtpBodyPrint(HtpBody *);
-void HtpBodyFree(HtpBody *);
 /* To free the state from unittests using app-layer-htp */
 void HTPStateFree(void *);
 void AppLayerHtpEnableRequestBodyCallback(void);
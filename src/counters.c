@@ -297,8 +297,9 @@ static void SCPerfReleaseOPCtx()
  */
 static void *SCPerfMgmtThread(void *arg)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv_local = (ThreadVars *)arg;
     uint8_t run = 1;
@@ -364,8 +365,9 @@ static void *SCPerfMgmtThread(void *arg)
  */
 static void *SCPerfWakeupThread(void *arg)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv_local = (ThreadVars *)arg;
     uint8_t run = 1;
@@ -38,6 +38,7 @@
 #include "util-debug.h"
 #include "util-optimize.h"
 #include "flow.h"
+#include "flow-bypass.h"
 #include "util-profiling.h"
 #include "pkt-var.h"
 #include "host.h"
@@ -202,8 +203,22 @@ int DecodeTCP(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p, uint8_t *pkt, ui
         p->tcpvars.mss ? "MSS " : "");
 #endif
 
+    /* packets of bypassed flows skip the flow, stream and detect engines */
+    if (dtv->bypass_table != NULL &&
+            FlowBypassTableLookup(dtv->bypass_table, p) == 1) {
+        SCPerfCounterIncr(dtv->counter_bypassed_pkts, tv->sc_perf_pca);
+        SCPerfCounterAddUI64(dtv->counter_bypassed_bytes, tv->sc_perf_pca,
+                GET_PKT_LEN(p));
+        DecodeSetNoPacketInspectionFlag(p);
+        p->flags |= (PKT_FLOW_BYPASSED|PKT_STREAM_NOPCAPLOG);
+        return TM_ECODE_OK;
+    }
+
     /* Flow is an integral part of us */
-    FlowHandlePacket(tv, p);
+    FlowHandlePacket(tv, dtv, p);
+
+    if ((p->flags & PKT_FLOW_BYPASSED) && dtv->bypass_table != NULL)
+        FlowBypassTableAdd(dtv->bypass_table, p);
 
     return TM_ECODE_OK;
 }
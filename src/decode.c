@@ -55,6 +55,9 @@
 #include "util-mem.h"
 #include "app-layer-detect-proto.h"
 #include "app-layer.h"
+#include "flow-bypass.h"
+#include "flow-spare-cache.h"
+#include "stream-tcp.h"
 #include "tm-threads.h"
 #include "util-error.h"
 #include "util-print.h"
@@ -255,6 +258,7 @@ Packet *PacketTunnelPktSetup(ThreadVars *tv, DecodeThreadVars *dtv, Packet *pare
     /* copy packet and set lenght, proto */
     PacketCopyData(p, pkt, len);
     p->recursion_level = parent->recursion_level + 1;
+    p->time_domain = parent->time_domain;
     p->ts.tv_sec = parent->ts.tv_sec;
     p->ts.tv_usec = parent->ts.tv_usec;
     p->datalink = DLT_RAW;
@@ -334,6 +338,7 @@ Packet *PacketDefragPktSetup(Packet *parent, uint8_t *pkt, uint16_t len, uint8_t
     p->vlan_id[0] = parent->vlan_id[0];
     p->vlan_id[1] = parent->vlan_id[1];
     p->vlan_idx = parent->vlan_idx;
+    p->time_domain = parent->time_domain;
 
     SCReturnPtr(p, "Packet");
 }
@@ -428,6 +433,20 @@ void DecodeRegisterPerfCounters(DecodeThreadVars *dtv, ThreadVars *tv)
         SCPerfTVRegisterCounter("defrag.max_frag_hits", tv,
             SC_PERF_TYPE_UINT64, "NULL");
 
+    dtv->counter_bypassed_pkts =
+        SCPerfTVRegisterCounter("decoder.bypassed_pkts", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_bypassed_bytes =
+        SCPerfTVRegisterCounter("decoder.bypassed_bytes", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+
+    dtv->counter_flow_spare_refills =
+        SCPerfTVRegisterCounter("flow.spare_cache_refills", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+    dtv->counter_flow_spare_misses =
+        SCPerfTVRegisterCounter("flow.spare_cache_misses", tv,
+            SC_PERF_TYPE_UINT64, "NULL");
+
     return;
 }
 
@@ -472,9 +491,38 @@ DecodeThreadVars *DecodeThreadVarsAlloc(ThreadVars *tv)
     }
     SCLogDebug("vlan tracking is %s", dtv->vlan_disabled == 0 ? "enabled" : "disabled");
 
+    if (StreamTcpBypassEnabled()) {
+        dtv->bypass_table = FlowBypassTableAlloc(FLOW_BYPASS_TABLE_SIZE);
+        if (dtv->bypass_table == NULL) {
+            SCFree(dtv);
+            return NULL;
+        }
+    }
+
+    /* no cache just means the flows come from the spare queue */
+    dtv->flow_spare_cache = FlowSpareCacheAlloc();
+
     return dtv;
 }
 
+/**
+ * \brief Free the decode thread vars of a thread
+ *
+ * The spare flow cache stays, it's owned by the cache list until
+ * FlowSpareCacheShutdown.
+ */
+void DecodeThreadVarsFree(ThreadVars *tv, DecodeThreadVars *dtv)
+{
+    if (dtv == NULL)
+        return;
+
+    if (dtv->app_tctx != NULL)
+        AppLayerDestroyCtxThread(dtv->app_tctx);
+    if (dtv->bypass_table != NULL)
+        FlowBypassTableFree(dtv->bypass_table);
+    SCFree(dtv);
+}
+
 /**
  * \brief Set data for Packet and set length when zeo copy is used
  *
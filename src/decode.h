@@ -382,6 +382,10 @@ typedef struct Packet_
     uint16_t vlan_id[2];
     uint8_t vlan_idx;
 
+    /** time domain of the reader the packet came from, see util-time.c.
+     *  Flows are never shared between time domains. */
+    uint8_t time_domain;
+
     /* flow */
     uint8_t flowflags;
     /* coccinelle: Packet:flowflags:FLOW_PKT_ */
@@ -416,6 +420,9 @@ typedef struct Packet_
     /** The release function for packet structure and data */
     void (*ReleasePacket)(struct Packet_ *);
 
+    /** pool that owns this packet in per-thread packet pool mode */
+    struct PktPool_ *pool;
+
     /* pkt vars */
     PktVar *pktvar;
 
@@ -597,6 +604,16 @@ typedef struct DecodeThreadVars_
     uint16_t counter_defrag_ipv6_timeouts;
     uint16_t counter_defrag_max_hit;
 
+    /** bypassed flows, NULL if bypass is disabled */
+    struct FlowBypassTable_ *bypass_table;
+    uint16_t counter_bypassed_pkts;
+    uint16_t counter_bypassed_bytes;
+
+    /** spare flows of this thread, NULL if the caches are disabled */
+    struct FlowSpareCache_ *flow_spare_cache;
+    uint16_t counter_flow_spare_refills;
+    uint16_t counter_flow_spare_misses;
+
 #ifdef __SC_CUDA_SUPPORT__
     CudaThreadVars cuda_vars;
 #endif
@@ -650,6 +667,7 @@ typedef struct DecodeThreadVars_
         (p)->vlan_id[0] = 0;                    \
         (p)->vlan_id[1] = 0;                    \
         (p)->vlan_idx = 0;                      \
+        (p)->time_domain = 0;                   \
         FlowDeReference(&((p)->flow));          \
         (p)->ts.tv_sec = 0;                     \
         (p)->ts.tv_usec = 0;                    \
@@ -808,6 +826,7 @@ int PacketCopyDataOffset(Packet *p, int offset, uint8_t *data, int datalen);
 const char *PktSrcToString(enum PktSrcEnum pkt_src);
 
 DecodeThreadVars *DecodeThreadVarsAlloc(ThreadVars *);
+void DecodeThreadVarsFree(ThreadVars *, DecodeThreadVars *);
 
 /* decoder functions */
 int DecodeEthernet(ThreadVars *, DecodeThreadVars *, Packet *, uint8_t *, uint16_t, PacketQueue *);
@@ -938,6 +957,7 @@ void AddressDebugPrint(Address *);
 #define PKT_IS_FRAGMENT                 (1<<19)     /**< Packet is a fragment */
 #define PKT_IS_INVALID                  (1<<20)
 #define PKT_PROFILE                     (1<<21)
+#define PKT_FLOW_BYPASSED               (1<<22)     /**< Packet belongs to a bypassed flow */
 
 /** \brief return 1 if the packet is a pseudo packet */
 #define PKT_IS_PSEUDOPKT(p) ((p)->flags & PKT_PSEUDO_STREAM_END)
@@ -89,6 +89,7 @@ static void DefragTrackerInit(DefragTracker *dt, Packet *p) {
     }
     dt->vlan_id[0] = p->vlan_id[0];
     dt->vlan_id[1] = p->vlan_id[1];
+    dt->time_domain = p->time_domain;
     dt->policy = DefragGetOsPolicy(p);
     dt->host_timeout = DefragPolicyGetHostTimeout(p);
 
@@ -409,7 +410,8 @@ static inline uint32_t DefragHashGetKey(Packet *p) {
        CMP_ADDR(&(d1)->dst_addr, &(d2)->src))) && \
      (d1)->id == (id) && \
      (d1)->vlan_id[0] == (d2)->vlan_id[0] && \
-     (d1)->vlan_id[1] == (d2)->vlan_id[1])
+     (d1)->vlan_id[1] == (d2)->vlan_id[1] && \
+     (d1)->time_domain == (d2)->time_domain)
 
 static inline int DefragTrackerCompare(DefragTracker *t, Packet *p) {
     uint32_t id;
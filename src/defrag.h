@@ -94,6 +94,8 @@ typedef struct DefragTracker_ {
                            * this tracker. */
 
     uint16_t vlan_id[2]; /**< VLAN ID tracker applies to. */
+    uint8_t time_domain; /**< Time domain of the reader the fragments
+                          *   came from. */
 
     uint32_t id; /**< IP ID for this tracker.  32 bits for IPv6, 16
                   * for IPv4. */
@@ -961,8 +961,8 @@ int DetectAddressParse2(DetectAddressHead *gh, DetectAddressHead *ghn, char *s,
                      * applicable. Then insert the result into the ghn list. */
                     SCLogDebug("negated block");
 
-                    DetectAddressHead tmp_gh = { NULL, NULL, NULL };
-                    DetectAddressHead tmp_ghn = { NULL, NULL, NULL };
+                    DetectAddressHead tmp_gh = { NULL, NULL, NULL, NULL, NULL };
+                    DetectAddressHead tmp_ghn = { NULL, NULL, NULL, NULL, NULL };
 
                     if (DetectAddressParse2(&tmp_gh, &tmp_ghn, address, 0) < 0)
                         goto error;
@@ -1475,6 +1475,8 @@ DetectAddressHead *DetectAddressHeadInit(void)
 void DetectAddressHeadCleanup(DetectAddressHead *gh)
 {
     if (gh != NULL) {
+        DetectAddressHeadFreeLookup(gh);
+
         if (gh->any_head != NULL) {
             DetectAddressCleanupList(gh->any_head);
             gh->any_head = NULL;
@@ -1772,6 +1774,171 @@ void DetectAddressPrint(DetectAddress *gr)
     return;
 }
 
+static inline void DetectAddressIPv6ToU64(const uint32_t *addr, uint64_t *r)
+{
+    r[0] = ((uint64_t)ntohl(addr[0]) << 32) | ntohl(addr[1]);
+    r[1] = ((uint64_t)ntohl(addr[2]) << 32) | ntohl(addr[3]);
+}
+
+static inline int DetectAddressIPv6U64Lt(const uint64_t *a, const uint64_t *b)
+{
+    return (a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]));
+}
+
+void DetectAddressHeadFreeLookup(DetectAddressHead *gh)
+{
+    if (gh->ipv4_lookup != NULL) {
+        SCFree(gh->ipv4_lookup->ip2);
+        SCFree(gh->ipv4_lookup->ip);
+        SCFree(gh->ipv4_lookup->ag);
+        SCFree(gh->ipv4_lookup);
+        gh->ipv4_lookup = NULL;
+    }
+    if (gh->ipv6_lookup != NULL) {
+        SCFree(gh->ipv6_lookup->ip2);
+        SCFree(gh->ipv6_lookup->ip);
+        SCFree(gh->ipv6_lookup->ag);
+        SCFree(gh->ipv6_lookup);
+        gh->ipv6_lookup = NULL;
+    }
+}
+
+static int DetectAddressHeadBuildLookupIPv4(DetectAddressHead *gh)
+{
+    DetectAddress *ag;
+    uint32_t cnt = 0, i;
+
+    for (ag = gh->ipv4_head; ag != NULL; ag = ag->next) {
+        /* the lists are sorted and the ranges are cut so they don't
+         * overlap. If that's not the case, stick to the list walk. */
+        if (ag->next != NULL &&
+            ntohl(ag->next->ip.addr_data32[0]) <= ntohl(ag->ip2.addr_data32[0])) {
+            SCLogDebug("overlapping or unsorted ipv4 groups, no lookup array");
+            return 0;
+        }
+        cnt++;
+    }
+    if (cnt == 0)
+        return 0;
+
+    DetectAddressLookupIPv4 *l = SCMalloc(sizeof(DetectAddressLookupIPv4));
+    if (unlikely(l == NULL))
+        return -1;
+    memset(l, 0, sizeof(DetectAddressLookupIPv4));
+    gh->ipv4_lookup = l;
+
+    l->cnt = cnt;
+    l->ip2 = SCMalloc(cnt * sizeof(uint32_t));
+    l->ip = SCMalloc(cnt * sizeof(uint32_t));
+    l->ag = SCMalloc(cnt * sizeof(DetectAddress *));
+    if (l->ip2 == NULL || l->ip == NULL || l->ag == NULL)
+        return -1;
+
+    for (i = 0, ag = gh->ipv4_head; ag != NULL; ag = ag->next, i++) {
+        l->ip2[i] = ntohl(ag->ip2.addr_data32[0]);
+        l->ip[i] = ntohl(ag->ip.addr_data32[0]);
+        l->ag[i] = ag;
+    }
+    return 0;
+}
+
+static int DetectAddressHeadBuildLookupIPv6(DetectAddressHead *gh)
+{
+    DetectAddress *ag;
+    uint32_t cnt = 0, i;
+
+    for (ag = gh->ipv6_head; ag != NULL; ag = ag->next) {
+        if (ag->next != NULL && AddressIPv6Le(&ag->next->ip, &ag->ip2) == 1) {
+            SCLogDebug("overlapping or unsorted ipv6 groups, no lookup array");
+            return 0;
+        }
+        cnt++;
+    }
+    if (cnt == 0)
+        return 0;
+
+    DetectAddressLookupIPv6 *l = SCMalloc(sizeof(DetectAddressLookupIPv6));
+    if (unlikely(l == NULL))
+        return -1;
+    memset(l, 0, sizeof(DetectAddressLookupIPv6));
+    gh->ipv6_lookup = l;
+
+    l->cnt = cnt;
+    l->ip2 = SCMalloc(cnt * sizeof(*l->ip2));
+    l->ip = SCMalloc(cnt * sizeof(*l->ip));
+    l->ag = SCMalloc(cnt * sizeof(DetectAddress *));
+    if (l->ip2 == NULL || l->ip == NULL || l->ag == NULL)
+        return -1;
+
+    for (i = 0, ag = gh->ipv6_head; ag != NULL; ag = ag->next, i++) {
+        DetectAddressIPv6ToU64(ag->ip2.addr_data32, l->ip2[i]);
+        DetectAddressIPv6ToU64(ag->ip.addr_data32, l->ip[i]);
+        l->ag[i] = ag;
+    }
+    return 0;
+}
+
+/**
+ * \brief Set up the lookup arrays for the ipv4 and ipv6 lists of a final
+ *        address group head, so that DetectAddressLookupInHead() can do a
+ *        binary search instead of walking the lists.
+ *
+ * \param gh the head
+ *
+ * \retval 0 ok
+ * \retval -1 error
+ */
+int DetectAddressHeadBuildLookup(DetectAddressHead *gh)
+{
+    if (gh == NULL || gh->ipv4_lookup != NULL || gh->ipv6_lookup != NULL)
+        return 0;
+
+    if (DetectAddressHeadBuildLookupIPv4(gh) < 0 ||
+        DetectAddressHeadBuildLookupIPv6(gh) < 0) {
+        DetectAddressHeadFreeLookup(gh);
+        return -1;
+    }
+    return 0;
+}
+
+static DetectAddress *DetectAddressLookupIPv4Array(DetectAddressLookupIPv4 *l,
+                                                   Address *a)
+{
+    uint32_t addr = ntohl(a->addr_data32[0]);
+    uint32_t lo = 0, hi = l->cnt;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (l->ip2[mid] < addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < l->cnt && l->ip[lo] <= addr)
+        return l->ag[lo];
+    return NULL;
+}
+
+static DetectAddress *DetectAddressLookupIPv6Array(DetectAddressLookupIPv6 *l,
+                                                   Address *a)
+{
+    uint64_t addr[2];
+    uint32_t lo = 0, hi = l->cnt;
+
+    DetectAddressIPv6ToU64(a->addr_data32, addr);
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (DetectAddressIPv6U64Lt(l->ip2[mid], addr))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < l->cnt && !DetectAddressIPv6U64Lt(addr, l->ip[lo]))
+        return l->ag[lo];
+    return NULL;
+}
+
 /**
  * \brief Find the group matching address in a group head.
  *
@@ -1794,9 +1961,17 @@ DetectAddress *DetectAddressLookupInHead(DetectAddressHead *gh, Address *a)
     /* XXX should we really do this check every time we run this function? */
     if (a->family == AF_INET) {
         SCLogDebug("IPv4");
+        if (gh->ipv4_lookup != NULL) {
+            SCReturnPtr(DetectAddressLookupIPv4Array(gh->ipv4_lookup, a),
+                        "DetectAddress");
+        }
         g = gh->ipv4_head;
     } else if (a->family == AF_INET6) {
         SCLogDebug("IPv6");
+        if (gh->ipv6_lookup != NULL) {
+            SCReturnPtr(DetectAddressLookupIPv6Array(gh->ipv6_lookup, a),
+                        "DetectAddress");
+        }
         g = gh->ipv6_head;
     } else {
         SCLogDebug("ANY");
@@ -5119,6 +5294,67 @@ end:
     return result;
 }
 
+/** \test flat lookup arrays give the same groups as the list walk */
+static int AddressTestLookup01(void)
+{
+    char *addrs[] = { "0.0.0.0", "1.2.3.3", "1.2.3.4", "1.2.3.5",
+                      "9.255.255.255", "10.0.0.0", "10.1.2.3",
+                      "10.255.255.255", "11.0.0.0", "192.168.1.1",
+                      "255.255.255.255", "::", "::1", "::2", "2000::",
+                      "2001::", "2001:ffff::1", "2002::", "ffff::", NULL };
+    int result = 0;
+    int i;
+
+    DetectAddressHead *gh = DetectAddressHeadInit();
+    if (gh == NULL)
+        return 0;
+
+    if (DetectAddressParse(gh, "[1.2.3.4,10.0.0.0/8,192.168.0.0/16,"
+                               "2001::/16,::1]") < 0)
+        goto end;
+
+    if (DetectAddressHeadBuildLookup(gh) != 0 ||
+        gh->ipv4_lookup == NULL || gh->ipv6_lookup == NULL) {
+        printf("lookup not set up: ");
+        goto end;
+    }
+
+    for (i = 0; addrs[i] != NULL; i++) {
+        Address a;
+        DetectAddress *ag, *found = NULL;
+
+        memset(&a, 0, sizeof(a));
+        if (strchr(addrs[i], ':') != NULL) {
+            a.family = AF_INET6;
+            if (inet_pton(AF_INET6, addrs[i], a.addr_data32) != 1)
+                goto end;
+            ag = gh->ipv6_head;
+        } else {
+            a.family = AF_INET;
+            if (inet_pton(AF_INET, addrs[i], a.addr_data32) != 1)
+                goto end;
+            ag = gh->ipv4_head;
+        }
+
+        for ( ; ag != NULL; ag = ag->next) {
+            if (DetectAddressMatch(ag, &a) == 1) {
+                found = ag;
+                break;
+            }
+        }
+
+        if (DetectAddressLookupInHead(gh, &a) != found) {
+            printf("%s: lookup mismatch: ", addrs[i]);
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    DetectAddressHeadFree(gh);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DetectAddressTests(void)
@@ -5326,5 +5562,6 @@ void DetectAddressTests(void)
     UtRegisterTest("AddressTestFunctions02", AddressTestFunctions02, 1);
     UtRegisterTest("AddressTestFunctions03", AddressTestFunctions03, 1);
     UtRegisterTest("AddressTestFunctions04", AddressTestFunctions04, 1);
+    UtRegisterTest("AddressTestLookup01", AddressTestLookup01, 1);
 #endif /* UNITTESTS */
 }
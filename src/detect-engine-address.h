@@ -46,6 +46,8 @@ int DetectAddressInsert(DetectEngineCtx *, DetectAddressHead *, DetectAddress *)
 int DetectAddressJoin(DetectEngineCtx *, DetectAddress *, DetectAddress *);
 
 DetectAddress *DetectAddressLookupInHead(DetectAddressHead *, Address *);
+int DetectAddressHeadBuildLookup(DetectAddressHead *);
+void DetectAddressHeadFreeLookup(DetectAddressHead *);
 DetectAddress *DetectAddressLookupInList(DetectAddress *, DetectAddress *);
 int DetectAddressMatch(DetectAddress *, Address *);
 
@@ -0,0 +1,264 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Build threads used by SigGroupBuild().
+ *
+ * The threads only live for the duration of a single run: the build
+ * happens once at start up and on rule reloads, so there is no point in
+ * keeping them around. With a single build thread everything runs inline
+ * on the calling thread, which is the old behaviour.
+ */
+
+#include "suricata-common.h"
+#include "detect.h"
+#include "detect-engine-build.h"
+
+#include "util-byte.h"
+#include "util-cpu.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+
+/** \brief Parse the detect-engine.build-threads value
+ *
+ *  \param str "auto" for the number of online cpus, or a number
+ *
+ *  \retval threads number of build threads, 1 if str is NULL or invalid
+ */
+uint16_t DetectBuildThreadsParse(const char *str)
+{
+    uint16_t threads = 1;
+
+    if (str == NULL)
+        return 1;
+
+    if (strcmp(str, "auto") == 0) {
+        threads = UtilCpuGetNumProcessorsOnline();
+    } else if (ByteExtractStringUint16(&threads, 10, strlen(str), str) <= 0) {
+        SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid value \"%s\" "
+                "for detect-engine.build-threads, using 1", str);
+        return 1;
+    }
+
+    if (threads == 0)
+        threads = 1;
+    else if (threads > DETECT_BUILD_THREADS_MAX)
+        threads = DETECT_BUILD_THREADS_MAX;
+    return threads;
+}
+
+/** \brief Get the ms elapsed since start */
+uint64_t DetectBuildTimeMs(const struct timeval *start)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    return (uint64_t)(now.tv_sec - start->tv_sec) * 1000 +
+           (int64_t)(now.tv_usec - start->tv_usec) / 1000;
+}
+
+typedef struct DetectBuildArray_ {
+    DetectBuildFunc Func;
+    void **items;
+    uint32_t cnt;
+    /** next item to hand out, protected by lock */
+    uint32_t next;
+    SCMutex lock;
+} DetectBuildArray;
+
+static void *DetectBuildArrayWorker(void *data)
+{
+    DetectBuildArray *a = (DetectBuildArray *)data;
+
+    while (1) {
+        SCMutexLock(&a->lock);
+        uint32_t i = a->next;
+        if (i < a->cnt)
+            a->next++;
+        SCMutexUnlock(&a->lock);
+
+        if (i >= a->cnt)
+            break;
+        a->Func(a->items[i]);
+    }
+    return NULL;
+}
+
+/** \brief Run Func on every item of an array, using up to threads threads
+ *
+ *  Items are handed out in array order, so callers can put the most
+ *  expensive items first to keep the threads evenly busy. The calling
+ *  thread works on the array as well. Func must not touch state shared
+ *  with the other items.
+ *
+ *  \retval 0 all items done
+ */
+int DetectBuildRunArray(uint16_t threads, DetectBuildFunc Func,
+        void **items, uint32_t cnt)
+{
+    DetectBuildArray a;
+    pthread_t tids[DETECT_BUILD_THREADS_MAX];
+    uint16_t spawned = 0;
+
+    if (threads > DETECT_BUILD_THREADS_MAX)
+        threads = DETECT_BUILD_THREADS_MAX;
+    if (threads > cnt)
+        threads = (uint16_t)cnt;
+
+    if (threads <= 1) {
+        uint32_t i;
+        for (i = 0; i < cnt; i++)
+            Func(items[i]);
+        return 0;
+    }
+
+    memset(&a, 0, sizeof(a));
+    a.Func = Func;
+    a.items = items;
+    a.cnt = cnt;
+    SCMutexInit(&a.lock, NULL);
+
+    for ( ; spawned < threads - 1; spawned++) {
+        if (pthread_create(&tids[spawned], NULL, DetectBuildArrayWorker, &a) != 0) {
+            SCLogWarning(SC_ERR_THREAD_CREATE, "creating build thread failed, "
+                    "continuing with %"PRIu16" threads", spawned + 1);
+            break;
+        }
+    }
+
+    DetectBuildArrayWorker(&a);
+
+    uint16_t t;
+    for (t = 0; t < spawned; t++)
+        pthread_join(tids[t], NULL);
+
+    SCMutexDestroy(&a.lock);
+    return 0;
+}
+
+static void *DetectBuildTaskRun(void *data)
+{
+    DetectBuildTask *task = (DetectBuildTask *)data;
+    struct timeval start;
+
+    gettimeofday(&start, NULL);
+    task->Func(task->data);
+    task->ms = DetectBuildTimeMs(&start);
+    return NULL;
+}
+
+/** \brief Start Func on a build thread, to run next to the caller
+ *
+ *  With a single build thread, or if no thread can be created, Func runs
+ *  inline before this returns. DetectBuildTaskWait() must be called
+ *  before the caller touches anything Func works on.
+ */
+void DetectBuildTaskStart(uint16_t threads, DetectBuildTask *task,
+        DetectBuildFunc Func, void *data)
+{
+    memset(task, 0, sizeof(*task));
+    task->Func = Func;
+    task->data = data;
+
+    if (threads > 1) {
+        if (pthread_create(&task->thread, NULL, DetectBuildTaskRun, task) == 0) {
+            task->threaded = 1;
+            return;
+        }
+        SCLogWarning(SC_ERR_THREAD_CREATE, "creating build thread failed, "
+                "running inline");
+    }
+
+    DetectBuildTaskRun(task);
+}
+
+/** \brief Wait for a task started by DetectBuildTaskStart() */
+void DetectBuildTaskWait(DetectBuildTask *task)
+{
+    if (task->threaded) {
+        pthread_join(task->thread, NULL);
+        task->threaded = 0;
+    }
+}
+
+#ifdef UNITTESTS
+
+static void DetectBuildTestIncr(void *data)
+{
+    (*(uint32_t *)data)++;
+}
+
+/** \test every item is handled exactly once, for several thread counts,
+ *        and a task is done after the wait */
+static int DetectBuildTest01(void)
+{
+    uint32_t values[100];
+    void *items[100];
+    uint16_t threads[] = { 1, 4, 200 };
+    uint32_t i, t;
+
+    for (i = 0; i < 100; i++)
+        items[i] = &values[i];
+
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        memset(values, 0, sizeof(values));
+
+        if (DetectBuildRunArray(threads[t], DetectBuildTestIncr, items, 100) != 0)
+            return 0;
+
+        for (i = 0; i < 100; i++) {
+            if (values[i] != 1) {
+                printf("threads %u item %u done %u times: ",
+                        threads[t], i, values[i]);
+                return 0;
+            }
+        }
+    }
+
+    if (DetectBuildRunArray(4, DetectBuildTestIncr, items, 0) != 0)
+        return 0;
+
+    for (t = 0; t < sizeof(threads) / sizeof(threads[0]); t++) {
+        DetectBuildTask task;
+
+        values[0] = 0;
+        DetectBuildTaskStart(threads[t], &task, DetectBuildTestIncr, &values[0]);
+        DetectBuildTaskWait(&task);
+        if (values[0] != 1)
+            return 0;
+    }
+
+    if (DetectBuildThreadsParse(NULL) != 1 ||
+        DetectBuildThreadsParse("0") != 1 ||
+        DetectBuildThreadsParse("8") != 8 ||
+        DetectBuildThreadsParse("1000") != DETECT_BUILD_THREADS_MAX ||
+        DetectBuildThreadsParse("auto") < 1)
+        return 0;
+
+    return 1;
+}
+
+#endif /* UNITTESTS */
+
+void DetectBuildRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectBuildTest01", DetectBuildTest01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,61 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Build threads used by SigGroupBuild() for the independent parts of
+ * the detection engine build.
+ */
+
+#ifndef __DETECT_ENGINE_BUILD_H__
+#define __DETECT_ENGINE_BUILD_H__
+
+#include "detect.h"
+
+/** max value of detect-engine.build-threads */
+#define DETECT_BUILD_THREADS_MAX    64
+
+typedef void (*DetectBuildFunc)(void *);
+
+/**
+ * \brief Single function run on a build thread next to the main build.
+ */
+typedef struct DetectBuildTask_ {
+    DetectBuildFunc Func;
+    void *data;
+    pthread_t thread;
+    /** 1 if Func runs on its own thread, 0 if it ran inline */
+    int threaded;
+    /** run time of Func in ms */
+    uint64_t ms;
+} DetectBuildTask;
+
+uint16_t DetectBuildThreadsParse(const char *str);
+
+int DetectBuildRunArray(uint16_t threads, DetectBuildFunc Func,
+        void **items, uint32_t cnt);
+
+void DetectBuildTaskStart(uint16_t threads, DetectBuildTask *task,
+        DetectBuildFunc Func, void *data);
+void DetectBuildTaskWait(DetectBuildTask *task);
+
+uint64_t DetectBuildTimeMs(const struct timeval *start);
+
+void DetectBuildRegisterTests(void);
+
+#endif /* __DETECT_ENGINE_BUILD_H__ */
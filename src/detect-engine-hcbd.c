@@ -81,8 +81,12 @@ static inline int HCBDCreateSpace(DetectEngineThreadCtx *det_ctx, uint16_t size)
         det_ctx->hcbd_buffers_size += BUFFER_STEP;
 
         for (int i = det_ctx->hcbd_buffers_list_len; i < (size); i++) {
+            det_ctx->hcbd[i].data = NULL;
             det_ctx->hcbd[i].buffer_len = 0;
             det_ctx->hcbd[i].offset = 0;
+            det_ctx->hcbd[i].chunk = NULL;
+            det_ctx->hcbd[i].skip = 0;
+            det_ctx->hcbd[i].len = 0;
         }
     }
 
@@ -90,23 +94,22 @@ static inline int HCBDCreateSpace(DetectEngineThreadCtx *det_ctx, uint16_t size)
 }
 
 /**
+ * \brief Set up the part of the tx's request body to inspect in this
+ *        run, without linearizing it.
+ *
+ * \retval body the setup or NULL if there is nothing to inspect (yet)
  */
-static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
-                                               DetectEngineCtx *de_ctx,
-                                               DetectEngineThreadCtx *det_ctx,
-                                               Flow *f, HtpState *htp_state,
-                                               uint8_t flags,
-                                               uint32_t *buffer_len,
-                                               uint32_t *stream_start_offset)
+static HttpReassembledBody *DetectEngineHCBDSetupForTX(htp_tx_t *tx, uint64_t tx_id,
+                                                       DetectEngineCtx *de_ctx,
+                                                       DetectEngineThreadCtx *det_ctx,
+                                                       Flow *f, HtpState *htp_state,
+                                                       uint8_t flags)
 {
     int index = 0;
-    uint8_t *buffer = NULL;
-    *buffer_len = 0;
-    *stream_start_offset = 0;
 
     if (det_ctx->hcbd_buffers_list_len == 0) {
         if (HCBDCreateSpace(det_ctx, 1) < 0)
-            goto end; /* let's consider it as stage not done for now */
+            return NULL; /* let's consider it as stage not done for now */
         index = 0;
 
         if (det_ctx->hcbd_buffers_list_len == 0) {
@@ -115,14 +118,12 @@ static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         det_ctx->hcbd_buffers_list_len++;
     } else {
         if ((tx_id - det_ctx->hcbd_start_tx_id) < det_ctx->hcbd_buffers_list_len) {
-            if (det_ctx->hcbd[(tx_id - det_ctx->hcbd_start_tx_id)].buffer_len != 0) {
-                *buffer_len = det_ctx->hcbd[(tx_id - det_ctx->hcbd_start_tx_id)].buffer_len;
-                *stream_start_offset = det_ctx->hcbd[(tx_id - det_ctx->hcbd_start_tx_id)].offset;
-                return det_ctx->hcbd[(tx_id - det_ctx->hcbd_start_tx_id)].buffer;
+            if (det_ctx->hcbd[(tx_id - det_ctx->hcbd_start_tx_id)].len != 0) {
+                return &det_ctx->hcbd[(tx_id - det_ctx->hcbd_start_tx_id)];
             }
         } else {
             if (HCBDCreateSpace(det_ctx, (tx_id - det_ctx->hcbd_start_tx_id) + 1) < 0)
-                goto end; /* let's consider it as stage not done for now */
+                return NULL; /* let's consider it as stage not done for now */
 
             if (det_ctx->hcbd_buffers_list_len == 0) {
                 det_ctx->hcbd_start_tx_id = tx_id;
@@ -135,19 +136,19 @@ static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
     HtpTxUserData *htud = (HtpTxUserData *)htp_tx_get_user_data(tx);
     if (htud == NULL) {
         SCLogDebug("no htud");
-        goto end;
+        return NULL;
     }
 
     /* no new data */
     if (htud->request_body.body_inspected == htud->request_body.content_len_so_far) {
         SCLogDebug("no new data");
-        goto end;
+        return NULL;
     }
 
     HtpBodyChunk *cur = htud->request_body.first;
     if (cur == NULL) {
         SCLogDebug("No http chunks to inspect for this transacation");
-        goto end;
+        return NULL;
     }
 
     /* inspect the body if the transfer is complete or we have hit
@@ -160,58 +161,98 @@ static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         SCLogDebug("we still haven't seen the entire request body.  "
                    "Let's defer body inspection till we see the "
                    "entire body.");
-        goto end;
+        return NULL;
     }
 
-    int first = 1;
+    /* skip the data that was inspected before, but keep the last
+     * request_inspect_min_size bytes of it. A chunk holds the data of
+     * several libhtp callbacks, so this may start inside of it. */
+    uint32_t skip = 0;
     while (cur != NULL) {
-        /* see if we can filter out chunks */
-        if (htud->request_body.body_inspected > 0) {
-            if (cur->stream_offset < htud->request_body.body_inspected) {
-                if ((htud->request_body.body_inspected - cur->stream_offset) > htp_state->cfg->request_inspect_min_size) {
-                    cur = cur->next;
-                    continue;
-                } else {
-                    /* include this one */
-                }
-            } else {
-                /* include this one */
+        if (htud->request_body.body_inspected > cur->stream_offset + htp_state->cfg->request_inspect_min_size) {
+            uint64_t start = htud->request_body.body_inspected - htp_state->cfg->request_inspect_min_size;
+            if (start >= cur->stream_offset + cur->len) {
+                cur = cur->next;
+                continue;
             }
+            skip = (uint32_t)(start - cur->stream_offset);
         }
+        break;
+    }
+    if (cur == NULL)
+        return NULL;
 
-        if (first) {
-            det_ctx->hcbd[index].offset = cur->stream_offset;
-            first = 0;
-        }
+    HttpReassembledBody *body = &det_ctx->hcbd[index];
+    body->chunk = cur;
+    body->skip = skip;
+    body->offset = cur->stream_offset + skip;
+    body->len = (uint32_t)(htud->request_body.last->stream_offset +
+                           htud->request_body.last->len - body->offset);
+
+    /* update inspected tracker */
+    htud->request_body.body_inspected = htud->request_body.last->stream_offset + htud->request_body.last->len;
+
+    return body;
+}
 
-        /* see if we need to grow the buffer */
-        if (det_ctx->hcbd[index].buffer == NULL || (det_ctx->hcbd[index].buffer_len + cur->len) > det_ctx->hcbd[index].buffer_size) {
-            void *ptmp;
-            det_ctx->hcbd[index].buffer_size += cur->len * 2;
-
-            if ((ptmp = SCRealloc(det_ctx->hcbd[index].buffer, det_ctx->hcbd[index].buffer_size)) == NULL) {
-                SCFree(det_ctx->hcbd[index].buffer);
-                det_ctx->hcbd[index].buffer = NULL;
-                det_ctx->hcbd[index].buffer_size = 0;
-                det_ctx->hcbd[index].buffer_len = 0;
-                goto end;
+/**
+ * \brief Get the request body to inspect as a contiguous buffer. Data in a
+ *        single chunk is inspected in place, otherwise the chunks are
+ *        copied into the thread's buffer for this tx.
+ */
+static uint8_t *DetectEngineHCBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
+                                               DetectEngineCtx *de_ctx,
+                                               DetectEngineThreadCtx *det_ctx,
+                                               Flow *f, HtpState *htp_state,
+                                               uint8_t flags,
+                                               uint32_t *buffer_len,
+                                               uint32_t *stream_start_offset)
+{
+    *buffer_len = 0;
+    *stream_start_offset = 0;
+
+    HttpReassembledBody *body = DetectEngineHCBDSetupForTX(tx, tx_id, de_ctx,
+                                                           det_ctx, f, htp_state,
+                                                           flags);
+    if (body == NULL)
+        return NULL;
+
+    if (body->data == NULL) {
+        HtpBodyChunk *cur = body->chunk;
+        if (cur->next == NULL) {
+            /* all data is in this chunk, inspect it in place */
+            body->data = cur->data + body->skip;
+        } else {
+            /* see if we need to grow the buffer */
+            if (body->buffer == NULL || body->len > body->buffer_size) {
+                void *ptmp;
+                uint32_t size = body->len * 2;
+
+                if ((ptmp = SCRealloc(body->buffer, size)) == NULL) {
+                    SCFree(body->buffer);
+                    body->buffer = NULL;
+                    body->buffer_size = 0;
+                    body->buffer_len = 0;
+                    return NULL;
+                }
+                body->buffer = ptmp;
+                body->buffer_size = size;
             }
-            det_ctx->hcbd[index].buffer = ptmp;
-        }
-        memcpy(det_ctx->hcbd[index].buffer + det_ctx->hcbd[index].buffer_len, cur->data, cur->len);
-        det_ctx->hcbd[index].buffer_len += cur->len;
 
-        cur = cur->next;
+            uint32_t skip = body->skip;
+            body->buffer_len = 0;
+            for ( ; cur != NULL; cur = cur->next) {
+                memcpy(body->buffer + body->buffer_len, cur->data + skip, cur->len - skip);
+                body->buffer_len += cur->len - skip;
+                skip = 0;
+            }
+            body->data = body->buffer;
+        }
     }
 
-    /* update inspected tracker */
-    htud->request_body.body_inspected = htud->request_body.last->stream_offset + htud->request_body.last->len;
-
-    buffer = det_ctx->hcbd[index].buffer;
-    *buffer_len = det_ctx->hcbd[index].buffer_len;
-    *stream_start_offset = det_ctx->hcbd[index].offset;
- end:
-    return buffer;
+    *buffer_len = body->len;
+    *stream_start_offset = body->offset;
+    return body->data;
 }
 
 int DetectEngineRunHttpClientBodyMpm(DetectEngineCtx *de_ctx,
@@ -222,6 +263,21 @@ int DetectEngineRunHttpClientBodyMpm(DetectEngineCtx *de_ctx,
     uint32_t cnt = 0;
     uint32_t buffer_len = 0;
     uint32_t stream_start_offset = 0;
+
+    HttpReassembledBody *body = DetectEngineHCBDSetupForTX(tx, idx, de_ctx,
+                                                           det_ctx, f, htp_state,
+                                                           flags);
+    if (body == NULL)
+        goto end;
+
+    /* a body over several chunks is searched chunk by chunk, carrying
+     * the mpm state over, so that it's only linearized if a rule
+     * needs it */
+    if (body->data == NULL && body->chunk->next != NULL &&
+        HttpClientBodyChunksPatternSearch(det_ctx, body->chunk, body->skip,
+                                          flags, &cnt) == 0)
+        goto end;
+
     uint8_t *buffer = DetectEngineHCBDGetBufferForTX(tx, idx,
                                                      de_ctx, det_ctx,
                                                      f, htp_state,
@@ -279,8 +335,12 @@ void DetectEngineCleanHCBDBuffers(DetectEngineThreadCtx *det_ctx)
 {
     if (det_ctx->hcbd_buffers_list_len > 0) {
         for (int i = 0; i < det_ctx->hcbd_buffers_list_len; i++) {
+            det_ctx->hcbd[i].data = NULL;
             det_ctx->hcbd[i].buffer_len = 0;
             det_ctx->hcbd[i].offset = 0;
+            det_ctx->hcbd[i].chunk = NULL;
+            det_ctx->hcbd[i].skip = 0;
+            det_ctx->hcbd[i].len = 0;
         }
     }
     det_ctx->hcbd_buffers_list_len = 0;
@@ -82,30 +82,35 @@ static inline int HSBDCreateSpace(DetectEngineThreadCtx *det_ctx, uint16_t size)
         det_ctx->hsbd_buffers_size += BUFFER_STEP;
     }
     for (int i = det_ctx->hsbd_buffers_list_len; i < (size); i++) {
+        det_ctx->hsbd[i].data = NULL;
         det_ctx->hsbd[i].buffer_len = 0;
         det_ctx->hsbd[i].offset = 0;
+        det_ctx->hsbd[i].chunk = NULL;
+        det_ctx->hsbd[i].skip = 0;
+        det_ctx->hsbd[i].len = 0;
     }
 
     return 0;
 }
 
 
-static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
-                                               DetectEngineCtx *de_ctx,
-                                               DetectEngineThreadCtx *det_ctx,
-                                               Flow *f, HtpState *htp_state,
-                                               uint8_t flags,
-                                               uint32_t *buffer_len,
-                                               uint32_t *stream_start_offset)
+/**
+ * \brief Set up the part of the tx's response body to inspect in this
+ *        run, without linearizing it.
+ *
+ * \retval body the setup or NULL if there is nothing to inspect (yet)
+ */
+static HttpReassembledBody *DetectEngineHSBDSetupForTX(htp_tx_t *tx, uint64_t tx_id,
+                                                       DetectEngineCtx *de_ctx,
+                                                       DetectEngineThreadCtx *det_ctx,
+                                                       Flow *f, HtpState *htp_state,
+                                                       uint8_t flags)
 {
     int index = 0;
-    uint8_t *buffer = NULL;
-    *buffer_len = 0;
-    *stream_start_offset = 0;
 
     if (det_ctx->hsbd_buffers_list_len == 0) {
         if (HSBDCreateSpace(det_ctx, 1) < 0)
-            goto end;
+            return NULL;
         index = 0;
 
         if (det_ctx->hsbd_buffers_list_len == 0) {
@@ -114,14 +119,12 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         det_ctx->hsbd_buffers_list_len++;
     } else {
         if ((tx_id - det_ctx->hsbd_start_tx_id) < det_ctx->hsbd_buffers_list_len) {
-            if (det_ctx->hsbd[(tx_id - det_ctx->hsbd_start_tx_id)].buffer_len != 0) {
-                *buffer_len = det_ctx->hsbd[(tx_id - det_ctx->hsbd_start_tx_id)].buffer_len;
-                *stream_start_offset = det_ctx->hsbd[(tx_id - det_ctx->hsbd_start_tx_id)].offset;
-                return det_ctx->hsbd[(tx_id - det_ctx->hsbd_start_tx_id)].buffer;
+            if (det_ctx->hsbd[(tx_id - det_ctx->hsbd_start_tx_id)].len != 0) {
+                return &det_ctx->hsbd[(tx_id - det_ctx->hsbd_start_tx_id)];
             }
         } else {
             if (HSBDCreateSpace(det_ctx, (tx_id - det_ctx->hsbd_start_tx_id) + 1) < 0)
-                goto end;
+                return NULL;
 
             if (det_ctx->hsbd_buffers_list_len == 0) {
                 det_ctx->hsbd_start_tx_id = tx_id;
@@ -134,19 +137,19 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
     HtpTxUserData *htud = (HtpTxUserData *)htp_tx_get_user_data(tx);
     if (htud == NULL) {
         SCLogDebug("no htud");
-        goto end;
+        return NULL;
     }
 
     /* no new data */
     if (htud->response_body.body_inspected == htud->response_body.content_len_so_far) {
         SCLogDebug("no new data");
-        goto end;
+        return NULL;
     }
 
     HtpBodyChunk *cur = htud->response_body.first;
     if (cur == NULL) {
         SCLogDebug("No http chunks to inspect for this transacation");
-        goto end;
+        return NULL;
     }
 
     SCLogDebug("response_body_limit %u response_body.content_len_so_far %"PRIu64
@@ -161,64 +164,104 @@ static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
      * our body size limit */
     if ((htp_state->cfg->response_body_limit == 0 ||
          htud->response_body.content_len_so_far < htp_state->cfg->response_body_limit) &&
-        htud->response_body.content_len_so_far < htp_state->cfg->response_inspect_min_size &&
+        htud->response_body.content_len_so_far < htp_state->cfg->response_inspect_window &&
         !(AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOCLIENT) > HTP_RESPONSE_BODY) &&
         !(flags & STREAM_EOF)) {
         SCLogDebug("we still haven't seen the entire response body.  "
                    "Let's defer body inspection till we see the "
                    "entire body.");
-        goto end;
+        return NULL;
     }
 
-    int first = 1;
+    /* skip the data before the inspection window. A chunk holds
+     * data of several libhtp callbacks, so the window may start
+     * inside of it. */
+    uint32_t skip = 0;
     while (cur != NULL) {
-        /* see if we can filter out chunks */
-        if (htud->response_body.body_inspected > 0) {
-            if (cur->stream_offset < htud->response_body.body_inspected) {
-                if ((htud->response_body.body_inspected - cur->stream_offset) > htp_state->cfg->response_inspect_window) {
-                    cur = cur->next;
-                    continue;
-                } else {
-                    /* include this one */
-                }
-            } else {
-                /* include this one */
+        if (htud->response_body.body_inspected > cur->stream_offset + htp_state->cfg->response_inspect_window) {
+            uint64_t start = htud->response_body.body_inspected - htp_state->cfg->response_inspect_window;
+            if (start >= cur->stream_offset + cur->len) {
+                cur = cur->next;
+                continue;
             }
+            skip = (uint32_t)(start - cur->stream_offset);
         }
+        break;
+    }
+    if (cur == NULL)
+        return NULL;
 
-        if (first) {
-            det_ctx->hsbd[index].offset = cur->stream_offset;
-            first = 0;
-        }
+    HttpReassembledBody *body = &det_ctx->hsbd[index];
+    body->chunk = cur;
+    body->skip = skip;
+    body->offset = cur->stream_offset + skip;
+    body->len = (uint32_t)(htud->response_body.last->stream_offset +
+                           htud->response_body.last->len - body->offset);
 
-        /* see if we need to grow the buffer */
-        if (det_ctx->hsbd[index].buffer == NULL || (det_ctx->hsbd[index].buffer_len + cur->len) > det_ctx->hsbd[index].buffer_size) {
-            void *ptmp;
-            det_ctx->hsbd[index].buffer_size += cur->len * 2;
-
-            if ((ptmp = SCRealloc(det_ctx->hsbd[index].buffer, det_ctx->hsbd[index].buffer_size)) == NULL) {
-                SCFree(det_ctx->hsbd[index].buffer);
-                det_ctx->hsbd[index].buffer = NULL;
-                det_ctx->hsbd[index].buffer_size = 0;
-                det_ctx->hsbd[index].buffer_len = 0;
-                goto end;
+    /* update inspected tracker */
+    htud->response_body.body_inspected = htud->response_body.last->stream_offset + htud->response_body.last->len;
+
+    return body;
+}
+
+/**
+ * \brief Get the response body to inspect as a contiguous buffer. Data in a
+ *        single chunk is inspected in place, otherwise the chunks are
+ *        copied into the thread's buffer for this tx.
+ */
+static uint8_t *DetectEngineHSBDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
+                                               DetectEngineCtx *de_ctx,
+                                               DetectEngineThreadCtx *det_ctx,
+                                               Flow *f, HtpState *htp_state,
+                                               uint8_t flags,
+                                               uint32_t *buffer_len,
+                                               uint32_t *stream_start_offset)
+{
+    *buffer_len = 0;
+    *stream_start_offset = 0;
+
+    HttpReassembledBody *body = DetectEngineHSBDSetupForTX(tx, tx_id, de_ctx,
+                                                           det_ctx, f, htp_state,
+                                                           flags);
+    if (body == NULL)
+        return NULL;
+
+    if (body->data == NULL) {
+        HtpBodyChunk *cur = body->chunk;
+        if (cur->next == NULL) {
+            /* all data is in this chunk, inspect it in place */
+            body->data = cur->data + body->skip;
+        } else {
+            /* see if we need to grow the buffer */
+            if (body->buffer == NULL || body->len > body->buffer_size) {
+                void *ptmp;
+                uint32_t size = body->len * 2;
+
+                if ((ptmp = SCRealloc(body->buffer, size)) == NULL) {
+                    SCFree(body->buffer);
+                    body->buffer = NULL;
+                    body->buffer_size = 0;
+                    body->buffer_len = 0;
+                    return NULL;
+                }
+                body->buffer = ptmp;
+                body->buffer_size = size;
             }
-            det_ctx->hsbd[index].buffer = ptmp;
-        }
-        memcpy(det_ctx->hsbd[index].buffer + det_ctx->hsbd[index].buffer_len, cur->data, cur->len);
-        det_ctx->hsbd[index].buffer_len += cur->len;
 
-        cur = cur->next;
+            uint32_t skip = body->skip;
+            body->buffer_len = 0;
+            for ( ; cur != NULL; cur = cur->next) {
+                memcpy(body->buffer + body->buffer_len, cur->data + skip, cur->len - skip);
+                body->buffer_len += cur->len - skip;
+                skip = 0;
+            }
+            body->data = body->buffer;
+        }
     }
 
-    /* update inspected tracker */
-    htud->response_body.body_inspected = htud->response_body.last->stream_offset + htud->response_body.last->len;
-
-    buffer = det_ctx->hsbd[index].buffer;
-    *buffer_len = det_ctx->hsbd[index].buffer_len;
-    *stream_start_offset = det_ctx->hsbd[index].offset;
- end:
-    return buffer;
+    *buffer_len = body->len;
+    *stream_start_offset = body->offset;
+    return body->data;
 }
 
 int DetectEngineRunHttpServerBodyMpm(DetectEngineCtx *de_ctx,
@@ -229,6 +272,21 @@ int DetectEngineRunHttpServerBodyMpm(DetectEngineCtx *de_ctx,
     uint32_t cnt = 0;
     uint32_t buffer_len = 0;
     uint32_t stream_start_offset = 0;
+
+    HttpReassembledBody *body = DetectEngineHSBDSetupForTX(tx, idx, de_ctx,
+                                                           det_ctx, f, htp_state,
+                                                           flags);
+    if (body == NULL)
+        goto end;
+
+    /* a body over several chunks is searched chunk by chunk, carrying
+     * the mpm state over, so that it's only linearized if a rule
+     * needs it */
+    if (body->data == NULL && body->chunk->next != NULL &&
+        HttpServerBodyChunksPatternSearch(det_ctx, body->chunk, body->skip,
+                                          flags, &cnt) == 0)
+        goto end;
+
     uint8_t *buffer = DetectEngineHSBDGetBufferForTX(tx, idx,
                                                      de_ctx, det_ctx,
                                                      f, htp_state,
@@ -286,8 +344,12 @@ void DetectEngineCleanHSBDBuffers(DetectEngineThreadCtx *det_ctx)
 {
     if (det_ctx->hsbd_buffers_list_len > 0) {
         for (int i = 0; i < det_ctx->hsbd_buffers_list_len; i++) {
+            det_ctx->hsbd[i].data = NULL;
             det_ctx->hsbd[i].buffer_len = 0;
             det_ctx->hsbd[i].offset = 0;
+            det_ctx->hsbd[i].chunk = NULL;
+            det_ctx->hsbd[i].skip = 0;
+            det_ctx->hsbd[i].len = 0;
         }
     }
     det_ctx->hsbd_buffers_list_len = 0;
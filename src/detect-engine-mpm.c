@@ -34,6 +34,7 @@
 #include "detect-engine.h"
 #include "detect-engine-siggroup.h"
 #include "detect-engine-mpm.h"
+#include "detect-engine-build.h"
 #include "detect-engine-iponly.h"
 #include "detect-parse.h"
 #include "util-mpm.h"
@@ -51,6 +52,8 @@
 
 #include "stream.h"
 
+#include "app-layer-htp.h"
+
 #include "util-enum.h"
 #include "util-debug.h"
 #include "util-print.h"
@@ -282,6 +285,65 @@ uint32_t UriPatternSearch(DetectEngineThreadCtx *det_ctx,
     SCReturnUInt(ret);
 }
 
+/** \internal
+ *  \brief Search a buffer that may be larger than 64k
+ *
+ *  Mpms that support resumable searches search all of the buffer. For
+ *  the others only the first 64k are searched.
+ */
+static inline uint32_t MpmSearchLargeBuffer(DetectEngineThreadCtx *det_ctx,
+        MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, uint8_t *buf, uint32_t buflen)
+{
+    MpmTableElmt *mpm = &mpm_table[mpm_ctx->mpm_type];
+
+    if (buflen > USHRT_MAX && mpm->SearchContinue != NULL &&
+        mpm->SearchStart(mpm_ctx, mpm_thread_ctx, &det_ctx->mpm_search_state) == 0)
+    {
+        mpm->SearchContinue(mpm_ctx, mpm_thread_ctx, &det_ctx->mpm_search_state,
+                &det_ctx->pmq, buf, buflen);
+        return mpm->SearchEnd(mpm_ctx, mpm_thread_ctx, &det_ctx->mpm_search_state);
+    }
+
+    if (buflen > USHRT_MAX)
+        buflen = USHRT_MAX;
+    return mpm->Search(mpm_ctx, mpm_thread_ctx, &det_ctx->pmq, buf,
+            (uint16_t)buflen);
+}
+
+/** \brief Search the body chunks with the resumable mpm api, so that
+ *         a body spread over several chunks doesn't need to be copied
+ *         into a contiguous buffer first.
+ *
+ *  \param chunk first chunk to search
+ *  \param skip  bytes of the first chunk to skip
+ *  \param cnt   number of matches
+ *
+ *  \retval 0 body searched
+ *  \retval -1 mpm can't search in parts, caller needs to fall back to a
+ *          search over the linearized body
+ */
+static int MpmSearchBodyChunks(DetectEngineThreadCtx *det_ctx,
+        MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        HtpBodyChunk *chunk, uint32_t skip, uint32_t *cnt)
+{
+    MpmTableElmt *mpm = &mpm_table[mpm_ctx->mpm_type];
+
+    if (mpm->SearchContinue == NULL ||
+        mpm->SearchStart(mpm_ctx, mpm_thread_ctx, &det_ctx->mpm_search_state) != 0)
+        return -1;
+
+    for ( ; chunk != NULL; chunk = chunk->next) {
+        if (chunk->len > skip) {
+            mpm->SearchContinue(mpm_ctx, mpm_thread_ctx, &det_ctx->mpm_search_state,
+                    &det_ctx->pmq, chunk->data + skip, chunk->len - skip);
+        }
+        skip = 0;
+    }
+
+    *cnt = mpm->SearchEnd(mpm_ctx, mpm_thread_ctx, &det_ctx->mpm_search_state);
+    return 0;
+}
+
 /** \brief Http client body pattern match -- searches for one pattern per
  *         signature.
  *
@@ -301,9 +363,8 @@ uint32_t HttpClientBodyPatternSearch(DetectEngineThreadCtx *det_ctx,
         if (det_ctx->sgh->mpm_hcbd_ctx_ts == NULL)
             SCReturnUInt(0);
 
-        ret = mpm_table[det_ctx->sgh->mpm_hcbd_ctx_ts->mpm_type].
-            Search(det_ctx->sgh->mpm_hcbd_ctx_ts, &det_ctx->mtcu,
-                   &det_ctx->pmq, body, body_len);
+        ret = MpmSearchLargeBuffer(det_ctx, det_ctx->sgh->mpm_hcbd_ctx_ts,
+                                   &det_ctx->mtcu, body, body_len);
     } else {
         BUG_ON(1);
     }
@@ -332,14 +393,71 @@ uint32_t HttpServerBodyPatternSearch(DetectEngineThreadCtx *det_ctx,
         if (det_ctx->sgh->mpm_hsbd_ctx_tc == NULL)
             SCReturnUInt(0);
 
-        ret = mpm_table[det_ctx->sgh->mpm_hsbd_ctx_tc->mpm_type].
-            Search(det_ctx->sgh->mpm_hsbd_ctx_tc, &det_ctx->mtcu,
-                   &det_ctx->pmq, body, body_len);
+        ret = MpmSearchLargeBuffer(det_ctx, det_ctx->sgh->mpm_hsbd_ctx_tc,
+                                   &det_ctx->mtcu, body, body_len);
     }
 
     SCReturnUInt(ret);
 }
 
+/** \brief Http client body pattern match over the body chunks.
+ *
+ *  \param det_ctx Detection engine thread ctx.
+ *  \param chunk   First body chunk to inspect.
+ *  \param skip    Bytes to skip in the first chunk.
+ *  \param cnt     Number of matches.
+ *
+ *  \retval 0 searched, -1 use HttpClientBodyPatternSearch instead
+ */
+int HttpClientBodyChunksPatternSearch(DetectEngineThreadCtx *det_ctx,
+                                      HtpBodyChunk *chunk, uint32_t skip,
+                                      uint8_t flags, uint32_t *cnt)
+{
+    SCEnter();
+
+    *cnt = 0;
+    if (flags & STREAM_TOSERVER) {
+        if (det_ctx->sgh->mpm_hcbd_ctx_ts == NULL)
+            SCReturnInt(0);
+
+        SCReturnInt(MpmSearchBodyChunks(det_ctx, det_ctx->sgh->mpm_hcbd_ctx_ts,
+                                        &det_ctx->mtcu, chunk, skip, cnt));
+    } else {
+        BUG_ON(1);
+    }
+
+    SCReturnInt(-1);
+}
+
+/** \brief Http server body pattern match over the body chunks.
+ *
+ *  \param det_ctx Detection engine thread ctx.
+ *  \param chunk   First body chunk to inspect.
+ *  \param skip    Bytes to skip in the first chunk.
+ *  \param cnt     Number of matches.
+ *
+ *  \retval 0 searched, -1 use HttpServerBodyPatternSearch instead
+ */
+int HttpServerBodyChunksPatternSearch(DetectEngineThreadCtx *det_ctx,
+                                      HtpBodyChunk *chunk, uint32_t skip,
+                                      uint8_t flags, uint32_t *cnt)
+{
+    SCEnter();
+
+    *cnt = 0;
+    if (flags & STREAM_TOSERVER) {
+        BUG_ON(1);
+    } else {
+        if (det_ctx->sgh->mpm_hsbd_ctx_tc == NULL)
+            SCReturnInt(0);
+
+        SCReturnInt(MpmSearchBodyChunks(det_ctx, det_ctx->sgh->mpm_hsbd_ctx_tc,
+                                        &det_ctx->mtcu, chunk, skip, cnt));
+    }
+
+    SCReturnInt(-1);
+}
+
 /**
  * \brief Http header match -- searches for one pattern per signature.
  *
@@ -815,6 +933,80 @@ void PatternMatchThreadPrepare(MpmThreadCtx *mpm_thread_ctx, uint16_t mpm_matche
     MpmInitThreadCtx(mpm_thread_ctx, mpm_matcher, max_id);
 }
 
+/** \brief Prepare a mpm ctx for searching
+ *
+ *  With multiple build threads the Prepare of matchers that support it
+ *  is deferred to PatternMatchPrepareRun(), at the end of SigGroupBuild().
+ */
+void PatternMatchPrepareCtx(DetectEngineCtx *de_ctx, MpmCtx *mpm_ctx)
+{
+    if (mpm_ctx == NULL || mpm_table[mpm_ctx->mpm_type].Prepare == NULL)
+        return;
+
+    if (de_ctx->build_threads <= 1 ||
+        !(mpm_table[mpm_ctx->mpm_type].flags & MPM_FLAG_PREPARE_THREAD_SAFE)) {
+        mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+        return;
+    }
+
+    if (de_ctx->mpm_prepare_cnt == de_ctx->mpm_prepare_size) {
+        uint32_t size = de_ctx->mpm_prepare_size ? de_ctx->mpm_prepare_size * 2 : 64;
+        MpmCtx **ptmp = SCRealloc(de_ctx->mpm_prepare_array, size * sizeof(MpmCtx *));
+        if (ptmp == NULL) {
+            /* no room to defer it, do it now */
+            mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+            return;
+        }
+        de_ctx->mpm_prepare_array = ptmp;
+        de_ctx->mpm_prepare_size = size;
+    }
+    de_ctx->mpm_prepare_array[de_ctx->mpm_prepare_cnt++] = mpm_ctx;
+}
+
+static void PatternMatchPrepareRunCtx(void *data)
+{
+    MpmCtx *mpm_ctx = (MpmCtx *)data;
+    mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+}
+
+/** \internal
+ *  \brief sort ctxs on descending pattern count, so the biggest ones
+ *         are started first */
+static int PatternMatchPrepareCmp(const void *a, const void *b)
+{
+    const MpmCtx *ma = *(const MpmCtx **)a;
+    const MpmCtx *mb = *(const MpmCtx **)b;
+
+    if (ma->pattern_cnt > mb->pattern_cnt)
+        return -1;
+    if (ma->pattern_cnt < mb->pattern_cnt)
+        return 1;
+    return 0;
+}
+
+/** \brief Prepare the mpm ctxs deferred by PatternMatchPrepareCtx() on
+ *         the build threads
+ *
+ *  \retval cnt number of ctxs prepared
+ */
+uint32_t PatternMatchPrepareRun(DetectEngineCtx *de_ctx)
+{
+    uint32_t cnt = de_ctx->mpm_prepare_cnt;
+
+    if (cnt > 0) {
+        qsort(de_ctx->mpm_prepare_array, cnt, sizeof(MpmCtx *),
+                PatternMatchPrepareCmp);
+        DetectBuildRunArray(de_ctx->build_threads, PatternMatchPrepareRunCtx,
+                (void **)de_ctx->mpm_prepare_array, cnt);
+    }
+
+    SCFree(de_ctx->mpm_prepare_array);
+    de_ctx->mpm_prepare_array = NULL;
+    de_ctx->mpm_prepare_cnt = 0;
+    de_ctx->mpm_prepare_size = 0;
+    return cnt;
+}
+
 
 /* free the pattern matcher part of a SigGroupHead */
 void PatternMatchDestroyGroup(SigGroupHead *sh) {
@@ -2300,8 +2492,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_proto_tcp_ctx_ts->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_tcp_ctx_ts->mpm_type].
-                             Prepare(sh->mpm_proto_tcp_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_proto_tcp_ctx_ts);
                      }
                  }
              }
@@ -2313,8 +2504,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_proto_tcp_ctx_tc->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_tcp_ctx_tc->mpm_type].
-                             Prepare(sh->mpm_proto_tcp_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_proto_tcp_ctx_tc);
                      }
                  }
              }
@@ -2327,8 +2517,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_proto_udp_ctx_ts->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_udp_ctx_ts->mpm_type].
-                             Prepare(sh->mpm_proto_udp_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_proto_udp_ctx_ts);
                      }
                  }
              }
@@ -2340,8 +2529,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_proto_udp_ctx_tc->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_udp_ctx_tc->mpm_type].
-                             Prepare(sh->mpm_proto_udp_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_proto_udp_ctx_tc);
                      }
                  }
              }
@@ -2354,8 +2542,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_proto_other_ctx->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_other_ctx->mpm_type].
-                             Prepare(sh->mpm_proto_other_ctx);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_proto_other_ctx);
                      }
                  }
              }
@@ -2368,7 +2555,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_stream_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_stream_ctx_ts->mpm_type].Prepare(sh->mpm_stream_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_stream_ctx_ts);
                  }
              }
          }
@@ -2379,7 +2566,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_stream_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_stream_ctx_tc->mpm_type].Prepare(sh->mpm_stream_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_stream_ctx_tc);
                  }
              }
          }
@@ -2391,7 +2578,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_uri_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_uri_ctx_ts->mpm_type].Prepare(sh->mpm_uri_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_uri_ctx_ts);
                  }
              }
          }
@@ -2403,7 +2590,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hcbd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hcbd_ctx_ts->mpm_type].Prepare(sh->mpm_hcbd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hcbd_ctx_ts);
                  }
              }
          }
@@ -2415,7 +2602,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hsbd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hsbd_ctx_tc->mpm_type].Prepare(sh->mpm_hsbd_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hsbd_ctx_tc);
                  }
              }
          }
@@ -2427,7 +2614,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hhd_ctx_ts->mpm_type].Prepare(sh->mpm_hhd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hhd_ctx_ts);
                  }
              }
          }
@@ -2438,7 +2625,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hhd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hhd_ctx_tc->mpm_type].Prepare(sh->mpm_hhd_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hhd_ctx_tc);
                  }
              }
          }
@@ -2450,7 +2637,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hrhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrhd_ctx_ts->mpm_type].Prepare(sh->mpm_hrhd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hrhd_ctx_ts);
                  }
              }
          }
@@ -2461,7 +2648,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hrhd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrhd_ctx_tc->mpm_type].Prepare(sh->mpm_hrhd_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hrhd_ctx_tc);
                  }
              }
          }
@@ -2473,7 +2660,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hmd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hmd_ctx_ts->mpm_type].Prepare(sh->mpm_hmd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hmd_ctx_ts);
                  }
              }
          }
@@ -2485,7 +2672,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hcd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hcd_ctx_ts->mpm_type].Prepare(sh->mpm_hcd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hcd_ctx_ts);
                  }
              }
          }
@@ -2496,7 +2683,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hcd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hcd_ctx_tc->mpm_type].Prepare(sh->mpm_hcd_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hcd_ctx_tc);
                  }
              }
          }
@@ -2508,7 +2695,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hrud_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrud_ctx_ts->mpm_type].Prepare(sh->mpm_hrud_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hrud_ctx_ts);
                  }
              }
          }
@@ -2520,7 +2707,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hsmd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hsmd_ctx_tc->mpm_type].Prepare(sh->mpm_hsmd_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hsmd_ctx_tc);
                  }
              }
          }
@@ -2532,7 +2719,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hscd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hscd_ctx_tc->mpm_type].Prepare(sh->mpm_hscd_ctx_tc);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hscd_ctx_tc);
                  }
              }
          }
@@ -2544,7 +2731,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_huad_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_huad_ctx_ts->mpm_type].Prepare(sh->mpm_huad_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_huad_ctx_ts);
                  }
              }
          }
@@ -2556,7 +2743,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hhhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hhhd_ctx_ts->mpm_type].Prepare(sh->mpm_hhhd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hhhd_ctx_ts);
                  }
              }
          }
@@ -2568,7 +2755,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_hrhhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrhhd_ctx_ts->mpm_type].Prepare(sh->mpm_hrhhd_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_hrhhd_ctx_ts);
                  }
              }
          }
@@ -2580,7 +2767,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
                      if (mpm_table[sh->mpm_dnsquery_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_dnsquery_ctx_ts->mpm_type].Prepare(sh->mpm_dnsquery_ctx_ts);
+                         PatternMatchPrepareCtx(de_ctx, sh->mpm_dnsquery_ctx_ts);
                  }
              }
          }
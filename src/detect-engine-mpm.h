@@ -41,6 +41,8 @@ uint32_t UriPatternSearch(DetectEngineThreadCtx *, uint8_t *, uint16_t, uint8_t)
 uint32_t StreamPatternSearch(DetectEngineThreadCtx *, Packet *, StreamMsg *, uint8_t);
 uint32_t HttpClientBodyPatternSearch(DetectEngineThreadCtx *, uint8_t *, uint32_t, uint8_t);
 uint32_t HttpServerBodyPatternSearch(DetectEngineThreadCtx *, uint8_t *, uint32_t, uint8_t);
+int HttpClientBodyChunksPatternSearch(DetectEngineThreadCtx *, struct HtpBodyChunk_ *, uint32_t, uint8_t, uint32_t *);
+int HttpServerBodyChunksPatternSearch(DetectEngineThreadCtx *, struct HtpBodyChunk_ *, uint32_t, uint8_t, uint32_t *);
 uint32_t HttpHeaderPatternSearch(DetectEngineThreadCtx *, uint8_t *, uint32_t, uint8_t);
 uint32_t HttpRawHeaderPatternSearch(DetectEngineThreadCtx *, uint8_t *, uint32_t, uint8_t);
 uint32_t HttpMethodPatternSearch(DetectEngineThreadCtx *, uint8_t *, uint32_t, uint8_t);
@@ -58,6 +60,8 @@ void StreamPatternCleanup(ThreadVars *t, DetectEngineThreadCtx *det_ctx, StreamM
 
 void PatternMatchPrepare(MpmCtx *, uint16_t);
 void PatternMatchThreadPrepare(MpmThreadCtx *, uint16_t type, uint32_t max_id);
+void PatternMatchPrepareCtx(DetectEngineCtx *, MpmCtx *);
+uint32_t PatternMatchPrepareRun(DetectEngineCtx *);
 
 void PatternMatchDestroy(MpmCtx *, uint16_t);
 void PatternMatchThreadDestroy(MpmThreadCtx *mpm_thread_ctx, uint16_t);
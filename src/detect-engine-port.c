@@ -101,6 +101,9 @@ void DetectPortFree(DetectPort *dp) {
     }
     dp->dst_ph = NULL;
 
+    DetectPortGroupLookupFree(dp->lookup);
+    dp->lookup = NULL;
+
     //BUG_ON(dp->next != NULL);
 
     detect_port_memory -= sizeof(DetectPort);
@@ -854,6 +857,27 @@ DetectPortLookupGroup(DetectPort *dp, uint16_t port) {
     if (dp == NULL)
         return NULL;
 
+    if (dp->lookup != NULL) {
+        DetectPortGroupLookup *l = dp->lookup;
+
+        if (l->table != NULL) {
+            uint16_t idx = l->table[port];
+            return idx ? l->dp[idx - 1] : NULL;
+        }
+
+        uint32_t lo = 0, hi = l->cnt;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (l->port2[mid] < port)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo < l->cnt && l->port[lo] <= port)
+            return l->dp[lo];
+        return NULL;
+    }
+
     for ( ; p != NULL; p = p->next) {
         if (DetectPortMatch(p,port) == 1) {
             //SCLogDebug("match, port %" PRIu32 ", dp ", port);
@@ -865,6 +889,101 @@ DetectPortLookupGroup(DetectPort *dp, uint16_t port) {
     return NULL;
 }
 
+void DetectPortGroupLookupFree(DetectPortGroupLookup *l)
+{
+    if (l == NULL)
+        return;
+
+    if (l->port2 != NULL)
+        SCFree(l->port2);
+    if (l->port != NULL)
+        SCFree(l->port);
+    if (l->dp != NULL)
+        SCFree(l->dp);
+    if (l->table != NULL)
+        SCFree(l->table);
+    SCFree(l);
+}
+
+/**
+ * \brief Set up the lookup structure for a final port group list, so
+ *        that DetectPortLookupGroup() doesn't have to walk the list.
+ *
+ * Lists of sorted, non overlapping ranges (the normal case after the
+ * grouping) get arrays for a binary search. Long lists, and lists with
+ * overlapping ranges, get a direct index table, filled so that the first
+ * group in the list wins like in the list walk.
+ *
+ * \param head head of the list, the lookup is stored in it
+ *
+ * \retval 0 ok (also if the list was left as is)
+ * \retval -1 error
+ */
+int DetectPortBuildLookup(DetectPort *head)
+{
+    DetectPort *p;
+    uint32_t cnt = 0, i;
+    int sorted = 1;
+
+    if (head == NULL || head->lookup != NULL)
+        return 0;
+
+    for (p = head; p != NULL; p = p->next) {
+        if (p->next != NULL && p->next->port <= p->port2)
+            sorted = 0;
+        cnt++;
+    }
+    /* table entries are 16 bit: idx + 1 */
+    if (!sorted && cnt >= 65535)
+        return 0;
+
+    DetectPortGroupLookup *l = SCMalloc(sizeof(DetectPortGroupLookup));
+    if (unlikely(l == NULL))
+        return -1;
+    memset(l, 0, sizeof(DetectPortGroupLookup));
+    l->cnt = cnt;
+
+    l->dp = SCMalloc(cnt * sizeof(DetectPort *));
+    if (l->dp == NULL)
+        goto error;
+    for (i = 0, p = head; p != NULL; p = p->next, i++) {
+        l->dp[i] = p;
+    }
+
+    if (sorted) {
+        l->port2 = SCMalloc(cnt * sizeof(uint16_t));
+        l->port = SCMalloc(cnt * sizeof(uint16_t));
+        if (l->port2 == NULL || l->port == NULL)
+            goto error;
+        for (i = 0; i < cnt; i++) {
+            l->port2[i] = l->dp[i]->port2;
+            l->port[i] = l->dp[i]->port;
+        }
+    }
+
+    if ((!sorted || cnt > DETECT_PORT_LOOKUP_TABLE_MIN) && cnt < 65535) {
+        l->table = SCMalloc(65536 * sizeof(uint16_t));
+        if (l->table == NULL)
+            goto error;
+        memset(l->table, 0, 65536 * sizeof(uint16_t));
+
+        /* reverse order so the first group in the list wins */
+        for (i = cnt; i > 0; i--) {
+            uint32_t port;
+            for (port = l->dp[i - 1]->port; port <= l->dp[i - 1]->port2; port++) {
+                l->table[port] = (uint16_t)i;
+            }
+        }
+    }
+
+    head->lookup = l;
+    return 0;
+
+error:
+    DetectPortGroupLookupFree(l);
+    return -1;
+}
+
 /**
  * \brief Function to join the source group to the target and its members
  *
@@ -2731,6 +2850,56 @@ static int PortTestMatchDoubleNegation(void)
     return result;
 }
 
+static int PortTestLookupDo(char *str, int expect_table)
+{
+    DetectPort *head = NULL;
+    uint32_t port;
+    int result = 0;
+
+    if (DetectPortParse(&head, str) != 0 || head == NULL)
+        return 0;
+
+    if (DetectPortBuildLookup(head) != 0 || head->lookup == NULL) {
+        printf("no lookup for %s: ", str);
+        goto end;
+    }
+    if ((head->lookup->table != NULL) != expect_table) {
+        printf("unexpected table for %s: ", str);
+        goto end;
+    }
+
+    for (port = 0; port < 65536; port++) {
+        DetectPort *p = head, *found = NULL;
+        for ( ; p != NULL; p = p->next) {
+            if (DetectPortMatch(p, (uint16_t)port) == 1) {
+                found = p;
+                break;
+            }
+        }
+        if (DetectPortLookupGroup(head, (uint16_t)port) != found) {
+            printf("port %u mismatch for %s: ", port, str);
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    DetectPortCleanupList(head);
+    return result;
+}
+
+/** \test flat lookup of short (sorted array) and long (direct index
+ *        table) lists gives the same groups as the list walk */
+static int PortTestLookup01(void)
+{
+    if (!PortTestLookupDo("[1:10,80,443,1024:2048]", 0))
+        return 0;
+    if (!PortTestLookupDo("[1,3,5,7,9,11,13,15,17,19,21,23,25,27,29,31,33,"
+                          "35,40000:65535]", 1))
+        return 0;
+    return 1;
+}
+
 #endif /* UNITTESTS */
 
 void DetectPortTests(void) {
@@ -2778,6 +2947,7 @@ void DetectPortTests(void) {
     UtRegisterTest("PortTestMatchReal19",
                    PortTestMatchReal19, 1);
     UtRegisterTest("PortTestMatchDoubleNegation", PortTestMatchDoubleNegation, 1);
+    UtRegisterTest("PortTestLookup01", PortTestLookup01, 1);
 
 
 #endif /* UNITTESTS */
@@ -37,6 +37,8 @@ DetectPort *DetectPortLookup(DetectPort *head, DetectPort *dp);
 int DetectPortAdd(DetectPort **head, DetectPort *dp);
 
 DetectPort *DetectPortLookupGroup(DetectPort *dp, uint16_t port);
+int DetectPortBuildLookup(DetectPort *head);
+void DetectPortGroupLookupFree(DetectPortGroupLookup *);
 
 void DetectPortPrintMemory(void);
 
@@ -0,0 +1,527 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * App layer buffer prefilter engines.
+ *
+ * Every app layer buffer that has a mpm registers an engine here: the
+ * function getting the buffer from a tx and running the mpm on it, the
+ * tx progress from which on the buffer is available and the direction.
+ * At rule load each sgh gets an array of the engines it has a mpm ctx
+ * for, per direction, which DetectEnginePrefilterRunTx() walks for the
+ * txs of the flow.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+
+#include "detect.h"
+#include "detect-engine.h"
+#include "detect-engine-prefilter.h"
+
+#include "detect-uricontent.h"
+#include "detect-engine-hcbd.h"
+#include "detect-engine-hsbd.h"
+#include "detect-engine-hhd.h"
+#include "detect-engine-hrhd.h"
+#include "detect-engine-hmd.h"
+#include "detect-engine-hcd.h"
+#include "detect-engine-hrud.h"
+#include "detect-engine-hsmd.h"
+#include "detect-engine-hscd.h"
+#include "detect-engine-hua.h"
+#include "detect-engine-hhhd.h"
+#include "detect-engine-hrhhd.h"
+#include "detect-dns-query.h"
+
+#include "flow.h"
+#include "app-layer-parser.h"
+#include "app-layer-htp.h"
+
+#include "util-debug.h"
+#include "util-profiling.h"
+#include "util-unittest.h"
+
+/** registered engines, ordered by alproto so a sgh's engines for an
+ *  alproto are next to each other */
+static DetectEnginePrefilterEngine prefilter_engines[DETECT_PREFILTER_ENGINES_MAX];
+static int prefilter_engines_cnt = 0;
+
+/** optional per alproto check if the state can be inspected at all */
+static int (*prefilter_state_ready[ALPROTO_MAX])(void *alstate);
+
+/* wrappers giving the buffer mpm functions the engine signature */
+
+static uint32_t PrefilterTxUri(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectUricontentInspectMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpRawUri(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpRawUriMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpMethod(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpMethodMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpHH(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpHHMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpHRH(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpHRHMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpCookie(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpCookieMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpUA(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpUAMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpHeader(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpHeaderMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpRawHeader(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpRawHeaderMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpClientBody(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpClientBodyMpm(de_ctx, det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpServerBody(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpServerBodyMpm(de_ctx, det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpStatMsg(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpStatMsgMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxHttpStatCode(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectEngineRunHttpStatCodeMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+static uint32_t PrefilterTxDnsQuery(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Flow *f, void *alstate,
+        uint8_t flags, void *tx, uint64_t idx)
+{
+    return DetectDnsQueryInspectMpm(det_ctx, f, alstate, flags, tx, idx);
+}
+
+/** \internal
+ *  \brief the HTTP state has no txs until libhtp is set up
+ */
+static int PrefilterHttpStateIsReady(void *alstate)
+{
+    HtpState *htp_state = (HtpState *)alstate;
+    return (htp_state->connp != NULL);
+}
+
+void DetectEngineRegisterPrefilterEngines(void)
+{
+    struct tmp_t {
+        const char *name;
+        AppProto alproto;
+        uint16_t dir;
+        int tx_min_progress;
+        uint32_t sgh_mpm_flag;
+        uint8_t flags;
+        int profile_id;
+        uint32_t (*PrefilterTx)(DetectEngineCtx *de_ctx,
+                                DetectEngineThreadCtx *det_ctx, Flow *f,
+                                void *alstate, uint8_t flags,
+                                void *tx, uint64_t idx);
+    };
+
+    struct tmp_t data[] = {
+        /* HTTP toserver */
+        { "http_uri", ALPROTO_HTTP, 0, HTP_REQUEST_LINE + 1,
+          SIG_GROUP_HEAD_MPM_URI, 0, PROF_DETECT_MPM_URI,
+          PrefilterTxUri },
+        { "http_raw_uri", ALPROTO_HTTP, 0, HTP_REQUEST_LINE + 1,
+          SIG_GROUP_HEAD_MPM_HRUD, 0, PROF_DETECT_MPM_HRUD,
+          PrefilterTxHttpRawUri },
+        { "http_method", ALPROTO_HTTP, 0, HTP_REQUEST_LINE + 1,
+          SIG_GROUP_HEAD_MPM_HMD, 0, PROF_DETECT_MPM_HMD,
+          PrefilterTxHttpMethod },
+        { "http_host", ALPROTO_HTTP, 0, HTP_REQUEST_HEADERS,
+          SIG_GROUP_HEAD_MPM_HHHD, 0, PROF_DETECT_MPM_HHHD,
+          PrefilterTxHttpHH },
+        { "http_raw_host", ALPROTO_HTTP, 0, HTP_REQUEST_HEADERS,
+          SIG_GROUP_HEAD_MPM_HRHHD, 0, PROF_DETECT_MPM_HRHHD,
+          PrefilterTxHttpHRH },
+        { "http_cookie", ALPROTO_HTTP, 0, HTP_REQUEST_HEADERS,
+          SIG_GROUP_HEAD_MPM_HCD, 0, PROF_DETECT_MPM_HCD,
+          PrefilterTxHttpCookie },
+        { "http_user_agent", ALPROTO_HTTP, 0, HTP_REQUEST_HEADERS,
+          SIG_GROUP_HEAD_MPM_HUAD, 0, PROF_DETECT_MPM_HUAD,
+          PrefilterTxHttpUA },
+        { "http_header", ALPROTO_HTTP, 0, HTP_REQUEST_HEADERS,
+          SIG_GROUP_HEAD_MPM_HHD, 0, PROF_DETECT_MPM_HHD,
+          PrefilterTxHttpHeader },
+        { "http_raw_header", ALPROTO_HTTP, 0, HTP_REQUEST_HEADERS,
+          SIG_GROUP_HEAD_MPM_HRHD, 0, PROF_DETECT_MPM_HRHD,
+          PrefilterTxHttpRawHeader },
+        { "http_client_body", ALPROTO_HTTP, 0, HTP_REQUEST_BODY,
+          SIG_GROUP_HEAD_MPM_HCBD, DETECT_PREFILTER_FLAG_WRLOCK,
+          PROF_DETECT_MPM_HCBD, PrefilterTxHttpClientBody },
+        /* HTTP toclient */
+        { "http_stat_msg", ALPROTO_HTTP, 1, HTP_RESPONSE_LINE + 1,
+          SIG_GROUP_HEAD_MPM_HSMD, 0, PROF_DETECT_MPM_HSMD,
+          PrefilterTxHttpStatMsg },
+        { "http_stat_code", ALPROTO_HTTP, 1, HTP_RESPONSE_LINE + 1,
+          SIG_GROUP_HEAD_MPM_HSCD, 0, PROF_DETECT_MPM_HSCD,
+          PrefilterTxHttpStatCode },
+        { "http_header", ALPROTO_HTTP, 1, HTP_RESPONSE_HEADERS,
+          SIG_GROUP_HEAD_MPM_HHD, 0, PROF_DETECT_MPM_HHD,
+          PrefilterTxHttpHeader },
+        { "http_raw_header", ALPROTO_HTTP, 1, HTP_RESPONSE_HEADERS,
+          SIG_GROUP_HEAD_MPM_HRHD, 0, PROF_DETECT_MPM_HRHD,
+          PrefilterTxHttpRawHeader },
+        { "http_cookie", ALPROTO_HTTP, 1, HTP_RESPONSE_HEADERS,
+          SIG_GROUP_HEAD_MPM_HCD, 0, PROF_DETECT_MPM_HCD,
+          PrefilterTxHttpCookie },
+        { "http_server_body", ALPROTO_HTTP, 1, HTP_RESPONSE_BODY,
+          SIG_GROUP_HEAD_MPM_HSBD, DETECT_PREFILTER_FLAG_WRLOCK,
+          PROF_DETECT_MPM_HSBD, PrefilterTxHttpServerBody },
+        /* DNS */
+        { "dns_query", ALPROTO_DNS, 0, 0,
+          SIG_GROUP_HEAD_MPM_DNSQUERY, 0, PROF_DETECT_MPM_DNSQUERY,
+          PrefilterTxDnsQuery },
+    };
+
+    size_t i;
+    for (i = 0; i < sizeof(data) / sizeof(struct tmp_t); i++) {
+        DetectEngineRegisterPrefilterEngine(data[i].name,
+                                            data[i].alproto,
+                                            data[i].dir,
+                                            data[i].tx_min_progress,
+                                            data[i].sgh_mpm_flag,
+                                            data[i].flags,
+                                            data[i].profile_id,
+                                            data[i].PrefilterTx);
+    }
+
+    DetectEngineRegisterPrefilterStateCheck(ALPROTO_HTTP,
+                                            PrefilterHttpStateIsReady);
+    return;
+}
+
+/**
+ * \brief Register a prefilter engine for an app layer buffer.
+ *
+ * \param name name of the buffer, for debugging
+ * \param alproto app layer protocol of the buffer
+ * \param dir direction: 0 - toserver, 1 - toclient
+ * \param tx_min_progress tx progress from which on the buffer is available
+ * \param sgh_mpm_flag SIG_GROUP_HEAD_MPM_* flag of the buffer's mpm
+ * \param flags DETECT_PREFILTER_FLAG_*
+ * \param profile_id PROF_DETECT_MPM_* id for packet profiling
+ * \param PrefilterTx function running the mpm on the buffer of a tx
+ */
+void DetectEngineRegisterPrefilterEngine(const char *name, AppProto alproto,
+        uint16_t dir, int tx_min_progress, uint32_t sgh_mpm_flag,
+        uint8_t flags, int profile_id,
+        uint32_t (*PrefilterTx)(DetectEngineCtx *, DetectEngineThreadCtx *,
+                                Flow *, void *, uint8_t, void *, uint64_t))
+{
+    if (name == NULL ||
+        (alproto <= ALPROTO_UNKNOWN || alproto >= ALPROTO_FAILED) ||
+        (dir > 1) || sgh_mpm_flag == 0 || PrefilterTx == NULL)
+    {
+        SCLogError(SC_ERR_INVALID_ARGUMENTS, "Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    int i;
+    for (i = 0; i < prefilter_engines_cnt; i++) {
+        DetectEnginePrefilterEngine *tmp = &prefilter_engines[i];
+        if (tmp->alproto == alproto && tmp->dir == dir &&
+            tmp->sgh_mpm_flag == sgh_mpm_flag) {
+            /* registered already, e.g. by the unittests */
+            return;
+        }
+    }
+
+    if (prefilter_engines_cnt == DETECT_PREFILTER_ENGINES_MAX) {
+        SCLogError(SC_ERR_DETECT_PREPARE, "too many prefilter engines, "
+                   "max %d", DETECT_PREFILTER_ENGINES_MAX);
+        exit(EXIT_FAILURE);
+    }
+
+    /* keep the list ordered by alproto */
+    for (i = prefilter_engines_cnt; i > 0; i--) {
+        if (prefilter_engines[i - 1].alproto <= alproto)
+            break;
+        prefilter_engines[i] = prefilter_engines[i - 1];
+    }
+
+    DetectEnginePrefilterEngine *engine = &prefilter_engines[i];
+    memset(engine, 0, sizeof(*engine));
+    engine->name = name;
+    engine->alproto = alproto;
+    engine->dir = dir;
+    engine->tx_min_progress = tx_min_progress;
+    engine->sgh_mpm_flag = sgh_mpm_flag;
+    engine->flags = flags;
+    engine->profile_id = profile_id;
+    engine->PrefilterTx = PrefilterTx;
+    prefilter_engines_cnt++;
+
+    return;
+}
+
+/**
+ * \brief Register a check if the state of an alproto can be walked for
+ *        txs, the engines for the alproto are skipped if it fails.
+ */
+void DetectEngineRegisterPrefilterStateCheck(AppProto alproto,
+        int (*StateIsReady)(void *alstate))
+{
+    if (alproto <= ALPROTO_UNKNOWN || alproto >= ALPROTO_FAILED) {
+        SCLogError(SC_ERR_INVALID_ARGUMENTS, "Invalid arguments");
+        exit(EXIT_FAILURE);
+    }
+
+    prefilter_state_ready[alproto] = StateIsReady;
+}
+
+/**
+ * \brief Set up the prefilter engine arrays of a sgh, after its mpm's
+ *        were prepared.
+ *
+ * \retval 0 ok, -1 on error
+ */
+int DetectEnginePrefilterSetupSgh(SigGroupHead *sgh)
+{
+    uint16_t dir;
+    int i;
+
+    for (dir = 0; dir < 2; dir++) {
+        uint16_t cnt = 0;
+
+        BUG_ON(sgh->prefilter_engines[dir] != NULL);
+
+        for (i = 0; i < prefilter_engines_cnt; i++) {
+            if (prefilter_engines[i].dir == dir &&
+                (sgh->flags & prefilter_engines[i].sgh_mpm_flag))
+                cnt++;
+        }
+        if (cnt == 0)
+            continue;
+
+        sgh->prefilter_engines[dir] = SCMalloc(cnt * sizeof(DetectEnginePrefilterEngine *));
+        if (sgh->prefilter_engines[dir] == NULL)
+            return -1;
+
+        cnt = 0;
+        for (i = 0; i < prefilter_engines_cnt; i++) {
+            if (prefilter_engines[i].dir == dir &&
+                (sgh->flags & prefilter_engines[i].sgh_mpm_flag))
+                sgh->prefilter_engines[dir][cnt++] = &prefilter_engines[i];
+        }
+        sgh->prefilter_engines_cnt[dir] = cnt;
+    }
+
+    return 0;
+}
+
+void DetectEnginePrefilterFreeSgh(SigGroupHead *sgh)
+{
+    uint16_t dir;
+
+    for (dir = 0; dir < 2; dir++) {
+        if (sgh->prefilter_engines[dir] != NULL) {
+            SCFree(sgh->prefilter_engines[dir]);
+            sgh->prefilter_engines[dir] = NULL;
+        }
+        sgh->prefilter_engines_cnt[dir] = 0;
+    }
+}
+
+/**
+ * \brief Run the sgh's prefilter engines for alproto on the txs that
+ *        still need inspection.
+ *
+ * The flow is read locked, unless one of the engines needs the write lock.
+ *
+ * \param flags STREAM_* flags of the packet
+ */
+void DetectEnginePrefilterRunTx(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Packet *p, uint8_t flags,
+        AppProto alproto, void *alstate)
+{
+    SigGroupHead *sgh = det_ctx->sgh;
+    const uint16_t dir = (p->flowflags & FLOW_PKT_TOSERVER) ? 0 : 1;
+    const uint8_t direction = dir ? STREAM_TOCLIENT : STREAM_TOSERVER;
+    DetectEnginePrefilterEngine **engines = sgh->prefilter_engines[dir];
+    uint16_t cnt = sgh->prefilter_engines_cnt[dir];
+    uint16_t start, end, i;
+    uint8_t engine_flags = 0;
+
+    /* find the engines of the alproto */
+    for (start = 0; start < cnt; start++) {
+        if (engines[start]->alproto == alproto)
+            break;
+    }
+    for (end = start; end < cnt && engines[end]->alproto == alproto; end++) {
+        engine_flags |= engines[end]->flags;
+    }
+    if (start == end)
+        return;
+
+    if (engine_flags & DETECT_PREFILTER_FLAG_WRLOCK)
+        FLOWLOCK_WRLOCK(p->flow);
+    else
+        FLOWLOCK_RDLOCK(p->flow);
+
+    if (prefilter_state_ready[alproto] != NULL &&
+        !prefilter_state_ready[alproto](alstate)) {
+        SCLogDebug("state of alproto %u not ready", alproto);
+        goto end;
+    }
+
+    uint64_t idx = AppLayerParserGetTransactionInspectId(p->flow->alparser, flags);
+    uint64_t total_txs = AppLayerParserGetTxCnt(p->flow->proto, alproto, alstate);
+    for (; idx < total_txs; idx++) {
+        void *tx = AppLayerParserGetTx(p->flow->proto, alproto, alstate, idx);
+        if (tx == NULL)
+            continue;
+
+        int tx_progress = AppLayerParserGetStateProgress(p->flow->proto,
+                alproto, tx, direction);
+
+        for (i = start; i < end; i++) {
+            DetectEnginePrefilterEngine *engine = engines[i];
+            if (tx_progress < engine->tx_min_progress)
+                continue;
+
+            PACKET_PROFILING_DETECT_START(p, engine->profile_id);
+            engine->PrefilterTx(de_ctx, det_ctx, p->flow, alstate, flags, tx, idx);
+            PACKET_PROFILING_DETECT_END(p, engine->profile_id);
+        }
+    }
+
+end:
+    FLOWLOCK_UNLOCK(p->flow);
+    return;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+/**
+ * \test Test that a sgh only gets the engines it has a mpm for, in the
+ *       right directions.
+ */
+static int DetectEnginePrefilterTest01(void)
+{
+    SigGroupHead sgh;
+    int result = 0;
+    uint16_t i;
+
+    DetectEngineRegisterPrefilterEngines();
+
+    memset(&sgh, 0, sizeof(sgh));
+    sgh.flags = SIG_GROUP_HEAD_MPM_URI | SIG_GROUP_HEAD_MPM_HCBD |
+                SIG_GROUP_HEAD_MPM_HHD | SIG_GROUP_HEAD_MPM_DNSQUERY |
+                SIG_GROUP_HEAD_MPM_STREAM;
+
+    if (DetectEnginePrefilterSetupSgh(&sgh) < 0)
+        goto end;
+
+    /* uri, client body, header and dns query */
+    if (sgh.prefilter_engines_cnt[0] != 4) {
+        printf("toserver: expected 4 engines, got %u: ",
+               sgh.prefilter_engines_cnt[0]);
+        goto end;
+    }
+    /* header */
+    if (sgh.prefilter_engines_cnt[1] != 1 ||
+        sgh.prefilter_engines[1][0]->sgh_mpm_flag != SIG_GROUP_HEAD_MPM_HHD) {
+        printf("toclient: expected the header engine: ");
+        goto end;
+    }
+    /* grouped by alproto */
+    for (i = 1; i < sgh.prefilter_engines_cnt[0]; i++) {
+        if (sgh.prefilter_engines[0][i - 1]->alproto >
+            sgh.prefilter_engines[0][i]->alproto) {
+            printf("engines not ordered by alproto: ");
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    DetectEnginePrefilterFreeSgh(&sgh);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void DetectEnginePrefilterRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectEnginePrefilterTest01", DetectEnginePrefilterTest01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,84 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ */
+
+#ifndef __DETECT_ENGINE_PREFILTER_H__
+#define __DETECT_ENGINE_PREFILTER_H__
+
+#include "detect.h"
+
+/** the engine changes the app layer state (e.g. body tracking),
+ *  so it has to run under the flow write lock */
+#define DETECT_PREFILTER_FLAG_WRLOCK    0x01
+
+/** max number of registered prefilter engines */
+#define DETECT_PREFILTER_ENGINES_MAX    64
+
+/**
+ * \brief App layer buffer prefilter (mpm) engine
+ *
+ * An engine is registered per buffer and direction. A sgh gets the
+ * engines for which PatternMatchPrepareGroup() set up a mpm ctx, as
+ * indicated by sgh_mpm_flag.
+ */
+typedef struct DetectEnginePrefilterEngine_ {
+    const char *name;
+
+    AppProto alproto;
+    /** 0 - toserver, 1 - toclient */
+    uint16_t dir;
+    /** the buffer is available once the tx progress in dir is at least
+     *  this */
+    int tx_min_progress;
+
+    /** SIG_GROUP_HEAD_MPM_* flag of the buffer's mpm */
+    uint32_t sgh_mpm_flag;
+    /** DETECT_PREFILTER_FLAG_* */
+    uint8_t flags;
+    /** PROF_DETECT_MPM_* id the engine's ticks are counted under */
+    int profile_id;
+
+    /** get the buffer of the tx and run the mpm on it
+     *  \retval number of pattern matches */
+    uint32_t (*PrefilterTx)(DetectEngineCtx *de_ctx,
+                            DetectEngineThreadCtx *det_ctx, Flow *f,
+                            void *alstate, uint8_t flags,
+                            void *tx, uint64_t idx);
+} DetectEnginePrefilterEngine;
+
+void DetectEngineRegisterPrefilterEngines(void);
+void DetectEngineRegisterPrefilterEngine(const char *name, AppProto alproto,
+        uint16_t dir, int tx_min_progress, uint32_t sgh_mpm_flag,
+        uint8_t flags, int profile_id,
+        uint32_t (*PrefilterTx)(DetectEngineCtx *, DetectEngineThreadCtx *,
+                                Flow *, void *, uint8_t, void *, uint64_t));
+void DetectEngineRegisterPrefilterStateCheck(AppProto alproto,
+        int (*StateIsReady)(void *alstate));
+
+int DetectEnginePrefilterSetupSgh(SigGroupHead *sgh);
+void DetectEnginePrefilterFreeSgh(SigGroupHead *sgh);
+
+void DetectEnginePrefilterRunTx(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Packet *p, uint8_t flags,
+        AppProto alproto, void *alstate);
+
+void DetectEnginePrefilterRegisterTests(void);
+
+#endif /* __DETECT_ENGINE_PREFILTER_H__ */
@@ -36,6 +36,7 @@
 #include "detect-engine-address.h"
 #include "detect-engine-mpm.h"
 #include "detect-engine-siggroup.h"
+#include "detect-engine-prefilter.h"
 
 #include "detect-content.h"
 #include "detect-uricontent.h"
@@ -188,12 +189,24 @@ void SigGroupHeadFree(SigGroupHead *sgh)
         sgh->mask_array = NULL;
     }
 #endif
+#if defined(__AVX2__)
+    if (sgh->mpm_div8_array != NULL) {
+        SCFreeAligned(sgh->mpm_div8_array);
+        sgh->mpm_div8_array = NULL;
+    }
+    if (sgh->mpm_mod8_array != NULL) {
+        SCFreeAligned(sgh->mpm_mod8_array);
+        sgh->mpm_mod8_array = NULL;
+    }
+#endif
 
     if (sgh->head_array != NULL) {
         SCFree(sgh->head_array);
         sgh->head_array = NULL;
     }
 
+    DetectEnginePrefilterFreeSgh(sgh);
+
     if (sgh->match_array != NULL) {
         detect_siggroup_matcharray_free_cnt++;
         detect_siggroup_matcharray_memory -= (sgh->sig_cnt * sizeof(Signature *));
@@ -1686,6 +1699,32 @@ void SigGroupHeadSetFilestoreCount(DetectEngineCtx *de_ctx, SigGroupHead *sgh) {
     return;
 }
 
+#if defined(__AVX2__)
+/** \internal
+ *  \brief get the bit of the mpm pattern a sig needs a hit on to be
+ *         inspected, following the mpm check in
+ *         SigMatchSignaturesBuildMatchArrayAddSignature()
+ *  \retval bit or 0 if the sig is inspected without a hit
+ */
+static uint32_t SigGroupHeadSigMpmBit(const Signature *s)
+{
+    if (s->flags & SIG_FLAG_MPM_PACKET) {
+        if (s->flags & SIG_FLAG_MPM_PACKET_NEG)
+            return 0;
+    } else if (s->flags & SIG_FLAG_MPM_STREAM) {
+        if (s->flags & SIG_FLAG_MPM_STREAM_NEG)
+            return 0;
+    } else if (s->flags & SIG_FLAG_MPM_APPLAYER) {
+        if (s->flags & SIG_FLAG_MPM_APPLAYER_NEG)
+            return 0;
+    } else {
+        return 0;
+    }
+
+    return s->mpm_pattern_id_mod_8;
+}
+#endif
+
 int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
 {
     Signature *s = NULL;
@@ -1717,6 +1756,20 @@ int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
         return -1;
 
     memset(sgh->mask_array, 0, (cnt * sizeof(SignatureMask)));
+
+#if defined(__AVX2__)
+    BUG_ON(sgh->mpm_div8_array != NULL || sgh->mpm_mod8_array != NULL);
+
+    sgh->mpm_div8_array = (uint32_t *)SCMallocAligned((cnt * sizeof(uint32_t)), 32);
+    if (sgh->mpm_div8_array == NULL)
+        return -1;
+    sgh->mpm_mod8_array = (uint32_t *)SCMallocAligned((cnt * sizeof(uint32_t)), 32);
+    if (sgh->mpm_mod8_array == NULL)
+        return -1;
+
+    memset(sgh->mpm_div8_array, 0, (cnt * sizeof(uint32_t)));
+    memset(sgh->mpm_mod8_array, 0, (cnt * sizeof(uint32_t)));
+#endif
 #endif
 
     sgh->head_array = SCMalloc(sgh->sig_cnt * sizeof(SignatureHeader));
@@ -1740,6 +1793,10 @@ int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
 
 #if defined(__SSE3__) || defined(__tile__)
         sgh->mask_array[idx] = s->mask;
+#endif
+#if defined(__AVX2__)
+        sgh->mpm_div8_array[idx] = s->mpm_pattern_id_div_8;
+        sgh->mpm_mod8_array[idx] = SigGroupHeadSigMpmBit(s);
 #endif
         idx++;
     }
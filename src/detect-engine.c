@@ -61,6 +61,8 @@
 #include "detect-engine-dns.h"
 
 #include "detect-engine.h"
+#include "detect-engine-build.h"
+#include "util-mpm-cache.h"
 #include "detect-engine-state.h"
 
 #include "detect-byte-extract.h"
@@ -428,8 +430,9 @@ static void *DetectEngineLiveRuleSwap(void *arg)
 
     ThreadVars *tv_local = (ThreadVars *)arg;
 
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     if (tv_local->thread_setup_flags != 0)
         TmThreadSetupOptions(tv_local);
@@ -683,8 +686,6 @@ static void *DetectEngineLiveRuleSwap(void *arg)
     }
     DetectEngineCtxFree(old_de_ctx);
 
-    SRepReloadComplete();
-
     /* reset the handler */
     UtilSignalHandlerSetup(SIGUSR2, SignalHandlerSigusr2);
 
@@ -895,6 +896,10 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx) {
     VariableNameFreeHash(de_ctx);
     if (de_ctx->sig_array)
         SCFree(de_ctx->sig_array);
+    if (de_ctx->mpm_prepare_array)
+        SCFree(de_ctx->mpm_prepare_array);
+
+    SRepStoreFree(de_ctx->srep);
 
     SCClassConfDeInitContext(de_ctx);
     SCRConfDeInitContext(de_ctx);
@@ -932,6 +937,9 @@ static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx) {
     const char *max_uniq_toserver_dp_groups_str = NULL;
 
     char *sgh_mpm_context = NULL;
+    char *build_threads = NULL;
+    char *mpm_cache_dir = NULL;
+    char *mpm_cache_max_age = NULL;
 
     ConfNode *de_ctx_custom = ConfGetNode("detect-engine");
     ConfNode *opt = NULL;
@@ -942,10 +950,35 @@ static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx) {
                 de_ctx_profile = opt->head.tqh_first->val;
             } else if (strcmp(opt->val, "sgh-mpm-context") == 0) {
                 sgh_mpm_context = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "build-threads") == 0) {
+                build_threads = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "mpm-cache-dir") == 0) {
+                mpm_cache_dir = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "mpm-cache-max-age") == 0) {
+                mpm_cache_max_age = opt->head.tqh_first->val;
             }
         }
     }
 
+    /* detect-engine.build-threads option parsing */
+    de_ctx->build_threads = DetectBuildThreadsParse(build_threads);
+    SCLogDebug("using %"PRIu16" detect engine build threads", de_ctx->build_threads);
+
+    /* detect-engine.mpm-cache-dir option parsing */
+    MpmCacheSetDir(mpm_cache_dir);
+
+    /* detect-engine.mpm-cache-max-age option parsing, in days */
+    uint32_t max_age = MPM_CACHE_DEFAULT_MAX_AGE;
+    if (mpm_cache_max_age != NULL &&
+        ByteExtractStringUint32(&max_age, 10, strlen(mpm_cache_max_age),
+                                (const char *)mpm_cache_max_age) <= 0) {
+        SCLogWarning(SC_ERR_INVALID_VALUE, "invalid value for "
+                "detect-engine.mpm-cache-max-age: %s, using %u",
+                mpm_cache_max_age, MPM_CACHE_DEFAULT_MAX_AGE);
+        max_age = MPM_CACHE_DEFAULT_MAX_AGE;
+    }
+    MpmCachePrune((uint64_t)max_age * 24 * 60 * 60);
+
     if (de_ctx_profile != NULL) {
         if (strcmp(de_ctx_profile, "low") == 0) {
             profile = ENGINE_PROFILE_LOW;
@@ -1398,6 +1431,7 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
     PatternMatchThreadDestroy(&det_ctx->mtcu, det_ctx->de_ctx->mpm_matcher);
 
     PmqFree(&det_ctx->pmq);
+    MpmSearchStateFree(&det_ctx->mpm_search_state);
     int i;
     for (i = 0; i < DETECT_SMSG_PMQ_NUM; i++) {
         PmqFree(&det_ctx->smsg_pmq[i]);
@@ -597,7 +597,7 @@ static int FlowBitsTestSig04(void) {
 
     idx = VariableNameGetIdx(de_ctx, "fbt", DETECT_FLOWBITS);
 
-    if (s == NULL || idx != 1) {
+    if (s == NULL || idx == 0) {
         goto end;
     }
 
@@ -779,7 +779,7 @@ static int FlowBitsTestSig06(void) {
     gv = p->flow->flowvar;
 
     for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
+        if (gv->type == DETECT_FLOWBITS && FlowBitArrayIsset((FlowBit *)gv, idx)) {
                 result = 1;
         }
     }
@@ -884,7 +884,7 @@ static int FlowBitsTestSig07(void) {
     gv = p->flow->flowvar;
 
     for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
+        if (gv->type == DETECT_FLOWBITS && FlowBitArrayIsset((FlowBit *)gv, idx)) {
                 result = 1;
         }
     }
@@ -992,7 +992,7 @@ static int FlowBitsTestSig08(void) {
     gv = p->flow->flowvar;
 
     for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
+        if (gv->type == DETECT_FLOWBITS && FlowBitArrayIsset((FlowBit *)gv, idx)) {
                 result = 1;
         }
     }
@@ -1029,6 +1029,44 @@ end:
     SCFree(p);
     return result;
 }
+
+/**
+ * \test a name keeps its idx in the next ruleset, also when the names
+ *       before it are gone, and a new name doesn't reuse an idx
+ */
+static int FlowBitsTestSig09(void) {
+    int result = 0;
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineCtx *de_ctx2 = NULL;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    uint16_t a = VariableNameGetIdx(de_ctx, "fbreload_a", DETECT_FLOWBITS);
+    uint16_t b = VariableNameGetIdx(de_ctx, "fbreload_b", DETECT_FLOWBITS);
+    if (a == 0 || b == 0 || a == b)
+        goto end;
+
+    /* the reloaded ruleset only has b, and a new name */
+    de_ctx2 = DetectEngineCtxInit();
+    if (de_ctx2 == NULL)
+        goto end;
+    uint16_t c = VariableNameGetIdx(de_ctx2, "fbreload_c", DETECT_FLOWBITS);
+    if (VariableNameGetIdx(de_ctx2, "fbreload_b", DETECT_FLOWBITS) != b)
+        goto end;
+    if (c == 0 || c == a || c == b)
+        goto end;
+    if (de_ctx2->variable_names_idx < b || de_ctx2->variable_names_idx < c)
+        goto end;
+
+    result = 1;
+end:
+    if (de_ctx != NULL)
+        DetectEngineCtxFree(de_ctx);
+    if (de_ctx2 != NULL)
+        DetectEngineCtxFree(de_ctx2);
+    return result;
+}
 #endif /* UNITTESTS */
 
 /**
@@ -1044,5 +1082,6 @@ void FlowBitsRegisterTests(void) {
     UtRegisterTest("FlowBitsTestSig06", FlowBitsTestSig06, 1);
     UtRegisterTest("FlowBitsTestSig07", FlowBitsTestSig07, 0);
     UtRegisterTest("FlowBitsTestSig08", FlowBitsTestSig08, 0);
+    UtRegisterTest("FlowBitsTestSig09", FlowBitsTestSig09, 1);
 #endif /* UNITTESTS */
 }
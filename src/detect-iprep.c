@@ -43,7 +43,6 @@
 #include "util-debug.h"
 
 #include "reputation.h"
-#include "host.h"
 
 #define PARSE_REGEX         "\\s*(any|src|dst|both)\\s*,\\s*([A-Za-z0-9\\-\\_]+)\\s*,\\s*(\\<|\\>|\\=)\\s*,\\s*([0-9]+)\\s*"
 static pcre *parse_regex;
@@ -87,83 +86,6 @@ error:
     return;
 }
 
-static uint8_t GetHostRepSrc(Packet *p, uint8_t cat, uint32_t version) {
-    uint8_t val = 0;
-    Host *h = NULL;
-
-    if (p->flags & PKT_HOST_SRC_LOOKED_UP && p->host_src == NULL) {
-        return 0;
-    } else if (p->host_src != NULL) {
-        h = (Host *)p->host_src;
-        HostLock(h);
-    } else {
-        h = HostLookupHostFromHash(&(p->src));
-
-        p->flags |= PKT_HOST_SRC_LOOKED_UP;
-
-        if (h == NULL)
-            return 0;
-
-        HostReference(&p->host_src, h);
-    }
-
-    if (h->iprep == NULL) {
-        HostRelease(h);
-        return 0;
-    }
-
-    SReputation *r = (SReputation *)h->iprep;
-
-    /* allow higher versions as this happens during
-     * rule reload */
-    if (r->version >= version)
-        val = r->rep[cat];
-    else
-        SCLogDebug("version mismatch %u != %u", r->version, version);
-
-    HostRelease(h);
-    return val;
-}
-
-static uint8_t GetHostRepDst(Packet *p, uint8_t cat, uint32_t version) {
-    uint8_t val = 0;
-    Host *h = NULL;
-
-    if (p->flags & PKT_HOST_DST_LOOKED_UP && p->host_dst == NULL) {
-        return 0;
-    } else if (p->host_dst != NULL) {
-        h = (Host *)p->host_dst;
-        HostLock(h);
-    } else {
-        h = HostLookupHostFromHash(&(p->dst));
-
-        p->flags |= PKT_HOST_DST_LOOKED_UP;
-
-        if (h == NULL) {
-            return 0;
-        }
-
-        HostReference(&p->host_dst, h);
-    }
-
-    if (h->iprep == NULL) {
-        HostRelease(h);
-        return 0;
-    }
-
-    SReputation *r = (SReputation *)h->iprep;
-
-    /* allow higher versions as this happens during
-     * rule reload */
-    if (r->version >= version)
-        val = r->rep[cat];
-    else
-        SCLogDebug("version mismatch %u != %u", r->version, version);
-
-    HostRelease(h);
-    return val;
-}
-
 static inline int RepMatch(uint8_t op, uint8_t val1, uint8_t val2) {
     if (op == DETECT_IPREP_OP_GT && val1 > val2) {
         return 1;
@@ -186,25 +108,26 @@ int DetectIPRepMatch (ThreadVars *t, DetectEngineThreadCtx *det_ctx, Packet *p,
     if (rd == NULL)
         return 0;
 
-    uint32_t version = det_ctx->de_ctx->srep_version;
+    /* the store is read only, so no locking is needed */
+    const SRepStore *store = det_ctx->de_ctx->srep;
     uint8_t val = 0;
 
     SCLogDebug("rd->cmd %u", rd->cmd);
     switch(rd->cmd) {
         case DETECT_IPREP_CMD_ANY:
-            val = GetHostRepSrc(p, rd->cat, version);
+            val = SRepStoreLookup(store, &p->src, rd->cat);
             if (val > 0) {
                 if (RepMatch(rd->op, val, rd->val) == 1)
                     return 1;
             }
-            val = GetHostRepDst(p, rd->cat, version);
+            val = SRepStoreLookup(store, &p->dst, rd->cat);
             if (val > 0) {
                 return RepMatch(rd->op, val, rd->val);
             }
             break;
 
         case DETECT_IPREP_CMD_SRC:
-            val = GetHostRepSrc(p, rd->cat, version);
+            val = SRepStoreLookup(store, &p->src, rd->cat);
             SCLogDebug("checking src -- val %u (looking for cat %u, val %u)", val, rd->cat, rd->val);
             if (val > 0) {
                 return RepMatch(rd->op, val, rd->val);
@@ -213,17 +136,17 @@ int DetectIPRepMatch (ThreadVars *t, DetectEngineThreadCtx *det_ctx, Packet *p,
 
         case DETECT_IPREP_CMD_DST:
             SCLogDebug("checking dst");
-            val = GetHostRepDst(p, rd->cat, version);
+            val = SRepStoreLookup(store, &p->dst, rd->cat);
             if (val > 0) {
                 return RepMatch(rd->op, val, rd->val);
             }
             break;
 
         case DETECT_IPREP_CMD_BOTH:
-            val = GetHostRepSrc(p, rd->cat, version);
+            val = SRepStoreLookup(store, &p->src, rd->cat);
             if (val == 0 || RepMatch(rd->op, val, rd->val) == 0)
                 return 0;
-            val = GetHostRepDst(p, rd->cat, version);
+            val = SRepStoreLookup(store, &p->dst, rd->cat);
             if (val > 0) {
                 return RepMatch(rd->op, val, rd->val);
             }
@@ -32,7 +32,79 @@
 
 /* Included into detect.c */
 
-#if defined(__SSE3__)
+#if defined(__AVX2__)
+
+/**
+ *  \brief AVX2 implementation of the signature prefilter.
+ *
+ *  32 signatures are checked at a time: the masks in one compare, the
+ *  mpm pattern hits with 4 gathers of the pattern id bitarray of 8 sigs
+ *  each. Only the sigs passing both get the remaining scalar checks of
+ *  SigMatchSignaturesBuildMatchArrayAddSignature().
+ */
+void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
+                                       Packet *p, SignatureMask mask, AppProto alproto)
+{
+    const SigGroupHead *sgh = det_ctx->sgh;
+    const uint8_t *bitarray = det_ctx->pmq.pattern_id_bitarray;
+    const uint32_t sig_cnt = sgh->sig_cnt;
+    Signature **match_array = det_ctx->match_array;
+    uint32_t match_cnt = 0;
+    uint32_t u;
+    int i;
+
+    /* load the packet mask into each byte of the vector */
+    const __m256i pm = _mm256_set1_epi8(mask);
+    const __m256i zero = _mm256_setzero_si256();
+
+    for (u = 0; u < sig_cnt; u += 32) {
+        /* 32 masks: AND them with the packet's mask and compare the
+         * result with the original mask */
+        __m256i sm = _mm256_loadu_si256((const __m256i *)&sgh->mask_array[u]);
+        __m256i r = _mm256_cmpeq_epi8(sm, _mm256_and_si256(pm, sm));
+        uint32_t bm = (uint32_t)_mm256_movemask_epi8(r);
+
+        if (bm == 0)
+            continue;
+
+        /* without patterns no sig has a mpm bit set */
+        if (bitarray != NULL) {
+            uint32_t hits = 0;
+
+            for (i = 0; i < 4; i++) {
+                __m256i div = _mm256_load_si256((const __m256i *)&sgh->mpm_div8_array[u + (i * 8)]);
+                __m256i mod = _mm256_load_si256((const __m256i *)&sgh->mpm_mod8_array[u + (i * 8)]);
+                /* 32 bits from the bitarray at each sig's byte offset,
+                 * only the lowest byte is of interest */
+                __m256i pb = _mm256_i32gather_epi32((const int *)bitarray, div, 1);
+                __m256i miss = _mm256_cmpeq_epi32(_mm256_and_si256(pb, mod), zero);
+                /* sigs without a mpm bit never miss */
+                __m256i rej = _mm256_andnot_si256(_mm256_cmpeq_epi32(mod, zero), miss);
+                uint32_t rejbits = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(rej));
+
+                hits |= (~rejbits & 0xff) << (i * 8);
+            }
+            bm &= hits;
+        }
+
+        while (bm) {
+            uint32_t x = u + __builtin_ctz(bm);
+            if (x >= sig_cnt)
+                break;
+            bm &= bm - 1;
+
+            SignatureHeader *s = &sgh->head_array[x];
+            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
+                /* okay, store it */
+                match_array[match_cnt++] = s->full_sig;
+            }
+        }
+    }
+
+    det_ctx->match_array_cnt = match_cnt;
+}
+
+#elif defined(__SSE3__)
 
 /**
  *  \brief SIMD implementation of mask prefiltering.
@@ -562,6 +634,155 @@ static int SigTestSIMDMask04(void)
     return 1;
 #endif
 }
+
+#if defined(__AVX2__)
+#include "detect-engine-siggroup.h"
+#include "util-cpu.h"
+
+#define SIMD_BENCH_SIGS     20000
+#define SIMD_BENCH_PATTERNS 8192
+#define SIMD_BENCH_RUNS     100
+
+/** \internal
+ *  \brief scalar prefilter, the reference for the AVX2 one */
+static void SigMatchSignaturesBuildMatchArrayScalar(DetectEngineThreadCtx *det_ctx,
+                                                    Packet *p, SignatureMask mask,
+                                                    AppProto alproto)
+{
+    uint32_t u;
+
+    det_ctx->match_array_cnt = 0;
+
+    for (u = 0; u < det_ctx->sgh->sig_cnt; u++) {
+        SignatureHeader *s = &det_ctx->sgh->head_array[u];
+        if ((mask & s->mask) == s->mask) {
+            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
+                det_ctx->match_array[det_ctx->match_array_cnt] = s->full_sig;
+                det_ctx->match_array_cnt++;
+            }
+        }
+    }
+}
+
+/** \internal
+ *  \brief small LCG, so the generated sgh is the same every run */
+static uint32_t SigTestSIMDRand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+#endif /* __AVX2__ */
+
+/**
+ *  \test Compare the AVX2 prefilter with the scalar one on a large
+ *        generated sgh and print the ticks per run of both.
+ */
+static int SigTestSIMDMatchArray01(void)
+{
+#if defined(__AVX2__)
+    int result = 0;
+    uint32_t u, seed = 1;
+    uint64_t ticks, scalar_ticks, simd_ticks;
+    uint32_t scalar_cnt;
+    const SignatureMask mask = 0x5b;
+    int run;
+
+    Signature *sigs = SCCalloc(SIMD_BENCH_SIGS, sizeof(Signature));
+    Signature **scalar_array = SCCalloc(SIMD_BENCH_SIGS, sizeof(Signature *));
+    SigGroupHead *sgh = SCCalloc(1, sizeof(SigGroupHead));
+    DetectEngineThreadCtx *det_ctx = SCCalloc(1, sizeof(DetectEngineThreadCtx));
+    Packet *p = PacketGetFromAlloc();
+    if (sigs == NULL || scalar_array == NULL || sgh == NULL ||
+        det_ctx == NULL || p == NULL)
+        goto end;
+
+    sgh->sig_cnt = SIMD_BENCH_SIGS;
+    sgh->match_array = SCCalloc(SIMD_BENCH_SIGS, sizeof(Signature *));
+    det_ctx->match_array = SCCalloc(SIMD_BENCH_SIGS, sizeof(Signature *));
+    if (sgh->match_array == NULL || det_ctx->match_array == NULL)
+        goto end;
+
+    /* sparse masks, 3 out of 4 sigs with a pattern, some negated */
+    for (u = 0; u < SIMD_BENCH_SIGS; u++) {
+        Signature *s = &sigs[u];
+        s->num = u;
+        s->mask = SigTestSIMDRand(&seed) & SigTestSIMDRand(&seed) & 0xff;
+        if (SigTestSIMDRand(&seed) % 4 != 0) {
+            uint32_t id = SigTestSIMDRand(&seed) % SIMD_BENCH_PATTERNS;
+            s->flags |= SIG_FLAG_MPM_PACKET;
+            if (SigTestSIMDRand(&seed) % 16 == 0)
+                s->flags |= SIG_FLAG_MPM_PACKET_NEG;
+            s->mpm_pattern_id_div_8 = id / 8;
+            s->mpm_pattern_id_mod_8 = 1 << (id % 8);
+        }
+        sgh->match_array[u] = s;
+    }
+
+    if (SigGroupHeadBuildHeadArray(NULL, sgh) < 0)
+        goto end;
+
+    /* 1 in 10 patterns hit */
+    if (PmqSetup(&det_ctx->pmq, SIMD_BENCH_PATTERNS) < 0)
+        goto end;
+    for (u = 0; u < SIMD_BENCH_PATTERNS; u++) {
+        if (SigTestSIMDRand(&seed) % 10 == 0)
+            det_ctx->pmq.pattern_id_bitarray[u / 8] |= (1 << (u % 8));
+    }
+    det_ctx->sgh = sgh;
+
+    SigMatchSignaturesBuildMatchArrayScalar(det_ctx, p, mask, ALPROTO_UNKNOWN);
+    scalar_cnt = det_ctx->match_array_cnt;
+    memcpy(scalar_array, det_ctx->match_array, scalar_cnt * sizeof(Signature *));
+
+    SigMatchSignaturesBuildMatchArray(det_ctx, p, mask, ALPROTO_UNKNOWN);
+    if (det_ctx->match_array_cnt != scalar_cnt ||
+        memcmp(scalar_array, det_ctx->match_array, scalar_cnt * sizeof(Signature *)) != 0) {
+        printf("avx2 match array (%u sigs) differs from the scalar one "
+               "(%u sigs): ", det_ctx->match_array_cnt, scalar_cnt);
+        goto cleanup;
+    }
+
+    ticks = UtilCpuGetTicks();
+    for (run = 0; run < SIMD_BENCH_RUNS; run++)
+        SigMatchSignaturesBuildMatchArrayScalar(det_ctx, p, mask, ALPROTO_UNKNOWN);
+    scalar_ticks = (UtilCpuGetTicks() - ticks) / SIMD_BENCH_RUNS;
+
+    ticks = UtilCpuGetTicks();
+    for (run = 0; run < SIMD_BENCH_RUNS; run++)
+        SigMatchSignaturesBuildMatchArray(det_ctx, p, mask, ALPROTO_UNKNOWN);
+    simd_ticks = (UtilCpuGetTicks() - ticks) / SIMD_BENCH_RUNS;
+
+    SCLogInfo("%u sigs, %u pass: scalar %"PRIu64" ticks/run, "
+              "avx2 %"PRIu64" ticks/run", SIMD_BENCH_SIGS, scalar_cnt,
+              scalar_ticks, simd_ticks);
+
+    result = 1;
+cleanup:
+    PmqFree(&det_ctx->pmq);
+    SigGroupHeadFree(sgh);
+    sgh = NULL;
+end:
+    if (sgh != NULL) {
+        if (sgh->match_array != NULL)
+            SCFree(sgh->match_array);
+        SCFree(sgh);
+    }
+    if (det_ctx != NULL) {
+        if (det_ctx->match_array != NULL)
+            SCFree(det_ctx->match_array);
+        SCFree(det_ctx);
+    }
+    if (p != NULL)
+        SCFree(p);
+    if (scalar_array != NULL)
+        SCFree(scalar_array);
+    if (sigs != NULL)
+        SCFree(sigs);
+    return result;
+#else
+    return 1;
+#endif
+}
 #endif /* UNITTESTS */
 
 void DetectSimdRegisterTests(void)
@@ -571,5 +792,6 @@ void DetectSimdRegisterTests(void)
     UtRegisterTest("SigTestSIMDMask02", SigTestSIMDMask02, 1);
     UtRegisterTest("SigTestSIMDMask03", SigTestSIMDMask03, 1);
     UtRegisterTest("SigTestSIMDMask04", SigTestSIMDMask04, 1);
+    UtRegisterTest("SigTestSIMDMatchArray01", SigTestSIMDMatchArray01, 1);
 #endif /* UNITTESTS */
 }
@@ -35,11 +35,13 @@
 #include "detect-engine.h"
 
 #include "detect-engine-alert.h"
+#include "detect-engine-prefilter.h"
 #include "detect-engine-siggroup.h"
 #include "detect-engine-address.h"
 #include "detect-engine-proto.h"
 #include "detect-engine-port.h"
 #include "detect-engine-mpm.h"
+#include "detect-engine-build.h"
 #include "detect-engine-iponly.h"
 #include "detect-engine-threshold.h"
 
@@ -191,6 +193,7 @@
 #include "util-optimize.h"
 #include "util-path.h"
 #include "util-mpm-ac.h"
+#include "util-mpm-cache.h"
 
 #include "runmodes.h"
 
@@ -792,157 +795,15 @@ static inline void DetectMpmPrefilter(DetectEngineCtx *de_ctx,
         DetectEngineThreadCtx *det_ctx, StreamMsg *smsg, Packet *p,
         uint8_t flags, AppProto alproto, void *alstate, uint8_t *sms_runflags)
 {
+    /* app layer buffers of the txs, see detect-engine-prefilter.c */
+    if (alstate != NULL && alproto != ALPROTO_UNKNOWN) {
+        DetectEnginePrefilterRunTx(de_ctx, det_ctx, p, flags, alproto, alstate);
+    }
+
     /* have a look at the reassembled stream (if any) */
     if (p->flowflags & FLOW_PKT_ESTABLISHED) {
         SCLogDebug("p->flowflags & FLOW_PKT_ESTABLISHED");
 
-        /* all http based mpms */
-        if (alstate != NULL && alproto == ALPROTO_HTTP) {
-            FLOWLOCK_WRLOCK(p->flow);
-
-            HtpState *htp_state = (HtpState *)alstate;
-            if (htp_state->connp == NULL) {
-                SCLogDebug("no HTTP connp");
-                FLOWLOCK_UNLOCK(p->flow);
-                return;
-            }
-
-            int tx_progress = 0;
-            uint64_t idx = AppLayerParserGetTransactionInspectId(p->flow->alparser, flags);
-            uint64_t total_txs = AppLayerParserGetTxCnt(p->flow->proto, ALPROTO_HTTP, alstate);
-            for (; idx < total_txs; idx++) {
-                htp_tx_t *tx = AppLayerParserGetTx(p->flow->proto, ALPROTO_HTTP, htp_state, idx);
-                if (tx == NULL)
-                    continue;
-                tx_progress = AppLayerParserGetStateProgress(p->flow->proto, ALPROTO_HTTP, tx, STREAM_TOSERVER);
-
-                if (p->flowflags & FLOW_PKT_TOSERVER) {
-                    if (tx_progress > HTP_REQUEST_LINE) {
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_URI) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_URI);
-                            DetectUricontentInspectMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_URI);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRUD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRUD);
-                            DetectEngineRunHttpRawUriMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRUD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HMD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HMD);
-                            DetectEngineRunHttpMethodMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HMD);
-                        }
-                    }
-
-                    if (tx_progress >= HTP_REQUEST_HEADERS) {
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HHHD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HHHD);
-                            DetectEngineRunHttpHHMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HHHD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRHHD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRHHD);
-                            DetectEngineRunHttpHRHMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRHHD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HCD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HCD);
-                            DetectEngineRunHttpCookieMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HCD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HUAD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HUAD);
-                            DetectEngineRunHttpUAMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HUAD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HHD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HHD);
-                            DetectEngineRunHttpHeaderMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HHD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRHD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRHD);
-                            DetectEngineRunHttpRawHeaderMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRHD);
-                        }
-                    }
-
-                    if (tx_progress >= HTP_REQUEST_BODY) {
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HCBD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HCBD);
-                            DetectEngineRunHttpClientBodyMpm(de_ctx, det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HCBD);
-                        }
-                    }
-                } else { /* implied FLOW_PKT_TOCLIENT */
-                    tx_progress = AppLayerParserGetStateProgress(p->flow->proto, ALPROTO_HTTP, tx, STREAM_TOCLIENT);
-
-                    if (tx_progress > HTP_RESPONSE_LINE) {
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HSMD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HSMD);
-                            DetectEngineRunHttpStatMsgMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HSMD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HSCD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HSCD);
-                            DetectEngineRunHttpStatCodeMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HSCD);
-                        }
-                    }
-
-                    if (tx_progress >= HTP_RESPONSE_HEADERS) {
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HHD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HHD);
-                            DetectEngineRunHttpHeaderMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HHD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HRHD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HRHD);
-                            DetectEngineRunHttpRawHeaderMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HRHD);
-                        }
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HCD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HCD);
-                            DetectEngineRunHttpCookieMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HCD);
-                        }
-                    }
-
-                    if (tx_progress >= HTP_RESPONSE_BODY) {
-                        if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_HSBD) {
-                            PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_HSBD);
-                            DetectEngineRunHttpServerBodyMpm(de_ctx, det_ctx, p->flow, alstate, flags, tx, idx);
-                            PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_HSBD);
-                        }
-                    }
-                }
-            } /* for */
-
-            FLOWLOCK_UNLOCK(p->flow);
-        }
-        /* all dns based mpms */
-        else if (alproto == ALPROTO_DNS && alstate != NULL) {
-            if (p->flowflags & FLOW_PKT_TOSERVER) {
-                if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_DNSQUERY) {
-                    FLOWLOCK_RDLOCK(p->flow);
-
-                    uint64_t idx = AppLayerParserGetTransactionInspectId(p->flow->alparser, flags);
-                    uint64_t total_txs = AppLayerParserGetTxCnt(p->flow->proto, alproto, alstate);
-                    for (; idx < total_txs; idx++) {
-                        void *tx = AppLayerParserGetTx(p->flow->proto, alproto, alstate, idx);
-                        if (tx == NULL)
-                            continue;
-
-                        PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_DNSQUERY);
-                        DetectDnsQueryInspectMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                        PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_DNSQUERY);
-                    }
-                    FLOWLOCK_UNLOCK(p->flow);
-                }
-            }
-        }
-
         if (smsg != NULL && (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_STREAM)) {
             PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_STREAM);
             StreamPatternSearch(det_ctx, p, smsg, flags);
@@ -975,28 +836,6 @@ static inline void DetectMpmPrefilter(DetectEngineCtx *de_ctx,
             *sms_runflags |= SMS_USED_PM;
         }
     }
-
-    /* UDP DNS inspection is independent of est or not */
-    if (alproto == ALPROTO_DNS && alstate != NULL) {
-        if (p->flowflags & FLOW_PKT_TOSERVER) {
-            SCLogDebug("mpm inspection");
-            if (det_ctx->sgh->flags & SIG_GROUP_HEAD_MPM_DNSQUERY) {
-                FLOWLOCK_RDLOCK(p->flow);
-                uint64_t idx = AppLayerParserGetTransactionInspectId(p->flow->alparser, flags);
-                uint64_t total_txs = AppLayerParserGetTxCnt(p->flow->proto, alproto, alstate);
-                for (; idx < total_txs; idx++) {
-                    void *tx = AppLayerParserGetTx(p->flow->proto, alproto, alstate, idx);
-                    if (tx == NULL)
-                        continue;
-                    SCLogDebug("tx %p",tx);
-                    PACKET_PROFILING_DETECT_START(p, PROF_DETECT_MPM_DNSQUERY);
-                    DetectDnsQueryInspectMpm(det_ctx, p->flow, alstate, flags, tx, idx);
-                    PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM_DNSQUERY);
-                }
-                FLOWLOCK_UNLOCK(p->flow);
-            }
-        }
-    }
 }
 
 #ifdef DEBUG
@@ -1012,65 +851,45 @@ static void DebugInspectIds(Packet *p, Flow *f, StreamMsg *smsg)
 
 static void AlertDebugLogModeSyncFlowbitsNamesToPacketStruct(Packet *p, DetectEngineCtx *de_ctx)
 {
-#define MALLOC_JUMP 5
-
+    FlowBit *fb = NULL;
+    uint32_t idx;
     int i = 0;
 
     GenericVar *gv = p->flow->flowvar;
+    for ( ; gv != NULL; gv = gv->next) {
+        if (gv->type == DETECT_FLOWBITS) {
+            fb = (FlowBit *)gv;
+            break;
+        }
+    }
+    if (fb == NULL)
+        return;
 
-    while (gv != NULL) {
-        i++;
-        gv = gv->next;
+    for (idx = 0; idx < fb->size; idx++) {
+        if (FlowBitArrayIsset(fb, idx))
+            i++;
     }
     if (i == 0)
         return;
 
-    p->debuglog_flowbits_names_len = i;
-
-    p->debuglog_flowbits_names = SCMalloc(sizeof(char *) *
-                                          p->debuglog_flowbits_names_len);
+    p->debuglog_flowbits_names = SCMalloc(sizeof(char *) * i);
     if (p->debuglog_flowbits_names == NULL) {
         return;
     }
-    memset(p->debuglog_flowbits_names, 0,
-           sizeof(char *) * p->debuglog_flowbits_names_len);
+    memset(p->debuglog_flowbits_names, 0, sizeof(char *) * i);
+    p->debuglog_flowbits_names_len = i;
 
     i = 0;
-    gv = p->flow->flowvar;
-    while (gv != NULL) {
-        if (gv->type != DETECT_FLOWBITS) {
-            gv = gv->next;
+    for (idx = 0; idx < fb->size && i < p->debuglog_flowbits_names_len; idx++) {
+        if (!FlowBitArrayIsset(fb, idx))
             continue;
-        }
 
-        FlowBit *fb = (FlowBit *) gv;
-        char *name = VariableIdxGetName(de_ctx, fb->idx, fb->type);
+        /* name is a copy already */
+        char *name = VariableIdxGetName(de_ctx, (uint16_t)idx, DETECT_FLOWBITS);
         if (name != NULL) {
-            p->debuglog_flowbits_names[i] = SCStrdup(name);
-            if (p->debuglog_flowbits_names[i] == NULL) {
-                return;
-            }
+            p->debuglog_flowbits_names[i] = name;
             i++;
         }
-
-        if (i == p->debuglog_flowbits_names_len) {
-            p->debuglog_flowbits_names_len += MALLOC_JUMP;
-            const char **names = SCRealloc(p->debuglog_flowbits_names,
-                                                   sizeof(char *) *
-                                                   p->debuglog_flowbits_names_len);
-            if (names == NULL) {
-                SCFree(p->debuglog_flowbits_names);
-                p->debuglog_flowbits_names = NULL;
-                p->debuglog_flowbits_names_len = 0;
-                return;
-            }
-            p->debuglog_flowbits_names = names;
-            memset(p->debuglog_flowbits_names +
-                   p->debuglog_flowbits_names_len - MALLOC_JUMP,
-                   0, sizeof(char *) * MALLOC_JUMP);
-        }
-
-        gv = gv->next;
     }
 
     return;
@@ -3102,8 +2921,8 @@ int SigAddressPrepareStage2(DetectEngineCtx *de_ctx) {
     //DetectAddressPrintList(g_src_gh->ipv4_head);
     //printf("g_src_gh end\n");
 
-    IPOnlyPrepare(de_ctx);
-    IPOnlyPrint(de_ctx, &de_ctx->io_ctx);
+    /* the ip-only radix trees are prepared by SigGroupBuild(), next to
+     * stage 3 */
 #ifdef DEBUG
     DetectAddress *gr = NULL;
     if (!(de_ctx->flags & DE_QUIET)) {
@@ -3923,6 +3742,64 @@ void DbgSghContainsSig(DetectEngineCtx *de_ctx, SigGroupHead *sgh, uint32_t sid)
     printf("\n");
 }
 
+/**
+ *  \internal
+ *  \brief set up the flat lookup structures for the final address and
+ *         port group lists used by SigMatchSignaturesGetSgh()
+ */
+static int SigGroupBuildLookups(DetectEngineCtx *de_ctx)
+{
+    int f, proto, i, j;
+
+    for (f = 0; f < FLOW_STATES; f++) {
+        for (proto = 0; proto < 256; proto++) {
+            DetectAddressHead *src_gh = de_ctx->flow_gh[f].src_gh[proto];
+            if (src_gh == NULL)
+                continue;
+
+            if (DetectAddressHeadBuildLookup(src_gh) < 0)
+                return -1;
+
+            DetectAddress *src_lists[3] = { src_gh->ipv4_head,
+                src_gh->ipv6_head, src_gh->any_head };
+            for (i = 0; i < 3; i++) {
+                DetectAddress *src_gr = src_lists[i];
+                for ( ; src_gr != NULL; src_gr = src_gr->next) {
+                    DetectAddressHead *dst_gh = src_gr->dst_gh;
+                    if (dst_gh == NULL)
+                        continue;
+
+                    if (DetectAddressHeadBuildLookup(dst_gh) < 0)
+                        return -1;
+
+                    DetectAddress *dst_lists[3] = { dst_gh->ipv4_head,
+                        dst_gh->ipv6_head, dst_gh->any_head };
+                    for (j = 0; j < 3; j++) {
+                        DetectAddress *dst_gr = dst_lists[j];
+                        for ( ; dst_gr != NULL; dst_gr = dst_gr->next) {
+                            if (!(dst_gr->flags & ADDRESS_HAVEPORT))
+                                continue;
+
+                            /* port lists may be shared, they are only
+                             * set up once */
+                            if (DetectPortBuildLookup(dst_gr->port) < 0)
+                                return -1;
+
+                            DetectPort *sp = dst_gr->port;
+                            for ( ; sp != NULL; sp = sp->next) {
+                                if (DetectPortBuildLookup(sp->dst_ph) < 0)
+                                    return -1;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
 /** \brief finalize preparing sgh's */
 int SigAddressPrepareStage4(DetectEngineCtx *de_ctx) {
     SCEnter();
@@ -3937,6 +3814,11 @@ int SigAddressPrepareStage4(DetectEngineCtx *de_ctx) {
             continue;
 
         SigGroupHeadBuildHeadArray(de_ctx, sgh);
+        if (DetectEnginePrefilterSetupSgh(sgh) < 0) {
+            SCLogError(SC_ERR_MEM_ALLOC, "setting up the prefilter "
+                       "engines of a sgh failed");
+            SCReturnInt(-1);
+        }
         SigGroupHeadSetFilemagicFlag(de_ctx, sgh);
         SigGroupHeadSetFileMd5Flag(de_ctx, sgh);
         SigGroupHeadSetFilesizeFlag(de_ctx, sgh);
@@ -3954,6 +3836,12 @@ int SigAddressPrepareStage4(DetectEngineCtx *de_ctx) {
     de_ctx->sgh_array_cnt = 0;
     de_ctx->sgh_array_size = 0;
 
+    if (SigGroupBuildLookups(de_ctx) < 0) {
+        SCLogError(SC_ERR_MEM_ALLOC, "setting up the address and port "
+                   "group lookups failed");
+        SCReturnInt(-1);
+    }
+
     SCReturnInt(0);
 }
 
@@ -4268,6 +4156,16 @@ int SigAddressPrepareStage5(DetectEngineCtx *de_ctx) {
     return 0;
 }
 
+/** \internal
+ *  \brief build the ip-only radix trees, runs on a build thread */
+static void SigGroupBuildIPOnlyPrepare(void *data)
+{
+    DetectEngineCtx *de_ctx = (DetectEngineCtx *)data;
+
+    IPOnlyPrepare(de_ctx);
+    IPOnlyPrint(de_ctx, &de_ctx->io_ctx);
+}
+
 /**
  * \brief Convert the signature list into the runtime match structure.
  *
@@ -4280,6 +4178,12 @@ int SigAddressPrepareStage5(DetectEngineCtx *de_ctx) {
 int SigGroupBuild(DetectEngineCtx *de_ctx)
 {
     Signature *s = de_ctx->sig_list;
+    DetectBuildTask iponly_task;
+    struct timeval build_start, stage_start;
+    uint64_t fp_ms, stage1_ms, stage2_ms, stage3_ms, stage4_ms, mpm_ms;
+    uint32_t mpm_prepare_cnt;
+
+    gettimeofday(&build_start, NULL);
 
     /* Assign the unique order id of signatures after sorting,
      * so the IP Only engine process them in order too.  Also
@@ -4293,6 +4197,9 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
         s = s->next;
     }
 
+    /* new flowbit arrays are sized for the name idxs of this ruleset */
+    FlowBitSetMaxIdx(de_ctx->variable_names_idx);
+
     if (DetectSetFastPatternAndItsId(de_ctx) < 0)
         return -1;
 
@@ -4301,25 +4208,41 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
     if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_SINGLE) {
         SigInitStandardMpmFactoryContexts(de_ctx);
     }
+    fp_ms = DetectBuildTimeMs(&build_start);
 
+    gettimeofday(&stage_start, NULL);
     if (SigAddressPrepareStage1(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    stage1_ms = DetectBuildTimeMs(&stage_start);
 //exit(0);
+    gettimeofday(&stage_start, NULL);
     if (SigAddressPrepareStage2(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    stage2_ms = DetectBuildTimeMs(&stage_start);
 
+    /* stage 3 doesn't touch the ip-only ctx, so the radix trees can
+     * be built at the same time */
+    DetectBuildTaskStart(de_ctx->build_threads, &iponly_task,
+            SigGroupBuildIPOnlyPrepare, de_ctx);
+
+    gettimeofday(&stage_start, NULL);
     if (SigAddressPrepareStage3(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    DetectBuildTaskWait(&iponly_task);
+    stage3_ms = DetectBuildTimeMs(&stage_start);
+
+    gettimeofday(&stage_start, NULL);
     if (SigAddressPrepareStage4(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    stage4_ms = DetectBuildTimeMs(&stage_start);
 
     if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_SINGLE) {
         MpmCtx *mpm_ctx = NULL;
@@ -4345,174 +4268,174 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_tcp_packet, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_tcp_packet, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("packet- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_udp_packet, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_udp_packet, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("packet- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_other_packet, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("packet- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_uri, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_uri, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("uri- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcbd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcbd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hcbd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsbd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsbd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hsbd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hrhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hmd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hmd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hmd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hcd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrud, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrud, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hrud- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_stream, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_stream, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("stream- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsmd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hsmd- %d\n", mpm_ctx->pattern_cnt);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsmd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hsmd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hscd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hscd- %d\n", mpm_ctx->pattern_cnt);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hscd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hscd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_huad, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("huad- %d\n", mpm_ctx->pattern_cnt);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_huad, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("huad- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhhd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hhhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhhd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hhhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhhd, 0);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hrhhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhhd, 1);
         if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
+            PatternMatchPrepareCtx(de_ctx, mpm_ctx);
         }
         //printf("hrhhd- %d\n", mpm_ctx->pattern_cnt);
 
@@ -4532,6 +4455,30 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 
     }
 
+    /* prepare the mpm ctxs deferred by PatternMatchPrepareCtx() */
+    gettimeofday(&stage_start, NULL);
+    mpm_prepare_cnt = PatternMatchPrepareRun(de_ctx);
+    mpm_ms = DetectBuildTimeMs(&stage_start);
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        SCLogInfo("signature grouping built in %"PRIu64" ms using %"PRIu16" "
+                "build threads: fast pattern %"PRIu64" ms, stage 1 %"PRIu64" ms, "
+                "stage 2 %"PRIu64" ms, stage 3 %"PRIu64" ms (ip-only %"PRIu64" ms), "
+                "stage 4 %"PRIu64" ms, mpm prepare %"PRIu64" ms (%"PRIu32" "
+                "deferred ctxs)", DetectBuildTimeMs(&build_start),
+                de_ctx->build_threads, fp_ms, stage1_ms, stage2_ms, stage3_ms,
+                iponly_task.ms, stage4_ms, mpm_ms, mpm_prepare_cnt);
+    }
+
+    if (MpmCacheEnabled()) {
+        uint32_t hits, misses, stores;
+        MpmCacheGetStats(&hits, &misses, &stores, 1);
+        if (!(de_ctx->flags & DE_QUIET)) {
+            SCLogInfo("mpm cache: %"PRIu32" hits, %"PRIu32" misses, "
+                    "%"PRIu32" stored", hits, misses, stores);
+        }
+    }
+
 //    SigAddressPrepareStage5(de_ctx);
 //    DetectAddressPrintMemory();
 //    DetectSigGroupPrintMemory();
@@ -187,11 +187,34 @@ typedef struct DetectAddress_ {
     uint32_t cnt;
 } DetectAddress;
 
+/** Flattened ipv4 address group list, sorted by address. The ranges
+ *  don't overlap, so a binary search on ip2 finds the group. */
+typedef struct DetectAddressLookupIPv4_ {
+    uint32_t cnt;
+    uint32_t *ip2;  /**< end of range, host order */
+    uint32_t *ip;   /**< start of range, host order */
+    struct DetectAddress_ **ag;
+} DetectAddressLookupIPv4;
+
+/** Flattened ipv6 address group list. Addresses are stored as 2 host
+ *  order 64 bit words, most significant first. */
+typedef struct DetectAddressLookupIPv6_ {
+    uint32_t cnt;
+    uint64_t (*ip2)[2];
+    uint64_t (*ip)[2];
+    struct DetectAddress_ **ag;
+} DetectAddressLookupIPv6;
+
 /** Signature grouping head. Here 'any', ipv4 and ipv6 are split out */
 typedef struct DetectAddressHead_ {
     DetectAddress *any_head;
     DetectAddress *ipv4_head;
     DetectAddress *ipv6_head;
+
+    /** lookup arrays for the final lists, set up at the end of
+     *  SigGroupBuild(). NULL if not set up. */
+    DetectAddressLookupIPv4 *ipv4_lookup;
+    DetectAddressLookupIPv6 *ipv6_lookup;
 } DetectAddressHead;
 
 
@@ -228,6 +251,23 @@ enum {
 #define PORT_SIGGROUPHEAD_COPY  0x04 /**< sgh is a ptr copy */
 #define PORT_GROUP_PORTS_COPY   0x08 /**< dst_ph is a ptr copy */
 
+/** lists with more groups than this get a direct index table */
+#define DETECT_PORT_LOOKUP_TABLE_MIN    16
+
+/** Flattened port group list */
+typedef struct DetectPortGroupLookup_ {
+    uint32_t cnt;
+    /** sorted, non overlapping ranges. NULL if the list has overlapping
+     *  ranges, then table is always set. */
+    uint16_t *port2;
+    uint16_t *port;
+    struct DetectPort_ **dp;
+
+    /** 65536 entries: index in dp + 1, 0 for no match. Only for lists
+     *  longer than DETECT_PORT_LOOKUP_TABLE_MIN */
+    uint16_t *table;
+} DetectPortGroupLookup;
+
 /** \brief Port structure for detection engine */
 typedef struct DetectPort_ {
     uint16_t port;
@@ -238,6 +278,10 @@ typedef struct DetectPort_ {
 
     struct DetectPort_ *dst_ph;
 
+    /** lookup structure for the list this port is the head of, set up at
+     *  the end of SigGroupBuild() */
+    DetectPortGroupLookup *lookup;
+
     /* double linked list */
     union {
         struct DetectPort_ *prev;
@@ -583,8 +627,8 @@ typedef struct DetectEngineCtx_ {
     Signature *sig_list;
     uint32_t sig_cnt;
 
-    /* version of the srep data */
-    uint32_t srep_version;
+    /* ip reputation store, swapped together with the detect engine */
+    struct SRepStore_ *srep;
 
     Signature **sig_array;
     uint32_t sig_array_size; /* size in bytes */
@@ -625,6 +669,7 @@ typedef struct DetectEngineCtx_ {
 
     HashListTable *variable_names;
     HashListTable *variable_idxs;
+    /** highest name idx used by this ruleset, name idxs are process wide */
     uint16_t variable_names_idx;
 
     /* hash table used to cull out duplicate sigs */
@@ -685,6 +730,14 @@ typedef struct DetectEngineCtx_ {
     uint32_t sgh_array_cnt;
     uint32_t sgh_array_size;
 
+    /** number of threads SigGroupBuild() may use */
+    uint16_t build_threads;
+
+    /** mpm ctxs to prepare at the end of SigGroupBuild() */
+    MpmCtx **mpm_prepare_array;
+    uint32_t mpm_prepare_cnt;
+    uint32_t mpm_prepare_size;
+
     int32_t sgh_mpm_context_proto_tcp_packet;
     int32_t sgh_mpm_context_proto_udp_packet;
     int32_t sgh_mpm_context_proto_other_packet;
@@ -755,10 +808,16 @@ enum {
 };
 
 typedef struct HttpReassembledBody_ {
+    uint8_t *data;          /**< data to inspect: buffer or, if the data is
+                                 in a single body chunk, the chunk's data */
     uint8_t *buffer;
     uint32_t buffer_size;   /**< size of the buffer itself */
     uint32_t buffer_len;    /**< data len in the buffer */
     uint64_t offset;        /**< data offset */
+    struct HtpBodyChunk_ *chunk; /**< first chunk of the data to inspect */
+    uint32_t skip;          /**< bytes of chunk before offset */
+    uint32_t len;           /**< len of the data to inspect, 0 if not set
+                                 up for this run yet */
 } HttpReassembledBody;
 
 #define DETECT_FILESTORE_MAX 15
@@ -836,6 +895,8 @@ typedef struct DetectionEngineThreadCtx_ {
     MpmThreadCtx mtcs;  /**< thread ctx for stream mpm */
     PatternMatcherQueue pmq;
     PatternMatcherQueue smsg_pmq[DETECT_SMSG_PMQ_NUM];
+    /** state for resumable mpm searches */
+    MpmSearchState mpm_search_state;
 
     /** ip only rules ctx */
     DetectEngineIPOnlyThreadCtx io_ctx;
@@ -865,6 +926,10 @@ typedef struct DetectionEngineThreadCtx_ {
 #ifdef PROFILING
     struct SCProfileData_ *rule_perf_data;
     int rule_perf_data_size;
+    /** reset generation of rule_perf_data */
+    uint32_t rule_perf_gen;
+    /** next thread in the rule profiling ctx's list */
+    struct DetectionEngineThreadCtx_ *rule_perf_next;
     struct SCProfileKeywordData_ *keyword_perf_data;
     struct SCProfileKeywordData_ *keyword_perf_data_per_list[DETECT_SM_LIST_MAX];
     int keyword_perf_list; /**< list we're currently inspecting, DETECT_SM_LIST_* */
@@ -963,12 +1028,25 @@ typedef struct SigGroupHead_ {
      *  a packet using SIMD. */
 #if defined(__SSE3__) || defined(__tile__)
     SignatureMask *mask_array;
+#endif
+#if defined(__AVX2__)
+    /** per sig offset into the pattern id bitarray and bit of the mpm
+     *  pattern it needs a hit on, 0 if it needs none. Padded like the
+     *  mask_array, used by the AVX2 prefilter in detect-simd.c */
+    uint32_t *mpm_div8_array;
+    uint32_t *mpm_mod8_array;
 #endif
     /** chunk of memory containing the "header" part of each
      *  signature ordered as an array. Used to pre-filter the
      *  signatures to be inspected in a cache efficient way. */
     SignatureHeader *head_array;
 
+    /** app layer prefilter engines the sgh has a mpm for, per direction
+     *  (0 toserver, 1 toclient) and grouped by alproto. Set up by
+     *  DetectEnginePrefilterSetupSgh(). */
+    struct DetectEnginePrefilterEngine_ **prefilter_engines[2];
+    uint16_t prefilter_engines_cnt[2];
+
     /* pattern matcher instances */
     MpmCtx *mpm_proto_other_ctx;
 
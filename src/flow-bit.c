@@ -20,11 +20,17 @@
  *
  * \author Victor Julien <victor@inliniac.net>
  *
- * Implements per flow bits. Actually, not a bit,
- * but called that way because of Snort's flowbits.
- * It's a binary storage.
+ * Implements per flow bits, like Snort's flowbits.
+ *
+ * The bits of a flow are kept in a single bitmap indexed by the name idx.
+ * It's a GenericVar so it's freed with the other flow vars, and it's kept
+ * at the head of the flow's var list so it's found without walking the
+ * list. A name keeps its idx over rule reloads (see util-var-name.c), so
+ * the bits of a flow stay valid when the rules change. The bitmap is sized
+ * for the name idxs of the ruleset that was loaded last. A set of a higher
+ * idx, e.g. after a rule reload added names, grows the bitmap. Checks of
+ * bits beyond the bitmap find them unset.
  *
- * \todo move away from a linked list implementation
  * \todo use different datatypes, such as string, int, etc.
  * \todo have more than one instance of the same var, and be able to match on a
  *       specific one, or one all at a time. So if a certain capture matches
@@ -42,12 +48,40 @@
 #include "util-debug.h"
 #include "util-unittest.h"
 
-/* get the flowbit with idx from the flow */
-static FlowBit *FlowBitGet(Flow *f, uint16_t idx)
+/* The bitmap is cast to and from GenericVar, so its header has to line
+ * up with it. Each typedef gets a negative array size, and so fails to
+ * compile, if a field doesn't. */
+typedef char FlowBitTypeCheck[(offsetof(FlowBit, type) ==
+        offsetof(GenericVar, type)) ? 1 : -1];
+typedef char FlowBitIdxCheck[(offsetof(FlowBit, idx) ==
+        offsetof(GenericVar, idx)) ? 1 : -1];
+typedef char FlowBitNextCheck[(offsetof(FlowBit, next) ==
+        offsetof(GenericVar, next)) ? 1 : -1];
+
+/** highest name idx of the current ruleset. Only used to size new
+ *  bitmaps, so it's not protected. */
+static uint32_t flowbits_max_idx = 0;
+
+/** \brief set the highest name idx in use
+ *
+ *  Called when a ruleset is loaded. Bitmaps of existing flows are left
+ *  alone, they grow when a higher idx is set.
+ */
+void FlowBitSetMaxIdx(uint32_t idx)
+{
+    flowbits_max_idx = idx;
+}
+
+/* get the flowbit array of the flow */
+static FlowBit *FlowBitGetArray(Flow *f)
 {
     GenericVar *gv = f->flowvar;
+    if (likely(gv != NULL && gv->type == DETECT_FLOWBITS))
+        return (FlowBit *)gv;
+
+    /* not at the head means there is none, but be safe */
     for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
+        if (gv->type == DETECT_FLOWBITS) {
             return (FlowBit *)gv;
         }
     }
@@ -55,50 +89,84 @@ static FlowBit *FlowBitGet(Flow *f, uint16_t idx)
     return NULL;
 }
 
+/* get the flowbit array of the flow if the bit idx is set */
+static FlowBit *FlowBitGet(Flow *f, uint16_t idx)
+{
+    FlowBit *fb = FlowBitGetArray(f);
+    if (fb != NULL && FlowBitArrayIsset(fb, idx))
+        return fb;
+
+    return NULL;
+}
+
+/** \internal
+ *  \brief alloc a new array or grow the flow's array so idx fits
+ *
+ *  \retval fb the flow's array, which is at the head of the var list
+ */
+static FlowBit *FlowBitGrow(Flow *f, FlowBit *old, uint16_t idx)
+{
+    uint32_t size = flowbits_max_idx + 1;
+    if (size <= idx)
+        size = idx + 1;
+    /* round up to whole words */
+    size = (size + 31) & ~31;
+
+    FlowBit *fb = SCMalloc(sizeof(FlowBit) + size / 8);
+    if (unlikely(fb == NULL))
+        return NULL;
+    memset(fb, 0, sizeof(FlowBit) + size / 8);
+    fb->type = DETECT_FLOWBITS;
+    fb->size = size;
+
+    if (old != NULL) {
+        memcpy(fb->bits, old->bits, old->size / 8);
+        GenericVarRemove(&f->flowvar, (GenericVar *)old);
+        FlowBitFree(old);
+    }
+    fb->next = f->flowvar;
+    f->flowvar = (GenericVar *)fb;
+
+#ifdef FLOWBITS_STATS
+    SCMutexLock(&flowbits_mutex);
+    flowbits_memuse += sizeof(FlowBit) + size / 8;
+    if (flowbits_memuse > flowbits_memuse_max)
+        flowbits_memuse_max = flowbits_memuse;
+    SCMutexUnlock(&flowbits_mutex);
+#endif /* FLOWBITS_STATS */
+    return fb;
+}
+
 /* add a flowbit to the flow */
 static void FlowBitAdd(Flow *f, uint16_t idx)
 {
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        fb = SCMalloc(sizeof(FlowBit));
+    FlowBit *fb = FlowBitGetArray(f);
+    if (fb == NULL || idx >= fb->size) {
+        fb = FlowBitGrow(f, fb, idx);
         if (unlikely(fb == NULL))
             return;
+    }
 
-        fb->type = DETECT_FLOWBITS;
-        fb->idx = idx;
-        fb->next = NULL;
-        GenericVarAppend(&f->flowvar, (GenericVar *)fb);
+    fb->bits[idx >> 5] |= (1U << (idx & 31));
 
-        //printf("FlowBitAdd: adding flowbit with idx %" PRIu32 "\n", idx);
 #ifdef FLOWBITS_STATS
-        SCMutexLock(&flowbits_mutex);
-        flowbits_added++;
-        flowbits_memuse += sizeof(FlowBit);
-        if (flowbits_memuse > flowbits_memuse_max)
-            flowbits_memuse_max = flowbits_memuse;
-        SCMutexUnlock(&flowbits_mutex);
+    SCMutexLock(&flowbits_mutex);
+    flowbits_added++;
+    SCMutexUnlock(&flowbits_mutex);
 #endif /* FLOWBITS_STATS */
-    }
 }
 
 static void FlowBitRemove(Flow *f, uint16_t idx)
 {
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL)
+    FlowBit *fb = FlowBitGetArray(f);
+    if (fb == NULL || idx >= fb->size)
         return;
 
-    GenericVarRemove(&f->flowvar, (GenericVar *)fb);
+    fb->bits[idx >> 5] &= ~(1U << (idx & 31));
 
-    //printf("FlowBitRemove: remove flowbit with idx %" PRIu32 "\n", idx);
 #ifdef FLOWBITS_STATS
     SCMutexLock(&flowbits_mutex);
     flowbits_removed++;
-    if (flowbits_memuse >= sizeof(FlowBit))
-        flowbits_memuse -= sizeof(FlowBit);
-    else {
-        printf("ERROR: flowbits memory usage going below 0!\n");
-        flowbits_memuse = 0;
-    }
     SCMutexUnlock(&flowbits_mutex);
 #endif /* FLOWBITS_STATS */
 }
@@ -106,24 +174,14 @@ static void FlowBitRemove(Flow *f, uint16_t idx)
 void FlowBitSet(Flow *f, uint16_t idx)
 {
     FLOWLOCK_WRLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        FlowBitAdd(f, idx);
-    }
-
+    FlowBitAdd(f, idx);
     FLOWLOCK_UNLOCK(f);
 }
 
 void FlowBitUnset(Flow *f, uint16_t idx)
 {
     FLOWLOCK_WRLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
-        FlowBitRemove(f, idx);
-    }
-
+    FlowBitRemove(f, idx);
     FLOWLOCK_UNLOCK(f);
 }
 
@@ -131,9 +189,9 @@ void FlowBitToggle(Flow *f, uint16_t idx)
 {
     FLOWLOCK_WRLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
-        FlowBitRemove(f, idx);
+    FlowBit *fb = FlowBitGetArray(f);
+    if (fb != NULL && idx < fb->size) {
+        fb->bits[idx >> 5] ^= (1U << (idx & 31));
     } else {
         FlowBitAdd(f, idx);
     }
@@ -146,9 +204,9 @@ int FlowBitIsset(Flow *f, uint16_t idx)
     int r = 0;
     FLOWLOCK_RDLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
+    FlowBit *fb = FlowBitGetArray(f);
     if (fb != NULL) {
-        r = 1;
+        r = FlowBitArrayIsset(fb, idx);
     }
 
     FLOWLOCK_UNLOCK(f);
@@ -157,12 +215,12 @@ int FlowBitIsset(Flow *f, uint16_t idx)
 
 int FlowBitIsnotset(Flow *f, uint16_t idx)
 {
-    int r = 0;
+    int r = 1;
     FLOWLOCK_RDLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        r = 1;
+    FlowBit *fb = FlowBitGetArray(f);
+    if (fb != NULL) {
+        r = !FlowBitArrayIsset(fb, idx);
     }
 
     FLOWLOCK_UNLOCK(f);
@@ -174,19 +232,18 @@ void FlowBitFree(FlowBit *fb)
     if (fb == NULL)
         return;
 
-    SCFree(fb);
-
 #ifdef FLOWBITS_STATS
     SCMutexLock(&flowbits_mutex);
-    flowbits_removed++;
-    if (flowbits_memuse >= sizeof(FlowBit))
-        flowbits_memuse -= sizeof(FlowBit);
+    if (flowbits_memuse >= sizeof(FlowBit) + fb->size / 8)
+        flowbits_memuse -= sizeof(FlowBit) + fb->size / 8;
     else {
         printf("ERROR: flowbits memory usage going below 0!\n");
         flowbits_memuse = 0;
     }
     SCMutexUnlock(&flowbits_mutex);
 #endif /* FLOWBITS_STATS */
+
+    SCFree(fb);
 }
 
 
@@ -453,6 +510,55 @@ end:
     return ret;
 }
 
+/** \test bitmap sized from the ruleset, grown by a higher idx as after a
+ *        reload, toggle and checks beyond the bitmap */
+static int FlowBitTest12 (void)
+{
+    int ret = 0;
+
+    Flow f;
+    memset(&f, 0, sizeof(Flow));
+
+    FlowBitSetMaxIdx(40);
+    FlowBitSet(&f, 3);
+
+    FlowBit *fb = FlowBitGetArray(&f);
+    if (fb == NULL || fb->size != 64 || (GenericVar *)fb != f.flowvar)
+        goto end;
+    if (FlowBitIsset(&f, 3) != 1 || FlowBitIsnotset(&f, 4) != 1)
+        goto end;
+    if (FlowBitIsset(&f, 1000) != 0 || FlowBitIsnotset(&f, 1000) != 1)
+        goto end;
+
+    /* unset and toggle beyond the bitmap don't grow it */
+    FlowBitUnset(&f, 1000);
+    if (FlowBitGetArray(&f)->size != 64)
+        goto end;
+
+    FlowBitSet(&f, 100);
+    fb = FlowBitGetArray(&f);
+    if (fb == NULL || fb->size != 128 || (GenericVar *)fb != f.flowvar)
+        goto end;
+    if (FlowBitIsset(&f, 3) != 1 || FlowBitIsset(&f, 100) != 1)
+        goto end;
+
+    FlowBitToggle(&f, 5);
+    if (FlowBitIsset(&f, 5) != 1)
+        goto end;
+    FlowBitToggle(&f, 5);
+    if (FlowBitIsset(&f, 5) != 0)
+        goto end;
+    FlowBitToggle(&f, 200);
+    if (FlowBitIsset(&f, 200) != 1 || FlowBitGetArray(&f)->size != 224)
+        goto end;
+
+    ret = 1;
+end:
+    FlowBitSetMaxIdx(0);
+    GenericVarFree(f.flowvar);
+    return ret;
+}
+
 #endif /* UNITTESTS */
 
 void FlowBitRegisterTests(void)
@@ -469,6 +575,7 @@ void FlowBitRegisterTests(void)
     UtRegisterTest("FlowBitTest09", FlowBitTest09, 1);
     UtRegisterTest("FlowBitTest10", FlowBitTest10, 1);
     UtRegisterTest("FlowBitTest11", FlowBitTest11, 1);
+    UtRegisterTest("FlowBitTest12", FlowBitTest12, 1);
 #endif /* UNITTESTS */
 }
 
@@ -27,16 +27,25 @@
 #include "flow.h"
 #include "util-var.h"
 
+/** bitmap of the flowbits of a flow, indexed by name idx */
 typedef struct FlowBit_ {
     uint8_t type; /* type, DETECT_FLOWBITS in this case */
-    uint16_t idx; /* name idx */
-    GenericVar *next; /* right now just implement this as a list,
-                       * in the long run we have think of something
-                       * faster. */
+    uint16_t idx; /* unused, lines up with GenericVar's idx */
+    GenericVar *next; /* lines up with GenericVar's next */
+    uint32_t size; /**< number of bits, multiple of 32 */
+    uint32_t bits[];
 } FlowBit;
 
+static inline int FlowBitArrayIsset(const FlowBit *fb, uint32_t idx)
+{
+    if (idx >= fb->size)
+        return 0;
+    return (fb->bits[idx >> 5] >> (idx & 31)) & 1;
+}
+
 void FlowBitFree(FlowBit *);
 void FlowBitRegisterTests(void);
+void FlowBitSetMaxIdx(uint32_t);
 
 void FlowBitSet(Flow *, uint16_t);
 void FlowBitUnset(Flow *, uint16_t);
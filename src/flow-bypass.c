@@ -0,0 +1,270 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Local flow bypass.
+ *
+ * Once the stream engine is done with a TCP session (reassembly depth
+ * reached in both directions and all segments inspected) it flags the
+ * flow FLOW_BYPASSED. A decode thread that sees a packet of such a flow
+ * adds the flow to its bypass table. Later packets of the flow are looked
+ * up in the table right after decoding and skip the flow hash, the stream
+ * engine and detection. The flow's timeout is refreshed at most once per
+ * second through FlowRefreshBypassed(), so an idle bypassed flow still
+ * times out normally.
+ */
+
+#include "suricata-common.h"
+#include "decode.h"
+#include "flow.h"
+#include "flow-hash.h"
+#include "flow-util.h"
+#include "flow-bypass.h"
+
+#include "util-debug.h"
+#include "util-hash-lookup3.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+
+/** \brief Alloc a bypass table
+ *
+ *  \param size number of entries, rounded up to a power of 2
+ *
+ *  \retval table or NULL on error
+ */
+FlowBypassTable *FlowBypassTableAlloc(uint32_t size)
+{
+    uint32_t s = 1;
+    while (s < size)
+        s <<= 1;
+
+    FlowBypassTable *table = SCMalloc(sizeof(FlowBypassTable));
+    if (unlikely(table == NULL))
+        return NULL;
+
+    table->entries = SCMalloc(s * sizeof(FlowBypassEntry));
+    if (unlikely(table->entries == NULL)) {
+        SCFree(table);
+        return NULL;
+    }
+    memset(table->entries, 0, s * sizeof(FlowBypassEntry));
+    table->size = s;
+
+    return table;
+}
+
+void FlowBypassTableFree(FlowBypassTable *table)
+{
+    if (table == NULL)
+        return;
+
+    SCFree(table->entries);
+    SCFree(table);
+}
+
+/** \internal
+ *  \brief Get the direction independent key of a packet
+ *
+ *  \retval 1 key set
+ *  \retval 0 packet can't be bypassed
+ */
+static int FlowBypassGetKey(const Packet *p, FlowBypassKey *key)
+{
+    int swap = 0;
+    int i;
+
+    memset(key, 0, sizeof(*key));
+
+    if (p->tcph == NULL && p->udph == NULL)
+        return 0;
+
+    if (p->ip4h != NULL) {
+        key->addr[0][0] = p->src.addr_data32[0];
+        key->addr[1][0] = p->dst.addr_data32[0];
+    } else if (p->ip6h != NULL) {
+        for (i = 0; i < 4; i++) {
+            key->addr[0][i] = p->src.addr_data32[i];
+            key->addr[1][i] = p->dst.addr_data32[i];
+        }
+    } else {
+        return 0;
+    }
+
+    for (i = 0; i < 4; i++) {
+        if (key->addr[0][i] != key->addr[1][i]) {
+            swap = (key->addr[0][i] > key->addr[1][i]);
+            break;
+        }
+    }
+    /* equal addresses, order by port */
+    if (i == 4)
+        swap = (p->sp > p->dp);
+
+    if (swap) {
+        uint32_t tmp[4];
+        memcpy(tmp, key->addr[0], sizeof(tmp));
+        memcpy(key->addr[0], key->addr[1], sizeof(tmp));
+        memcpy(key->addr[1], tmp, sizeof(tmp));
+        key->port[0] = p->dp;
+        key->port[1] = p->sp;
+    } else {
+        key->port[0] = p->sp;
+        key->port[1] = p->dp;
+    }
+    key->proto = (uint16_t)p->proto;
+    key->recur = (uint16_t)(p->recursion_level | ((uint16_t)p->time_domain << 8));
+    key->vlan_id[0] = p->vlan_id[0];
+    key->vlan_id[1] = p->vlan_id[1];
+    return 1;
+}
+
+static inline FlowBypassEntry *FlowBypassGetEntry(FlowBypassTable *table,
+        const FlowBypassKey *key)
+{
+    uint32_t hash = hashword(key->u32, 11, 0);
+    return &table->entries[hash & (table->size - 1)];
+}
+
+/** \brief Add the flow of a packet to the bypass table
+ *
+ *  \param p packet of a flow flagged FLOW_BYPASSED
+ */
+void FlowBypassTableAdd(FlowBypassTable *table, const Packet *p)
+{
+    FlowBypassKey key;
+
+    if (FlowBypassGetKey(p, &key) == 0)
+        return;
+
+    FlowBypassEntry *e = FlowBypassGetEntry(table, &key);
+    e->key = key;
+    e->refresh_ts = (uint32_t)p->ts.tv_sec;
+}
+
+/** \brief Check if a packet belongs to a bypassed flow
+ *
+ *  Refreshes the flow's timeout once per second. If the flow is gone or
+ *  was unbypassed in the meantime the entry is removed.
+ *
+ *  \retval 1 packet is bypassed
+ *  \retval 0 packet needs normal handling
+ */
+int FlowBypassTableLookup(FlowBypassTable *table, const Packet *p)
+{
+    FlowBypassKey key;
+
+    if (FlowBypassGetKey(p, &key) == 0)
+        return 0;
+
+    FlowBypassEntry *e = FlowBypassGetEntry(table, &key);
+    if (e->key.proto == 0 || memcmp(&e->key, &key, sizeof(key)) != 0)
+        return 0;
+
+    if (e->refresh_ts != (uint32_t)p->ts.tv_sec) {
+        if (FlowRefreshBypassed(p) == 0) {
+            SCLogDebug("bypassed flow timed out, removing entry");
+            memset(e, 0, sizeof(*e));
+            return 0;
+        }
+        e->refresh_ts = (uint32_t)p->ts.tv_sec;
+    }
+    return 1;
+}
+
+#ifdef UNITTESTS
+
+/** \test bypass table add, lookup in both directions, timeout refresh
+ *        and removal */
+static int FlowBypassTest01(void)
+{
+    int result = 0;
+    Packet *p1 = NULL, *p2 = NULL, *p3 = NULL;
+    FlowBypassTable *table = NULL;
+
+    FlowInitConfig(FLOW_QUIET);
+
+    p1 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP, "1.2.3.4", "5.6.7.8",
+            1024, 80);
+    p2 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP, "5.6.7.8", "1.2.3.4",
+            80, 1024);
+    p3 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP, "1.2.3.4", "5.6.7.8",
+            1025, 80);
+    if (p1 == NULL || p2 == NULL || p3 == NULL)
+        goto end;
+    p1->ts.tv_sec = 1;
+
+    FlowHandlePacket(NULL, NULL, p1);
+    if (p1->flow == NULL || (p1->flags & PKT_FLOW_BYPASSED))
+        goto end;
+
+    table = FlowBypassTableAlloc(10);
+    if (table == NULL || table->size != 16)
+        goto end;
+
+    if (FlowBypassTableLookup(table, p1) != 0)
+        goto end;
+
+    p1->flow->flags |= FLOW_BYPASSED;
+    FlowBypassTableAdd(table, p1);
+
+    if (FlowBypassTableLookup(table, p1) != 1)
+        goto end;
+
+    /* other direction, new second: refreshes the flow timeout */
+    p2->ts.tv_sec = 5;
+    if (FlowBypassTableLookup(table, p2) != 1)
+        goto end;
+    if (p1->flow->lastts_sec != 5)
+        goto end;
+
+    /* other flow */
+    if (FlowBypassTableLookup(table, p3) != 0)
+        goto end;
+
+    /* flow no longer bypassed: entry is dropped on the next refresh */
+    p1->flow->flags &= ~FLOW_BYPASSED;
+    if (FlowBypassTableLookup(table, p2) != 1)
+        goto end;
+    p2->ts.tv_sec = 6;
+    if (FlowBypassTableLookup(table, p2) != 0)
+        goto end;
+    p2->ts.tv_sec = 5;
+    if (FlowBypassTableLookup(table, p2) != 0)
+        goto end;
+
+    result = 1;
+end:
+    FlowBypassTableFree(table);
+    if (p1 != NULL && p1->flow != NULL)
+        FlowDeReference(&p1->flow);
+    UTHFreePacket(p1);
+    UTHFreePacket(p2);
+    UTHFreePacket(p3);
+    FlowShutdown();
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void FlowBypassRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("FlowBypassTest01", FlowBypassTest01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,69 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per decode thread table of bypassed flows.
+ */
+
+#ifndef __FLOW_BYPASS_H__
+#define __FLOW_BYPASS_H__
+
+/** default number of entries of a decode thread's bypass table */
+#define FLOW_BYPASS_TABLE_SIZE  4096
+
+typedef struct FlowBypassKey_ {
+    union {
+        struct {
+            uint32_t addr[2][4];    /**< lowest address first */
+            uint16_t port[2];
+            uint16_t proto; /**< 0 for an unused entry */
+            uint16_t recur; /**< u16 so proto and recur add up to u32 */
+            uint16_t vlan_id[2];
+        };
+        uint32_t u32[11];
+    };
+} FlowBypassKey;
+
+typedef struct FlowBypassEntry_ {
+    FlowBypassKey key;
+    /** second in which the flow's timeout was last refreshed */
+    uint32_t refresh_ts;
+} FlowBypassEntry;
+
+/**
+ * \brief Direct mapped table of the bypassed flows seen by a decode thread.
+ *
+ * Entries are keyed by the 5-tuple. A colliding flow simply replaces the
+ * entry, after which its packets take the normal path again until they
+ * are re-added.
+ */
+typedef struct FlowBypassTable_ {
+    FlowBypassEntry *entries;
+    /** number of entries, power of 2 */
+    uint32_t size;
+} FlowBypassTable;
+
+FlowBypassTable *FlowBypassTableAlloc(uint32_t size);
+void FlowBypassTableFree(FlowBypassTable *table);
+void FlowBypassTableAdd(FlowBypassTable *table, const Packet *p);
+int FlowBypassTableLookup(FlowBypassTable *table, const Packet *p);
+
+void FlowBypassRegisterTests(void);
+
+#endif /* __FLOW_BYPASS_H__ */
@@ -35,6 +35,8 @@
 #include "flow-util.h"
 #include "flow-private.h"
 #include "flow-manager.h"
+#include "flow-wheel.h"
+#include "flow-spare-cache.h"
 #include "app-layer-parser.h"
 
 #include "util-time.h"
@@ -194,6 +196,10 @@ typedef struct FlowHashKey6_ {
     };
 } FlowHashKey6;
 
+/** recursion level in the low byte, time domain in the high byte */
+#define FLOW_HASH_RECUR(p) \
+    (uint16_t)((p)->recursion_level | ((uint16_t)(p)->time_domain << 8))
+
 /* calculate the hash key for this packet
  *
  * we're using:
@@ -204,6 +210,7 @@ typedef struct FlowHashKey6_ {
  *  destination address
  *  recursion level -- for tunnels, make sure different tunnel layers can
  *                     never get mixed up.
+ *  time domain -- flows of different pcap readers are kept apart
  *
  *  For ICMP we only consider UNREACHABLE errors atm.
  */
@@ -229,7 +236,7 @@ static inline uint32_t FlowGetKey(const Packet *p)
                 fhk.dp = p->sp;
             }
             fhk.proto = (uint16_t)p->proto;
-            fhk.recur = (uint16_t)p->recursion_level;
+            fhk.recur = FLOW_HASH_RECUR(p);
             fhk.vlan_id[0] = p->vlan_id[0];
             fhk.vlan_id[1] = p->vlan_id[1];
 
@@ -255,7 +262,7 @@ static inline uint32_t FlowGetKey(const Packet *p)
                 fhk.dp = p->icmpv4vars.emb_sport;
             }
             fhk.proto = (uint16_t)ICMPV4_GET_EMB_PROTO(p);
-            fhk.recur = (uint16_t)p->recursion_level;
+            fhk.recur = FLOW_HASH_RECUR(p);
             fhk.vlan_id[0] = p->vlan_id[0];
             fhk.vlan_id[1] = p->vlan_id[1];
 
@@ -274,7 +281,7 @@ static inline uint32_t FlowGetKey(const Packet *p)
             fhk.sp = 0xfeed;
             fhk.dp = 0xbeef;
             fhk.proto = (uint16_t)p->proto;
-            fhk.recur = (uint16_t)p->recursion_level;
+            fhk.recur = FLOW_HASH_RECUR(p);
             fhk.vlan_id[0] = p->vlan_id[0];
             fhk.vlan_id[1] = p->vlan_id[1];
 
@@ -310,7 +317,7 @@ static inline uint32_t FlowGetKey(const Packet *p)
             fhk.dp = p->sp;
         }
         fhk.proto = (uint16_t)p->proto;
-        fhk.recur = (uint16_t)p->recursion_level;
+        fhk.recur = FLOW_HASH_RECUR(p);
         fhk.vlan_id[0] = p->vlan_id[0];
         fhk.vlan_id[1] = p->vlan_id[1];
 
@@ -334,7 +341,8 @@ static inline uint32_t FlowGetKey(const Packet *p)
      (f1)->proto == (f2)->proto && \
      (f1)->recursion_level == (f2)->recursion_level && \
      (f1)->vlan_id[0] == (f2)->vlan_id[0] && \
-     (f1)->vlan_id[1] == (f2)->vlan_id[1])
+     (f1)->vlan_id[1] == (f2)->vlan_id[1] && \
+     (f1)->time_domain == (f2)->time_domain)
 
 /**
  *  \brief See if a ICMP packet belongs to a flow by comparing the embedded
@@ -359,7 +367,8 @@ static inline int FlowCompareICMPv4(Flow *f, const Packet *p)
                 f->proto == ICMPV4_GET_EMB_PROTO(p) &&
                 f->recursion_level == p->recursion_level &&
                 f->vlan_id[0] == p->vlan_id[0] &&
-                f->vlan_id[1] == p->vlan_id[1])
+                f->vlan_id[1] == p->vlan_id[1] &&
+                f->time_domain == p->time_domain)
         {
             return 1;
 
@@ -372,7 +381,8 @@ static inline int FlowCompareICMPv4(Flow *f, const Packet *p)
                 f->proto == ICMPV4_GET_EMB_PROTO(p) &&
                 f->recursion_level == p->recursion_level &&
                 f->vlan_id[0] == p->vlan_id[0] &&
-                f->vlan_id[1] == p->vlan_id[1])
+                f->vlan_id[1] == p->vlan_id[1] &&
+                f->time_domain == p->time_domain)
         {
             return 1;
         }
@@ -419,12 +429,13 @@ static inline int FlowCreateCheck(const Packet *p)
 /**
  *  \brief Get a new flow
  *
- *  Get a new flow. We're checking memcap first and will try to make room
+ *  Get a new flow. If the decode thread has a spare flow cache the flow
+ *  comes from there. We're checking memcap first and will try to make room
  *  if the memcap is reached.
  *
  *  \retval f *LOCKED* flow on succes, NULL on error.
  */
-static Flow *FlowGetNew(const Packet *p)
+static Flow *FlowGetNew(ThreadVars *tv, DecodeThreadVars *dtv, const Packet *p)
 {
     Flow *f = NULL;
 
@@ -432,8 +443,24 @@ static Flow *FlowGetNew(const Packet *p)
         return NULL;
     }
 
-    /* get a flow from the spare queue */
-    f = FlowDequeue(&flow_spare_q);
+    if (dtv != NULL && dtv->flow_spare_cache != NULL) {
+        /* get a flow from our own cache, without locking */
+        int refilled = 0;
+        f = FlowSpareCacheGet(dtv->flow_spare_cache, &refilled);
+        if (refilled && tv != NULL) {
+            SCPerfCounterIncr(dtv->counter_flow_spare_refills, tv->sc_perf_pca);
+        }
+        if (f == NULL) {
+            /* the flow manager didn't keep up, take a batch ourselves */
+            if (tv != NULL) {
+                SCPerfCounterIncr(dtv->counter_flow_spare_misses, tv->sc_perf_pca);
+            }
+            f = FlowSpareCacheFill(dtv->flow_spare_cache);
+        }
+    } else {
+        /* get a flow from the spare queue */
+        f = FlowDequeue(&flow_spare_q);
+    }
     if (f == NULL) {
         /* If we reached the max memcap, we get a used flow */
         if (!(FLOW_CHECK_MEMCAP(sizeof(Flow)))) {
@@ -487,7 +514,7 @@ static Flow *FlowGetNew(const Packet *p)
  *
  * returns a *LOCKED* flow or NULL
  */
-Flow *FlowGetFlowFromHash(const Packet *p)
+Flow *FlowGetFlowFromHash(ThreadVars *tv, DecodeThreadVars *dtv, const Packet *p)
 {
     Flow *f = NULL;
     FlowHashCountInit;
@@ -504,7 +531,7 @@ Flow *FlowGetFlowFromHash(const Packet *p)
 
     /* see if the bucket already has a flow */
     if (fb->head == NULL) {
-        f = FlowGetNew(p);
+        f = FlowGetNew(tv, dtv, p);
         if (f == NULL) {
             FBLOCK_UNLOCK(fb);
             FlowHashCountUpdate;
@@ -518,6 +545,8 @@ Flow *FlowGetFlowFromHash(const Packet *p)
         /* got one, now lock, initialize and return */
         FlowInit(f, p);
         f->fb = fb;
+        if (flow_wheel != NULL)
+            FlowWheelAddNew(flow_wheel, f, (uint32_t)p->ts.tv_sec);
 
         FBLOCK_UNLOCK(fb);
         FlowHashCountUpdate;
@@ -538,7 +567,7 @@ Flow *FlowGetFlowFromHash(const Packet *p)
             f = f->hnext;
 
             if (f == NULL) {
-                f = pf->hnext = FlowGetNew(p);
+                f = pf->hnext = FlowGetNew(tv, dtv, p);
                 if (f == NULL) {
                     FBLOCK_UNLOCK(fb);
                     FlowHashCountUpdate;
@@ -553,6 +582,8 @@ Flow *FlowGetFlowFromHash(const Packet *p)
                 /* initialize and return */
                 FlowInit(f, p);
                 f->fb = fb;
+                if (flow_wheel != NULL)
+                    FlowWheelAddNew(flow_wheel, f, (uint32_t)p->ts.tv_sec);
 
                 FBLOCK_UNLOCK(fb);
                 FlowHashCountUpdate;
@@ -593,6 +624,43 @@ Flow *FlowGetFlowFromHash(const Packet *p)
     return f;
 }
 
+/** \brief Refresh the timeout of a bypassed flow
+ *
+ *  Looks up the flow of the packet without creating one and updates its
+ *  last seen timestamp. Used by the decoders for packets that skip the
+ *  normal flow handling because their flow was bypassed.
+ *
+ *  \param p packet of the flow
+ *
+ *  \retval 1 flow found, bypassed and refreshed
+ *  \retval 0 flow is gone or no longer bypassed
+ */
+int FlowRefreshBypassed(const Packet *p)
+{
+    int r = 0;
+
+    uint32_t key = FlowGetKey(p);
+    FlowBucket *fb = &flow_hash[key];
+    FBLOCK_LOCK(fb);
+
+    Flow *f = fb->head;
+    for ( ; f != NULL; f = f->hnext) {
+        if (FlowCompare(f, p) != 0)
+            break;
+    }
+    if (f != NULL) {
+        FLOWLOCK_WRLOCK(f);
+        if (f->flags & FLOW_BYPASSED) {
+            f->lastts_sec = p->ts.tv_sec;
+            r = 1;
+        }
+        FLOWLOCK_UNLOCK(f);
+    }
+
+    FBLOCK_UNLOCK(fb);
+    return r;
+}
+
 /** \internal
  *  \brief Get a flow from the hash directly.
  *
@@ -651,6 +719,8 @@ static Flow *FlowGetUsedFlow(void)
         f->hnext = NULL;
         f->hprev = NULL;
         f->fb = NULL;
+        if (flow_wheel != NULL)
+            FlowWheelRemove(flow_wheel, f);
         FBLOCK_UNLOCK(fb);
 
         FlowClearMemory(f, f->protomap);
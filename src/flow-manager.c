@@ -41,6 +41,8 @@
 #include "flow-private.h"
 #include "flow-timeout.h"
 #include "flow-manager.h"
+#include "flow-wheel.h"
+#include "flow-spare-cache.h"
 
 #include "stream-tcp-private.h"
 #include "stream-tcp-reassemble.h"
@@ -83,6 +85,13 @@ typedef struct FlowTimeoutCounters_ {
     uint32_t clo;
 } FlowTimeoutCounters;
 
+/** number of flow manager threads, each owning a slice of the hash */
+static uint32_t flowmgr_number = 1;
+/** seconds a full pass over a flow manager's slice is spread over */
+static uint32_t flowmgr_pass_time = 1;
+/** used by the flow manager threads to pick their instance */
+SC_ATOMIC_DECLARE(uint32_t, flowmgr_cnt);
+
 /**
  * \brief Used to kill flow manager thread(s).
  *
@@ -102,12 +111,14 @@ void FlowKillFlowManagerThread(void)
     tv = tv_root[TVT_MGMT];
 
     while (tv != NULL) {
-        if (strcasecmp(tv->name, "FlowManagerThread") == 0) {
+        if (strncasecmp(tv->name, "FlowManagerThread",
+                    strlen("FlowManagerThread")) == 0) {
             TmThreadsSetFlag(tv, THV_KILL);
             TmThreadsSetFlag(tv, THV_DEINIT);
 
             /* be sure it has shut down */
             while (!TmThreadsCheckFlag(tv, THV_CLOSED)) {
+                FlowWakeupFlowManagerThread();
                 usleep(100);
             }
             cnt++;
@@ -125,70 +136,12 @@ void FlowKillFlowManagerThread(void)
     return;
 }
 
-/** \internal
- *  \brief Get the flow's state
- *
- *  \param f flow
- *
- *  \retval state either FLOW_STATE_NEW, FLOW_STATE_ESTABLISHED or FLOW_STATE_CLOSED
- */
-static inline int FlowGetFlowState(Flow *f) {
-    if (flow_proto[f->protomap].GetProtoState != NULL) {
-        return flow_proto[f->protomap].GetProtoState(f->protoctx);
-    } else {
-        if ((f->flags & FLOW_TO_SRC_SEEN) && (f->flags & FLOW_TO_DST_SEEN))
-            return FLOW_STATE_ESTABLISHED;
-        else
-            return FLOW_STATE_NEW;
-    }
-}
-
-/** \internal
- *  \brief get timeout for flow
- *
- *  \param f flow
- *  \param state flow state
- *  \param emergency bool indicating emergency mode 1 yes, 0 no
- *
- *  \retval timeout timeout in seconds
- */
-static inline uint32_t FlowGetFlowTimeout(Flow *f, int state, int emergency) {
-    uint32_t timeout;
-
-    if (emergency) {
-        switch(state) {
-            default:
-            case FLOW_STATE_NEW:
-                timeout = flow_proto[f->protomap].emerg_new_timeout;
-                break;
-            case FLOW_STATE_ESTABLISHED:
-                timeout = flow_proto[f->protomap].emerg_est_timeout;
-                break;
-            case FLOW_STATE_CLOSED:
-                timeout = flow_proto[f->protomap].emerg_closed_timeout;
-                break;
-        }
-    } else { /* implies no emergency */
-        switch(state) {
-            default:
-            case FLOW_STATE_NEW:
-                timeout = flow_proto[f->protomap].new_timeout;
-                break;
-            case FLOW_STATE_ESTABLISHED:
-                timeout = flow_proto[f->protomap].est_timeout;
-                break;
-            case FLOW_STATE_CLOSED:
-                timeout = flow_proto[f->protomap].closed_timeout;
-                break;
-        }
-    }
-
-    return timeout;
-}
-
 /** \internal
  *  \brief check if a flow is timed out
  *
+ *  Flows of a pcap reader with a time domain of its own are checked
+ *  against the clock of that domain instead of ts.
+ *
  *  \param f flow
  *  \param ts timestamp
  *  \param emergency bool indicating emergency mode
@@ -201,6 +154,12 @@ static int FlowManagerFlowTimeout(Flow *f, int state, struct timeval *ts, int em
      * flow's state and protocol.*/
     uint32_t timeout = FlowGetFlowTimeout(f, state, emergency);
 
+    struct timeval domain_ts;
+    if (f->time_domain != 0) {
+        TimeGetDomain(f->time_domain, &domain_ts);
+        ts = &domain_ts;
+    }
+
     /* do the timeout check */
     if ((int32_t)(f->lastts_sec + timeout) >= ts->tv_sec) {
         return 0;
@@ -290,6 +249,9 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
 
             f->hnext = NULL;
             f->hprev = NULL;
+            f->fb = NULL;
+            if (flow_wheel != NULL)
+                FlowWheelRemove(flow_wheel, f);
 
             FlowClearMemory (f, f->protomap);
 
@@ -329,11 +291,14 @@ static uint32_t FlowManagerHashRowTimeout(Flow *f, struct timeval *ts,
  *
  *  \param ts timestamp
  *  \param try_cnt number of flows to time out max (0 is unlimited)
+ *  \param hash_min first hash row to check
+ *  \param hash_max hash row to stop at (not checked)
  *  \param counters ptr to FlowTimeoutCounters structure
  *
  *  \retval cnt number of timed out flow
  */
-uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt, FlowTimeoutCounters *counters) {
+uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt,
+        uint32_t hash_min, uint32_t hash_max, FlowTimeoutCounters *counters) {
     uint32_t idx = 0;
     uint32_t cnt = 0;
     int emergency = 0;
@@ -341,7 +306,7 @@ uint32_t FlowTimeoutHash(struct timeval *ts, uint32_t try_cnt, FlowTimeoutCounte
     if (SC_ATOMIC_GET(flow_flags) & FLOW_EMERGENCY)
         emergency = 1;
 
-    for (idx = 0; idx < flow_config.hash_size; idx++) {
+    for (idx = hash_min; idx < hash_max; idx++) {
         FlowBucket *fb = &flow_hash[idx];
 
         if (FBLOCK_TRYLOCK(fb) != 0)
@@ -365,6 +330,102 @@ next:
     return cnt;
 }
 
+/**
+ *  \brief time out the flows that are due in the timer wheel
+ *
+ *  Flows that are not timed out yet, or can't be freed yet, are
+ *  rescheduled.
+ *
+ *  \param ts timestamp
+ *  \param counters ptr to FlowTimeoutCounters structure
+ *
+ *  \retval cnt number of timed out flows
+ */
+static uint32_t FlowTimeoutWheel(struct timeval *ts, FlowTimeoutCounters *counters)
+{
+    uint32_t cnt = 0;
+    Flow *f;
+
+    /* flows come out locked, and locked in their bucket */
+    while ((f = FlowWheelGetDue(flow_wheel, (uint32_t)ts->tv_sec)) != NULL) {
+        FlowBucket *fb = f->fb;
+        int state = FlowGetFlowState(f);
+
+        if (FlowManagerFlowTimeout(f, state, ts, 0) == 0) {
+            uint32_t timeout = FlowGetFlowTimeout(f, state, 0);
+            FlowWheelSchedule(flow_wheel, f, (uint32_t)f->lastts_sec + timeout + 1);
+            FLOWLOCK_UNLOCK(f);
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+        if (FlowManagerFlowTimedOut(f, ts) == 0) {
+            /* in use or waiting for its reassembly, try again soon */
+            FlowWheelSchedule(flow_wheel, f, (uint32_t)ts->tv_sec + 1);
+            FLOWLOCK_UNLOCK(f);
+            FBLOCK_UNLOCK(fb);
+            continue;
+        }
+
+        /* remove from the hash */
+        if (f->hprev != NULL)
+            f->hprev->hnext = f->hnext;
+        if (f->hnext != NULL)
+            f->hnext->hprev = f->hprev;
+        if (fb->head == f)
+            fb->head = f->hnext;
+        if (fb->tail == f)
+            fb->tail = f->hprev;
+
+        f->hnext = NULL;
+        f->hprev = NULL;
+        f->fb = NULL;
+        FBLOCK_UNLOCK(fb);
+
+        FlowClearMemory (f, f->protomap);
+        FLOWLOCK_UNLOCK(f);
+
+        /* move to spare list */
+        FlowMoveToSpare(f);
+
+        cnt++;
+
+        switch (state) {
+            case FLOW_STATE_NEW:
+            default:
+                counters->new++;
+                break;
+            case FLOW_STATE_ESTABLISHED:
+                counters->est++;
+                break;
+            case FLOW_STATE_CLOSED:
+                counters->clo++;
+                break;
+        }
+    }
+
+    return cnt;
+}
+
+/** \internal
+ *  \brief Get the slice of the hash owned by a flow manager thread
+ *
+ *  The rows are split evenly, the last thread gets the remainder.
+ *
+ *  \param instance flow manager number, starting at 0
+ *  \param hash_min first row of the slice
+ *  \param hash_max row after the last row of the slice
+ */
+static void FlowManagerGetSlice(uint32_t instance, uint32_t threads,
+        uint32_t hash_size, uint32_t *hash_min, uint32_t *hash_max)
+{
+    uint32_t range = hash_size / threads;
+
+    *hash_min = range * instance;
+    *hash_max = range * (instance + 1);
+    if (instance == threads - 1)
+        *hash_max = hash_size;
+}
+
 extern int g_detect_disabled;
 
 /** \brief Thread that manages the flow table and times out flows.
@@ -377,6 +438,7 @@ void *FlowManagerThread(void *td)
 {
     /* block usr1.  usr1 to be handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *th_v = (ThreadVars *)td;
     struct timeval ts;
@@ -387,6 +449,22 @@ void *FlowManagerThread(void *td)
     struct timespec cond_time;
     int flow_update_delay_sec = FLOW_NORMAL_MODE_UPDATE_DELAY_SEC;
     int flow_update_delay_nsec = FLOW_NORMAL_MODE_UPDATE_DELAY_NSEC;
+    /* the first flow manager also takes care of the spare queue, the
+     * emergency mode and the host and defrag tables */
+    uint32_t instance = SC_ATOMIC_ADD(flowmgr_cnt, 1) - 1;
+    uint32_t hash_min = 0, hash_max = 0;
+    FlowManagerGetSlice(instance, flowmgr_number, flow_config.hash_size,
+            &hash_min, &hash_max);
+    /* rows to check per wakeup in normal mode */
+    uint32_t rows_per_wakeup = (hash_max - hash_min + flowmgr_pass_time - 1) /
+        flowmgr_pass_time;
+    /* row the next incremental pass continues at */
+    uint32_t hash_pass_row = hash_min;
+    /* time spent scanning in the current pass */
+    uint64_t pass_usecs = 0;
+
+    SCLogDebug("%s: hash rows %"PRIu32"-%"PRIu32", %"PRIu32" rows per wakeup",
+            th_v->name, hash_min, hash_max, rows_per_wakeup);
 /* VJ leaving disabled for now, as hosts are only used by tags and the numbers
  * are really low. Might confuse ppl
     uint16_t flow_mgr_host_prune = SCPerfTVRegisterCounter("hosts.pruned", th_v,
@@ -420,6 +498,15 @@ void *FlowManagerThread(void *td)
     uint16_t flow_emerg_mode_over = SCPerfTVRegisterCounter("flow.emerg_mode_over", th_v,
             SC_PERF_TYPE_UINT64,
             "NULL");
+    uint16_t flow_mgr_rows_checked = SCPerfTVRegisterCounter("flow_mgr.rows_checked", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
+    uint16_t flow_mgr_flows_timeout = SCPerfTVRegisterCounter("flow_mgr.flows_timeout", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
+    uint16_t flow_mgr_pass_usec = SCPerfTVRegisterCounter("flow_mgr.pass_usec", th_v,
+            SC_PERF_TYPE_UINT64,
+            "NULL");
 
     if (th_v->thread_setup_flags != 0)
         TmThreadSetupOptions(th_v);
@@ -461,7 +548,8 @@ void *FlowManagerThread(void *td)
 
                 SCLogDebug("Flow emergency mode entered...");
 
-                SCPerfCounterIncr(flow_emerg_mode_enter, th_v->sc_perf_pca);
+                if (instance == 0)
+                    SCPerfCounterIncr(flow_emerg_mode_enter, th_v->sc_perf_pca);
             }
         }
 
@@ -475,17 +563,54 @@ void *FlowManagerThread(void *td)
             last_sec = (uint32_t)ts.tv_sec;
         }
 
-        /* see if we still have enough spare flows */
-        FlowUpdateSpareFlows();
+        /* see if we still have enough spare flows, then hand a batch to
+         * the decode threads that used up their last one */
+        if (instance == 0) {
+            FlowUpdateSpareFlows();
+            FlowSpareCacheRefill();
+        }
 
-        /* try to time out flows */
+        /* try to time out flows. In emergency mode the whole slice is
+         * checked, otherwise only the next part of the current pass. With
+         * the timer wheel only the flows that are due are checked, except
+         * in emergency mode where the timeouts are different, and when
+         * pcap readers run with time domains of their own: the wheel
+         * runs on a single clock. There is a single wheel, so only the
+         * first flow manager runs it. */
         FlowTimeoutCounters counters = { 0, 0, 0, };
-        FlowTimeoutHash(&ts, 0 /* check all */, &counters);
-
-
-        DefragTimeoutHash(&ts);
-        //uint32_t hosts_pruned =
-        HostTimeoutHash(&ts);
+        uint32_t rows = rows_per_wakeup;
+        if (emerg == TRUE || rows > hash_max - hash_pass_row)
+            rows = hash_max - hash_pass_row;
+        if (flow_wheel != NULL && emerg == FALSE && TimeDomainsActive() == 0)
+            rows = 0;
+
+        struct timeval scan_start, scan_end;
+        gettimeofday(&scan_start, NULL);
+        if (rows > 0) {
+            FlowTimeoutHash(&ts, 0 /* check all */, hash_pass_row,
+                    hash_pass_row + rows, &counters);
+        } else if (instance == 0) {
+            FlowTimeoutWheel(&ts, &counters);
+        }
+        gettimeofday(&scan_end, NULL);
+
+        pass_usecs += (uint64_t)(scan_end.tv_sec - scan_start.tv_sec) * 1000000 +
+            (scan_end.tv_usec - scan_start.tv_usec);
+        hash_pass_row += rows;
+        if (hash_pass_row >= hash_max || rows == 0) {
+            SCPerfCounterSetUI64(flow_mgr_pass_usec, th_v->sc_perf_pca, pass_usecs);
+            hash_pass_row = hash_min;
+            pass_usecs = 0;
+        }
+        SCPerfCounterAddUI64(flow_mgr_rows_checked, th_v->sc_perf_pca, (uint64_t)rows);
+        SCPerfCounterAddUI64(flow_mgr_flows_timeout, th_v->sc_perf_pca,
+                (uint64_t)(counters.new + counters.est + counters.clo));
+
+        if (instance == 0) {
+            DefragTimeoutHash(&ts);
+            //uint32_t hosts_pruned =
+            HostTimeoutHash(&ts);
+        }
 /*
         SCPerfCounterAddUI64(flow_mgr_host_prune, th_v->sc_perf_pca, (uint64_t)hosts_pruned);
         uint32_t hosts_active = HostGetActiveCount();
@@ -496,18 +621,36 @@ void *FlowManagerThread(void *td)
         SCPerfCounterAddUI64(flow_mgr_cnt_clo, th_v->sc_perf_pca, (uint64_t)counters.clo);
         SCPerfCounterAddUI64(flow_mgr_cnt_new, th_v->sc_perf_pca, (uint64_t)counters.new);
         SCPerfCounterAddUI64(flow_mgr_cnt_est, th_v->sc_perf_pca, (uint64_t)counters.est);
-        long long unsigned int flow_memuse = SC_ATOMIC_GET(flow_memuse);
-        SCPerfCounterSetUI64(flow_mgr_memuse, th_v->sc_perf_pca, (uint64_t)flow_memuse);
 
         uint32_t len = 0;
-        FQLOCK_LOCK(&flow_spare_q);
-        len = flow_spare_q.len;
-        FQLOCK_UNLOCK(&flow_spare_q);
-        SCPerfCounterSetUI64(flow_mgr_spare, th_v->sc_perf_pca, (uint64_t)len);
+        if (instance == 0) {
+            long long unsigned int flow_memuse = SC_ATOMIC_GET(flow_memuse);
+            SCPerfCounterSetUI64(flow_mgr_memuse, th_v->sc_perf_pca, (uint64_t)flow_memuse);
+
+            FQLOCK_LOCK(&flow_spare_q);
+            len = flow_spare_q.len;
+            FQLOCK_UNLOCK(&flow_spare_q);
+            SCPerfCounterSetUI64(flow_mgr_spare, th_v->sc_perf_pca, (uint64_t)len);
+        }
+
+        /* the other flow managers follow the emergency state set and
+         * cleared by the first one */
+        if (instance != 0) {
+            if (emerg == TRUE && !(SC_ATOMIC_GET(flow_flags) & FLOW_EMERGENCY)) {
+                emerg = FALSE;
+                prev_emerg = FALSE;
+            }
+            if (emerg == TRUE) {
+                flow_update_delay_sec = FLOW_EMERG_MODE_UPDATE_DELAY_SEC;
+                flow_update_delay_nsec = FLOW_EMERG_MODE_UPDATE_DELAY_NSEC;
+            } else {
+                flow_update_delay_sec = FLOW_NORMAL_MODE_UPDATE_DELAY_SEC;
+                flow_update_delay_nsec = FLOW_NORMAL_MODE_UPDATE_DELAY_NSEC;
+            }
 
         /* Don't fear, FlowManagerThread is here...
          * clear emergency bit if we have at least xx flows pruned. */
-        if (emerg == TRUE) {
+        } else if (emerg == TRUE) {
             SCLogDebug("flow_sparse_q.len = %"PRIu32" prealloc: %"PRIu32
                        "flow_spare_q status: %"PRIu32"%% flows at the queue",
                        len, flow_config.prealloc, len * 100 / flow_config.prealloc);
@@ -565,26 +708,71 @@ void *FlowManagerThread(void *td)
     return NULL;
 }
 
-/** \brief spawn the flow manager thread */
+/** \brief spawn the flow manager thread(s)
+ *
+ *  The number of threads is set by flow.managers. Each thread times out
+ *  the flows of its own slice of the hash.
+ */
 void FlowManagerThreadSpawn()
 {
     ThreadVars *tv_flowmgr = NULL;
+    intmax_t setting = 1;
+    uint32_t u;
 
     SCCtrlCondInit(&flow_manager_ctrl_cond, NULL);
     SCCtrlMutexInit(&flow_manager_ctrl_mutex, NULL);
 
-    tv_flowmgr = TmThreadCreateMgmtThread("FlowManagerThread",
-                                          FlowManagerThread, 0);
+    flowmgr_number = 1;
+    if (ConfGetInt("flow.managers", &setting) == 1) {
+        if (setting < 1 || setting > 1024) {
+            SCLogError(SC_ERR_INVALID_ARGUMENTS,
+                    "invalid flow.managers setting %"PRIdMAX", using 1", setting);
+            setting = 1;
+        }
+    }
+    flowmgr_number = (uint32_t)setting;
+    if (flowmgr_number > flow_config.hash_size)
+        flowmgr_number = flow_config.hash_size;
+
+    setting = 1;
+    if (ConfGetInt("flow.manager-pass-time", &setting) == 1) {
+        if (setting < 1 || setting > 3600) {
+            SCLogError(SC_ERR_INVALID_ARGUMENTS,
+                    "invalid flow.manager-pass-time setting %"PRIdMAX", using 1",
+                    setting);
+            setting = 1;
+        }
+    }
+    flowmgr_pass_time = (uint32_t)setting;
 
-    TmThreadSetCPU(tv_flowmgr, MANAGEMENT_CPU_SET);
+    SCLogInfo("using %"PRIu32" flow manager threads, full hash pass every "
+            "%"PRIu32"s", flowmgr_number, flowmgr_pass_time);
 
-    if (tv_flowmgr == NULL) {
-        printf("ERROR: TmThreadsCreate failed\n");
-        exit(1);
-    }
-    if (TmThreadSpawn(tv_flowmgr) != TM_ECODE_OK) {
-        printf("ERROR: TmThreadSpawn failed\n");
-        exit(1);
+    SC_ATOMIC_INIT(flowmgr_cnt);
+    (void)SC_ATOMIC_SET(flowmgr_cnt, 0);
+
+    for (u = 0; u < flowmgr_number; u++) {
+        char name[32];
+        snprintf(name, sizeof(name), "FlowManagerThread#%02"PRIu32, u + 1);
+        char *thread_name = SCStrdup(name);
+        if (unlikely(thread_name == NULL)) {
+            printf("ERROR: can't allocate thread name\n");
+            exit(1);
+        }
+
+        tv_flowmgr = TmThreadCreateMgmtThread(thread_name,
+                                              FlowManagerThread, 0);
+
+        if (tv_flowmgr == NULL) {
+            printf("ERROR: TmThreadsCreate failed\n");
+            exit(1);
+        }
+        TmThreadSetCPU(tv_flowmgr, MANAGEMENT_CPU_SET);
+
+        if (TmThreadSpawn(tv_flowmgr) != TM_ECODE_OK) {
+            printf("ERROR: TmThreadSpawn failed\n");
+            exit(1);
+        }
     }
 
     return;
@@ -840,7 +1028,7 @@ static int FlowMgrTest05 (void) {
     TimeGet(&ts);
     /* try to time out flows */
     FlowTimeoutCounters counters = { 0, 0, 0, };
-    FlowTimeoutHash(&ts, 0 /* check all */, &counters);
+    FlowTimeoutHash(&ts, 0 /* check all */, 0, flow_config.hash_size, &counters);
 
     if (flow_spare_q.len > 0) {
         result = 1;
@@ -851,6 +1039,37 @@ static int FlowMgrTest05 (void) {
 
     return result;
 }
+
+/**
+ *  \test  Test that the flow manager slices cover the hash rows without
+ *         overlap.
+ *
+ *  \retval On success it returns 1 and on failure 0.
+ */
+static int FlowMgrTest06 (void) {
+    uint32_t threads, instance;
+    uint32_t hash_min, hash_max, next;
+
+    for (threads = 1; threads <= 7; threads++) {
+        next = 0;
+        for (instance = 0; instance < threads; instance++) {
+            FlowManagerGetSlice(instance, threads, 65537, &hash_min, &hash_max);
+            if (hash_min != next || hash_max <= hash_min) {
+                printf("threads %u instance %u: %u-%u, expected start %u: ",
+                        threads, instance, hash_min, hash_max, next);
+                return 0;
+            }
+            next = hash_max;
+        }
+        if (next != 65537) {
+            printf("threads %u: slices end at %u: ", threads, next);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
 #endif /* UNITTESTS */
 
 /**
@@ -863,5 +1082,6 @@ void FlowMgrRegisterTests (void) {
     UtRegisterTest("FlowMgrTest03 -- Timeout a flow in emergency having fresh TcpSession", FlowMgrTest03, 1);
     UtRegisterTest("FlowMgrTest04 -- Timeout a flow in emergency having TcpSession with segments", FlowMgrTest04, 1);
     UtRegisterTest("FlowMgrTest05 -- Test flow Allocations when it reach memcap", FlowMgrTest05, 1);
+    UtRegisterTest("FlowMgrTest06 -- Flow manager hash slices", FlowMgrTest06, 1);
 #endif /* UNITTESTS */
 }
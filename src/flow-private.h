@@ -84,6 +84,67 @@ FlowConfig flow_config;
 /** flow memuse counter (atomic), for enforcing memcap limit */
 SC_ATOMIC_DECLARE(long long unsigned int, flow_memuse);
 
+/**
+ *  \brief Get the flow's state
+ *
+ *  \param f flow
+ *
+ *  \retval state either FLOW_STATE_NEW, FLOW_STATE_ESTABLISHED or FLOW_STATE_CLOSED
+ */
+static inline int FlowGetFlowState(Flow *f) {
+    if (flow_proto[f->protomap].GetProtoState != NULL) {
+        return flow_proto[f->protomap].GetProtoState(f->protoctx);
+    } else {
+        if ((f->flags & FLOW_TO_SRC_SEEN) && (f->flags & FLOW_TO_DST_SEEN))
+            return FLOW_STATE_ESTABLISHED;
+        else
+            return FLOW_STATE_NEW;
+    }
+}
+
+/**
+ *  \brief get timeout for flow
+ *
+ *  \param f flow
+ *  \param state flow state
+ *  \param emergency bool indicating emergency mode 1 yes, 0 no
+ *
+ *  \retval timeout timeout in seconds
+ */
+static inline uint32_t FlowGetFlowTimeout(Flow *f, int state, int emergency) {
+    uint32_t timeout;
+
+    if (emergency) {
+        switch(state) {
+            default:
+            case FLOW_STATE_NEW:
+                timeout = flow_proto[f->protomap].emerg_new_timeout;
+                break;
+            case FLOW_STATE_ESTABLISHED:
+                timeout = flow_proto[f->protomap].emerg_est_timeout;
+                break;
+            case FLOW_STATE_CLOSED:
+                timeout = flow_proto[f->protomap].emerg_closed_timeout;
+                break;
+        }
+    } else { /* implies no emergency */
+        switch(state) {
+            default:
+            case FLOW_STATE_NEW:
+                timeout = flow_proto[f->protomap].new_timeout;
+                break;
+            case FLOW_STATE_ESTABLISHED:
+                timeout = flow_proto[f->protomap].est_timeout;
+                break;
+            case FLOW_STATE_CLOSED:
+                timeout = flow_proto[f->protomap].closed_timeout;
+                break;
+        }
+    }
+
+    return timeout;
+}
+
 //#define FLOWBITS_STATS
 #ifdef FLOWBITS_STATS
 uint64_t flowbits_memuse;
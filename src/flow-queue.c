@@ -135,6 +135,47 @@ Flow *FlowDequeue (FlowQueue *q)
     return f;
 }
 
+/**
+ *  \brief remove up to max flows from the queue under a single lock
+ *
+ *  \param q queue
+ *  \param max max number of flows to remove
+ *
+ *  \retval list flows linked through lnext, or NULL if the queue is empty
+ */
+Flow *FlowDequeueBatch(FlowQueue *q, uint32_t max)
+{
+    Flow *list = NULL;
+    uint32_t cnt = 0;
+
+    FQLOCK_LOCK(q);
+    while (cnt < max && q->bot != NULL) {
+        Flow *f = q->bot;
+
+        q->bot = f->lprev;
+        if (q->bot != NULL)
+            q->bot->lnext = NULL;
+        else
+            q->top = NULL;
+
+        f->lprev = NULL;
+        f->lnext = list;
+        list = f;
+        cnt++;
+    }
+
+#ifdef DEBUG
+    BUG_ON(q->len < cnt);
+#endif
+    if (q->len >= cnt)
+        q->len -= cnt;
+    else
+        q->len = 0;
+    FQLOCK_UNLOCK(q);
+
+    return list;
+}
+
 /**
  *  \brief Transfer a flow from a queue to the spare queue
  *
@@ -78,6 +78,7 @@ void FlowQueueDestroy (FlowQueue *);
 
 void FlowEnqueue (FlowQueue *, Flow *);
 Flow *FlowDequeue (FlowQueue *);
+Flow *FlowDequeueBatch(FlowQueue *, uint32_t);
 
 void FlowMoveToSpare(Flow *);
 
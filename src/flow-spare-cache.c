@@ -0,0 +1,304 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per decode thread caches of spare flows.
+ *
+ * Every decode thread with a cache takes the flows for new sessions from
+ * it instead of from the global spare queue. The flow manager hands each
+ * cache a batch of spare flows when it has used up the last one, taking
+ * the spare queue lock once per batch. The decode thread picks up the
+ * batch with a single atomic swap, so in steady state it doesn't touch a
+ * lock shared with other threads to set up a flow. If the manager didn't
+ * keep up, the thread takes a batch from the spare queue itself.
+ *
+ * Flows in the caches are accounted in flow_memuse, but are not part of
+ * flow_spare_q.len.
+ */
+
+#include "suricata-common.h"
+#include "threads.h"
+#include "decode.h"
+#include "conf.h"
+
+#include "flow.h"
+#include "flow-queue.h"
+#include "flow-util.h"
+#include "flow-private.h"
+#include "flow-spare-cache.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+
+SC_ATOMIC_EXTERN(unsigned int, flow_flags);
+
+/** number of flows handed to a cache at once, 0 disables the caches */
+static uint32_t flow_spare_cache_size = FLOW_SPARE_CACHE_DEFAULT_SIZE;
+
+/** all caches, so the flow manager can refill them */
+static FlowSpareCache *flow_spare_caches = NULL;
+static SCMutex flow_spare_caches_lock = SCMUTEX_INITIALIZER;
+
+/** \brief read the spare cache config
+ *  \warning Not thread safe */
+void FlowSpareCacheInitConfig(char quiet)
+{
+    intmax_t val = 0;
+
+    flow_spare_cache_size = FLOW_SPARE_CACHE_DEFAULT_SIZE;
+    if (ConfGetInt("flow.spare-cache-size", &val) == 1) {
+        if (val >= 0 && val <= 65536) {
+            flow_spare_cache_size = (uint32_t)val;
+        } else {
+            SCLogError(SC_ERR_INVALID_VALUE, "flow.spare-cache-size must be "
+                    "in the range of 0 and 65536, using default %u",
+                    FLOW_SPARE_CACHE_DEFAULT_SIZE);
+        }
+    }
+
+    if (quiet == FALSE) {
+        if (flow_spare_cache_size > 0)
+            SCLogInfo("per thread spare flow caches of %u flows",
+                    flow_spare_cache_size);
+        else
+            SCLogInfo("per thread spare flow caches disabled");
+    }
+}
+
+/** \internal
+ *  \brief return a list of flows to the spare queue */
+static void FlowSpareCacheReturnList(Flow *list)
+{
+    while (list != NULL) {
+        Flow *f = list;
+        list = f->lnext;
+        f->lnext = NULL;
+        FlowEnqueue(&flow_spare_q, f);
+    }
+}
+
+/** \brief return the flows of all caches to the spare queue and free the
+ *         caches
+ *
+ *  Called from FlowShutdown() before the spare queue is cleared, after
+ *  the decode threads are gone.
+ *
+ *  \warning Not thread safe */
+void FlowSpareCacheShutdown(void)
+{
+    SCMutexLock(&flow_spare_caches_lock);
+    FlowSpareCache *c = flow_spare_caches;
+    while (c != NULL) {
+        FlowSpareCache *next = c->next;
+
+        FlowSpareCacheReturnList(c->local);
+        FlowSpareCacheReturnList(SC_ATOMIC_GET(c->refill));
+        SC_ATOMIC_DESTROY(c->refill);
+        SCFree(c);
+
+        c = next;
+    }
+    flow_spare_caches = NULL;
+    SCMutexUnlock(&flow_spare_caches_lock);
+}
+
+/** \brief setup a spare flow cache for a decode thread
+ *
+ *  \retval c cache or NULL if disabled or on alloc failure
+ */
+FlowSpareCache *FlowSpareCacheAlloc(void)
+{
+    if (flow_spare_cache_size == 0)
+        return NULL;
+
+    FlowSpareCache *c = SCMalloc(sizeof(FlowSpareCache));
+    if (unlikely(c == NULL))
+        return NULL;
+    memset(c, 0x00, sizeof(FlowSpareCache));
+    SC_ATOMIC_INIT(c->refill);
+
+    SCMutexLock(&flow_spare_caches_lock);
+    c->next = flow_spare_caches;
+    flow_spare_caches = c;
+    SCMutexUnlock(&flow_spare_caches_lock);
+    return c;
+}
+
+/** \brief get a flow from a cache, called by the owning thread only
+ *
+ *  \param refilled set to 1 if the batch from the flow manager was used
+ *
+ *  \retval f unlocked spare flow or NULL if the cache is empty
+ */
+Flow *FlowSpareCacheGet(FlowSpareCache *c, int *refilled)
+{
+    *refilled = 0;
+
+    if (c->local == NULL) {
+        Flow *list = SC_ATOMIC_GET(c->refill);
+        if (list == NULL)
+            return NULL;
+        /* only we clear refill and the manager only sets it when it's
+         * NULL, so this can't fail. The CAS orders our reads of the
+         * list after the manager's writes. */
+        if (SC_ATOMIC_CAS(&c->refill, list, NULL) == 0)
+            return NULL;
+        c->local = list;
+        *refilled = 1;
+    }
+
+    Flow *f = c->local;
+    c->local = f->lnext;
+    f->lnext = NULL;
+    return f;
+}
+
+/** \brief take a batch from the spare queue for an empty cache
+ *
+ *  In emergency mode only a single flow is taken, so the spare flows left
+ *  aren't stuck in the cache of a single thread.
+ *
+ *  \retval f unlocked spare flow or NULL if the spare queue is empty
+ */
+Flow *FlowSpareCacheFill(FlowSpareCache *c)
+{
+    uint32_t want = flow_spare_cache_size;
+    if (SC_ATOMIC_GET(flow_flags) & FLOW_EMERGENCY)
+        want = 1;
+
+    Flow *f = FlowDequeueBatch(&flow_spare_q, want);
+    if (f == NULL)
+        return NULL;
+
+    c->local = f->lnext;
+    f->lnext = NULL;
+    return f;
+}
+
+/** \brief hand a batch of spare flows to every cache that used its last
+ *         one
+ *
+ *  Called by the flow manager after it topped up the spare queue. Nothing
+ *  is handed out in emergency mode.
+ */
+void FlowSpareCacheRefill(void)
+{
+    if (flow_spare_cache_size == 0)
+        return;
+    if (SC_ATOMIC_GET(flow_flags) & FLOW_EMERGENCY)
+        return;
+
+    SCMutexLock(&flow_spare_caches_lock);
+    FlowSpareCache *c;
+    for (c = flow_spare_caches; c != NULL; c = c->next) {
+        if (SC_ATOMIC_GET(c->refill) != NULL)
+            continue;
+
+        Flow *list = FlowDequeueBatch(&flow_spare_q, flow_spare_cache_size);
+        if (list == NULL)
+            break;
+
+        if (SC_ATOMIC_CAS(&c->refill, NULL, list) == 0)
+            FlowSpareCacheReturnList(list);
+    }
+    SCMutexUnlock(&flow_spare_caches_lock);
+}
+
+#ifdef UNITTESTS
+
+/** \test fill on a miss, refill by the manager and return of the cached
+ *        flows at shutdown */
+static int FlowSpareCacheTest01(void)
+{
+    int result = 0;
+    int refilled = 0;
+    int i;
+    Flow *f[8];
+    Flow *g = NULL;
+    FlowSpareCache *c = NULL;
+
+    FlowInitConfig(FLOW_QUIET);
+    flow_spare_cache_size = 4;
+
+    uint32_t len = flow_spare_q.len;
+    if (len < 8)
+        goto end;
+
+    c = FlowSpareCacheAlloc();
+    if (c == NULL)
+        goto end;
+
+    if (FlowSpareCacheGet(c, &refilled) != NULL || refilled != 0)
+        goto end;
+
+    /* miss: the thread takes a batch itself */
+    f[0] = FlowSpareCacheFill(c);
+    if (f[0] == NULL || flow_spare_q.len != len - 4)
+        goto end;
+    for (i = 1; i < 4; i++) {
+        f[i] = FlowSpareCacheGet(c, &refilled);
+        if (f[i] == NULL || refilled != 0)
+            goto end;
+    }
+    if (FlowSpareCacheGet(c, &refilled) != NULL)
+        goto end;
+
+    /* batch from the manager, only handed out once */
+    FlowSpareCacheRefill();
+    FlowSpareCacheRefill();
+    if (flow_spare_q.len != len - 8)
+        goto end;
+    for (i = 4; i < 8; i++) {
+        f[i] = FlowSpareCacheGet(c, &refilled);
+        if (f[i] == NULL || refilled != (i == 4))
+            goto end;
+    }
+    for (i = 0; i < 8; i++) {
+        if (f[i]->lnext != NULL || f[i]->lprev != NULL)
+            goto end;
+        FlowEnqueue(&flow_spare_q, f[i]);
+    }
+
+    /* cached flows go back to the spare queue */
+    FlowSpareCacheRefill();
+    g = FlowSpareCacheGet(c, &refilled);
+    if (g == NULL || refilled != 1)
+        goto end;
+    FlowEnqueue(&flow_spare_q, g);
+    FlowSpareCacheRefill();
+    if (flow_spare_q.len != len - 7)
+        goto end;
+    FlowSpareCacheShutdown();
+    if (flow_spare_q.len != len)
+        goto end;
+
+    result = 1;
+end:
+    FlowShutdown();
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void FlowSpareCacheRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("FlowSpareCacheTest01", FlowSpareCacheTest01, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,57 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Per decode thread caches of spare flows.
+ */
+
+#ifndef __FLOW_SPARE_CACHE_H__
+#define __FLOW_SPARE_CACHE_H__
+
+/** default number of flows the flow manager hands to a cache at once */
+#define FLOW_SPARE_CACHE_DEFAULT_SIZE   64
+
+/**
+ * \brief Spare flows of a single decode thread.
+ *
+ * The owning thread takes flows from its local list without locking. When
+ * that runs dry it swaps in the batch the flow manager left in refill,
+ * again without taking a lock. Only if there is no batch either does the
+ * thread take one from the global spare queue itself.
+ */
+typedef struct FlowSpareCache_ {
+    /** flows of the owning thread, linked through lnext */
+    Flow *local;
+    /** batch put here by the flow manager, taken by the owning thread */
+    SC_ATOMIC_DECLARE(Flow *, refill);
+    /** next cache in the list of all caches */
+    struct FlowSpareCache_ *next;
+} FlowSpareCache;
+
+void FlowSpareCacheInitConfig(char quiet);
+void FlowSpareCacheShutdown(void);
+
+FlowSpareCache *FlowSpareCacheAlloc(void);
+Flow *FlowSpareCacheGet(FlowSpareCache *c, int *refilled);
+Flow *FlowSpareCacheFill(FlowSpareCache *c);
+void FlowSpareCacheRefill(void);
+
+void FlowSpareCacheRegisterTests(void);
+
+#endif /* __FLOW_SPARE_CACHE_H__ */
@@ -61,6 +61,7 @@
 #include "app-layer.h"
 
 #include "util-profiling.h"
+#include "tm-queuehandlers.h"
 
 static TmSlot *stream_pseudo_pkt_stream_tm_slot = NULL;
 static ThreadVars *stream_pseudo_pkt_stream_TV = NULL;
@@ -258,8 +259,9 @@ static inline Packet *FlowForceReassemblyPseudoPacketSetup(Packet *p,
                                                (uint16_t *)p->tcph, 20);
     }
 
+    p->time_domain = f->time_domain;
     memset(&p->ts, 0, sizeof(struct timeval));
-    TimeGet(&p->ts);
+    TimeGetDomain(f->time_domain, &p->ts);
 
     AppLayerParserSetEOF(f->alparser);
 
@@ -687,8 +689,7 @@ void FlowForceReassembly(void)
              * packet acquire by now using TmThreadDisableReceiveThreads()*/
             if (!(strlen(tv->inq->name) == strlen("packetpool") &&
                   strcasecmp(tv->inq->name, "packetpool") == 0)) {
-                PacketQueue *q = &trans_q[tv->inq->id];
-                while (q->len != 0) {
+                while (TmqhQueueLen(tv->inq->id) != 0) {
                     usleep(100);
                 }
                 TmThreadsSetFlag(tv, THV_PAUSE);
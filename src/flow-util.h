@@ -67,6 +67,9 @@
         (f)->hprev = NULL; \
         (f)->lnext = NULL; \
         (f)->lprev = NULL; \
+        (f)->wnext = NULL; \
+        (f)->wprev = NULL; \
+        (f)->wslot = NULL; \
         SC_ATOMIC_INIT((f)->autofp_tmqh_flow_qid);  \
         (void) SC_ATOMIC_SET((f)->autofp_tmqh_flow_qid, -1);  \
         RESET_COUNTERS((f)); \
@@ -75,7 +78,8 @@
 /** \brief macro to recycle a flow before it goes into the spare queue for reuse.
  *
  *  Note that the lnext, lprev, hnext, hprev fields are untouched, those are
- *  managed by the queueing code. Same goes for fb (FlowBucket ptr) field.
+ *  managed by the queueing code. Same goes for fb (FlowBucket ptr) field
+ *  and the timer wheel fields.
  */
 #define FLOW_RECYCLE(f) do { \
         FlowCleanupAppLayer((f)); \
@@ -0,0 +1,444 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Flow timer wheel.
+ *
+ * Flows are added to the wheel when they are added to the flow hash and
+ * removed when they leave it. The flow manager takes the flows that are
+ * due from the wheel, so it only looks at flows that may have timed out
+ * instead of walking the whole hash. Flows that turn out to have seen
+ * packets in the meantime are rescheduled.
+ */
+
+#include "suricata-common.h"
+#include "threads.h"
+#include "decode.h"
+
+#include "flow.h"
+#include "flow-hash.h"
+#include "flow-util.h"
+#include "flow-private.h"
+#include "flow-wheel.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#define FLOW_WHEEL_L0_MASK  (FLOW_WHEEL_L0_SIZE - 1)
+#define FLOW_WHEEL_L1_MASK  (FLOW_WHEEL_L1_SIZE - 1)
+#define FLOW_WHEEL_L2_MASK  (FLOW_WHEEL_L2_SIZE - 1)
+#define FLOW_WHEEL_L1_SHIFT FLOW_WHEEL_L0_BITS
+#define FLOW_WHEEL_L2_SHIFT (FLOW_WHEEL_L0_BITS + FLOW_WHEEL_L1_BITS)
+#define FLOW_WHEEL_SPAN     (1 << (FLOW_WHEEL_L2_SHIFT + FLOW_WHEEL_L2_BITS))
+
+FlowWheel *flow_wheel = NULL;
+
+FlowWheel *FlowWheelAlloc(void)
+{
+    FlowWheel *w = SCMalloc(sizeof(FlowWheel));
+    if (unlikely(w == NULL))
+        return NULL;
+    memset(w, 0, sizeof(FlowWheel));
+    SCSpinInit(&w->lock, 0);
+    return w;
+}
+
+/** \brief free the wheel. The flows in it are not touched. */
+void FlowWheelFree(FlowWheel *w)
+{
+    if (w == NULL)
+        return;
+
+    SCSpinDestroy(&w->lock);
+    SCFree(w);
+}
+
+static inline int FlowWheelSlotLevel(const FlowWheel *w, const FlowWheelSlot *slot)
+{
+    if (slot < w->l1)
+        return 0;
+    else if (slot < w->l2)
+        return 1;
+    return 2;
+}
+
+/** \internal
+ *  \brief add a flow to the slot of its expire time, wheel is locked */
+static void FlowWheelLink(FlowWheel *w, Flow *f, uint32_t expire)
+{
+    FlowWheelSlot *slot;
+
+    /* first flow ever, start the wheel at its time */
+    if (w->cur == 0)
+        w->cur = expire;
+
+    uint32_t delta = (expire > w->cur) ? expire - w->cur : 0;
+    uint32_t due = w->cur + delta;
+
+    if (delta < FLOW_WHEEL_L0_SIZE) {
+        slot = &w->l0[due & FLOW_WHEEL_L0_MASK];
+    } else if (delta < (1 << FLOW_WHEEL_L2_SHIFT)) {
+        slot = &w->l1[(due >> FLOW_WHEEL_L1_SHIFT) & FLOW_WHEEL_L1_MASK];
+    } else if (delta < FLOW_WHEEL_SPAN) {
+        slot = &w->l2[(due >> FLOW_WHEEL_L2_SHIFT) & FLOW_WHEEL_L2_MASK];
+    } else {
+        /* beyond the wheel: park it in the last level 2 slot, it's
+         * relinked from there when the slot is cascaded */
+        slot = &w->l2[((w->cur >> FLOW_WHEEL_L2_SHIFT) + FLOW_WHEEL_L2_MASK) &
+            FLOW_WHEEL_L2_MASK];
+    }
+
+    f->wprev = NULL;
+    f->wnext = slot->head;
+    if (slot->head != NULL)
+        slot->head->wprev = f;
+    slot->head = f;
+    f->wslot = slot;
+    f->wheel_expire = expire;
+    w->cnt[FlowWheelSlotLevel(w, slot)]++;
+}
+
+/** \internal
+ *  \brief remove a flow from its slot, wheel is locked */
+static void FlowWheelUnlink(FlowWheel *w, Flow *f)
+{
+    FlowWheelSlot *slot = f->wslot;
+
+    if (f->wprev != NULL)
+        f->wprev->wnext = f->wnext;
+    else
+        slot->head = f->wnext;
+    if (f->wnext != NULL)
+        f->wnext->wprev = f->wprev;
+
+    f->wnext = NULL;
+    f->wprev = NULL;
+    f->wslot = NULL;
+    w->cnt[FlowWheelSlotLevel(w, slot)]--;
+}
+
+/** \internal
+ *  \brief relink the flows of a higher level slot */
+static void FlowWheelCascade(FlowWheel *w, FlowWheelSlot *slot)
+{
+    Flow *f = slot->head;
+    int level = FlowWheelSlotLevel(w, slot);
+
+    slot->head = NULL;
+    while (f != NULL) {
+        Flow *next = f->wnext;
+        w->cnt[level]--;
+        FlowWheelLink(w, f, f->wheel_expire);
+        f = next;
+    }
+}
+
+/** \internal
+ *  \brief move the wheel to the next second, wheel is locked */
+static void FlowWheelAdvance(FlowWheel *w)
+{
+    w->cur++;
+    if ((w->cur & FLOW_WHEEL_L0_MASK) == 0) {
+        if (((w->cur >> FLOW_WHEEL_L1_SHIFT) & FLOW_WHEEL_L1_MASK) == 0) {
+            FlowWheelCascade(w,
+                    &w->l2[(w->cur >> FLOW_WHEEL_L2_SHIFT) & FLOW_WHEEL_L2_MASK]);
+        }
+        FlowWheelCascade(w,
+                &w->l1[(w->cur >> FLOW_WHEEL_L1_SHIFT) & FLOW_WHEEL_L1_MASK]);
+    }
+}
+
+/** \brief schedule a flow at a time, or reschedule it if it's in the
+ *         wheel already
+ *
+ *  \param expire second at which the flow is due
+ */
+void FlowWheelSchedule(FlowWheel *w, Flow *f, uint32_t expire)
+{
+    SCSpinLock(&w->lock);
+    if (f->wslot != NULL)
+        FlowWheelUnlink(w, f);
+    FlowWheelLink(w, f, expire);
+    SCSpinUnlock(&w->lock);
+}
+
+/** \brief add a flow that was just added to the flow hash
+ *
+ *  \param ts time of the flow's first packet
+ */
+void FlowWheelAddNew(FlowWheel *w, Flow *f, uint32_t ts)
+{
+    uint32_t timeout = FlowGetFlowTimeout(f, FLOW_STATE_NEW, 0);
+    FlowWheelSchedule(w, f, ts + timeout + 1);
+}
+
+/** \brief move a flow to an earlier slot if a state change shortened its
+ *         timeout. Called with the flow locked.
+ */
+void FlowWheelUpdate(FlowWheel *w, Flow *f)
+{
+    uint32_t timeout = FlowGetFlowTimeout(f, FlowGetFlowState(f), 0);
+    uint32_t expire = (uint32_t)f->lastts_sec + timeout + 1;
+
+    /* unlocked check first, the common case is a longer timeout */
+    if (expire >= f->wheel_expire)
+        return;
+
+    SCSpinLock(&w->lock);
+    /* not in the wheel: not in the hash, or being checked by the flow
+     * manager which will see the new state */
+    if (f->wslot != NULL && expire < f->wheel_expire) {
+        FlowWheelUnlink(w, f);
+        FlowWheelLink(w, f, expire);
+    }
+    SCSpinUnlock(&w->lock);
+}
+
+/** \brief remove a flow that is taken out of the flow hash */
+void FlowWheelRemove(FlowWheel *w, Flow *f)
+{
+    SCSpinLock(&w->lock);
+    if (f->wslot != NULL)
+        FlowWheelUnlink(w, f);
+    SCSpinUnlock(&w->lock);
+}
+
+/** \brief get the next flow that is due
+ *
+ *  Flows of which the bucket or the flow itself can't be locked right
+ *  away are rescheduled a second later.
+ *
+ *  \param now current time in seconds
+ *
+ *  \retval f flow, removed from the wheel, flow and its bucket locked
+ *  \retval NULL no more flows due
+ */
+Flow *FlowWheelGetDue(FlowWheel *w, uint32_t now)
+{
+    Flow *f = NULL;
+
+    SCSpinLock(&w->lock);
+    if (w->cnt[0] + w->cnt[1] + w->cnt[2] == 0) {
+        if (now >= w->cur)
+            w->cur = now + 1;
+        goto end;
+    }
+
+    while (w->cur <= now) {
+        FlowWheelSlot *slot = &w->l0[w->cur & FLOW_WHEEL_L0_MASK];
+
+        f = slot->head;
+        if (f == NULL) {
+            /* skip to the end of the lap if the level is empty */
+            if (w->cnt[0] == 0) {
+                uint32_t last = w->cur | FLOW_WHEEL_L0_MASK;
+                if (last > now) {
+                    w->cur = now + 1;
+                    break;
+                }
+                w->cur = last;
+            }
+            FlowWheelAdvance(w);
+            continue;
+        }
+
+        FlowWheelUnlink(w, f);
+
+        /* a flow in the wheel can only lose its bucket, in which case the
+         * thread removing it from the hash waits for our lock */
+        FlowBucket *fb = f->fb;
+        if (fb == NULL) {
+            f = NULL;
+            continue;
+        }
+        if (FBLOCK_TRYLOCK(fb) != 0) {
+            FlowWheelLink(w, f, now + 1);
+            f = NULL;
+            continue;
+        }
+        if (f->fb != fb) {
+            FBLOCK_UNLOCK(fb);
+            f = NULL;
+            continue;
+        }
+        if (FLOWLOCK_TRYWRLOCK(f) != 0) {
+            FBLOCK_UNLOCK(fb);
+            FlowWheelLink(w, f, now + 1);
+            f = NULL;
+            continue;
+        }
+        break;
+    }
+end:
+    SCSpinUnlock(&w->lock);
+    return f;
+}
+
+#ifdef UNITTESTS
+
+/** \test flows come out of the wheel at their time, across the levels,
+ *        rescheduling, early update and removal */
+static int FlowWheelTest01(void)
+{
+    int result = 0;
+    FlowWheel *w = NULL;
+    FlowBucket fb;
+    Flow f[4];
+    Flow *r;
+    int i;
+    uint32_t new_timeout = flow_proto[FLOW_PROTO_DEFAULT].new_timeout;
+
+    memset(&fb, 0, sizeof(fb));
+    FBLOCK_INIT(&fb);
+    memset(f, 0, sizeof(f));
+    for (i = 0; i < 4; i++) {
+        FLOW_INITIALIZE(&f[i]);
+        f[i].fb = &fb;
+    }
+
+    w = FlowWheelAlloc();
+    if (w == NULL)
+        goto end;
+
+    /* level 0, level 1, level 2 and beyond the wheel */
+    FlowWheelSchedule(w, &f[0], 1000);
+    FlowWheelSchedule(w, &f[1], 1000 + 300);
+    FlowWheelSchedule(w, &f[2], 1000 + 20000);
+    FlowWheelSchedule(w, &f[3], 1000 + FLOW_WHEEL_SPAN + 10);
+    if (w->cnt[0] != 1 || w->cnt[1] != 1 || w->cnt[2] != 2)
+        goto end;
+
+    if (FlowWheelGetDue(w, 999) != NULL)
+        goto end;
+    r = FlowWheelGetDue(w, 1000);
+    if (r != &f[0] || r->wslot != NULL)
+        goto end;
+    FLOWLOCK_UNLOCK(r);
+    FBLOCK_UNLOCK(&fb);
+    if (FlowWheelGetDue(w, 1000) != NULL)
+        goto end;
+
+    /* reschedule 100s later, then a state change brings it back */
+    FlowWheelSchedule(w, &f[0], 1100);
+    f[0].lastts_sec = 1000;
+    f[0].protomap = FLOW_PROTO_DEFAULT;
+    flow_proto[FLOW_PROTO_DEFAULT].new_timeout = 30;
+    FlowWheelUpdate(w, &f[0]);
+    if (f[0].wheel_expire != 1031)
+        goto end;
+
+    if (FlowWheelGetDue(w, 1030) != NULL)
+        goto end;
+    r = FlowWheelGetDue(w, 1031);
+    if (r != &f[0])
+        goto end;
+    FLOWLOCK_UNLOCK(r);
+    FBLOCK_UNLOCK(&fb);
+
+    /* level 1 flow is cascaded down and due at its time */
+    if (FlowWheelGetDue(w, 1299) != NULL)
+        goto end;
+    r = FlowWheelGetDue(w, 1300);
+    if (r != &f[1])
+        goto end;
+    FLOWLOCK_UNLOCK(r);
+    FBLOCK_UNLOCK(&fb);
+
+    /* busy bucket: rescheduled a second later */
+    FBLOCK_LOCK(&fb);
+    if (FlowWheelGetDue(w, 21000) != NULL)
+        goto end;
+    FBLOCK_UNLOCK(&fb);
+    if (f[2].wslot == NULL || f[2].wheel_expire != 21001)
+        goto end;
+    r = FlowWheelGetDue(w, 21001);
+    if (r != &f[2])
+        goto end;
+    FLOWLOCK_UNLOCK(r);
+    FBLOCK_UNLOCK(&fb);
+
+    /* removed flows don't come out */
+    FlowWheelRemove(w, &f[3]);
+    if (w->cnt[0] + w->cnt[1] + w->cnt[2] != 0)
+        goto end;
+    if (FlowWheelGetDue(w, 1000 + FLOW_WHEEL_SPAN + 10) != NULL)
+        goto end;
+
+    result = 1;
+end:
+    flow_proto[FLOW_PROTO_DEFAULT].new_timeout = new_timeout;
+    FlowWheelFree(w);
+    for (i = 0; i < 4; i++) {
+        FLOW_DESTROY(&f[i]);
+    }
+    FBLOCK_DESTROY(&fb);
+    return result;
+}
+
+/** \test far away flows are relinked until they are due */
+static int FlowWheelTest02(void)
+{
+    int result = 0;
+    FlowWheel *w = NULL;
+    FlowBucket fb;
+    Flow f;
+    Flow *r;
+
+    memset(&fb, 0, sizeof(fb));
+    FBLOCK_INIT(&fb);
+    memset(&f, 0, sizeof(f));
+    FLOW_INITIALIZE(&f);
+    f.fb = &fb;
+
+    w = FlowWheelAlloc();
+    if (w == NULL)
+        goto end;
+
+    FlowWheelSchedule(w, &f, 5);
+    FlowWheelSchedule(w, &f, 5 + 3 * FLOW_WHEEL_SPAN + 7);
+    if (w->cnt[2] != 1)
+        goto end;
+
+    if (FlowWheelGetDue(w, 5 + 3 * FLOW_WHEEL_SPAN + 6) != NULL)
+        goto end;
+    if (f.wslot == NULL)
+        goto end;
+    r = FlowWheelGetDue(w, 5 + 3 * FLOW_WHEEL_SPAN + 7);
+    if (r != &f)
+        goto end;
+    FLOWLOCK_UNLOCK(r);
+    FBLOCK_UNLOCK(&fb);
+
+    result = 1;
+end:
+    FlowWheelFree(w);
+    FLOW_DESTROY(&f);
+    FBLOCK_DESTROY(&fb);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void FlowWheelRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("FlowWheelTest01", FlowWheelTest01, 1);
+    UtRegisterTest("FlowWheelTest02", FlowWheelTest02, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,78 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Timer wheel of the flows in the flow hash, indexed by the second
+ * they are due to be checked for timeout.
+ */
+
+#ifndef __FLOW_WHEEL_H__
+#define __FLOW_WHEEL_H__
+
+/* level 0 has a slot per second, level 1 a slot per level 0 lap and
+ * level 2 a slot per level 1 lap: 2^20 seconds in total */
+#define FLOW_WHEEL_L0_BITS  8
+#define FLOW_WHEEL_L1_BITS  6
+#define FLOW_WHEEL_L2_BITS  6
+#define FLOW_WHEEL_L0_SIZE  (1 << FLOW_WHEEL_L0_BITS)
+#define FLOW_WHEEL_L1_SIZE  (1 << FLOW_WHEEL_L1_BITS)
+#define FLOW_WHEEL_L2_SIZE  (1 << FLOW_WHEEL_L2_BITS)
+
+typedef struct FlowWheelSlot_ {
+    struct Flow_ *head;
+} FlowWheelSlot;
+
+/**
+ * \brief Hierarchical timer wheel of flows.
+ *
+ * A flow is in the wheel while it is in the flow hash. Its slot is the
+ * second it is due at, computed from its last seen time and the timeout
+ * of its state. When a packet moves the flow's last seen time forward the
+ * wheel is not touched: the flow manager reschedules the flow when it
+ * finds it isn't timed out yet. Only state changes that shorten the
+ * timeout move the flow to an earlier slot.
+ *
+ * Lock order is bucket, flow, wheel. The flow manager only trylocks the
+ * bucket and the flow while holding the wheel lock.
+ */
+typedef struct FlowWheel_ {
+    SCSpinlock lock;
+    /** next second to expire, all earlier slots are done */
+    uint32_t cur;
+    /** flows per level */
+    uint32_t cnt[3];
+    FlowWheelSlot l0[FLOW_WHEEL_L0_SIZE];
+    FlowWheelSlot l1[FLOW_WHEEL_L1_SIZE];
+    FlowWheelSlot l2[FLOW_WHEEL_L2_SIZE];
+} FlowWheel;
+
+/** the wheel, NULL unless flow.timer-wheel is enabled */
+extern FlowWheel *flow_wheel;
+
+FlowWheel *FlowWheelAlloc(void);
+void FlowWheelFree(FlowWheel *w);
+void FlowWheelSchedule(FlowWheel *w, Flow *f, uint32_t expire);
+void FlowWheelAddNew(FlowWheel *w, Flow *f, uint32_t ts);
+void FlowWheelUpdate(FlowWheel *w, Flow *f);
+void FlowWheelRemove(FlowWheel *w, Flow *f);
+Flow *FlowWheelGetDue(FlowWheel *w, uint32_t now);
+
+void FlowWheelRegisterTests(void);
+
+#endif /* __FLOW_WHEEL_H__ */
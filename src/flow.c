@@ -43,6 +43,8 @@
 #include "flow-timeout.h"
 #include "flow-manager.h"
 #include "flow-storage.h"
+#include "flow-wheel.h"
+#include "flow-spare-cache.h"
 
 #include "stream-tcp-private.h"
 #include "stream-tcp-reassemble.h"
@@ -232,14 +234,15 @@ static inline int FlowUpdateSeenFlag(const Packet *p)
  * This is called for every packet.
  *
  *  \param tv threadvars
+ *  \param dtv decode thread vars, may be NULL
  *  \param p packet to handle flow for
  */
-void FlowHandlePacket(ThreadVars *tv, Packet *p)
+void FlowHandlePacket(ThreadVars *tv, DecodeThreadVars *dtv, Packet *p)
 {
     /* Get this packet's flow from the hash. FlowHandlePacket() will setup
      * a new flow if nescesary. If we get NULL, we're out of flow memory.
      * The returned flow is locked. */
-    Flow *f = FlowGetFlowFromHash(p);
+    Flow *f = FlowGetFlowFromHash(tv, dtv, p);
     if (f == NULL)
         return;
 
@@ -285,6 +288,11 @@ void FlowHandlePacket(ThreadVars *tv, Packet *p)
         SCLogDebug("setting FLOW_NOPAYLOAD_INSPECTION flag on flow %p", f);
         DecodeSetNoPayloadInspectionFlag(p);
     }
+    if (f->flags & FLOW_BYPASSED) {
+        SCLogDebug("flow %p is bypassed", f);
+        DecodeSetNoPacketInspectionFlag(p);
+        p->flags |= PKT_FLOW_BYPASSED;
+    }
 
     FLOWLOCK_UNLOCK(f);
 
@@ -384,6 +392,19 @@ void FlowInitConfig(char quiet)
     }
     (void) SC_ATOMIC_ADD(flow_memuse, (flow_config.hash_size * sizeof(FlowBucket)));
 
+    int wheel = 0;
+    if (ConfGetBool("flow.timer-wheel", &wheel) == 1 && wheel == 1) {
+        flow_wheel = FlowWheelAlloc();
+        if (unlikely(flow_wheel == NULL)) {
+            SCLogError(SC_ERR_FATAL, "Fatal error encountered in FlowInitConfig. Exiting...");
+            exit(EXIT_FAILURE);
+        }
+        (void) SC_ATOMIC_ADD(flow_memuse, sizeof(FlowWheel));
+        if (quiet == FALSE) {
+            SCLogInfo("using a timer wheel for flow timeouts");
+        }
+    }
+
     if (quiet == FALSE) {
         SCLogInfo("allocated %llu bytes of memory for the flow hash... "
                   "%" PRIu32 " buckets of size %" PRIuMAX "",
@@ -417,6 +438,7 @@ void FlowInitConfig(char quiet)
                 SC_ATOMIC_GET(flow_memuse), flow_config.memcap);
     }
 
+    FlowSpareCacheInitConfig(quiet);
     FlowInitFlowProto();
 
     return;
@@ -442,6 +464,9 @@ void FlowShutdown(void)
 
     FlowPrintStats();
 
+    /* return the flows of the thread caches before freeing them */
+    FlowSpareCacheShutdown();
+
     /* free spare queue */
     while((f = FlowDequeue(&flow_spare_q))) {
         FlowFree(f);
@@ -469,6 +494,11 @@ void FlowShutdown(void)
         flow_hash = NULL;
     }
     (void) SC_ATOMIC_SUB(flow_memuse, flow_config.hash_size * sizeof(FlowBucket));
+    if (flow_wheel != NULL) {
+        FlowWheelFree(flow_wheel);
+        flow_wheel = NULL;
+        (void) SC_ATOMIC_SUB(flow_memuse, sizeof(FlowWheel));
+    }
     FlowQueueDestroy(&flow_spare_q);
 
     SC_ATOMIC_DESTROY(flow_prune_idx);
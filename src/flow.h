@@ -47,7 +47,9 @@ typedef struct AppLayerParserState_ AppLayerParserState;
 /** At least on packet from the destination address was seen */
 #define FLOW_TO_DST_SEEN                  0x00000002
 
-// vacany 1x
+/** Flow is past inspection, its packets are handled by the decoder's
+ *  bypass table */
+#define FLOW_BYPASSED                     0x00000004
 
 /** no magic on files in this flow */
 #define FLOW_FILE_NO_MAGIC_TS             0x00000008
@@ -298,6 +300,8 @@ typedef struct Flow_
     uint8_t proto;
     uint8_t recursion_level;
     uint16_t vlan_id[2];
+    /** time domain of the reader the flow was created by */
+    uint8_t time_domain;
 
     /* end of flow "header" */
 
@@ -373,6 +377,13 @@ typedef struct Flow_
     struct Flow_ *hprev;
     struct FlowBucket_ *fb;
 
+    /** timer wheel list pointers, protected by the wheel lock */
+    struct Flow_ *wnext;
+    struct Flow_ *wprev;
+    struct FlowWheelSlot_ *wslot;
+    /** second at which the flow is due in the timer wheel */
+    uint32_t wheel_expire;
+
     /** queue list pointers, protected by queue mutex */
     struct Flow_ *lnext; /* list */
     struct Flow_ *lprev;
@@ -401,7 +412,7 @@ typedef struct FlowProto_ {
     int (*GetProtoState)(void *);
 } FlowProto;
 
-void FlowHandlePacket (ThreadVars *, Packet *);
+void FlowHandlePacket (ThreadVars *, DecodeThreadVars *, Packet *);
 void FlowInitConfig (char);
 void FlowPrintQueueInfo (void);
 void FlowShutdown(void);
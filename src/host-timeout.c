@@ -26,7 +26,6 @@
 
 #include "detect-engine-tag.h"
 #include "detect-engine-threshold.h"
-#include "reputation.h"
 
 uint32_t HostGetSpareCount(void) {
     return HostSpareQueueGetSize();
@@ -55,13 +54,6 @@ static int HostHostTimedOut(Host *h, struct timeval *ts) {
         return 0;
     }
 
-    if (h->iprep) {
-        if (SRepHostTimedOut(h) == 0)
-            return 0;
-
-        SCLogDebug("host %p reputation timed out", h);
-    }
-
     if (TagHostHasTag(h) && TagTimeoutCheck(h, ts) == 0) {
         tags = 1;
     }
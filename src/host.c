@@ -105,11 +105,6 @@ error:
 }
 
 void HostClearMemory(Host *h) {
-    if (h->iprep != NULL) {
-        SCFree(h->iprep);
-        h->iprep = NULL;
-    }
-
     if (HostStorageSize() > 0)
         HostFreeStorage(h);
 }
@@ -302,27 +297,21 @@ void HostCleanup(void)
             HostHashRow *hb = &host_hash[u];
             HRLOCK_LOCK(hb);
             while (h) {
-                if ((SC_ATOMIC_GET(h->use_cnt) > 0) && (h->iprep != NULL)) {
-                    /* iprep is attached to host only clear local storage */
-                    HostFreeStorage(h);
-                    h = h->hnext;
-                } else {
-                    Host *n = h->hnext;
-                    /* remove from the hash */
-                    if (h->hprev != NULL)
-                        h->hprev->hnext = h->hnext;
-                    if (h->hnext != NULL)
-                        h->hnext->hprev = h->hprev;
-                    if (hb->head == h)
-                        hb->head = h->hnext;
-                    if (hb->tail == h)
-                        hb->tail = h->hprev;
-                    h->hnext = NULL;
-                    h->hprev = NULL;
-                    HostClearMemory(h);
-                    HostMoveToSpare(h);
-                    h = n;
-                }
+                Host *n = h->hnext;
+                /* remove from the hash */
+                if (h->hprev != NULL)
+                    h->hprev->hnext = h->hnext;
+                if (h->hnext != NULL)
+                    h->hnext->hprev = h->hprev;
+                if (hb->head == h)
+                    hb->head = h->hnext;
+                if (hb->tail == h)
+                    hb->tail = h->hprev;
+                h->hnext = NULL;
+                h->hprev = NULL;
+                HostClearMemory(h);
+                HostMoveToSpare(h);
+                h = n;
             }
             HRLOCK_UNLOCK(hb);
         }
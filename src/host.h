@@ -65,9 +65,6 @@ typedef struct Host_ {
     /** use cnt, reference counter */
     SC_ATOMIC_DECLARE(unsigned int, use_cnt);
 
-    /** pointers to iprep storage */
-    void *iprep;
-
     /** storage api handle */
     Storage *storage;
 
@@ -67,7 +67,7 @@ extern int engine_mode;
 typedef struct JsonAlertLogThread_ {
     /** LogFileCtx has the pointer to the file and a mutex to allow multithreading */
     LogFileCtx* file_ctx;
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } JsonAlertLogThread;
 
 /** Handle the case where no JSON support is compiled in.
@@ -75,15 +75,13 @@ typedef struct JsonAlertLogThread_ {
  */
 static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
 {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
     int i;
     char *action = "Pass";
 
     if (p->alerts.cnt == 0)
         return TM_ECODE_OK;
 
-    MemBufferReset(buffer);
-
     json_t *js = CreateJSONHeader((Packet *)p, 0, "alert");
     if (unlikely(js == NULL))
         return TM_ECODE_OK;
@@ -119,7 +117,7 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
         /* alert */
         json_object_set_new(js, "alert", ajs);
 
-        OutputJSONBuffer(js, aft->file_ctx, aft->buffer);
+        OutputJSONBuffer(js, buffer);
         json_object_del(js, "alert");
     }
     json_object_clear(js);
@@ -130,7 +128,7 @@ static int AlertJson(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
 
 static int AlertJsonDecoderEvent(ThreadVars *tv, JsonAlertLogThread *aft, const Packet *p)
 {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
     int i;
     char timebuf[64];
     char *action = "Pass";
@@ -139,8 +137,6 @@ static int AlertJsonDecoderEvent(ThreadVars *tv, JsonAlertLogThread *aft, const
     if (p->alerts.cnt == 0)
         return TM_ECODE_OK;
 
-    MemBufferReset(buffer);
-
     CreateTimeString(&p->ts, timebuf, sizeof(timebuf));
 
     for (i = 0; i < p->alerts.cnt; i++) {
@@ -190,7 +186,7 @@ static int AlertJsonDecoderEvent(ThreadVars *tv, JsonAlertLogThread *aft, const
 
         /* alert */
         json_object_set_new(js, "alert", ajs);
-        OutputJSONBuffer(js, aft->file_ctx, buffer);
+        OutputJSONBuffer(js, buffer);
         json_object_clear(js);
         json_decref(js);
     }
@@ -229,15 +225,15 @@ static TmEcode JsonAlertLogThreadInit(ThreadVars *t, void *initdata, void **data
         return TM_ECODE_FAILED;
     }
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    /** Use the Ouptut Context (file pointer and mutex) */
+    aft->file_ctx = ((OutputCtx *)initdata)->data;
+
+    aft->buffer = OutputJsonThreadBufferNew(aft->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
     }
 
-    /** Use the Ouptut Context (file pointer and mutex) */
-    aft->file_ctx = ((OutputCtx *)initdata)->data;
-
     *data = (void *)aft;
     return TM_ECODE_OK;
 }
@@ -249,7 +245,7 @@ static TmEcode JsonAlertLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
 
     /* clear memory */
     memset(aft, 0, sizeof(JsonAlertLogThread));
@@ -67,7 +67,7 @@ typedef struct LogDnsLogThread_ {
     /** LogFileCtx has the pointer to the file and a mutex to allow multithreading */
     uint32_t dns_cnt;
 
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } LogDnsLogThread;
 
 static void CreateTypeString(uint16_t type, char *str, size_t str_size) {
@@ -99,7 +99,7 @@ static void CreateTypeString(uint16_t type, char *str, size_t str_size) {
 }
 
 static void LogQuery(LogDnsLogThread *aft, json_t *js, DNSTransaction *tx, DNSQueryEntry *entry) {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
 
     SCLogDebug("got a DNS request and now logging !!");
 
@@ -108,9 +108,6 @@ static void LogQuery(LogDnsLogThread *aft, json_t *js, DNSTransaction *tx, DNSQu
         return;
     }
 
-    /* reset */
-    MemBufferReset(buffer);
-
     /* type */
     json_object_set_new(djs, "type", json_string("query"));
 
@@ -132,12 +129,12 @@ static void LogQuery(LogDnsLogThread *aft, json_t *js, DNSTransaction *tx, DNSQu
 
     /* dns */
     json_object_set_new(js, "dns", djs);
-    OutputJSONBuffer(js, aft->dnslog_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, buffer);
     json_object_del(js, "dns");
 }
 
 static void OutputAnswer(LogDnsLogThread *aft, json_t *djs, DNSTransaction *tx, DNSAnswerEntry *entry) {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
     json_t *js = json_object();
     if (js == NULL)
         return;
@@ -182,10 +179,8 @@ static void OutputAnswer(LogDnsLogThread *aft, json_t *djs, DNSTransaction *tx,
         }
     }
 
-    /* reset */
-    MemBufferReset(buffer);
     json_object_set_new(djs, "dns", js);
-    OutputJSONBuffer(djs, aft->dnslog_ctx->file_ctx, buffer);
+    OutputJSONBuffer(djs, buffer);
     json_object_del(djs, "dns");
 
     return;
@@ -249,15 +244,15 @@ static TmEcode LogDnsLogThreadInit(ThreadVars *t, void *initdata, void **data)
         return TM_ECODE_FAILED;
     }
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    /* Use the Ouptut Context (file pointer and mutex) */
+    aft->dnslog_ctx= ((OutputCtx *)initdata)->data;
+
+    aft->buffer = OutputJsonThreadBufferNew(aft->dnslog_ctx->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
     }
 
-    /* Use the Ouptut Context (file pointer and mutex) */
-    aft->dnslog_ctx= ((OutputCtx *)initdata)->data;
-
     *data = (void *)aft;
     return TM_ECODE_OK;
 }
@@ -269,7 +264,7 @@ static TmEcode LogDnsLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
     /* clear memory */
     memset(aft, 0, sizeof(LogDnsLogThread));
 
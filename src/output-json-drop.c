@@ -63,7 +63,7 @@
 typedef struct JsonDropLogThread_ {
     /** LogFileCtx has the pointer to the file and a mutex to allow multithreading */
     LogFileCtx* file_ctx;
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } JsonDropLogThread;
 
 /**
@@ -78,7 +78,7 @@ typedef struct JsonDropLogThread_ {
 static int DropLogJSON (JsonDropLogThread *aft, const Packet *p)
 {
     uint16_t proto = 0;
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
     json_t *js = CreateJSONHeader((Packet *)p, 0, "drop");//TODO const
     if (unlikely(js == NULL))
         return TM_ECODE_OK;
@@ -89,9 +89,6 @@ static int DropLogJSON (JsonDropLogThread *aft, const Packet *p)
         return TM_ECODE_OK;
     }
 
-    /* reset */
-    MemBufferReset(buffer);
-
     if (PKT_IS_IPV4(p)) {
         json_object_set_new(djs, "len", json_integer(IPV4_GET_IPLEN(p)));
         json_object_set_new(djs, "tos", json_integer(IPV4_GET_IPTOS(p)));
@@ -133,7 +130,7 @@ static int DropLogJSON (JsonDropLogThread *aft, const Packet *p)
             break;
     }
     json_object_set_new(js, "drop", djs);
-    OutputJSONBuffer(js, aft->file_ctx, buffer);
+    OutputJSONBuffer(js, buffer);
     json_object_del(js, "drop");
     json_object_clear(js);
     json_decref(js);
@@ -155,15 +152,15 @@ static TmEcode JsonDropLogThreadInit(ThreadVars *t, void *initdata, void **data)
         return TM_ECODE_FAILED;
     }
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    /** Use the Ouptut Context (file pointer and mutex) */
+    aft->file_ctx = ((OutputCtx *)initdata)->data;
+
+    aft->buffer = OutputJsonThreadBufferNew(aft->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
     }
 
-    /** Use the Ouptut Context (file pointer and mutex) */
-    aft->file_ctx = ((OutputCtx *)initdata)->data;
-
     *data = (void *)aft;
     return TM_ECODE_OK;
 }
@@ -175,7 +172,7 @@ static TmEcode JsonDropLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
 
     /* clear memory */
     memset(aft, 0, sizeof(*aft));
@@ -71,7 +71,7 @@ typedef struct OutputFileCtx_ {
 
 typedef struct JsonFileLogThread_ {
     OutputFileCtx *filelog_ctx;
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } JsonFileLogThread;
 
 static json_t *LogFileMetaGetUri(const Packet *p, const File *ff) {
@@ -164,14 +164,11 @@ static json_t *LogFileMetaGetUserAgent(const Packet *p, const File *ff) {
  *  \brief Write meta data on a single line json record
  */
 static void FileWriteJsonRecord(JsonFileLogThread *aft, const Packet *p, const File *ff) {
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
     json_t *js = CreateJSONHeader((Packet *)p, 0, "file"); //TODO const
     if (unlikely(js == NULL))
         return;
 
-    /* reset */
-    MemBufferReset(buffer);
-
     json_t *hjs = json_object();
     if (unlikely(hjs == NULL)) {
         json_decref(js);
@@ -232,7 +229,7 @@ static void FileWriteJsonRecord(JsonFileLogThread *aft, const Packet *p, const F
     json_object_set_new(fjs, "size", json_integer(ff->size));
 
     json_object_set_new(js, "file", fjs);
-    OutputJSONBuffer(js, aft->filelog_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, buffer);
     json_object_del(js, "file");
     json_object_del(js, "http");
 
@@ -272,7 +269,7 @@ static TmEcode JsonFileLogThreadInit(ThreadVars *t, void *initdata, void **data)
     /* Use the Ouptut Context (file pointer and mutex) */
     aft->filelog_ctx = ((OutputCtx *)initdata)->data;
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    aft->buffer = OutputJsonThreadBufferNew(aft->filelog_ctx->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
@@ -289,7 +286,7 @@ static TmEcode JsonFileLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
     /* clear memory */
     memset(aft, 0, sizeof(JsonFileLogThread));
 
@@ -62,7 +62,7 @@ typedef struct JsonHttpLogThread_ {
     /** LogFileCtx has the pointer to the file and a mutex to allow multithreading */
     uint32_t uri_cnt;
 
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } JsonHttpLogThread;
 
 
@@ -210,7 +210,7 @@ static int JsonHttpLogger(ThreadVars *tv, void *thread_data, const Packet *p, Fl
 
     htp_tx_t *tx = txptr;
     JsonHttpLogThread *jhl = (JsonHttpLogThread *)thread_data;
-    MemBuffer *buffer = (MemBuffer *)jhl->buffer;
+    OutputJsonThreadBuffer *buffer = jhl->buffer;
 
     json_t *js = CreateJSONHeader((Packet *)p, 1, "http"); //TODO const
     if (unlikely(js == NULL))
@@ -218,12 +218,9 @@ static int JsonHttpLogger(ThreadVars *tv, void *thread_data, const Packet *p, Fl
 
     SCLogDebug("got a HTTP request and now logging !!");
 
-    /* reset */
-    MemBufferReset(buffer);
-
     JsonHttpLogJSON(jhl, js, tx);
 
-    OutputJSONBuffer(js, jhl->httplog_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, buffer);
     json_object_del(js, "http");
 
     json_object_clear(js);
@@ -327,7 +324,7 @@ static TmEcode JsonHttpLogThreadInit(ThreadVars *t, void *initdata, void **data)
     /* Use the Ouptut Context (file pointer and mutex) */
     aft->httplog_ctx = ((OutputCtx *)initdata)->data; //TODO
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    aft->buffer = OutputJsonThreadBufferNew(aft->httplog_ctx->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
@@ -344,7 +341,7 @@ static TmEcode JsonHttpLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
     /* clear memory */
     memset(aft, 0, sizeof(JsonHttpLogThread));
 
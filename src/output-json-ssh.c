@@ -62,13 +62,12 @@ typedef struct OutputSshCtx_ {
 
 typedef struct JsonSshLogThread_ {
     OutputSshCtx *sshlog_ctx;
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } JsonSshLogThread;
 
 static int JsonSshLogger(ThreadVars *tv, void *thread_data, const Packet *p) {
     JsonSshLogThread *aft = (JsonSshLogThread *)thread_data;
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
-    OutputSshCtx *ssh_ctx = aft->sshlog_ctx;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
 
     if (unlikely(p->flow == NULL)) {
         return 0;
@@ -98,9 +97,6 @@ static int JsonSshLogger(ThreadVars *tv, void *thread_data, const Packet *p) {
         goto end;
     }
 
-    /* reset */
-    MemBufferReset(buffer);
-
     json_t *cjs = json_object();
     if (cjs != NULL) {
         json_object_set_new(cjs, "proto_version",
@@ -123,7 +119,7 @@ static int JsonSshLogger(ThreadVars *tv, void *thread_data, const Packet *p) {
 
     json_object_set_new(js, "ssh", tjs);
 
-    OutputJSONBuffer(js, ssh_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, buffer);
     json_object_clear(js);
     json_decref(js);
 
@@ -152,7 +148,7 @@ static TmEcode JsonSshLogThreadInit(ThreadVars *t, void *initdata, void **data)
     /* Use the Ouptut Context (file pointer and mutex) */
     aft->sshlog_ctx = ((OutputCtx *)initdata)->data;
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    aft->buffer = OutputJsonThreadBufferNew(aft->sshlog_ctx->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
@@ -169,7 +165,7 @@ static TmEcode JsonSshLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
     /* clear memory */
     memset(aft, 0, sizeof(JsonSshLogThread));
 
@@ -67,7 +67,7 @@ typedef struct OutputTlsCtx_ {
 
 typedef struct JsonTlsLogThread_ {
     OutputTlsCtx *tlslog_ctx;
-    MemBuffer *buffer;
+    OutputJsonThreadBuffer *buffer;
 } JsonTlsLogThread;
 
 #define SSL_VERSION_LENGTH 13
@@ -110,7 +110,7 @@ static void LogTlsLogExtendedJSON(json_t *tjs, SSLState * state)
 
 static int JsonTlsLogger(ThreadVars *tv, void *thread_data, const Packet *p) {
     JsonTlsLogThread *aft = (JsonTlsLogThread *)thread_data;
-    MemBuffer *buffer = (MemBuffer *)aft->buffer;
+    OutputJsonThreadBuffer *buffer = aft->buffer;
     OutputTlsCtx *tls_ctx = aft->tlslog_ctx;
 
     if (unlikely(p->flow == NULL)) {
@@ -141,9 +141,6 @@ static int JsonTlsLogger(ThreadVars *tv, void *thread_data, const Packet *p) {
         goto end;
     }
 
-    /* reset */
-    MemBufferReset(buffer);
-
     /* tls.subject */
     json_object_set_new(tjs, "subject",
                         json_string(ssl_state->server_connp.cert0_subject));
@@ -158,7 +155,7 @@ static int JsonTlsLogger(ThreadVars *tv, void *thread_data, const Packet *p) {
 
     json_object_set_new(js, "tls", tjs);
 
-    OutputJSONBuffer(js, tls_ctx->file_ctx, buffer);
+    OutputJSONBuffer(js, buffer);
     json_object_clear(js);
     json_decref(js);
 
@@ -187,7 +184,7 @@ static TmEcode JsonTlsLogThreadInit(ThreadVars *t, void *initdata, void **data)
     /* Use the Ouptut Context (file pointer and mutex) */
     aft->tlslog_ctx = ((OutputCtx *)initdata)->data;
 
-    aft->buffer = MemBufferCreateNew(OUTPUT_BUFFER_SIZE);
+    aft->buffer = OutputJsonThreadBufferNew(aft->tlslog_ctx->file_ctx, OUTPUT_BUFFER_SIZE);
     if (aft->buffer == NULL) {
         SCFree(aft);
         return TM_ECODE_FAILED;
@@ -204,7 +201,7 @@ static TmEcode JsonTlsLogThreadDeinit(ThreadVars *t, void *data)
         return TM_ECODE_OK;
     }
 
-    MemBufferFree(aft->buffer);
+    OutputJsonThreadBufferFree(aft->buffer);
     /* clear memory */
     memset(aft, 0, sizeof(JsonTlsLogThread));
 
@@ -57,6 +57,10 @@
 #include "util-optimize.h"
 #include "util-buffer.h"
 #include "util-logopenfile.h"
+#include "util-misc.h"
+#include "util-signal.h"
+
+#include "source-pcap-file.h"
 
 
 #ifndef HAVE_LIBJANSSON
@@ -105,6 +109,10 @@ void OutputJsonRegisterTests (void)
 {
 }
 
+void OutputJsonFlushThreadSpawn(void)
+{
+}
+
 #else /* implied we do have JSON support */
 
 #include <jansson.h>
@@ -117,6 +125,11 @@ void OutputJsonRegisterTests (void)
 
 #define OUTPUT_BUFFER_SIZE 65535
 
+/** default number of bytes per thread collected before writing */
+#define DEFAULT_JSON_BUFFER_SIZE    32768
+/** default max time in ms events stay in the thread buffers */
+#define DEFAULT_JSON_FLUSH_INTERVAL 1000
+
 extern uint8_t engine_mode;
 #ifndef OS_WIN32
 static int alert_syslog_level = DEFAULT_ALERT_SYSLOG_LEVEL;
@@ -148,6 +161,23 @@ static enum JsonOutput json_out = ALERT_FILE;
 
 static enum JsonFormat format = COMPACT;
 
+/** flush threshold of the thread buffers, 0 to write each event */
+static uint32_t json_buffer_size = DEFAULT_JSON_BUFFER_SIZE;
+/** interval in ms of the flush thread, 0 to disable it */
+static uint32_t json_flush_interval = DEFAULT_JSON_FLUSH_INTERVAL;
+
+/** list of the thread buffers, to share them between the loggers of a
+ *  thread and for the flush thread */
+static OutputJsonThreadBuffer *json_buffers = NULL;
+static SCMutex json_buffers_lock = SCMUTEX_INITIALIZER;
+
+#ifdef JSON_ESCAPE_SLASH
+#define JSON_DUMP_ESCAPE_SLASH JSON_ESCAPE_SLASH
+#else
+#define JSON_DUMP_ESCAPE_SLASH 0
+#endif
+#define JSON_DUMP_FLAGS (JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_ENSURE_ASCII|JSON_DUMP_ESCAPE_SLASH)
+
 json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
 {
     char timebuf[64];
@@ -215,6 +245,13 @@ json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
         json_object_set_new(js, "pcap_cnt", json_integer(p->pcap_cnt));
     }
 
+    /* pcap_filename, the records of the multi reader runmode's files are
+     * interleaved */
+    const char *pcap_file = PcapFileGetFilename(p);
+    if (pcap_file != NULL) {
+        json_object_set_new(js, "pcap_filename", json_string(pcap_file));
+    }
+
     if (event_type) {
         json_object_set_new(js, "event_type", json_string(event_type));
     }
@@ -287,31 +324,340 @@ json_t *CreateJSONHeader(Packet *p, int direction_sensitive, char *event_type)
     return js;
 }
 
-int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer) {
-    char *js_s = json_dumps(js,
-                            JSON_PRESERVE_ORDER|JSON_COMPACT|JSON_ENSURE_ASCII|
-#ifdef JSON_ESCAPE_SLASH
-                            JSON_ESCAPE_SLASH
-#else
-                            0
-#endif
-                            );
+/**
+ * \brief json_dump_callback callback appending to a MemBuffer
+ *
+ * \retval 0 ok, -1 if the buffer is full
+ */
+static int OutputJsonMemBufferCallback(const char *str, size_t size, void *data)
+{
+    MemBuffer *buffer = (MemBuffer *)data;
+
+    /* keep room for the terminating '\0' */
+    if (size >= (size_t)(buffer->size - buffer->offset))
+        return -1;
+
+    memcpy(buffer->buffer + buffer->offset, str, size);
+    buffer->offset += size;
+    return 0;
+}
+
+/**
+ * \brief serialize an event followed by a newline into a MemBuffer
+ *
+ * \retval 0 ok, -1 if the event didn't fit. The buffer is left as it was.
+ */
+static int OutputJsonSerialize(json_t *js, MemBuffer *buffer)
+{
+    uint32_t offset = buffer->offset;
+
+    if (json_dump_callback(js, OutputJsonMemBufferCallback, buffer,
+                JSON_DUMP_FLAGS) != 0 ||
+        OutputJsonMemBufferCallback("\n", 1, buffer) != 0)
+    {
+        buffer->offset = offset;
+        buffer->buffer[offset] = '\0';
+        return -1;
+    }
+
+    buffer->buffer[buffer->offset] = '\0';
+    return 0;
+}
+
+/**
+ * \brief write the events in the thread buffer to the file.
+ *
+ * The caller has to hold buffer->lock.
+ */
+static void OutputJsonThreadBufferWrite(OutputJsonThreadBuffer *buffer)
+{
+    LogFileCtx *file_ctx = buffer->file_ctx;
+
+    if (buffer->buffer->offset == 0)
+        return;
+
+    SCMutexLock(&file_ctx->fp_mutex);
+    LogFileCheckRotate(file_ctx, buffer->buffer->offset);
+    if (file_ctx->fp != NULL) {
+        (void)MemBufferPrintToFPAsString(buffer->buffer, file_ctx->fp);
+        fflush(file_ctx->fp);
+    }
+    SCMutexUnlock(&file_ctx->fp_mutex);
+
+    MemBufferReset(buffer->buffer);
+}
+
+/**
+ * \brief write an event that doesn't fit in the thread buffer
+ */
+static void OutputJsonWriteUnbuffered(json_t *js, LogFileCtx *file_ctx)
+{
+    char *js_s = json_dumps(js, JSON_DUMP_FLAGS);
     if (unlikely(js_s == NULL))
-        return TM_ECODE_OK;
+        return;
 
     SCMutexLock(&file_ctx->fp_mutex);
-    if (json_out == ALERT_SYSLOG) {
-        syslog(alert_syslog_level, "%s", js_s);
-    } else if (json_out == ALERT_FILE) {
-        MemBufferWriteString(buffer, "%s\n", js_s);
-        (void)MemBufferPrintToFPAsString(buffer, file_ctx->fp);
+    LogFileCheckRotate(file_ctx, strlen(js_s) + 1);
+    if (file_ctx->fp != NULL) {
+        fprintf(file_ctx->fp, "%s\n", js_s);
         fflush(file_ctx->fp);
     }
     SCMutexUnlock(&file_ctx->fp_mutex);
     free(js_s);
+}
+
+/**
+ * \brief Log an event.
+ *
+ * The event is serialized straight into the thread buffer. In file mode
+ * the buffer is written out once it holds json_buffer_size bytes, so the
+ * file lock is taken and the file is flushed once per batch of events
+ * instead of per event. In threaded mode the event is tagged with the
+ * sequence number of the thread's shard. It's assigned under the buffer
+ * lock, and the buffer is the only writer of the shard, so the numbers
+ * follow the order of the events in the file.
+ *
+ * \param js event
+ * \param buffer thread buffer of the logger
+ */
+int OutputJSONBuffer(json_t *js, OutputJsonThreadBuffer *buffer) {
+    MemBuffer *mbuf = buffer->buffer;
+
+    if (json_out == ALERT_SYSLOG) {
+        MemBufferReset(mbuf);
+        if (OutputJsonSerialize(js, mbuf) == 0) {
+            /* strip the newline */
+            mbuf->buffer[mbuf->offset - 1] = '\0';
+            syslog(alert_syslog_level, "%s", (char *)mbuf->buffer);
+        }
+        MemBufferReset(mbuf);
+        return 0;
+    } else if (json_out != ALERT_FILE) {
+        return 0;
+    }
+
+    SCMutexLock(&buffer->lock);
+    LogFileCtx *shard = buffer->file_ctx;
+    if (shard->parent != NULL) {
+        json_object_set_new(js, "seq", json_integer(++shard->seq));
+    }
+
+    if (OutputJsonSerialize(js, mbuf) != 0) {
+        /* no room left: write what we have and try again */
+        OutputJsonThreadBufferWrite(buffer);
+        if (OutputJsonSerialize(js, mbuf) != 0) {
+            OutputJsonWriteUnbuffered(js, buffer->file_ctx);
+        }
+    }
+
+    if (!buffer->buffered || mbuf->offset >= json_buffer_size) {
+        OutputJsonThreadBufferWrite(buffer);
+    }
+    SCMutexUnlock(&buffer->lock);
     return 0;
 }
 
+/**
+ * \brief get the thread buffer of a logger thread
+ *
+ * The loggers of a thread writing to the same file get the same buffer.
+ * The first of them creates it.
+ *
+ * \param file_ctx file the logger writes to. If it's threaded, the buffer
+ *                 writes to the shard of the calling thread instead.
+ * \param size size of a new buffer, the largest event we can serialize
+ *             without an extra allocation
+ *
+ * \retval buffer or NULL on error
+ */
+OutputJsonThreadBuffer *OutputJsonThreadBufferNew(LogFileCtx *file_ctx, uint32_t size)
+{
+    unsigned long tid = SCGetThreadIdLong();
+    OutputJsonThreadBuffer *buffer;
+
+    SCMutexLock(&json_buffers_lock);
+    for (buffer = json_buffers; buffer != NULL; buffer = buffer->next) {
+        if (buffer->tid == tid && buffer->ctx == file_ctx) {
+            buffer->refcnt++;
+            goto end;
+        }
+    }
+
+    buffer = SCMalloc(sizeof(OutputJsonThreadBuffer));
+    if (unlikely(buffer == NULL))
+        goto end;
+    memset(buffer, 0x00, sizeof(OutputJsonThreadBuffer));
+
+    buffer->buffer = MemBufferCreateNew(size);
+    if (buffer->buffer == NULL) {
+        SCFree(buffer);
+        buffer = NULL;
+        goto end;
+    }
+    buffer->ctx = file_ctx;
+    if (file_ctx->threaded) {
+        file_ctx = LogFileGetThreadShard(file_ctx);
+        if (file_ctx == NULL) {
+            MemBufferFree(buffer->buffer);
+            SCFree(buffer);
+            buffer = NULL;
+            goto end;
+        }
+    }
+    SCMutexInit(&buffer->lock, NULL);
+    buffer->file_ctx = file_ctx;
+    buffer->tid = tid;
+    buffer->refcnt = 1;
+
+    if (json_out == ALERT_FILE && json_buffer_size > 0)
+        buffer->buffered = 1;
+
+    buffer->next = json_buffers;
+    json_buffers = buffer;
+end:
+    SCMutexUnlock(&json_buffers_lock);
+    return buffer;
+}
+
+/**
+ * \brief release a thread buffer. The last logger using it writes out
+ *        the remaining events and frees it.
+ */
+void OutputJsonThreadBufferFree(OutputJsonThreadBuffer *buffer)
+{
+    if (buffer == NULL)
+        return;
+
+    SCMutexLock(&json_buffers_lock);
+    if (--buffer->refcnt > 0) {
+        SCMutexUnlock(&json_buffers_lock);
+        return;
+    }
+
+    OutputJsonThreadBuffer **prev = &json_buffers;
+    while (*prev != NULL) {
+        if (*prev == buffer) {
+            *prev = buffer->next;
+            break;
+        }
+        prev = &(*prev)->next;
+    }
+    SCMutexUnlock(&json_buffers_lock);
+
+    SCMutexLock(&buffer->lock);
+    OutputJsonThreadBufferWrite(buffer);
+    SCMutexUnlock(&buffer->lock);
+
+    if (buffer->file_ctx->parent != NULL) {
+        LogFileReleaseThreadShard(buffer->file_ctx);
+    }
+
+    SCMutexDestroy(&buffer->lock);
+    MemBufferFree(buffer->buffer);
+    SCFree(buffer);
+}
+
+/**
+ * \brief write out the events of all thread buffers
+ */
+static void OutputJsonFlushAll(void)
+{
+    OutputJsonThreadBuffer *buffer;
+
+    SCMutexLock(&json_buffers_lock);
+    for (buffer = json_buffers; buffer != NULL; buffer = buffer->next) {
+        if (!buffer->buffered)
+            continue;
+        SCMutexLock(&buffer->lock);
+        OutputJsonThreadBufferWrite(buffer);
+        SCMutexUnlock(&buffer->lock);
+    }
+    SCMutexUnlock(&json_buffers_lock);
+}
+
+/**
+ * \brief Thread writing out the thread buffers every json_flush_interval
+ *        ms, so events of idle threads don't sit in the buffers.
+ */
+static void *OutputJsonFlushThread(void *arg)
+{
+    /* block usr2 and hup.  they are handled by the main thread only */
+    UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
+
+    ThreadVars *tv_local = (ThreadVars *)arg;
+    uint8_t run = 1;
+    struct timeval now;
+    struct timespec cond_time;
+
+    /* Set the thread name */
+    if (SCSetThreadName(tv_local->name) < 0) {
+        SCLogWarning(SC_ERR_THREAD_INIT, "Unable to set thread name");
+    }
+
+    if (tv_local->thread_setup_flags != 0)
+        TmThreadSetupOptions(tv_local);
+
+    /* Set the threads capability */
+    tv_local->cap_flags = 0;
+
+    SCDropCaps(tv_local);
+
+    TmThreadsSetFlag(tv_local, THV_INIT_DONE);
+    while (run) {
+        if (TmThreadsCheckFlag(tv_local, THV_PAUSE)) {
+            TmThreadsSetFlag(tv_local, THV_PAUSED);
+            TmThreadTestThreadUnPaused(tv_local);
+            TmThreadsUnsetFlag(tv_local, THV_PAUSED);
+        }
+
+        gettimeofday(&now, NULL);
+        uint64_t usecs = (uint64_t)now.tv_usec + (uint64_t)json_flush_interval * 1000;
+        cond_time.tv_sec = now.tv_sec + (usecs / 1000000);
+        cond_time.tv_nsec = (usecs % 1000000) * 1000;
+
+        SCCtrlMutexLock(tv_local->ctrl_mutex);
+        SCCtrlCondTimedwait(tv_local->ctrl_cond, tv_local->ctrl_mutex, &cond_time);
+        SCCtrlMutexUnlock(tv_local->ctrl_mutex);
+
+        OutputJsonFlushAll();
+
+        if (TmThreadsCheckFlag(tv_local, THV_KILL)) {
+            run = 0;
+        }
+    }
+
+    TmThreadsSetFlag(tv_local, THV_RUNNING_DONE);
+    TmThreadWaitForFlag(tv_local, THV_DEINIT);
+
+    TmThreadsSetFlag(tv_local, THV_CLOSED);
+    return NULL;
+}
+
+/**
+ * \brief Spawn the thread writing out the JSON thread buffers, if
+ *        buffering and the flush interval are enabled.
+ */
+void OutputJsonFlushThreadSpawn(void)
+{
+    if (json_buffer_size == 0 || json_flush_interval == 0)
+        return;
+
+    ThreadVars *tv = TmThreadCreateMgmtThread("JsonFlushThread",
+                                              OutputJsonFlushThread, 1);
+    if (tv == NULL) {
+        SCLogError(SC_ERR_THREAD_CREATE, "TmThreadCreateMgmtThread "
+                   "failed");
+        exit(EXIT_FAILURE);
+    }
+
+    if (TmThreadSpawn(tv) != 0) {
+        SCLogError(SC_ERR_THREAD_SPAWN, "TmThreadSpawn failed for "
+                   "JsonFlushThread");
+        exit(EXIT_FAILURE);
+    }
+}
+
 TmEcode OutputJson (ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq)
 {
     return TM_ECODE_OK;
@@ -406,6 +752,10 @@ OutputCtx *OutputJsonInitCtx(ConfNode *conf)
 
         if (json_ctx->json_out == ALERT_FILE) {
 
+            /* every thread writes to its own <filename>.<n> */
+            json_ctx->file_ctx->threaded =
+                ConfNodeChildValueIsTrue(conf, "threaded");
+
             if (SCConfLogOpenGeneric(conf, json_ctx->file_ctx, DEFAULT_LOG_FILENAME) < 0) {
                 LogFileFreeCtx(json_ctx->file_ctx);
                 SCFree(json_ctx);
@@ -413,6 +763,37 @@ OutputCtx *OutputJsonInitCtx(ConfNode *conf)
                 return NULL;
             }
 
+            const char *limit_s = ConfNodeLookupChildValue(conf, "limit");
+            if (limit_s != NULL) {
+                if (ParseSizeStringU64(limit_s, &json_ctx->file_ctx->size_limit) < 0) {
+                    SCLogError(SC_ERR_INVALID_ARGUMENT,
+                               "Invalid JSON limit option: %s", limit_s);
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            const char *buffer_size_s = ConfNodeLookupChildValue(conf, "buffer-size");
+            if (buffer_size_s != NULL) {
+                if (ParseSizeStringU32(buffer_size_s, &json_buffer_size) < 0 ||
+                    json_buffer_size >= OUTPUT_BUFFER_SIZE) {
+                    SCLogError(SC_ERR_INVALID_ARGUMENT,
+                               "Invalid JSON buffer-size option: %s, should be "
+                               "less than %u", buffer_size_s, OUTPUT_BUFFER_SIZE);
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            const char *flush_interval_s = ConfNodeLookupChildValue(conf, "flush-interval");
+            if (flush_interval_s != NULL) {
+                if (ByteExtractStringUint32(&json_flush_interval, 10, 0,
+                            flush_interval_s) <= 0) {
+                    SCLogError(SC_ERR_INVALID_ARGUMENT,
+                               "Invalid JSON flush-interval option: %s",
+                               flush_interval_s);
+                    exit(EXIT_FAILURE);
+                }
+            }
+
             const char *format_s = ConfNodeLookupChildValue(conf, "format");
             if (format_s != NULL) {
                 if (strcmp(format_s, "indent") == 0) {
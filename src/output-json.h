@@ -25,6 +25,7 @@
 #define __OUTPUT_JSON_H__
 
 void TmModuleOutputJsonRegister (void);
+void OutputJsonFlushThreadSpawn(void);
 
 #ifdef HAVE_LIBJANSSON
 
@@ -32,9 +33,35 @@ void TmModuleOutputJsonRegister (void);
 #include "util-buffer.h"
 #include "util-logopenfile.h"
 
+/** \brief per thread buffer the events of a thread are serialized into
+ *
+ *  The loggers of a thread that write to the same file share the buffer,
+ *  so the events are written in the order the thread logged them. Events
+ *  are collected in the buffer and written to the file when it is full,
+ *  by the flush thread every flush-interval, and when the last logger of
+ *  the thread exits. */
+typedef struct OutputJsonThreadBuffer_ {
+    /** protects the buffer against the flush thread */
+    SCMutex lock;
+    MemBuffer *buffer;
+    /** file the loggers passed in, and the file written to: the thread's
+     *  shard of it in threaded mode, the same file otherwise */
+    LogFileCtx *ctx;
+    LogFileCtx *file_ctx;
+    /** thread and number of loggers sharing the buffer, protected by
+     *  the lock of the buffer list */
+    unsigned long tid;
+    uint32_t refcnt;
+    /** 1 if the events are collected, 0 if written one by one */
+    int buffered;
+    struct OutputJsonThreadBuffer_ *next;
+} OutputJsonThreadBuffer;
+
 json_t *CreateJSONHeader(Packet *p, int direction_sensative, char *event_type);
 TmEcode OutputJSON(json_t *js, void *data, uint64_t *count);
-int OutputJSONBuffer(json_t *js, LogFileCtx *file_ctx, MemBuffer *buffer);
+int OutputJSONBuffer(json_t *js, OutputJsonThreadBuffer *buffer);
+OutputJsonThreadBuffer *OutputJsonThreadBufferNew(LogFileCtx *file_ctx, uint32_t size);
+void OutputJsonThreadBufferFree(OutputJsonThreadBuffer *buffer);
 OutputCtx *OutputJsonInitCtx(ConfNode *);
 
 enum JsonOutput { ALERT_FILE,
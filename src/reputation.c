@@ -33,77 +33,12 @@
 #include "suricata-common.h"
 #include "threads.h"
 #include "util-print.h"
-#include "host.h"
 #include "conf.h"
 #include "detect.h"
 #include "reputation.h"
+#include "util-hashlist.h"
 
-/** effective reputation version, atomic as the host
- *  time out code will use it to check if a host's
- *  reputation info is outdated. */
-SC_ATOMIC_DECLARE(uint32_t, srep_eversion);
-/** reputation version set to the host's reputation,
- *  this will be set to 1 before rep files are loaded,
- *  so hosts will always have a minial value of 1 */
-static uint32_t srep_version = 0;
-
-static uint32_t SRepIncrVersion(void) {
-    return ++srep_version;
-}
-
-static uint32_t SRepGetVersion(void) {
-    return srep_version;
-}
-
-static uint32_t SRepGetEffectiveVersion(void) {
-    return SC_ATOMIC_GET(srep_eversion);
-}
-
-/** \brief Increment effective reputation version after
- *         a rule/reputatio reload is complete. */
-void SRepReloadComplete(void) {
-    (void) SC_ATOMIC_ADD(srep_eversion, 1);
-    SCLogDebug("effective Reputation version %u", SRepGetEffectiveVersion());
-}
-
-/** \brief Set effective reputation version after
- *         reputation initialization is complete. */
-void SRepInitComplete(void) {
-    (void) SC_ATOMIC_SET(srep_eversion, 1);
-    SCLogDebug("effective Reputation version %u", SRepGetEffectiveVersion());
-}
-
-/** \brief Check if a Host is timed out wrt ip rep, meaning a new
- *         version is in place.
- *
- *  We clean up the old version here.
- *
- *  \param h host
- *
- *  \retval 0 not timed out
- *  \retval 1 timed out
- */
-int SRepHostTimedOut(Host *h) {
-    BUG_ON(h == NULL);
-
-    if (h->iprep == NULL)
-        return 1;
-
-    uint32_t eversion = SRepGetEffectiveVersion();
-    SReputation *r = h->iprep;
-    if (r->version < eversion) {
-        SCLogDebug("host %p has reputation version %u, "
-                "effective version is %u", h, r->version, eversion);
-
-        SCFree(h->iprep);
-        h->iprep = NULL;
-
-        HostDecrUsecnt(h);
-        return 1;
-    }
-
-    return 0;
-}
+#include <sys/mman.h>
 
 static int SRepCatSplitLine(char *line, uint8_t *cat, char *shortname, size_t shortname_len) {
     size_t line_len = strlen(line);
@@ -155,7 +90,7 @@ static int SRepCatSplitLine(char *line, uint8_t *cat, char *shortname, size_t sh
  *  \retval 1 header
  *  \retval -1 boo
  */
-static int SRepSplitLine(char *line, uint32_t *ip, uint8_t *cat, uint8_t *value) {
+static int SRepSplitLine(char *line, Address *ip, uint8_t *cat, uint8_t *value) {
     size_t line_len = strlen(line);
     char *ptrs[3] = {NULL,NULL,NULL};
     int i = 0;
@@ -192,9 +127,16 @@ static int SRepSplitLine(char *line, uint32_t *ip, uint8_t *cat, uint8_t *value)
     if (strcmp(ptrs[0], "ip") == 0)
         return 1;
 
-    uint32_t addr;
-    if (inet_pton(AF_INET, ptrs[0], &addr) <= 0) {
-        return -1;
+    Address addr;
+    memset(&addr, 0x00, sizeof(addr));
+    if (strchr(ptrs[0], ':') != NULL) {
+        if (inet_pton(AF_INET6, ptrs[0], &addr.addr_data32) <= 0)
+            return -1;
+        addr.family = AF_INET6;
+    } else {
+        if (inet_pton(AF_INET, ptrs[0], &addr.addr_data32[0]) <= 0)
+            return -1;
+        addr.family = AF_INET;
     }
 
     int c = atoi(ptrs[1]);
@@ -243,8 +185,6 @@ int SRepLoadCatFile(char *filename) {
     a.family = AF_INET;
     memset(&srep_cat_table, 0x00, sizeof(srep_cat_table));
 
-    BUG_ON(SRepGetVersion() > 0);
-
     FILE *fp = fopen(filename, "r");
     if (fp == NULL) {
         SCLogError(SC_ERR_OPENING_RULE_FILE, "opening ip rep file %s: %s", filename, strerror(errno));
@@ -292,11 +232,62 @@ int SRepLoadCatFile(char *filename) {
     return 0;
 }
 
-static int SRepLoadFile(char *filename) {
+/** \internal
+ *  \brief reputation file line, collected while building a store */
+typedef struct SRepBuildEntry_ {
+    uint8_t family;
+    uint8_t cat;
+    uint8_t value;
+    /** line order, so that a later line wins */
+    uint32_t seq;
+    /** address in network order, ipv4 uses the first 4 bytes */
+    uint8_t addr[16];
+} SRepBuildEntry;
+
+typedef struct SRepBuild_ {
+    SRepBuildEntry *entries;
+    uint32_t cnt;
+    uint32_t size;
+    /** reputation files, laid out as in the store, see SRepStoreSource */
+    uint8_t *src;
+    uint32_t src_cnt;
+    uint32_t src_size;
+} SRepBuild;
+
+static int SRepBuildAdd(SRepBuild *b, const Address *a, uint8_t cat, uint8_t value) {
+    if (b->cnt == b->size) {
+        uint32_t size = b->size ? b->size * 2 : 4096;
+        SRepBuildEntry *ptr = SCRealloc(b->entries, size * sizeof(SRepBuildEntry));
+        if (unlikely(ptr == NULL))
+            return -1;
+        b->entries = ptr;
+        b->size = size;
+    }
+
+    SRepBuildEntry *e = &b->entries[b->cnt];
+    memset(e, 0x00, sizeof(*e));
+    e->family = a->family;
+    e->cat = cat;
+    e->value = value;
+    e->seq = b->cnt;
+    if (a->family == AF_INET)
+        memcpy(e->addr, &a->addr_data32[0], 4);
+    else
+        memcpy(e->addr, a->addr_data8, 16);
+    b->cnt++;
+    return 0;
+}
+
+static void SRepBuildFree(SRepBuild *b) {
+    if (b->entries != NULL)
+        SCFree(b->entries);
+    if (b->src != NULL)
+        SCFree(b->src);
+    memset(b, 0x00, sizeof(*b));
+}
+
+static int SRepLoadFile(SRepBuild *b, char *filename) {
     char line[8192] = "";
-    Address a;
-    memset(&a, 0x00, sizeof(a));
-    a.family = AF_INET;
 
     FILE *fp = fopen(filename, "r");
     if (fp == NULL) {
@@ -324,61 +315,18 @@ static int SRepLoadFile(char *filename) {
             line[len - 1] = '\0';
         }
 
-        uint32_t ip = 0;
+        Address a;
         uint8_t cat = 0, value = 0;
-        int r = SRepSplitLine(line, &ip, &cat, &value);
+        int r = SRepSplitLine(line, &a, &cat, &value);
         if (r < 0) {
             SCLogError(SC_ERR_NO_REPUTATION, "bad line \"%s\"", line);
         } else if (r == 0) {
-            char ipstr[16];
-            PrintInet(AF_INET, (const void *)&ip, ipstr, sizeof(ipstr));
-            SCLogDebug("%s %u %u", ipstr, cat, value);
-
-            a.addr_data32[0] = ip;
-            Host *h = HostGetHostFromHash(&a);
-            if (h == NULL) {
-                SCLogError(SC_ERR_NO_REPUTATION, "failed to get a host, increase host.memcap");
-                break;
-            } else {
-                //SCLogInfo("host %p", h);
-
-                if (h->iprep == NULL) {
-                    h->iprep = SCMalloc(sizeof(SReputation));
-                    if (h->iprep != NULL) {
-                        memset(h->iprep, 0x00, sizeof(SReputation));
-
-                        HostIncrUsecnt(h);
-                    }
-                }
-                if (h->iprep != NULL) {
-                    SReputation *rep = h->iprep;
-
-                    /* if version is outdated, it's an older entry that we'll
-                     * now replace. */
-                    if (rep->version != SRepGetVersion()) {
-                        memset(rep, 0x00, sizeof(SReputation));
-                    }
-
-                    rep->version = SRepGetVersion();
-                    rep->rep[cat] = value;
-
-                    SCLogDebug("host %p iprep %p setting cat %u to value %u",
-                        h, h->iprep, cat, value);
-#ifdef DEBUG
-                    if (SCLogDebugEnabled()) {
-                        int i;
-                        for (i = 0; i < SREP_MAX_CATS; i++) {
-                            if (rep->rep[i] == 0)
-                                continue;
-
-                            SCLogDebug("--> host %p iprep %p cat %d to value %u",
-                                    h, h->iprep, i, rep->rep[i]);
-                        }
-                    }
-#endif
-                }
+            SCLogDebug("family %u cat %u value %u", a.family, cat, value);
 
-                HostRelease(h);
+            if (SRepBuildAdd(b, &a, cat, value) < 0) {
+                SCLogError(SC_ERR_MEM_ALLOC, "failed to add reputation entry");
+                fclose(fp);
+                return -1;
             }
         }
     }
@@ -429,28 +377,623 @@ static char *SRepCompleteFilePath(char *file)
     return path;
 }
 
+#define SREP_STORE_MAGIC    "SCIPREP\0"
+#define SREP_STORE_VERSION  2
+/** written in host order, to catch stores from another architecture */
+#define SREP_STORE_ENDIAN   0x01020304
+
+#define SREP_STORE_ALIGN(len) (((len) + 7) & ~((uint64_t)7))
+
+/** \internal
+ *  \brief header of a reputation store
+ *
+ *  It's followed by the reputation files the store was built from, the
+ *  sorted ipv4 addresses (host order), their vector offsets, the sorted
+ *  ipv6 addresses, their vector offsets and the vectors. Each part starts
+ *  8 byte aligned. A vector is a count followed by that many
+ *  category/value pairs.
+ */
+typedef struct SRepStoreHeader_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t ipv4_cnt;
+    uint32_t ipv6_cnt;
+    uint32_t vec_size;
+    uint32_t src_cnt;
+    uint32_t src_size;
+    uint32_t pad;
+} SRepStoreHeader;
+
+/** \internal
+ *  \brief reputation file of a store, with its size and mtime when it was
+ *         loaded. It's followed by the nul terminated path, padded to
+ *         8 bytes.
+ */
+typedef struct SRepStoreSource_ {
+    uint64_t size;
+    int64_t mtime;
+    /** path length, without the nul */
+    uint32_t path_len;
+    uint32_t pad;
+} SRepStoreSource;
+
+#define SREP_STORE_SOURCE_LEN(path_len) \
+    (sizeof(SRepStoreSource) + SREP_STORE_ALIGN((uint64_t)(path_len) + 1))
+
+/** \internal
+ *  \brief Record a reputation file the store is built from
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+static int SRepBuildAddSource(SRepBuild *b, const char *path, const struct stat *st) {
+    size_t path_len = strlen(path);
+    if (path_len >= PATH_MAX)
+        return -1;
+
+    uint32_t len = (uint32_t)SREP_STORE_SOURCE_LEN(path_len);
+    uint8_t *ptr = SCRealloc(b->src, b->src_size + len);
+    if (unlikely(ptr == NULL))
+        return -1;
+    b->src = ptr;
+
+    SRepStoreSource *src = (SRepStoreSource *)(b->src + b->src_size);
+    memset(src, 0x00, len);
+    src->size = (uint64_t)st->st_size;
+    src->mtime = (int64_t)st->st_mtime;
+    src->path_len = (uint32_t)path_len;
+    memcpy((uint8_t *)src + sizeof(SRepStoreSource), path, path_len);
+
+    b->src_size += len;
+    b->src_cnt++;
+    return 0;
+}
+
+/** \internal
+ *  \brief Get the next source of a store
+ *
+ *  \param off offset of the source in the sources, updated to the next
+ *
+ *  \retval src source or NULL if there are no more valid ones
+ */
+static const SRepStoreSource *SRepStoreNextSource(const uint8_t *data,
+        uint32_t size, uint32_t *off)
+{
+    if ((uint64_t)*off + sizeof(SRepStoreSource) > size)
+        return NULL;
+
+    const SRepStoreSource *src = (const SRepStoreSource *)(data + *off);
+    uint64_t len = SREP_STORE_SOURCE_LEN(src->path_len);
+    if (src->path_len >= PATH_MAX || *off + len > size ||
+        data[*off + sizeof(SRepStoreSource) + src->path_len] != '\0')
+        return NULL;
+
+    *off += (uint32_t)len;
+    return src;
+}
+
+/** \internal
+ *  \brief Check that a vector lies within the vector area */
+static inline int SRepStoreVecValid(const SRepStore *s, uint32_t off) {
+    if (off >= s->vec_size)
+        return 0;
+    return ((uint64_t)off + 1 + 2 * s->vec[off] <= s->vec_size);
+}
+
+/** \internal
+ *  \brief Point a store into its data, checking the data along the way
+ *
+ *  \retval 0 ok
+ *  \retval -1 data is not a valid store
+ */
+static int SRepStoreSetup(SRepStore *s, uint8_t *data, uint64_t len) {
+    const SRepStoreHeader *hdr = (const SRepStoreHeader *)data;
+    uint32_t i;
+
+    if (len < sizeof(SRepStoreHeader) ||
+        memcmp(hdr->magic, SREP_STORE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != SREP_STORE_VERSION || hdr->endian != SREP_STORE_ENDIAN)
+        return -1;
+
+    uint64_t off = SREP_STORE_ALIGN(sizeof(SRepStoreHeader));
+    uint64_t src_off = off;
+    off += SREP_STORE_ALIGN((uint64_t)hdr->src_size);
+    uint64_t ipv4_off = off;
+    off += SREP_STORE_ALIGN((uint64_t)hdr->ipv4_cnt * sizeof(uint32_t));
+    uint64_t ipv4_vec_off = off;
+    off += SREP_STORE_ALIGN((uint64_t)hdr->ipv4_cnt * sizeof(uint32_t));
+    uint64_t ipv6_off = off;
+    off += SREP_STORE_ALIGN((uint64_t)hdr->ipv6_cnt * 16);
+    uint64_t ipv6_vec_off = off;
+    off += SREP_STORE_ALIGN((uint64_t)hdr->ipv6_cnt * sizeof(uint32_t));
+    uint64_t vec_off = off;
+    off += hdr->vec_size;
+    if (off > len)
+        return -1;
+
+    s->ipv4 = (const uint32_t *)(data + ipv4_off);
+    s->ipv4_vec = (const uint32_t *)(data + ipv4_vec_off);
+    s->ipv4_cnt = hdr->ipv4_cnt;
+    s->ipv6 = (const uint8_t (*)[16])(data + ipv6_off);
+    s->ipv6_vec = (const uint32_t *)(data + ipv6_vec_off);
+    s->ipv6_cnt = hdr->ipv6_cnt;
+    s->vec = data + vec_off;
+    s->vec_size = hdr->vec_size;
+    s->src = data + src_off;
+    s->src_cnt = hdr->src_cnt;
+    s->src_size = hdr->src_size;
+
+    /* the sources have to fill their part exactly */
+    uint32_t src_pos = 0;
+    for (i = 0; i < s->src_cnt; i++) {
+        if (SRepStoreNextSource(s->src, s->src_size, &src_pos) == NULL)
+            return -1;
+    }
+    if (src_pos != s->src_size)
+        return -1;
+
+    /* lookups rely on sorted addresses and complete vectors */
+    for (i = 0; i < s->ipv4_cnt; i++) {
+        if (i > 0 && s->ipv4[i - 1] >= s->ipv4[i])
+            return -1;
+    }
+    for (i = 0; i < s->ipv6_cnt; i++) {
+        if (i > 0 && memcmp(s->ipv6[i - 1], s->ipv6[i], 16) >= 0)
+            return -1;
+    }
+    for (i = 0; i < s->ipv4_cnt; i++) {
+        if (!SRepStoreVecValid(s, s->ipv4_vec[i]))
+            return -1;
+    }
+    for (i = 0; i < s->ipv6_cnt; i++) {
+        if (!SRepStoreVecValid(s, s->ipv6_vec[i]))
+            return -1;
+    }
+
+    s->data = data;
+    s->len = len;
+    return 0;
+}
+
+static int SRepBuildEntryCmp(const void *a, const void *b) {
+    const SRepBuildEntry *ea = (const SRepBuildEntry *)a;
+    const SRepBuildEntry *eb = (const SRepBuildEntry *)b;
+
+    if (ea->family != eb->family)
+        return (ea->family < eb->family) ? -1 : 1;
+    int r = memcmp(ea->addr, eb->addr, sizeof(ea->addr));
+    if (r != 0)
+        return r;
+    if (ea->seq != eb->seq)
+        return (ea->seq < eb->seq) ? -1 : 1;
+    return 0;
+}
+
+/** \internal
+ *  \brief vector while building a store, so that addresses with the
+ *         same reputation share it */
+typedef struct SRepBuildVec_ {
+    uint32_t off;
+    uint8_t len;
+    uint8_t data[1 + 2 * SREP_MAX_CATS];
+} SRepBuildVec;
+
+static uint32_t SRepBuildVecHash(HashListTable *ht, void *data, uint16_t datalen) {
+    SRepBuildVec *v = (SRepBuildVec *)data;
+    uint32_t hash = 0;
+    uint8_t i;
+
+    for (i = 0; i < v->len; i++)
+        hash = hash * 31 + v->data[i];
+    return hash % ht->array_size;
+}
+
+static char SRepBuildVecCompare(void *data1, uint16_t len1, void *data2, uint16_t len2) {
+    SRepBuildVec *v1 = (SRepBuildVec *)data1;
+    SRepBuildVec *v2 = (SRepBuildVec *)data2;
+
+    return (v1->len == v2->len && memcmp(v1->data, v2->data, v1->len) == 0);
+}
+
+static void SRepBuildVecFree(void *data) {
+    SCFree(data);
+}
+
+/** \internal
+ *  \brief Get the offset of a vector in the vector area, adding it if
+ *         it's not there yet
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+static int SRepBuildVecGet(HashListTable *ht, SRepBuildVec *v,
+        uint8_t **vec, uint32_t *vec_size, uint32_t *vec_len, uint32_t *off) {
+    SRepBuildVec *e = HashListTableLookup(ht, v, sizeof(*v));
+    if (e != NULL) {
+        *off = e->off;
+        return 0;
+    }
+
+    if (*vec_len + v->len > *vec_size) {
+        uint32_t size = *vec_size ? *vec_size * 2 : 4096;
+        uint8_t *ptr = SCRealloc(*vec, size);
+        if (unlikely(ptr == NULL))
+            return -1;
+        *vec = ptr;
+        *vec_size = size;
+    }
+    memcpy(*vec + *vec_len, v->data, v->len);
+    v->off = *vec_len;
+    *vec_len += v->len;
+
+    e = SCMalloc(sizeof(*e));
+    if (unlikely(e == NULL))
+        return -1;
+    memcpy(e, v, sizeof(*e));
+    if (HashListTableAdd(ht, e, sizeof(*e)) != 0) {
+        SCFree(e);
+        return -1;
+    }
+    *off = v->off;
+    return 0;
+}
+
+/** \internal
+ *  \brief Build a store from the reputation file lines
+ *
+ *  For every address the lines are merged into a single vector, a later
+ *  line overriding the value of a category set earlier. Addresses that
+ *  end up without any non 0 value are left out.
+ *
+ *  \retval s store or NULL on error
+ */
+static SRepStore *SRepBuildStore(SRepBuild *b) {
+    SRepStore *s = NULL;
+    HashListTable *ht = NULL;
+    uint32_t *keys4 = NULL, *vecs4 = NULL, *vecs6 = NULL;
+    uint8_t (*keys6)[16] = NULL;
+    uint8_t *vec = NULL, *data = NULL;
+    uint32_t vec_size = 0, vec_len = 0;
+    uint32_t cnt4 = 0, cnt6 = 0;
+    uint32_t i, j;
+
+    if (b->cnt > 0)
+        qsort(b->entries, b->cnt, sizeof(SRepBuildEntry), SRepBuildEntryCmp);
+
+    for (i = 0; i < b->cnt; i++) {
+        if (b->entries[i].family == AF_INET)
+            cnt4++;
+        else
+            cnt6++;
+    }
+
+    ht = HashListTableInit(4096, SRepBuildVecHash, SRepBuildVecCompare, SRepBuildVecFree);
+    keys4 = SCMalloc((cnt4 + 1) * sizeof(uint32_t));
+    vecs4 = SCMalloc((cnt4 + 1) * sizeof(uint32_t));
+    keys6 = SCMalloc((cnt6 + 1) * 16);
+    vecs6 = SCMalloc((cnt6 + 1) * sizeof(uint32_t));
+    cnt4 = cnt6 = 0;
+    if (ht == NULL || keys4 == NULL || vecs4 == NULL || keys6 == NULL || vecs6 == NULL)
+        goto end;
+
+    for (i = 0; i < b->cnt; i = j) {
+        uint8_t rep[SREP_MAX_CATS];
+        SRepBuildVec v;
+        uint32_t off;
+        uint8_t cat;
+
+        memset(rep, 0x00, sizeof(rep));
+        for (j = i; j < b->cnt && b->entries[j].family == b->entries[i].family &&
+                memcmp(b->entries[j].addr, b->entries[i].addr, 16) == 0; j++) {
+            rep[b->entries[j].cat] = b->entries[j].value;
+        }
+
+        memset(&v, 0x00, sizeof(v));
+        v.len = 1;
+        for (cat = 0; cat < SREP_MAX_CATS; cat++) {
+            if (rep[cat] == 0)
+                continue;
+            v.data[v.len++] = cat;
+            v.data[v.len++] = rep[cat];
+            v.data[0]++;
+        }
+        if (v.data[0] == 0)
+            continue;
+
+        if (SRepBuildVecGet(ht, &v, &vec, &vec_size, &vec_len, &off) < 0)
+            goto end;
+
+        if (b->entries[i].family == AF_INET) {
+            uint32_t ip;
+            memcpy(&ip, b->entries[i].addr, sizeof(ip));
+            keys4[cnt4] = ntohl(ip);
+            vecs4[cnt4++] = off;
+        } else {
+            memcpy(keys6[cnt6], b->entries[i].addr, 16);
+            vecs6[cnt6++] = off;
+        }
+    }
+
+    SRepStoreHeader hdr;
+    memset(&hdr, 0x00, sizeof(hdr));
+    memcpy(hdr.magic, SREP_STORE_MAGIC, sizeof(hdr.magic));
+    hdr.version = SREP_STORE_VERSION;
+    hdr.endian = SREP_STORE_ENDIAN;
+    hdr.ipv4_cnt = cnt4;
+    hdr.ipv6_cnt = cnt6;
+    hdr.vec_size = vec_len;
+    hdr.src_cnt = b->src_cnt;
+    hdr.src_size = b->src_size;
+
+    uint64_t len = SREP_STORE_ALIGN(sizeof(hdr)) +
+                   SREP_STORE_ALIGN((uint64_t)b->src_size) +
+                   SREP_STORE_ALIGN((uint64_t)cnt4 * sizeof(uint32_t)) * 2 +
+                   SREP_STORE_ALIGN((uint64_t)cnt6 * 16) +
+                   SREP_STORE_ALIGN((uint64_t)cnt6 * sizeof(uint32_t)) +
+                   vec_len;
+    data = SCMalloc(len);
+    if (data == NULL)
+        goto end;
+    memset(data, 0x00, len);
+
+    uint64_t off = 0;
+    memcpy(data + off, &hdr, sizeof(hdr));
+    off += SREP_STORE_ALIGN(sizeof(hdr));
+    if (b->src_size > 0)
+        memcpy(data + off, b->src, b->src_size);
+    off += SREP_STORE_ALIGN((uint64_t)b->src_size);
+    memcpy(data + off, keys4, cnt4 * sizeof(uint32_t));
+    off += SREP_STORE_ALIGN((uint64_t)cnt4 * sizeof(uint32_t));
+    memcpy(data + off, vecs4, cnt4 * sizeof(uint32_t));
+    off += SREP_STORE_ALIGN((uint64_t)cnt4 * sizeof(uint32_t));
+    memcpy(data + off, keys6, (uint64_t)cnt6 * 16);
+    off += SREP_STORE_ALIGN((uint64_t)cnt6 * 16);
+    memcpy(data + off, vecs6, cnt6 * sizeof(uint32_t));
+    off += SREP_STORE_ALIGN((uint64_t)cnt6 * sizeof(uint32_t));
+    if (vec_len > 0)
+        memcpy(data + off, vec, vec_len);
+
+    s = SCMalloc(sizeof(SRepStore));
+    if (s == NULL)
+        goto end;
+    memset(s, 0x00, sizeof(*s));
+    if (SRepStoreSetup(s, data, len) < 0) {
+        SCFree(s);
+        s = NULL;
+        goto end;
+    }
+    data = NULL;
+
+end:
+    if (data != NULL)
+        SCFree(data);
+    if (ht != NULL)
+        HashListTableFree(ht);
+    if (keys4 != NULL)
+        SCFree(keys4);
+    if (vecs4 != NULL)
+        SCFree(vecs4);
+    if (keys6 != NULL)
+        SCFree(keys6);
+    if (vecs6 != NULL)
+        SCFree(vecs6);
+    if (vec != NULL)
+        SCFree(vec);
+    return s;
+}
+
+/** \internal
+ *  \brief Write a store to path, replacing an existing file atomically
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+static int SRepStoreWrite(const SRepStore *s, const char *path) {
+    char tmp[PATH_MAX];
+    const uint8_t *data = s->data;
+    size_t left = s->len;
+
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+        return -1;
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        SCLogWarning(SC_ERR_OPENING_FILE, "can't create reputation store "
+                "\"%s\": %s", tmp, strerror(errno));
+        return -1;
+    }
+
+    while (left > 0) {
+        ssize_t r = write(fd, data, left);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            SCLogWarning(SC_ERR_FWRITE, "writing reputation store \"%s\" "
+                    "failed: %s", tmp, strerror(errno));
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        data += r;
+        left -= (size_t)r;
+    }
+    close(fd);
+
+    /* detect engines that mapped the old store keep using it */
+    if (rename(tmp, path) != 0) {
+        SCLogWarning(SC_ERR_FWRITE, "renaming reputation store to \"%s\" "
+                "failed: %s", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief Map a store written by SRepStoreWrite()
+ *
+ *  \retval s store or NULL if the file is missing or not a valid store
+ */
+static SRepStore *SRepStoreMap(const char *path) {
+    struct stat st;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SRepStoreHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return NULL;
+
+    SRepStore *s = SCMalloc(sizeof(SRepStore));
+    if (s == NULL) {
+        munmap(data, (size_t)st.st_size);
+        return NULL;
+    }
+    memset(s, 0x00, sizeof(*s));
+    if (SRepStoreSetup(s, data, (uint64_t)st.st_size) < 0) {
+        SCLogWarning(SC_ERR_NO_REPUTATION, "\"%s\" is not a valid reputation "
+                "store, rebuilding it", path);
+        munmap(data, (size_t)st.st_size);
+        SCFree(s);
+        return NULL;
+    }
+    s->mapped = 1;
+    return s;
+}
+
+/** \brief Free a reputation store */
+void SRepStoreFree(SRepStore *s) {
+    if (s == NULL)
+        return;
+
+    if (s->mapped)
+        munmap(s->data, s->len);
+    else
+        SCFree(s->data);
+    SCFree(s);
+}
+
+/** \brief Get the reputation of an address for a category
+ *
+ *  Lock free, the store is read only once it's set up.
+ *
+ *  \retval value reputation value, 0 if the address has none
+ */
+uint8_t SRepStoreLookup(const SRepStore *s, const Address *a, uint8_t cat) {
+    uint32_t lo = 0, hi, off;
+
+    if (s == NULL)
+        return 0;
+
+    if (a->family == AF_INET) {
+        uint32_t ip = ntohl(a->addr_data32[0]);
+        hi = s->ipv4_cnt;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (s->ipv4[mid] < ip)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == s->ipv4_cnt || s->ipv4[lo] != ip)
+            return 0;
+        off = s->ipv4_vec[lo];
+    } else if (a->family == AF_INET6) {
+        hi = s->ipv6_cnt;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (memcmp(s->ipv6[mid], a->addr_data8, 16) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == s->ipv6_cnt || memcmp(s->ipv6[lo], a->addr_data8, 16) != 0)
+            return 0;
+        off = s->ipv6_vec[lo];
+    } else {
+        return 0;
+    }
+
+    const uint8_t *v = s->vec + off;
+    uint8_t i;
+    for (i = 0; i < v[0]; i++) {
+        if (v[1 + 2 * i] == cat)
+            return v[2 + 2 * i];
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief Check if a store mapped from path was built from the reputation
+ *         files as they are now
+ *
+ *  The files have to be the ones the store was built from, in the same
+ *  order, with the same size and mtime. So removing, reordering or
+ *  replacing a file, even by one with an older mtime, makes the store
+ *  stale. A file changed in the second the store was written in can't
+ *  be told apart by its mtime, so it makes the store stale as well.
+ */
+static int SRepStoreIsCurrent(const SRepStore *s, const char *path, ConfNode *files) {
+    struct stat st, fst;
+    ConfNode *file = NULL;
+    uint32_t off = 0, cnt = 0;
+
+    if (stat(path, &st) != 0)
+        return 0;
+
+    TAILQ_FOREACH(file, &files->head, next) {
+        const SRepStoreSource *src = SRepStoreNextSource(s->src, s->src_size, &off);
+        if (src == NULL)
+            return 0;
+        cnt++;
+
+        char *sfile = SRepCompleteFilePath(file->val);
+        if (sfile == NULL)
+            return 0;
+        int r = stat(sfile, &fst);
+        int same = (strcmp(sfile, (const char *)src + sizeof(SRepStoreSource)) == 0);
+        SCFree(sfile);
+        if (r != 0 || !same || (uint64_t)fst.st_size != src->size ||
+            (int64_t)fst.st_mtime != src->mtime || fst.st_mtime >= st.st_mtime)
+            return 0;
+    }
+    return (cnt == s->src_cnt);
+}
+
 /** \brief init reputation
  *
- *  \param de_ctx detection engine ctx for tracking iprep version
+ *  \param de_ctx detection engine ctx the reputation store is set up in
  *
  *  \retval 0 ok
  *  \retval -1 error
  *
  *  If this function is called more than once, the category file
  *  is not reloaded.
+ *
+ *  The reputation files are compiled into a read only store owned by
+ *  de_ctx, so a rule reload swaps it together with the detect engine.
+ *  With reputation-store-file set, the store is written to that file and
+ *  mapped from it as long as the reputation files are the ones it was
+ *  built from, see SRepStoreIsCurrent().
  */
 int SRepInit(DetectEngineCtx *de_ctx) {
+    static int srep_cats_loaded = 0;
     ConfNode *files;
     ConfNode *file = NULL;
     int r = 0;
     char *sfile = NULL;
     char *filename = NULL;
-    int init = 0;
-
-    if (SRepGetVersion() == 0) {
-        SC_ATOMIC_INIT(srep_eversion);
-        init = 1;
-    }
+    char *store_file = NULL;
+    char *store_path = NULL;
+    int complete = 1;
+    SRepBuild b;
 
     /* if both settings are missing, we assume the user doesn't want ip rep */
     (void)ConfGet("reputation-categories-file", &filename);
@@ -465,7 +1008,7 @@ int SRepInit(DetectEngineCtx *de_ctx) {
         return -1;
     }
 
-    if (init) {
+    if (!srep_cats_loaded) {
         if (filename == NULL) {
             SCLogError(SC_ERR_NO_REPUTATION, "\"reputation-categories-file\" not set");
             return -1;
@@ -478,34 +1021,73 @@ int SRepInit(DetectEngineCtx *de_ctx) {
                     "categories file %s", filename);
             return -1;
         }
+        srep_cats_loaded = 1;
     }
 
-    de_ctx->srep_version = SRepIncrVersion();
-    SCLogDebug("Reputation version %u", de_ctx->srep_version);
+    if (ConfGet("reputation-store-file", &store_file) == 1 && store_file != NULL) {
+        store_path = SRepCompleteFilePath(store_file);
+        if (store_path != NULL)
+            de_ctx->srep = SRepStoreMap(store_path);
+        if (de_ctx->srep != NULL) {
+            if (SRepStoreIsCurrent(de_ctx->srep, store_path, files)) {
+                SCLogInfo("Mapped reputation store %s", store_path);
+                goto done;
+            }
+            SCLogInfo("Reputation store %s is out of date, rebuilding it",
+                    store_path);
+            SRepStoreFree(de_ctx->srep);
+            de_ctx->srep = NULL;
+        }
+    }
+
+    memset(&b, 0x00, sizeof(b));
 
     /* ok, let's load signature files from the general config */
-    if (files != NULL) {
-        TAILQ_FOREACH(file, &files->head, next) {
-            sfile = SRepCompleteFilePath(file->val);
-            SCLogInfo("Loading reputation file: %s", sfile);
-
-            r = SRepLoadFile(sfile);
-            if (r < 0){
-                if (de_ctx->failure_fatal == 1) {
-                    exit(EXIT_FAILURE);
-                }
+    TAILQ_FOREACH(file, &files->head, next) {
+        sfile = SRepCompleteFilePath(file->val);
+        if (sfile == NULL) {
+            complete = 0;
+            continue;
+        }
+        SCLogInfo("Loading reputation file: %s", sfile);
+
+        /* stat before loading, so a change while loading makes the
+         * store stale */
+        struct stat st;
+        if (stat(sfile, &st) != 0 || SRepBuildAddSource(&b, sfile, &st) < 0)
+            complete = 0;
+
+        r = SRepLoadFile(&b, sfile);
+        if (r < 0){
+            complete = 0;
+            if (de_ctx->failure_fatal == 1) {
+                exit(EXIT_FAILURE);
             }
-            SCFree(sfile);
         }
+        SCFree(sfile);
     }
 
-    /* Set effective rep version.
-     * On live reload we will handle this after de_ctx has been swapped */
-    if (init) {
-        SRepInitComplete();
+    de_ctx->srep = SRepBuildStore(&b);
+    SRepBuildFree(&b);
+    if (de_ctx->srep == NULL) {
+        SCLogError(SC_ERR_NO_REPUTATION, "failed to build the reputation store");
+        if (store_path != NULL)
+            SCFree(store_path);
+        return -1;
     }
 
-    HostPrintStats();
+    /* a store missing a file would be taken as current once the file is
+     * back, so only write it if all files were loaded */
+    if (store_path != NULL && complete &&
+        SRepStoreWrite(de_ctx->srep, store_path) == 0)
+        SCLogInfo("Wrote reputation store %s", store_path);
+
+done:
+    SCLogInfo("IP reputation: %"PRIu32" IPv4 and %"PRIu32" IPv6 addresses, "
+            "%"PRIuMAX" bytes", de_ctx->srep->ipv4_cnt, de_ctx->srep->ipv6_cnt,
+            (uintmax_t)de_ctx->srep->len);
+    if (store_path != NULL)
+        SCFree(store_path);
     return 0;
 }
 
@@ -513,14 +1095,17 @@ int SRepInit(DetectEngineCtx *de_ctx) {
 static int SRepTest01(void) {
     char str[] = "1.2.3.4,1,2";
 
-    uint32_t ip = 0;
+    Address ip;
     uint8_t cat = 0, value = 0;
     if (SRepSplitLine(str, &ip, &cat, &value) != 0) {
         return 0;
     }
 
     char ipstr[16];
-    PrintInet(AF_INET, (const void *)&ip, ipstr, sizeof(ipstr));
+    PrintInet(AF_INET, (const void *)&ip.addr_data32[0], ipstr, sizeof(ipstr));
+
+    if (ip.family != AF_INET)
+        return 0;
 
     if (strcmp(ipstr, "1.2.3.4") != 0)
         return 0;
@@ -537,7 +1122,7 @@ static int SRepTest01(void) {
 static int SRepTest02(void) {
     char str[] = "1.1.1.1,";
 
-    uint32_t ip = 0;
+    Address ip;
     uint8_t cat = 0, value = 0;
     if (SRepSplitLine(str, &ip, &cat, &value) == 0) {
         return 0;
@@ -570,6 +1155,227 @@ static int SRepTest03(void) {
 }
 
 
+static int SRepTest04(void) {
+    char str[] = "2001:db8::1,3,127";
+
+    Address ip;
+    uint8_t cat = 0, value = 0;
+    if (SRepSplitLine(str, &ip, &cat, &value) != 0) {
+        return 0;
+    }
+
+    char ipstr[46];
+    PrintInet(AF_INET6, (const void *)ip.addr_data8, ipstr, sizeof(ipstr));
+
+    if (ip.family != AF_INET6 || strcmp(ipstr, "2001:0db8:0000:0000:0000:0000:0000:0001") != 0) {
+        printf("%s: ", ipstr);
+        return 0;
+    }
+
+    if (cat != 3 || value != 127)
+        return 0;
+
+    return 1;
+}
+
+static int SRepTest05Check(const SRepStore *s) {
+    Address a;
+
+    memset(&a, 0x00, sizeof(a));
+    a.family = AF_INET;
+    inet_pton(AF_INET, "1.2.3.4", &a.addr_data32[0]);
+    if (SRepStoreLookup(s, &a, 1) != 20 || SRepStoreLookup(s, &a, 2) != 3 ||
+        SRepStoreLookup(s, &a, 4) != 0)
+        return 0;
+
+    /* value 0 on the last line removed it */
+    inet_pton(AF_INET, "10.0.0.1", &a.addr_data32[0]);
+    if (SRepStoreLookup(s, &a, 1) != 0)
+        return 0;
+
+    inet_pton(AF_INET, "255.255.255.255", &a.addr_data32[0]);
+    if (SRepStoreLookup(s, &a, 2) != 3)
+        return 0;
+
+    inet_pton(AF_INET, "1.2.3.5", &a.addr_data32[0]);
+    if (SRepStoreLookup(s, &a, 1) != 0)
+        return 0;
+
+    memset(&a, 0x00, sizeof(a));
+    a.family = AF_INET6;
+    inet_pton(AF_INET6, "2001:db8::1", a.addr_data8);
+    if (SRepStoreLookup(s, &a, 1) != 5)
+        return 0;
+    inet_pton(AF_INET6, "2001:db8::2", a.addr_data8);
+    if (SRepStoreLookup(s, &a, 1) != 0)
+        return 0;
+
+    return (s->ipv4_cnt == 2 && s->ipv6_cnt == 1);
+}
+
+/** \test store built from lines, lookups and a write/map round trip */
+static int SRepTest05(void) {
+    char *lines[] = { "1.2.3.4,1,10", "255.255.255.255,2,3", "10.0.0.1,1,7",
+                      "2001:db8::1,1,5", "1.2.3.4,2,3", "1.2.3.4,1,20",
+                      "10.0.0.1,1,0", NULL };
+    char dir[] = "/tmp/srep-test.XXXXXX";
+    char path[PATH_MAX];
+    SRepBuild b;
+    SRepStore *s = NULL, *m = NULL;
+    int result = 0;
+    int i;
+
+    memset(&b, 0x00, sizeof(b));
+    for (i = 0; lines[i] != NULL; i++) {
+        char str[64];
+        Address a;
+        uint8_t cat = 0, value = 0;
+
+        strlcpy(str, lines[i], sizeof(str));
+        if (SRepSplitLine(str, &a, &cat, &value) != 0 ||
+            SRepBuildAdd(&b, &a, cat, value) != 0)
+            goto end;
+    }
+
+    s = SRepBuildStore(&b);
+    if (s == NULL || SRepTest05Check(s) == 0)
+        goto end;
+
+    if (mkdtemp(dir) == NULL)
+        goto end;
+    snprintf(path, sizeof(path), "%s/store", dir);
+    if (SRepStoreWrite(s, path) != 0)
+        goto cleanup;
+    m = SRepStoreMap(path);
+    if (m == NULL || !m->mapped || SRepTest05Check(m) == 0)
+        goto cleanup;
+
+    /* a truncated store is not used */
+    if (truncate(path, (off_t)(s->len - 1)) != 0 || SRepStoreMap(path) != NULL)
+        goto cleanup;
+
+    result = 1;
+cleanup:
+    unlink(path);
+    rmdir(dir);
+end:
+    SRepBuildFree(&b);
+    SRepStoreFree(s);
+    SRepStoreFree(m);
+    return result;
+}
+
+/** \internal
+ *  \brief write a reputation file with an mtime in the past */
+static int SRepTest06WriteFile(const char *path, const char *data, time_t mtime) {
+    struct timeval tv[2];
+
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fputs(data, fp);
+    fclose(fp);
+
+    memset(tv, 0x00, sizeof(tv));
+    tv[0].tv_sec = tv[1].tv_sec = mtime;
+    return utimes(path, tv);
+}
+
+/** \internal
+ *  \brief set up a reputation-files list of the given paths */
+static ConfNode *SRepTest06Files(char *a, char *b) {
+    ConfNode *files = ConfNodeNew();
+    if (files == NULL)
+        return NULL;
+
+    char *paths[] = { a, b };
+    int i;
+    for (i = 0; i < 2; i++) {
+        if (paths[i] == NULL)
+            continue;
+        ConfNode *file = ConfNodeNew();
+        if (file == NULL) {
+            ConfNodeFree(files);
+            return NULL;
+        }
+        file->val = SCStrdup(paths[i]);
+        TAILQ_INSERT_TAIL(&files->head, file, next);
+    }
+    return files;
+}
+
+/** \test a store is stale once its files are removed, reordered or
+ *        replaced, even by one with an older mtime */
+static int SRepTest06(void) {
+    char dir[] = "/tmp/srep-test.XXXXXX";
+    char path[PATH_MAX], a[PATH_MAX], b[PATH_MAX];
+    time_t now = time(NULL);
+    SRepBuild build;
+    SRepStore *s = NULL, *m = NULL;
+    ConfNode *files = NULL;
+    struct stat st;
+    int result = 0;
+
+    memset(&build, 0x00, sizeof(build));
+    if (mkdtemp(dir) == NULL)
+        goto end;
+    snprintf(path, sizeof(path), "%s/store", dir);
+    snprintf(a, sizeof(a), "%s/a.list", dir);
+    snprintf(b, sizeof(b), "%s/b.list", dir);
+
+    if (SRepTest06WriteFile(a, "1.2.3.4,1,10\n", now - 100) != 0 ||
+        SRepTest06WriteFile(b, "1.2.3.5,1,10\n", now - 100) != 0)
+        goto cleanup;
+    if (stat(a, &st) != 0 || SRepBuildAddSource(&build, a, &st) != 0 ||
+        stat(b, &st) != 0 || SRepBuildAddSource(&build, b, &st) != 0)
+        goto cleanup;
+
+    s = SRepBuildStore(&build);
+    if (s == NULL || SRepStoreWrite(s, path) != 0)
+        goto cleanup;
+    m = SRepStoreMap(path);
+    if (m == NULL || m->src_cnt != 2)
+        goto cleanup;
+
+    files = SRepTest06Files(a, b);
+    if (files == NULL || SRepStoreIsCurrent(m, path, files) != 1)
+        goto cleanup;
+    ConfNodeFree(files);
+
+    /* reordered */
+    files = SRepTest06Files(b, a);
+    if (files == NULL || SRepStoreIsCurrent(m, path, files) != 0)
+        goto cleanup;
+    ConfNodeFree(files);
+
+    /* removed */
+    files = SRepTest06Files(a, NULL);
+    if (files == NULL || SRepStoreIsCurrent(m, path, files) != 0)
+        goto cleanup;
+    ConfNodeFree(files);
+
+    /* replaced by an older file */
+    files = SRepTest06Files(a, b);
+    if (files == NULL ||
+        SRepTest06WriteFile(b, "1.2.3.6,1,10\n", now - 200) != 0 ||
+        SRepStoreIsCurrent(m, path, files) != 0)
+        goto cleanup;
+
+    result = 1;
+cleanup:
+    if (files != NULL)
+        ConfNodeFree(files);
+    unlink(a);
+    unlink(b);
+    unlink(path);
+    rmdir(dir);
+end:
+    SRepBuildFree(&build);
+    SRepStoreFree(s);
+    SRepStoreFree(m);
+    return result;
+}
+
 #endif
 
 /** Global trees that hold host reputation for IPV4 and IPV6 hosts */
@@ -2002,6 +2808,9 @@ void SCReputationRegisterTests(void)
     UtRegisterTest("SRepTest01", SRepTest01, 1);
     UtRegisterTest("SRepTest02", SRepTest02, 1);
     UtRegisterTest("SRepTest03", SRepTest03, 1);
+    UtRegisterTest("SRepTest04", SRepTest04, 1);
+    UtRegisterTest("SRepTest05", SRepTest05, 1);
+    UtRegisterTest("SRepTest06", SRepTest06, 1);
 #endif /* UNITTESTS */
 }
 
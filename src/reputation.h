@@ -27,18 +27,37 @@
 #define __REPUTATION_H__
 
 #include "detect.h"
-#include "host.h"
 
 #define SREP_MAX_CATS 60
-typedef struct SReputation_ {
-    uint32_t version;
-    uint8_t rep[SREP_MAX_CATS];
-} SReputation;
+
+/** \brief Read only reputation store, owned by a detect engine ctx
+ *
+ *  Sorted address arrays, each address pointing to a vector of the
+ *  category/value pairs it has a reputation for. */
+typedef struct SRepStore_ {
+    const uint32_t *ipv4;
+    const uint32_t *ipv4_vec;
+    uint32_t ipv4_cnt;
+    const uint8_t (*ipv6)[16];
+    const uint32_t *ipv6_vec;
+    uint32_t ipv6_cnt;
+    const uint8_t *vec;
+    uint32_t vec_size;
+    /** reputation files the store was built from */
+    const uint8_t *src;
+    uint32_t src_cnt;
+    uint32_t src_size;
+
+    /** store data, mapped from the store file or on the heap */
+    void *data;
+    size_t len;
+    int mapped;
+} SRepStore;
 
 uint8_t SRepCatGetByShortname(char *shortname);
 int SRepInit(DetectEngineCtx *de_ctx);
-void SRepReloadComplete(void);
-int SRepHostTimedOut(Host *);
+uint8_t SRepStoreLookup(const SRepStore *s, const Address *a, uint8_t cat);
+void SRepStoreFree(SRepStore *s);
 
 /** Reputation numbers (types) that we can use to lookup/update, etc
  *  Please, dont convert this to a enum since we want the same reputation
@@ -142,6 +142,8 @@ void *ParseAFPConfig(const char *iface)
     aconf->bpf_filter = NULL;
     aconf->out_iface = NULL;
     aconf->copy_mode = AFP_COPY_MODE_NONE;
+    aconf->block_size = AFP_BLOCK_SIZE_DEFAULT;
+    aconf->block_timeout = AFP_BLOCK_TIMEOUT_DEFAULT;
 
     if (ConfGet("bpf-filter", &bpf_filter) == 1) {
         if (strlen(bpf_filter) > 0) {
@@ -198,6 +200,17 @@ void *ParseAFPConfig(const char *iface)
                 aconf->iface);
         aconf->flags |= AFP_RING_MODE;
     }
+    (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "tpacket-v3", (int *)&boolval);
+    if (boolval) {
+        if (aconf->flags & AFP_RING_MODE) {
+            SCLogInfo("Enabling tpacket v3 capture on iface %s",
+                    aconf->iface);
+            aconf->flags |= AFP_TPACKET_V3;
+        } else {
+            SCLogInfo("tpacket-v3 activated but use-mmap "
+                      "set to no. Disabling feature");
+        }
+    }
     (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "use-emergency-flush", (int *)&boolval);
     if (boolval) {
         SCLogInfo("Enabling ring emergency flush on iface %s",
@@ -303,6 +316,19 @@ void *ParseAFPConfig(const char *iface)
         aconf->ring_size = max_pending_packets * 2 / aconf->threads;
     }
 
+    if ((ConfGetChildValueIntWithDefault(if_root, if_default, "block-size", &value)) == 1) {
+        if (value % getpagesize() != 0) {
+            SCLogWarning(SC_ERR_INVALID_VALUE, "block-size %"PRIdMAX" is not a "
+                         "multiple of the page size, using default value %d",
+                         value, AFP_BLOCK_SIZE_DEFAULT);
+        } else {
+            aconf->block_size = value;
+        }
+    }
+    if ((ConfGetChildValueIntWithDefault(if_root, if_default, "block-timeout", &value)) == 1) {
+        aconf->block_timeout = value;
+    }
+
     (void)ConfGetChildValueBoolWithDefault(if_root, if_default, "disable-promisc", (int *)&boolval);
     if (boolval) {
         SCLogInfo("Disabling promiscuous mode on iface %s",
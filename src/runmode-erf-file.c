@@ -172,7 +172,7 @@ int RunModeErfFileAutoFp(DetectEngineCtx *de_ctx)
     ThreadVars *tv =
         TmThreadCreatePacketHandler("ReceiveErfFile",
                                     "packetpool", "packetpool",
-                                    queues, "flow",
+                                    queues, RunmodeAutoFpGetQueueHandler(),
                                     "pktacqloop");
     SCFree(queues);
 
@@ -220,7 +220,7 @@ int RunModeErfFileAutoFp(DetectEngineCtx *de_ctx)
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(thread_name,
-                                        qname, "flow",
+                                        qname, RunmodeAutoFpGetQueueHandler(),
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
@@ -24,6 +24,7 @@
 #include "output.h"
 #include "source-pfring.h"
 #include "detect-engine-mpm.h"
+#include "source-pcap-file.h"
 
 #include "alert-fastlog.h"
 #include "alert-prelude.h"
@@ -34,6 +35,7 @@
 #include "util-time.h"
 #include "util-cpu.h"
 #include "util-affinity.h"
+#include "util-byte.h"
 
 #include "util-runmodes.h"
 
@@ -60,10 +62,30 @@ void RunModeFilePcapRegister(void)
                               "the same flow can be processed by any detect "
                               "thread",
                               RunModeFilePcapAutoFp);
+    RunModeRegisterNewRunMode(RUNMODE_PCAP_FILE, "multi",
+                              "Multi reader pcap file mode. A directory of "
+                              "pcap files is split into time ordered shards "
+                              "that are read in parallel, each by a worker "
+                              "thread with a flow time of its own",
+                              RunModeFilePcapMulti);
 
     return;
 }
 
+/** \internal
+ *  \brief Check pcap-file.mmap, to read the files with the mmap reader
+ *         instead of libpcap */
+static uint8_t RunModeFilePcapGetMmap(void)
+{
+    int use_mmap = 0;
+
+    if (ConfGetBool("pcap-file.mmap", &use_mmap) != 1)
+        return 0;
+    if (use_mmap)
+        SCLogInfo("reading pcap files with the mmap reader");
+    return use_mmap ? 1 : 0;
+}
+
 /**
  * \brief Single thread version of the Pcap file processing.
  */
@@ -93,7 +115,13 @@ int RunModeFilePcapSingle(DetectEngineCtx *de_ctx)
         SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName failed for ReceivePcap");
         exit(EXIT_FAILURE);
     }
-    TmSlotSetFuncAppend(tv, tm_module, file);
+    PcapFileShard *shard = PcapFileShardNew(file);
+    if (shard == NULL) {
+        SCLogError(SC_ERR_RUNMODE, "pcap file setup failed");
+        exit(EXIT_FAILURE);
+    }
+    shard->mmap = RunModeFilePcapGetMmap();
+    TmSlotSetFuncAppend(tv, tm_module, shard);
 
     tm_module = TmModuleGetByName("DecodePcapFile");
     if (tm_module == NULL) {
@@ -187,7 +215,13 @@ int RunModeFilePcapAuto(DetectEngineCtx *de_ctx)
         SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName failed for ReceivePcap");
         exit(EXIT_FAILURE);
     }
-    TmSlotSetFuncAppend(tv_receivepcap, tm_module, file);
+    PcapFileShard *shard = PcapFileShardNew(file);
+    if (shard == NULL) {
+        SCLogError(SC_ERR_RUNMODE, "pcap file setup failed");
+        exit(EXIT_FAILURE);
+    }
+    shard->mmap = RunModeFilePcapGetMmap();
+    TmSlotSetFuncAppend(tv_receivepcap, tm_module, shard);
 
     tm_module = TmModuleGetByName("DecodePcapFile");
     if (tm_module == NULL) {
@@ -353,7 +387,7 @@ int RunModeFilePcapAutoFp(DetectEngineCtx *de_ctx)
     ThreadVars *tv_receivepcap =
         TmThreadCreatePacketHandler("ReceivePcapFile",
                                     "packetpool", "packetpool",
-                                    queues, "flow",
+                                    queues, RunmodeAutoFpGetQueueHandler(),
                                     "pktacqloop");
     SCFree(queues);
 
@@ -366,7 +400,13 @@ int RunModeFilePcapAutoFp(DetectEngineCtx *de_ctx)
         SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName failed for ReceivePcap");
         exit(EXIT_FAILURE);
     }
-    TmSlotSetFuncAppend(tv_receivepcap, tm_module, file);
+    PcapFileShard *shard = PcapFileShardNew(file);
+    if (shard == NULL) {
+        SCLogError(SC_ERR_RUNMODE, "pcap file setup failed");
+        exit(EXIT_FAILURE);
+    }
+    shard->mmap = RunModeFilePcapGetMmap();
+    TmSlotSetFuncAppend(tv_receivepcap, tm_module, shard);
 
     tm_module = TmModuleGetByName("DecodePcapFile");
     if (tm_module == NULL) {
@@ -397,7 +437,7 @@ int RunModeFilePcapAutoFp(DetectEngineCtx *de_ctx)
 
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(thread_name,
-                                        qname, "flow",
+                                        qname, RunmodeAutoFpGetQueueHandler(),
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
@@ -445,3 +485,138 @@ int RunModeFilePcapAutoFp(DetectEngineCtx *de_ctx)
 
     return 0;
 }
+
+/** \internal
+ *  \brief Get the number of pcap readers from pcap-file.readers
+ *
+ *  \retval readers "auto" or no setting gives the number of cpus */
+static uint16_t RunModeFilePcapGetReaders(void)
+{
+    char *str = NULL;
+    uint16_t readers = 0;
+
+    if (ConfGet("pcap-file.readers", &str) != 1 || strcmp(str, "auto") == 0) {
+        readers = UtilCpuGetNumProcessorsOnline();
+    } else if (ByteExtractStringUint16(&readers, 10, strlen(str), str) <= 0) {
+        SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "invalid value \"%s\" "
+                "for pcap-file.readers, using 1", str);
+        readers = 1;
+    }
+
+    if (readers == 0)
+        readers = 1;
+    return readers;
+}
+
+/**
+ * \brief RunModeFilePcapMulti set up a worker thread per pcap reader.
+ *
+ *        pcap-file.file is a pcap file or a directory of pcap files. The
+ *        files of a directory are sorted by name and split into
+ *        contiguous shards, one per reader. Each worker reads, decodes,
+ *        streams, inspects and logs the packets of its shard itself, one
+ *        file after the other, so the records of a file are logged in
+ *        the same order on every run. The readers each keep a clock of
+ *        their own (a time domain), so that their flows time out on
+ *        their own packet timestamps and flows of different readers are
+ *        never mixed up. The readers share the outputs, so the records
+ *        of different readers are interleaved in the logs. Eve records
+ *        are tagged with the file they come from, see
+ *        PcapFileGetFilename().
+ *
+ * \param de_ctx Pointer to the Detection Engine
+ *
+ * \retval 0 If all goes well. (If any problem is detected the engine will
+ *           exit()).
+ */
+int RunModeFilePcapMulti(DetectEngineCtx *de_ctx)
+{
+    SCEnter();
+    char tname[TM_THREAD_NAME_MAX];
+    TmModule *tm_module;
+    uint16_t reader;
+
+    RunModeInitialize();
+
+    char *file = NULL;
+    if (ConfGet("pcap-file.file", &file) == 0) {
+        SCLogError(SC_ERR_RUNMODE, "Failed retrieving pcap-file from Conf");
+        exit(EXIT_FAILURE);
+    }
+    SCLogDebug("file %s", file);
+
+    TimeModeSetOffline();
+
+    uint16_t readers = RunModeFilePcapGetReaders();
+    PcapFileShard **shards = PcapFileShardsBuild(file, &readers);
+    if (shards == NULL) {
+        SCLogError(SC_ERR_RUNMODE, "pcap file setup failed");
+        exit(EXIT_FAILURE);
+    }
+    SCLogInfo("reading %s with %"PRIu16" pcap readers", file, readers);
+
+    uint8_t use_mmap = RunModeFilePcapGetMmap();
+
+    for (reader = 0; reader < readers; reader++) {
+        snprintf(tname, sizeof(tname), "RxPcapFile%"PRIu16, reader+1);
+
+        char *thread_name = SCStrdup(tname);
+        if (unlikely(thread_name == NULL)) {
+            SCLogError(SC_ERR_RUNMODE, "failed to strdup thread name");
+            exit(EXIT_FAILURE);
+        }
+
+        ThreadVars *tv = TmThreadCreatePacketHandler(thread_name,
+                                                     "packetpool", "packetpool",
+                                                     "packetpool", "packetpool",
+                                                     "pktacqloop");
+        if (tv == NULL) {
+            SCLogError(SC_ERR_RUNMODE, "threading setup failed");
+            exit(EXIT_FAILURE);
+        }
+
+        tm_module = TmModuleGetByName("ReceivePcapFile");
+        if (tm_module == NULL) {
+            SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName failed for ReceivePcap");
+            exit(EXIT_FAILURE);
+        }
+        shards[reader]->mmap = use_mmap;
+        TmSlotSetFuncAppend(tv, tm_module, shards[reader]);
+
+        tm_module = TmModuleGetByName("DecodePcapFile");
+        if (tm_module == NULL) {
+            SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName DecodePcap failed");
+            exit(EXIT_FAILURE);
+        }
+        TmSlotSetFuncAppend(tv, tm_module, NULL);
+
+        tm_module = TmModuleGetByName("StreamTcp");
+        if (tm_module == NULL) {
+            SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName StreamTcp failed");
+            exit(EXIT_FAILURE);
+        }
+        TmSlotSetFuncAppend(tv, tm_module, NULL);
+
+        if (de_ctx) {
+            tm_module = TmModuleGetByName("Detect");
+            if (tm_module == NULL) {
+                SCLogError(SC_ERR_RUNMODE, "TmModuleGetByName Detect failed");
+                exit(EXIT_FAILURE);
+            }
+            TmSlotSetFuncAppend(tv, tm_module, (void *)de_ctx);
+        }
+
+        SetupOutputs(tv);
+
+        TmThreadSetCPU(tv, DETECT_CPU_SET);
+
+        if (TmThreadSpawn(tv) != TM_ECODE_OK) {
+            SCLogError(SC_ERR_RUNMODE, "TmThreadSpawn failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* the shards are owned by the readers */
+    SCFree(shards);
+    return 0;
+}
@@ -28,6 +28,8 @@
 
 #include "detect-parse.h"
 #include "detect-engine.h"
+#include "detect-engine-prefilter.h"
+#include "detect-engine-build.h"
 #include "detect-engine-address.h"
 #include "detect-engine-proto.h"
 #include "detect-engine-port.h"
@@ -56,6 +58,9 @@
 #include "flow-manager.h"
 #include "flow-var.h"
 #include "flow-bit.h"
+#include "flow-bypass.h"
+#include "flow-wheel.h"
+#include "flow-spare-cache.h"
 #include "pkt-var.h"
 
 #include "host.h"
@@ -103,13 +108,16 @@
 #include "util-memrchr.h"
 
 #include "util-mpm-ac.h"
+#include "util-mpm-cache.h"
 #include "detect-engine-mpm.h"
 
 #include "util-decode-asn1.h"
+#include "source-pcap-file-mmap.h"
 
 #include "conf.h"
 #include "conf-yaml-loader.h"
 #include "tmqh-flow.h"
+#include "tmqh-flow-ring.h"
 #include "defrag.h"
 #include "detect-engine-siggroup.h"
 
@@ -159,6 +167,7 @@ int RunUnittests(int list_unittests, char *regex_arg)
     RegisterAllModules();
 
     DetectEngineRegisterAppInspectionEngines();
+    DetectEngineRegisterPrefilterEngines();
 
     StorageFinalize();
    /* test and initialize the unittesting subsystem */
@@ -182,6 +191,7 @@ int RunUnittests(int list_unittests, char *regex_arg)
     PoolRegisterTests();
     ByteRegisterTests();
     MpmRegisterTests();
+    MpmCacheRegisterTests();
     FlowBitRegisterTests();
     SCPerfRegisterTests();
     DecodePPPRegisterTests();
@@ -210,7 +220,11 @@ int RunUnittests(int list_unittests, char *regex_arg)
     ConfRegisterTests();
     ConfYamlRegisterTests();
     TmqhFlowRegisterTests();
+    TmqhFlowRingRegisterTests();
     FlowRegisterTests();
+    FlowBypassRegisterTests();
+    FlowWheelRegisterTests();
+    FlowSpareCacheRegisterTests();
     SCSigRegisterSignatureOrderingTests();
     SCRadixRegisterTests();
     DefragRegisterTests();
@@ -249,6 +263,8 @@ int RunUnittests(int list_unittests, char *regex_arg)
     DetectEngineHttpHHRegisterTests();
     DetectEngineHttpHRHRegisterTests();
     DetectEngineRegisterTests();
+    DetectEnginePrefilterRegisterTests();
+    DetectBuildRegisterTests();
     SCLogRegisterTests();
     SMTPParserRegisterTests();
     MagicRegisterTests();
@@ -258,6 +274,7 @@ int RunUnittests(int list_unittests, char *regex_arg)
     DetectPortTests();
     SCAtomicRegisterTests();
     MemrchrRegisterTests();
+    PcapFileMmapRegisterTests();
 #ifdef __SC_CUDA_SUPPORT__
     CudaBufferRegisterUnittests();
 #endif
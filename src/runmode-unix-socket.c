@@ -22,6 +22,7 @@
 #include "runmode-pcap-file.h"
 #include "log-httplog.h"
 #include "output.h"
+#include "output-json.h"
 #include "source-pfring.h"
 #include "detect-engine-mpm.h"
 
@@ -40,6 +41,7 @@
 #include "flow-timeout.h"
 #include "stream-tcp.h"
 #include "output.h"
+#include "output-json.h"
 #include "host.h"
 #include "defrag.h"
 
@@ -333,6 +335,7 @@ TmEcode UnixSocketPcapFilesCheck(void *data)
         RunModeDispatch(RUNMODE_PCAP_FILE, NULL, this->de_ctx);
         FlowManagerThreadSpawn();
         SCPerfSpawnThreads();
+        OutputJsonFlushThreadSpawn();
         /* Un-pause all the paused threads */
         TmThreadContinueThreads();
     }
@@ -173,9 +173,28 @@ enum {
 
 union thdr {
     struct tpacket2_hdr *h2;
+#ifdef HAVE_TPACKET_V3
+    struct tpacket3_hdr *h3;
+#endif
     void *raw;
 };
 
+#ifdef HAVE_TPACKET_V3
+/**
+ * \brief A block of a TPACKET_V3 ring.
+ *
+ * In zero copy mode the packets point into the block, so it is only
+ * given back to the kernel once all of them are released.
+ */
+typedef struct AFPBlock_ {
+    struct tpacket_block_desc *pbd;
+    /** seq_num of the block the last time we read it */
+    uint64_t seq_num;
+    /** packets of the block in use, plus one while we read it */
+    SC_ATOMIC_DECLARE(unsigned int, refcnt);
+} AFPBlock;
+#endif
+
 /**
  * \brief Structure to hold thread specific variables.
  */
@@ -222,6 +241,7 @@ typedef struct AFPThreadVars_
     int flags;
     uint16_t capture_kernel_packets;
     uint16_t capture_kernel_drops;
+    uint16_t capture_kernel_ring_full;
 
     int cluster_id;
     int cluster_type;
@@ -237,6 +257,20 @@ typedef struct AFPThreadVars_
     unsigned int frame_offset;
     int ring_size;
 
+    int block_size;
+    int block_timeout;
+#ifdef HAVE_TPACKET_V3
+    struct tpacket_req3 req3;
+    /** blocks of the TPACKET_V3 ring */
+    AFPBlock *blocks;
+    unsigned int block_offset;
+#endif
+    uint64_t blocks_read;
+
+    /** packets read from the ring but not yet passed on */
+    uint16_t batch_cnt;
+    Packet *batch[TM_PKT_BATCH_SIZE];
+
 } AFPThreadVars;
 
 TmEcode ReceiveAFP(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
@@ -246,7 +280,9 @@ TmEcode ReceiveAFPThreadDeinit(ThreadVars *, void *);
 TmEcode ReceiveAFPLoop(ThreadVars *tv, void *data, void *slot);
 
 TmEcode DecodeAFPThreadInit(ThreadVars *, void *, void **);
+TmEcode DecodeAFPThreadDeinit(ThreadVars *, void *);
 TmEcode DecodeAFP(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode DecodeAFPBatch(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 
 TmEcode AFPSetBPFFilter(AFPThreadVars *ptv);
 static int AFPGetIfnumByDev(int fd, const char *ifname, int verbose);
@@ -477,8 +513,9 @@ void TmModuleDecodeAFPRegister (void) {
     tmm_modules[TMM_DECODEAFP].name = "DecodeAFP";
     tmm_modules[TMM_DECODEAFP].ThreadInit = DecodeAFPThreadInit;
     tmm_modules[TMM_DECODEAFP].Func = DecodeAFP;
+    tmm_modules[TMM_DECODEAFP].FuncBatch = DecodeAFPBatch;
     tmm_modules[TMM_DECODEAFP].ThreadExitPrintStats = NULL;
-    tmm_modules[TMM_DECODEAFP].ThreadDeinit = NULL;
+    tmm_modules[TMM_DECODEAFP].ThreadDeinit = DecodeAFPThreadDeinit;
     tmm_modules[TMM_DECODEAFP].RegisterTests = NULL;
     tmm_modules[TMM_DECODEAFP].cap_flags = 0;
     tmm_modules[TMM_DECODEAFP].flags = TM_FLAG_DECODE_TM;
@@ -490,17 +527,34 @@ static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose);
 static inline void AFPDumpCounters(AFPThreadVars *ptv)
 {
 #ifdef PACKET_STATISTICS
-    struct tpacket_stats kstats;
+    /* the v3 stats start with the v2 ones */
+    union {
+        struct tpacket_stats v2;
+#ifdef HAVE_TPACKET_V3
+        struct tpacket_stats_v3 v3;
+#endif
+    } kstats;
     socklen_t len = sizeof (struct tpacket_stats);
+#ifdef HAVE_TPACKET_V3
+    if (ptv->flags & AFP_TPACKET_V3)
+        len = sizeof (struct tpacket_stats_v3);
+#endif
     if (getsockopt(ptv->socket, SOL_PACKET, PACKET_STATISTICS,
                 &kstats, &len) > -1) {
         SCLogDebug("(%s) Kernel: Packets %" PRIu32 ", dropped %" PRIu32 "",
                 ptv->tv->name,
-                kstats.tp_packets, kstats.tp_drops);
-        SCPerfCounterAddUI64(ptv->capture_kernel_packets, ptv->tv->sc_perf_pca, kstats.tp_packets);
-        SCPerfCounterAddUI64(ptv->capture_kernel_drops, ptv->tv->sc_perf_pca, kstats.tp_drops);
-        (void) SC_ATOMIC_ADD(ptv->livedev->drop, (uint64_t) kstats.tp_drops);
-        (void) SC_ATOMIC_ADD(ptv->livedev->pkts, (uint64_t) kstats.tp_packets);
+                kstats.v2.tp_packets, kstats.v2.tp_drops);
+        SCPerfCounterAddUI64(ptv->capture_kernel_packets, ptv->tv->sc_perf_pca, kstats.v2.tp_packets);
+        SCPerfCounterAddUI64(ptv->capture_kernel_drops, ptv->tv->sc_perf_pca, kstats.v2.tp_drops);
+        (void) SC_ATOMIC_ADD(ptv->livedev->drop, (uint64_t) kstats.v2.tp_drops);
+        (void) SC_ATOMIC_ADD(ptv->livedev->pkts, (uint64_t) kstats.v2.tp_packets);
+#ifdef HAVE_TPACKET_V3
+        /* number of times all blocks of the ring were in use */
+        if (ptv->flags & AFP_TPACKET_V3) {
+            SCPerfCounterAddUI64(ptv->capture_kernel_ring_full, ptv->tv->sc_perf_pca,
+                    kstats.v3.tp_freeze_q_cnt);
+        }
+#endif
     }
 #endif
 }
@@ -699,16 +753,94 @@ void AFPReleasePacket(Packet *p)
     PacketFreeOrRelease(p);
 }
 
+#ifdef HAVE_TPACKET_V3
+/**
+ * \brief Drop a reference to a ring block, giving it back to the kernel
+ *        once it is no longer used
+ */
+static inline void AFPBlockDeref(AFPBlock *block)
+{
+    if (SC_ATOMIC_SUB(block->refcnt, 1) == 0) {
+        block->pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    }
+}
+
+static void AFPReleaseDataFromRingV3(Packet *p)
+{
+    /* Need to be in copy mode and need to detect early release
+       where Ethernet header could not be set (and pseudo packet) */
+    if ((p->afp_v.copy_mode != AFP_COPY_MODE_NONE) && !PKT_IS_PSEUDOPKT(p)) {
+        AFPWritePacket(p);
+    }
+
+    /* release the block before the socket: the blocks array is
+     * replaced once the socket is no longer used, see AFPTryReopen */
+    if (p->afp_v.relptr) {
+        AFPBlockDeref((AFPBlock *)p->afp_v.relptr);
+    }
+
+    (void)AFPDerefSocket(p->afp_v.mpeer);
+
+    AFPV_CLEANUP(&p->afp_v);
+}
+
+static void AFPReleasePacketV3(Packet *p)
+{
+    AFPReleaseDataFromRingV3(p);
+    PacketFreeOrRelease(p);
+}
+#endif /* HAVE_TPACKET_V3 */
+
+/**
+ * \brief pass the packets of the batch on to the next slots
+ *
+ * \retval TM_ECODE_FAILED on failure and TM_ECODE_OK on success
+ */
+static inline TmEcode AFPFlushBatch(AFPThreadVars *ptv)
+{
+    uint16_t cnt = ptv->batch_cnt;
+
+    ptv->batch_cnt = 0;
+    return TmThreadsSlotProcessPktBatch(ptv->tv, ptv->slot, ptv->batch, cnt);
+}
+
+/**
+ * \brief Set the checksum flags of a packet read from the ring
+ *
+ * \param tp_status status of the packet's frame
+ */
+static inline void AFPSetChecksumFlags(AFPThreadVars *ptv, Packet *p,
+        uint32_t tp_status)
+{
+    /* We only check for checksum disable */
+    if (ptv->checksum_mode == CHECKSUM_VALIDATION_DISABLE) {
+        p->flags |= PKT_IGNORE_CHECKSUM;
+    } else if (ptv->checksum_mode == CHECKSUM_VALIDATION_AUTO) {
+        if (ptv->livedev->ignore_checksum) {
+            p->flags |= PKT_IGNORE_CHECKSUM;
+        } else if (ChecksumAutoModeCheck(ptv->pkts,
+                    SC_ATOMIC_GET(ptv->livedev->pkts),
+                    SC_ATOMIC_GET(ptv->livedev->invalid_checksums))) {
+            ptv->livedev->ignore_checksum = 1;
+            p->flags |= PKT_IGNORE_CHECKSUM;
+        }
+    } else {
+        if (tp_status & TP_STATUS_CSUMNOTREADY) {
+            p->flags |= PKT_IGNORE_CHECKSUM;
+        }
+    }
+}
+
 /**
  * \brief AF packet read function for ring
  *
- * This function fills
- * From here the packets are picked up by the DecodeAFP thread.
+ * This function fills the batch, and passes it on each time
+ * it is full. AFPReadFromRing passes on the rest.
  *
  * \param user pointer to AFPThreadVars
  * \retval TM_ECODE_FAILED on failure and TM_ECODE_OK on success
  */
-int AFPReadFromRing(AFPThreadVars *ptv)
+static int AFPReadFromRingFrames(AFPThreadVars *ptv)
 {
     Packet *p = NULL;
     union thdr h;
@@ -830,23 +962,7 @@ int AFPReadFromRing(AFPThreadVars *ptv)
         SCLogDebug("pktlen: %" PRIu32 " (pkt %p, pkt data %p)",
                 GET_PKT_LEN(p), p, GET_PKT_DATA(p));
 
-        /* We only check for checksum disable */
-        if (ptv->checksum_mode == CHECKSUM_VALIDATION_DISABLE) {
-            p->flags |= PKT_IGNORE_CHECKSUM;
-        } else if (ptv->checksum_mode == CHECKSUM_VALIDATION_AUTO) {
-            if (ptv->livedev->ignore_checksum) {
-                p->flags |= PKT_IGNORE_CHECKSUM;
-            } else if (ChecksumAutoModeCheck(ptv->pkts,
-                        SC_ATOMIC_GET(ptv->livedev->pkts),
-                        SC_ATOMIC_GET(ptv->livedev->invalid_checksums))) {
-                ptv->livedev->ignore_checksum = 1;
-                p->flags |= PKT_IGNORE_CHECKSUM;
-            }
-        } else {
-            if (h.h2->tp_status & TP_STATUS_CSUMNOTREADY) {
-                p->flags |= PKT_IGNORE_CHECKSUM;
-            }
-        }
+        AFPSetChecksumFlags(ptv, p, h.h2->tp_status);
         if (h.h2->tp_status & TP_STATUS_LOSING) {
             emergency_flush = 1;
             AFPDumpCounters(ptv);
@@ -857,13 +973,16 @@ int AFPReadFromRing(AFPThreadVars *ptv)
             h.h2->tp_status = TP_STATUS_KERNEL;
         }
 
-        if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
-            h.h2->tp_status = TP_STATUS_KERNEL;
-            if (++ptv->frame_offset >= ptv->req.tp_frame_nr) {
-                ptv->frame_offset = 0;
+        ptv->batch[ptv->batch_cnt++] = p;
+        if (ptv->batch_cnt == TM_PKT_BATCH_SIZE) {
+            /* on failure the packets are returned to the pool, which
+             * releases their frames */
+            if (AFPFlushBatch(ptv) != TM_ECODE_OK) {
+                if (++ptv->frame_offset >= ptv->req.tp_frame_nr) {
+                    ptv->frame_offset = 0;
+                }
+                SCReturnInt(AFP_FAILURE);
             }
-            TmqhOutputPacketpool(ptv->tv, p);
-            SCReturnInt(AFP_FAILURE);
         }
 
 next_frame:
@@ -877,6 +996,191 @@ next_frame:
     SCReturnInt(AFP_READ_OK);
 }
 
+#ifdef HAVE_TPACKET_V3
+/**
+ * \brief Add the packets of a TPACKET_V3 block to the batch
+ *
+ * The batch is passed on each time it is full.
+ *
+ * \retval AFP_READ_OK on success, AFP_FAILURE on failure
+ */
+static int AFPWalkBlock(AFPThreadVars *ptv, AFPBlock *block)
+{
+    struct tpacket_block_desc *pbd = block->pbd;
+    uint32_t num_pkts = pbd->hdr.bh1.num_pkts;
+    uint8_t *ppd = (uint8_t *)pbd + pbd->hdr.bh1.offset_to_first_pkt;
+    uint32_t i;
+
+    for (i = 0; i < num_pkts; i++) {
+        struct tpacket3_hdr *h3 = (struct tpacket3_hdr *)ppd;
+        struct sockaddr_ll *from = (void *)h3 + TPACKET_ALIGN(ptv->tp_hdrlen);
+
+        Packet *p = PacketGetFromQueueOrAlloc();
+        if (p == NULL) {
+            SCReturnInt(AFP_FAILURE);
+        }
+        PKT_SET_SRC(p, PKT_SRC_WIRE);
+
+        ptv->pkts++;
+        ptv->bytes += h3->tp_len;
+        p->livedev = ptv->livedev;
+
+        /* add forged header */
+        if (ptv->cooked) {
+            SllHdr * hdrp = (SllHdr *)ptv->data;
+            /* XXX this is minimalist, but this seems enough */
+            hdrp->sll_protocol = from->sll_protocol;
+        }
+
+        p->datalink = ptv->datalink;
+
+        /* get vlan id from header */
+        if ((!ptv->vlan_disabled) &&
+            (h3->tp_status & TP_STATUS_VLAN_VALID || h3->hv1.tp_vlan_tci)) {
+            p->vlan_id[0] = h3->hv1.tp_vlan_tci;
+            p->vlan_idx = 1;
+            p->vlanh[0] = NULL;
+        }
+
+        if (ptv->flags & AFP_ZERO_COPY) {
+            if (PacketSetData(p, (unsigned char*)h3 + h3->tp_mac, h3->tp_snaplen) == -1) {
+                TmqhOutputPacketpool(ptv->tv, p);
+                SCReturnInt(AFP_FAILURE);
+            }
+            (void)SC_ATOMIC_ADD(block->refcnt, 1);
+            p->afp_v.relptr = block;
+            p->ReleasePacket = AFPReleasePacketV3;
+            p->afp_v.mpeer = ptv->mpeer;
+            AFPRefSocket(ptv->mpeer);
+
+            p->afp_v.copy_mode = ptv->copy_mode;
+            if (p->afp_v.copy_mode != AFP_COPY_MODE_NONE) {
+                p->afp_v.peer = ptv->mpeer->peer;
+            } else {
+                p->afp_v.peer = NULL;
+            }
+        } else {
+            if (PacketCopyData(p, (unsigned char*)h3 + h3->tp_mac, h3->tp_snaplen) == -1) {
+                TmqhOutputPacketpool(ptv->tv, p);
+                SCReturnInt(AFP_FAILURE);
+            }
+        }
+        /* Timestamp */
+        p->ts.tv_sec = h3->tp_sec;
+        p->ts.tv_usec = h3->tp_nsec/1000;
+        SCLogDebug("pktlen: %" PRIu32 " (pkt %p, pkt data %p)",
+                GET_PKT_LEN(p), p, GET_PKT_DATA(p));
+
+        AFPSetChecksumFlags(ptv, p, h3->tp_status);
+
+        ptv->batch[ptv->batch_cnt++] = p;
+        if (ptv->batch_cnt == TM_PKT_BATCH_SIZE) {
+            /* on failure the packets are returned to the pool, which
+             * releases their block references */
+            if (AFPFlushBatch(ptv) != TM_ECODE_OK) {
+                SCReturnInt(AFP_FAILURE);
+            }
+        }
+
+        ppd += h3->tp_next_offset;
+    }
+
+    SCReturnInt(AFP_READ_OK);
+}
+
+/**
+ * \brief AF packet read function for a TPACKET_V3 ring
+ *
+ * Walks the blocks the kernel has handed over, in ring order. A block
+ * is given back once it is read and, in zero copy mode, all its packets
+ * are released.
+ *
+ * \retval AFP_READ_OK, AFP_KERNEL_DROP or AFP_FAILURE
+ */
+static int AFPReadFromRingBlocks(AFPThreadVars *ptv)
+{
+    uint8_t emergency_flush = 0;
+    unsigned int read_blocks = 0;
+
+    while (read_blocks < ptv->req3.tp_block_nr) {
+        if (unlikely(suricata_ctl_flags != 0)) {
+            break;
+        }
+
+        AFPBlock *block = &ptv->blocks[ptv->block_offset];
+        struct tpacket_block_desc *pbd = block->pbd;
+
+        /* not filled yet, or filled and read but still used by some of
+         * its packets */
+        if (!(pbd->hdr.bh1.block_status & TP_STATUS_USER) ||
+                pbd->hdr.bh1.seq_num == block->seq_num) {
+            break;
+        }
+        block->seq_num = pbd->hdr.bh1.seq_num;
+        read_blocks++;
+        /* the block may be reused by the kernel once we're done with it */
+        uint32_t block_status = pbd->hdr.bh1.block_status;
+
+        if (++ptv->block_offset >= ptv->req3.tp_block_nr) {
+            ptv->block_offset = 0;
+        }
+
+        if ((ptv->flags & AFP_EMERGENCY_MODE) && (emergency_flush == 1)) {
+            pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            continue;
+        }
+
+        ptv->blocks_read++;
+
+        /* hold the block while adding its packets */
+        (void)SC_ATOMIC_SET(block->refcnt, 1);
+        int r = AFPWalkBlock(ptv, block);
+        AFPBlockDeref(block);
+        if (r != AFP_READ_OK) {
+            SCReturnInt(r);
+        }
+
+        if (block_status & TP_STATUS_LOSING) {
+            emergency_flush = 1;
+            AFPDumpCounters(ptv);
+        }
+    }
+
+    if ((emergency_flush) && (ptv->flags & AFP_EMERGENCY_MODE)) {
+        SCReturnInt(AFP_KERNEL_DROP);
+    }
+    SCReturnInt(AFP_READ_OK);
+}
+#endif /* HAVE_TPACKET_V3 */
+
+/**
+ * \brief AF packet read function for ring
+ *
+ * Reads the available frames from the ring and passes them on
+ * to the next slots in batches of up to TM_PKT_BATCH_SIZE packets.
+ *
+ * \param user pointer to AFPThreadVars
+ * \retval TM_ECODE_FAILED on failure and TM_ECODE_OK on success
+ */
+int AFPReadFromRing(AFPThreadVars *ptv)
+{
+    int r;
+
+#ifdef HAVE_TPACKET_V3
+    if (ptv->flags & AFP_TPACKET_V3)
+        r = AFPReadFromRingBlocks(ptv);
+    else
+#endif
+        r = AFPReadFromRingFrames(ptv);
+
+    if (ptv->batch_cnt > 0) {
+        if (AFPFlushBatch(ptv) != TM_ECODE_OK)
+            SCReturnInt(AFP_FAILURE);
+    }
+
+    SCReturnInt(r);
+}
+
 /**
  * \brief Reference socket
  *
@@ -1207,13 +1511,214 @@ frame size: TPACKET_ALIGN(snaplen + TPACKET_ALIGN(TPACKET_ALIGN(tp_hdrlen) + siz
     return 1;
 }
 
+/**
+ * \brief Set up the TPACKET_V2 ring of the socket
+ *
+ * \retval 0 on success, -1 on error
+ */
+static int AFPSetupRing(AFPThreadVars *ptv, char *devname)
+{
+    int r;
+    int order;
+    unsigned int i;
+
+    int val = TPACKET_V2;
+    unsigned int len = sizeof(val);
+    if (getsockopt(ptv->socket, SOL_PACKET, PACKET_HDRLEN, &val, &len) < 0) {
+        if (errno == ENOPROTOOPT) {
+            SCLogError(SC_ERR_AFP_CREATE,
+                       "Too old kernel giving up (need 2.6.27 at least)");
+        }
+        SCLogError(SC_ERR_AFP_CREATE, "Error when retrieving packet header len");
+        return -1;
+    }
+    ptv->tp_hdrlen = val;
+
+    val = TPACKET_V2;
+    if (setsockopt(ptv->socket, SOL_PACKET, PACKET_VERSION, &val,
+                sizeof(val)) < 0) {
+        SCLogError(SC_ERR_AFP_CREATE,
+                   "Can't activate TPACKET_V2 on packet socket: %s",
+                   strerror(errno));
+        return -1;
+    }
+
+    if (GetIfaceOffloading(devname) == 1) {
+        SCLogWarning(SC_ERR_AFP_CREATE,
+                     "Using mmap mode with GRO or LRO activated can lead to capture problems");
+    }
+
+    /* Allocate RX ring */
+#define DEFAULT_ORDER 3
+    for (order = DEFAULT_ORDER; order >= 0; order--) {
+        if (AFPComputeRingParams(ptv, order) != 1) {
+            SCLogInfo("Ring parameter are incorrect. Please correct the devel");
+        }
+
+        r = setsockopt(ptv->socket, SOL_PACKET, PACKET_RX_RING, (void *) &ptv->req, sizeof(ptv->req));
+        if (r < 0) {
+            if (errno == ENOMEM) {
+                SCLogInfo("Memory issue with ring parameters. Retrying.");
+                continue;
+            }
+            SCLogError(SC_ERR_MEM_ALLOC,
+                    "Unable to allocate RX Ring for iface %s: (%d) %s",
+                    devname,
+                    errno,
+                    strerror(errno));
+            return -1;
+        } else {
+            break;
+        }
+    }
+
+    if (order < 0) {
+        SCLogError(SC_ERR_MEM_ALLOC,
+                "Unable to allocate RX Ring for iface %s (order 0 failed)",
+                devname);
+        return -1;
+    }
+
+    /* Allocate the Ring */
+    ptv->ring_buflen = ptv->req.tp_block_nr * ptv->req.tp_block_size;
+    ptv->ring_buf = mmap(0, ptv->ring_buflen, PROT_READ|PROT_WRITE,
+            MAP_SHARED, ptv->socket, 0);
+    if (ptv->ring_buf == MAP_FAILED) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to mmap");
+        return -1;
+    }
+    /* allocate a ring for each frame header pointer*/
+    ptv->frame_buf = SCMalloc(ptv->req.tp_frame_nr * sizeof (union thdr *));
+    if (ptv->frame_buf == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate frame buf");
+        return -1;
+    }
+    memset(ptv->frame_buf, 0, ptv->req.tp_frame_nr * sizeof (union thdr *));
+    /* fill the header ring with proper frame ptr*/
+    ptv->frame_offset = 0;
+    for (i = 0; i < ptv->req.tp_block_nr; ++i) {
+        void *base = &ptv->ring_buf[i * ptv->req.tp_block_size];
+        unsigned int j;
+        for (j = 0; j < ptv->req.tp_block_size / ptv->req.tp_frame_size; ++j, ++ptv->frame_offset) {
+            (((union thdr **)ptv->frame_buf)[ptv->frame_offset]) = base;
+            base += ptv->req.tp_frame_size;
+        }
+    }
+    ptv->frame_offset = 0;
+
+    return 0;
+}
+
+#ifdef HAVE_TPACKET_V3
+static int AFPComputeRingParamsV3(AFPThreadVars *ptv)
+{
+    /* frames are of variable size in v3, the frame size is only used to
+     * size the ring so it can hold ring_size full size packets */
+    int snaplen = default_packet_size;
+
+    ptv->req3.tp_frame_size = TPACKET_ALIGN(snaplen +TPACKET_ALIGN(TPACKET_ALIGN(ptv->tp_hdrlen) + sizeof(struct sockaddr_ll) + ETH_HLEN) - ETH_HLEN);
+    ptv->req3.tp_block_size = ptv->block_size;
+    int frames_per_block = ptv->req3.tp_block_size / ptv->req3.tp_frame_size;
+    if (frames_per_block == 0) {
+        SCLogError(SC_ERR_INVALID_VALUE, "block-size %d is too small for a "
+                   "frame of %d bytes", ptv->block_size, ptv->req3.tp_frame_size);
+        return -1;
+    }
+    ptv->req3.tp_block_nr = ptv->ring_size / frames_per_block + 1;
+    ptv->req3.tp_frame_nr = ptv->req3.tp_block_nr * frames_per_block;
+    ptv->req3.tp_retire_blk_tov = ptv->block_timeout;
+    ptv->req3.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    SCLogInfo("AF_PACKET V3 RX Ring params: block_size=%d block_nr=%d frame_size=%d frame_nr=%d block_timeout=%d",
+              ptv->req3.tp_block_size, ptv->req3.tp_block_nr,
+              ptv->req3.tp_frame_size, ptv->req3.tp_frame_nr,
+              ptv->req3.tp_retire_blk_tov);
+    return 1;
+}
+
+/**
+ * \brief Set up the TPACKET_V3 ring of the socket
+ *
+ * \retval 0 on success, -1 on error
+ */
+static int AFPSetupRingV3(AFPThreadVars *ptv, char *devname)
+{
+    int val = TPACKET_V3;
+    unsigned int len = sizeof(val);
+    unsigned int i;
+
+    if (getsockopt(ptv->socket, SOL_PACKET, PACKET_HDRLEN, &val, &len) < 0) {
+        if (errno == ENOPROTOOPT) {
+            SCLogError(SC_ERR_AFP_CREATE,
+                       "Too old kernel giving up (need 3.2 at least for tpacket-v3)");
+        }
+        SCLogError(SC_ERR_AFP_CREATE, "Error when retrieving packet header len");
+        return -1;
+    }
+    ptv->tp_hdrlen = val;
+
+    val = TPACKET_V3;
+    if (setsockopt(ptv->socket, SOL_PACKET, PACKET_VERSION, &val,
+                sizeof(val)) < 0) {
+        SCLogError(SC_ERR_AFP_CREATE,
+                   "Can't activate TPACKET_V3 on packet socket: %s",
+                   strerror(errno));
+        return -1;
+    }
+
+    if (GetIfaceOffloading(devname) == 1) {
+        SCLogWarning(SC_ERR_AFP_CREATE,
+                     "Using mmap mode with GRO or LRO activated can lead to capture problems");
+    }
+
+    /* Allocate RX ring */
+    if (AFPComputeRingParamsV3(ptv) != 1) {
+        return -1;
+    }
+    if (setsockopt(ptv->socket, SOL_PACKET, PACKET_RX_RING,
+                (void *) &ptv->req3, sizeof(ptv->req3)) < 0) {
+        SCLogError(SC_ERR_MEM_ALLOC,
+                "Unable to allocate RX Ring for iface %s: (%d) %s",
+                devname,
+                errno,
+                strerror(errno));
+        return -1;
+    }
+
+    /* Allocate the Ring */
+    ptv->ring_buflen = ptv->req3.tp_block_nr * ptv->req3.tp_block_size;
+    ptv->ring_buf = mmap(0, ptv->ring_buflen, PROT_READ|PROT_WRITE,
+            MAP_SHARED, ptv->socket, 0);
+    if (ptv->ring_buf == MAP_FAILED) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to mmap");
+        return -1;
+    }
+
+    /* no packet of a previous socket is in use anymore, see
+     * AFPTryReopen, so its blocks can go */
+    if (ptv->blocks != NULL) {
+        SCFree(ptv->blocks);
+    }
+    ptv->blocks = SCMalloc(ptv->req3.tp_block_nr * sizeof(AFPBlock));
+    if (ptv->blocks == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate block array");
+        return -1;
+    }
+    for (i = 0; i < ptv->req3.tp_block_nr; ++i) {
+        ptv->blocks[i].pbd = (struct tpacket_block_desc *)
+            &ptv->ring_buf[i * ptv->req3.tp_block_size];
+        ptv->blocks[i].seq_num = 0;
+        SC_ATOMIC_INIT(ptv->blocks[i].refcnt);
+    }
+    ptv->block_offset = 0;
+    return 0;
+}
+#endif /* HAVE_TPACKET_V3 */
+
 static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
 {
     int r;
     struct packet_mreq sock_params;
     struct sockaddr_ll bind_address;
-    int order;
-    unsigned int i;
     int if_idx;
 
     /* open socket */
@@ -1309,89 +1814,14 @@ static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
     }
 
     if (ptv->flags & AFP_RING_MODE) {
-        int val = TPACKET_V2;
-        unsigned int len = sizeof(val);
-        if (getsockopt(ptv->socket, SOL_PACKET, PACKET_HDRLEN, &val, &len) < 0) {
-            if (errno == ENOPROTOOPT) {
-                SCLogError(SC_ERR_AFP_CREATE,
-                           "Too old kernel giving up (need 2.6.27 at least)");
-            }
-            SCLogError(SC_ERR_AFP_CREATE, "Error when retrieving packet header len");
-            goto socket_err;
-        }
-        ptv->tp_hdrlen = val;
-
-        val = TPACKET_V2;
-        if (setsockopt(ptv->socket, SOL_PACKET, PACKET_VERSION, &val,
-                    sizeof(val)) < 0) {
-            SCLogError(SC_ERR_AFP_CREATE,
-                       "Can't activate TPACKET_V2 on packet socket: %s",
-                       strerror(errno));
-            goto socket_err;
-        }
-
-        if (GetIfaceOffloading(devname) == 1) {
-            SCLogWarning(SC_ERR_AFP_CREATE,
-                         "Using mmap mode with GRO or LRO activated can lead to capture problems");
-        }
-
-        /* Allocate RX ring */
-#define DEFAULT_ORDER 3
-        for (order = DEFAULT_ORDER; order >= 0; order--) {
-            if (AFPComputeRingParams(ptv, order) != 1) {
-                SCLogInfo("Ring parameter are incorrect. Please correct the devel");
-            }
-
-            r = setsockopt(ptv->socket, SOL_PACKET, PACKET_RX_RING, (void *) &ptv->req, sizeof(ptv->req));
-            if (r < 0) {
-                if (errno == ENOMEM) {
-                    SCLogInfo("Memory issue with ring parameters. Retrying.");
-                    continue;
-                }
-                SCLogError(SC_ERR_MEM_ALLOC,
-                        "Unable to allocate RX Ring for iface %s: (%d) %s",
-                        devname,
-                        errno,
-                        strerror(errno));
-                goto socket_err;
-            } else {
-                break;
-            }
-        }
-
-        if (order < 0) {
-            SCLogError(SC_ERR_MEM_ALLOC,
-                    "Unable to allocate RX Ring for iface %s (order 0 failed)",
-                    devname);
-            goto socket_err;
-        }
-
-        /* Allocate the Ring */
-        ptv->ring_buflen = ptv->req.tp_block_nr * ptv->req.tp_block_size;
-        ptv->ring_buf = mmap(0, ptv->ring_buflen, PROT_READ|PROT_WRITE,
-                MAP_SHARED, ptv->socket, 0);
-        if (ptv->ring_buf == MAP_FAILED) {
-            SCLogError(SC_ERR_MEM_ALLOC, "Unable to mmap");
+#ifdef HAVE_TPACKET_V3
+        if (ptv->flags & AFP_TPACKET_V3)
+            r = AFPSetupRingV3(ptv, devname);
+        else
+#endif
+            r = AFPSetupRing(ptv, devname);
+        if (r < 0)
             goto socket_err;
-        }
-        /* allocate a ring for each frame header pointer*/
-        ptv->frame_buf = SCMalloc(ptv->req.tp_frame_nr * sizeof (union thdr *));
-        if (ptv->frame_buf == NULL) {
-            SCLogError(SC_ERR_MEM_ALLOC, "Unable to allocate frame buf");
-            goto mmap_err;
-        }
-        memset(ptv->frame_buf, 0, ptv->req.tp_frame_nr * sizeof (union thdr *));
-        /* fill the header ring with proper frame ptr*/
-        ptv->frame_offset = 0;
-        for (i = 0; i < ptv->req.tp_block_nr; ++i) {
-            void *base = &ptv->ring_buf[i * ptv->req.tp_block_size];
-            unsigned int j;
-            for (j = 0; j < ptv->req.tp_block_size / ptv->req.tp_frame_size; ++j, ++ptv->frame_offset) {
-                (((union thdr **)ptv->frame_buf)[ptv->frame_offset]) = base;
-                base += ptv->req.tp_frame_size;
-            }
-        }
-        ptv->frame_offset = 0;
     }
 
     SCLogInfo("Using interface '%s' via socket %d", (char *)devname, ptv->socket);
@@ -1435,7 +1865,6 @@ static int AFPCreateSocket(AFPThreadVars *ptv, char *devname, int verbose)
 frame_err:
     if (ptv->frame_buf)
         SCFree(ptv->frame_buf);
-mmap_err:
     /* Packet mmap does the cleaning when socket is closed */
 socket_err:
     close(ptv->socket);
@@ -1531,6 +1960,8 @@ TmEcode ReceiveAFPThreadInit(ThreadVars *tv, void *initdata, void **data) {
 
     ptv->buffer_size = afpconfig->buffer_size;
     ptv->ring_size = afpconfig->ring_size;
+    ptv->block_size = afpconfig->block_size;
+    ptv->block_timeout = afpconfig->block_timeout;
 
     ptv->promisc = afpconfig->promisc;
     ptv->checksum_mode = afpconfig->checksum_mode;
@@ -1548,6 +1979,13 @@ TmEcode ReceiveAFPThreadInit(ThreadVars *tv, void *initdata, void **data) {
     }
 #endif
     ptv->flags = afpconfig->flags;
+#ifndef HAVE_TPACKET_V3
+    if (ptv->flags & AFP_TPACKET_V3) {
+        SCLogWarning(SC_ERR_NO_AF_PACKET, "tpacket-v3 is not supported by this "
+                     "build, using tpacket v2 on iface %s", ptv->iface);
+        ptv->flags &= ~AFP_TPACKET_V3;
+    }
+#endif
 
     if (afpconfig->bpf_filter) {
         ptv->bpf_filter = afpconfig->bpf_filter;
@@ -1562,6 +2000,12 @@ TmEcode ReceiveAFPThreadInit(ThreadVars *tv, void *initdata, void **data) {
             ptv->tv,
             SC_PERF_TYPE_UINT64,
             "NULL");
+    if (ptv->flags & AFP_TPACKET_V3) {
+        ptv->capture_kernel_ring_full = SCPerfTVRegisterCounter("capture.kernel_ring_full",
+                ptv->tv,
+                SC_PERF_TYPE_UINT64,
+                "NULL");
+    }
 #endif
 
     char *active_runmode = RunmodeGetActive();
@@ -1646,9 +2090,16 @@ void ReceiveAFPThreadExitStats(ThreadVars *tv, void *data) {
             tv->name,
             (uint64_t) SCPerfGetLocalCounterValue(ptv->capture_kernel_packets, tv->sc_perf_pca),
             (uint64_t) SCPerfGetLocalCounterValue(ptv->capture_kernel_drops, tv->sc_perf_pca));
+    if (ptv->flags & AFP_TPACKET_V3) {
+        SCLogInfo("(%s) Kernel: Ring full %" PRIu64 "", tv->name,
+                (uint64_t) SCPerfGetLocalCounterValue(ptv->capture_kernel_ring_full, tv->sc_perf_pca));
+    }
 #endif
 
     SCLogInfo("(%s) Packets %" PRIu64 ", bytes %" PRIu64 "", tv->name, ptv->pkts, ptv->bytes);
+    if (ptv->flags & AFP_TPACKET_V3) {
+        SCLogInfo("(%s) Blocks %" PRIu64 "", tv->name, ptv->blocks_read);
+    }
 }
 
 /**
@@ -1667,6 +2118,13 @@ TmEcode ReceiveAFPThreadDeinit(ThreadVars *tv, void *data) {
     }
     ptv->datalen = 0;
 
+#ifdef HAVE_TPACKET_V3
+    if (ptv->blocks != NULL) {
+        SCFree(ptv->blocks);
+        ptv->blocks = NULL;
+    }
+#endif
+
     ptv->bpf_filter = NULL;
 
     SCReturnInt(TM_ECODE_OK);
@@ -1736,6 +2194,26 @@ TmEcode DecodeAFP(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packet
     SCReturnInt(TM_ECODE_OK);
 }
 
+/**
+ * \brief decode a batch of packets, prefetching the data of the
+ *        next packet while decoding the current one.
+ */
+TmEcode DecodeAFPBatch(ThreadVars *tv, Packet **pkts, uint16_t n, void *data,
+                       PacketQueue *pq, PacketQueue *postpq)
+{
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        if (i + 1 < n)
+            prefetch(GET_PKT_DATA(pkts[i + 1]));
+
+        if (DecodeAFP(tv, pkts[i], data, pq, postpq) == TM_ECODE_FAILED)
+            return TM_ECODE_FAILED;
+    }
+
+    return TM_ECODE_OK;
+}
+
 TmEcode DecodeAFPThreadInit(ThreadVars *tv, void *initdata, void **data)
 {
     SCEnter();
@@ -1758,6 +2236,13 @@ TmEcode DecodeAFPThreadInit(ThreadVars *tv, void *initdata, void **data)
     SCReturnInt(TM_ECODE_OK);
 }
 
+TmEcode DecodeAFPThreadDeinit(ThreadVars *tv, void *data)
+{
+    if (data != NULL)
+        DecodeThreadVarsFree(tv, data);
+    SCReturnInt(TM_ECODE_OK);
+}
+
 #endif /* HAVE_AF_PACKET */
 /* eof */
 /**
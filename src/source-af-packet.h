@@ -43,12 +43,17 @@
 #define AFP_ZERO_COPY (1<<1)
 #define AFP_SOCK_PROTECT (1<<2)
 #define AFP_EMERGENCY_MODE (1<<3)
+#define AFP_TPACKET_V3 (1<<4)
 
 #define AFP_COPY_MODE_NONE  0
 #define AFP_COPY_MODE_TAP   1
 #define AFP_COPY_MODE_IPS   2
 
 #define AFP_FILE_MAX_PKTS 256
+
+/** default TPACKET_V3 block size and timeout in ms */
+#define AFP_BLOCK_SIZE_DEFAULT 32768
+#define AFP_BLOCK_TIMEOUT_DEFAULT 10
 #define AFP_IFACE_NAME_LENGTH 48
 
 typedef struct AFPIfaceConfig_
@@ -60,6 +65,9 @@ typedef struct AFPIfaceConfig_
     int buffer_size;
     /* ring size in number of packets */
     int ring_size;
+    /* TPACKET_V3 block size and timeout (ms) */
+    int block_size;
+    int block_timeout;
     /* cluster param */
     int cluster_id;
     int cluster_type;
@@ -0,0 +1,879 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * mmap based reader for pcap and pcapng files.
+ *
+ * libpcap reads a file through stdio and copies every record into its
+ * own buffer, after which the pcap-file module copies it once more into
+ * the Packet. This reader maps the file instead, and the packets point
+ * straight into the mapping. The kernel is told the mapping is read
+ * sequentially, and the next window is requested ahead of the reader.
+ *
+ * The mapping is private and writable, so code that changes packet data
+ * gets a copy of the page instead of a fault.
+ */
+
+#include "suricata-common.h"
+#include "decode.h"
+#include "source-pcap-file-mmap.h"
+
+#include "util-byte.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+
+#include <sys/mman.h>
+
+#define PCAP_MAGIC          0xa1b2c3d4
+#define PCAP_MAGIC_SWAPPED  0xd4c3b2a1
+#define PCAP_MAGIC_NSEC     0xa1b23c4d
+#define PCAP_MAGIC_NSEC_SWAPPED 0x4d3cb2a1
+
+#define PCAP_FILE_HDR_LEN   24
+#define PCAP_REC_HDR_LEN    16
+
+#define PCAPNG_BLOCK_SHB    0x0a0d0d0a
+#define PCAPNG_BLOCK_IDB    0x00000001
+#define PCAPNG_BLOCK_SPB    0x00000003
+#define PCAPNG_BLOCK_EPB    0x00000006
+#define PCAPNG_BOM          0x1a2b3c4d
+#define PCAPNG_BOM_SWAPPED  0x4d3c2b1a
+#define PCAPNG_OPT_TSRESOL  9
+
+/** linktype of raw ip in files, libpcap maps it to DLT_RAW */
+#define PCAP_LINKTYPE_RAW   101
+
+static inline uint16_t PcapFileMmapU16(const PcapFileMmap *m, const uint8_t *ptr)
+{
+    uint16_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return m->swapped ? SCByteSwap16(v) : v;
+}
+
+static inline uint32_t PcapFileMmapU32(const PcapFileMmap *m, const uint8_t *ptr)
+{
+    uint32_t v;
+    memcpy(&v, ptr, sizeof(v));
+    return m->swapped ? SCByteSwap32(v) : v;
+}
+
+static int PcapFileMmapLinktype(uint32_t linktype)
+{
+    /* the upper bits of the classic header may hold the fcs length */
+    linktype &= 0x03ffffff;
+    if (linktype == PCAP_LINKTYPE_RAW)
+        return DLT_RAW;
+    return (int)linktype;
+}
+
+static void PcapFileMmapTs(uint64_t ts, uint64_t units, struct timeval *tv)
+{
+    uint64_t frac = ts % units;
+
+    tv->tv_sec = (time_t)(ts / units);
+    if (units <= 1000000)
+        tv->tv_usec = (suseconds_t)(frac * 1000000 / units);
+    else if (units % 1000000 == 0)
+        tv->tv_usec = (suseconds_t)(frac / (units / 1000000));
+    else
+        tv->tv_usec = (suseconds_t)((double)frac * 1000000.0 / (double)units);
+}
+
+/** \internal
+ *  \brief Ask the kernel for the next window once the reader gets within
+ *         a window of what was asked for before
+ *
+ *  Windows are a multiple of the page size, so the offsets stay aligned.
+ */
+static inline void PcapFileMmapReadahead(PcapFileMmap *m)
+{
+#ifdef MADV_WILLNEED
+    PcapFileMap *map = m->map;
+
+    if (m->ra_off >= map->len || m->off + PCAP_FILE_MMAP_WINDOW <= m->ra_off)
+        return;
+
+    uint64_t len = map->len - m->ra_off;
+    if (len > PCAP_FILE_MMAP_WINDOW)
+        len = PCAP_FILE_MMAP_WINDOW;
+    (void)madvise(map->data + m->ra_off, (size_t)len, MADV_WILLNEED);
+    m->ra_off += len;
+#endif
+}
+
+void PcapFileMapDeref(PcapFileMap *map)
+{
+    if (SC_ATOMIC_SUB(map->refcnt, 1) == 0) {
+        munmap(map->data, (size_t)map->len);
+        SC_ATOMIC_DESTROY(map->refcnt);
+        SCFree(map);
+    }
+}
+
+/** \internal
+ *  \brief Handle a pcapng interface description block
+ *
+ *  All interfaces of a file need to have the same link type, as the
+ *  file has a single decoder. This includes the interfaces of later
+ *  sections, which are numbered from 0 again.
+ */
+static int PcapFileMmapNgInterface(PcapFileMmap *m, const uint8_t *b, uint32_t blen)
+{
+    if (blen < 20) {
+        snprintf(m->err, sizeof(m->err), "corrupt interface block");
+        return -1;
+    }
+
+    int datalink = PcapFileMmapLinktype(PcapFileMmapU16(m, b + 8));
+    if (m->datalink_set && datalink != m->datalink) {
+        snprintf(m->err, sizeof(m->err), "interfaces with different link "
+                "types (%d, %d) are not supported", m->datalink, datalink);
+        return -1;
+    }
+
+    uint64_t units = 1000000;
+    uint32_t o = 16;
+    while (o + 4 <= blen - 4) {
+        uint16_t code = PcapFileMmapU16(m, b + o);
+        uint16_t olen = PcapFileMmapU16(m, b + o + 2);
+        if (code == 0 || o + 4 + olen > blen - 4)
+            break;
+
+        if (code == PCAPNG_OPT_TSRESOL && olen >= 1) {
+            uint8_t v = b[o + 4];
+            if (v & 0x80) {
+                units = 1ULL << ((v & 0x7f) > 63 ? 63 : (v & 0x7f));
+            } else {
+                uint8_t i;
+                units = 1;
+                for (i = 0; i < v && i < 19; i++)
+                    units *= 10;
+            }
+        }
+        o += 4 + ((olen + 3) & ~3);
+    }
+
+    uint64_t *ptr = SCRealloc(m->if_units, (m->if_cnt + 1) * sizeof(uint64_t));
+    if (unlikely(ptr == NULL)) {
+        snprintf(m->err, sizeof(m->err), "out of memory");
+        return -1;
+    }
+    m->if_units = ptr;
+    m->if_units[m->if_cnt++] = units;
+
+    if (m->if_cnt == 1)
+        m->snaplen = PcapFileMmapU32(m, b + 12);
+    if (!m->datalink_set) {
+        m->datalink = datalink;
+        m->datalink_set = 1;
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief Handle the pcapng block at the current offset
+ *
+ *  \retval 1 packet block, h and pkt are set
+ *  \retval 2 other block, skipped
+ *  \retval 0 end of file
+ *  \retval -1 corrupt file, m->err is set
+ */
+static int PcapFileMmapNgBlock(PcapFileMmap *m, struct pcap_pkthdr *h, uint8_t **pkt)
+{
+    PcapFileMap *map = m->map;
+    uint64_t left = map->len - m->off;
+    uint8_t *b = map->data + m->off;
+
+    if (left == 0)
+        return 0;
+    if (left < 12) {
+        snprintf(m->err, sizeof(m->err), "truncated block at offset %"PRIu64, m->off);
+        return -1;
+    }
+
+    uint32_t type = PcapFileMmapU32(m, b);
+    if (type == PCAPNG_BLOCK_SHB) {
+        /* a section sets its own byte order */
+        uint32_t bom;
+        memcpy(&bom, b + 8, sizeof(bom));
+        if (bom == PCAPNG_BOM) {
+            m->swapped = 0;
+        } else if (bom == PCAPNG_BOM_SWAPPED) {
+            m->swapped = 1;
+        } else {
+            snprintf(m->err, sizeof(m->err), "bad byte order magic");
+            return -1;
+        }
+    }
+
+    uint32_t blen = PcapFileMmapU32(m, b + 4);
+    if (blen < 12 || (blen & 3) != 0 || blen > left) {
+        snprintf(m->err, sizeof(m->err), "corrupt block at offset %"PRIu64, m->off);
+        return -1;
+    }
+
+    int r = 2;
+    uint32_t caplen = 0;
+    switch (type) {
+        case PCAPNG_BLOCK_SHB:
+            /* interfaces are numbered per section */
+            m->if_cnt = 0;
+            break;
+        case PCAPNG_BLOCK_IDB:
+            if (PcapFileMmapNgInterface(m, b, blen) < 0)
+                return -1;
+            break;
+        case PCAPNG_BLOCK_EPB:
+        {
+            if (blen < 32) {
+                snprintf(m->err, sizeof(m->err), "corrupt packet block");
+                return -1;
+            }
+            uint32_t id = PcapFileMmapU32(m, b + 8);
+            if (id >= m->if_cnt) {
+                snprintf(m->err, sizeof(m->err), "packet of unknown interface %"PRIu32, id);
+                return -1;
+            }
+            uint64_t ts = ((uint64_t)PcapFileMmapU32(m, b + 12) << 32) |
+                PcapFileMmapU32(m, b + 16);
+            caplen = PcapFileMmapU32(m, b + 20);
+            if (caplen > blen - 32) {
+                snprintf(m->err, sizeof(m->err), "corrupt packet block");
+                return -1;
+            }
+            PcapFileMmapTs(ts, m->if_units[id], &h->ts);
+            h->len = PcapFileMmapU32(m, b + 24);
+            *pkt = b + 28;
+            r = 1;
+            break;
+        }
+        case PCAPNG_BLOCK_SPB:
+            if (blen < 16 || m->if_cnt == 0) {
+                snprintf(m->err, sizeof(m->err), "corrupt simple packet block");
+                return -1;
+            }
+            h->len = PcapFileMmapU32(m, b + 8);
+            caplen = h->len;
+            if (caplen > blen - 16)
+                caplen = blen - 16;
+            if (m->snaplen != 0 && caplen > m->snaplen)
+                caplen = m->snaplen;
+            /* simple packet blocks have no timestamp */
+            h->ts.tv_sec = 0;
+            h->ts.tv_usec = 0;
+            *pkt = b + 12;
+            r = 1;
+            break;
+        default:
+            break;
+    }
+
+    if (r == 1) {
+        if (caplen > PCAP_FILE_MMAP_MAX_CAPLEN) {
+            snprintf(m->err, sizeof(m->err), "invalid packet capture length "
+                    "%"PRIu32, caplen);
+            return -1;
+        }
+        h->caplen = caplen;
+    }
+    m->off += blen;
+    return r;
+}
+
+/**
+ *  \brief Map a pcap or pcapng file
+ *
+ *  \retval 0 file is mapped and its header is read
+ *  \retval -1 error, m->err is set
+ *  \retval -2 not a file this reader handles, use libpcap instead
+ */
+int PcapFileMmapOpen(PcapFileMmap *m, const char *file)
+{
+    struct stat st;
+
+    memset(m, 0x00, sizeof(*m));
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        snprintf(m->err, sizeof(m->err), "%s: %s", file, strerror(errno));
+        return -1;
+    }
+    /* a file that doesn't fit the address space, e.g. with large file
+     * support on 32 bit, is left to libpcap */
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < PCAP_FILE_HDR_LEN ||
+        (uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+        close(fd);
+        return -2;
+    }
+
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        SCLogDebug("mmap of %s failed: %s", file, strerror(errno));
+        return -2;
+    }
+#ifdef MADV_SEQUENTIAL
+    (void)madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    PcapFileMap *map = SCMalloc(sizeof(PcapFileMap));
+    if (unlikely(map == NULL)) {
+        munmap(addr, (size_t)st.st_size);
+        snprintf(m->err, sizeof(m->err), "out of memory");
+        return -1;
+    }
+    map->data = addr;
+    map->len = (uint64_t)st.st_size;
+    SC_ATOMIC_INIT(map->refcnt);
+    (void) SC_ATOMIC_ADD(map->refcnt, 1);
+    m->map = map;
+
+    uint32_t magic;
+    memcpy(&magic, map->data, sizeof(magic));
+    switch (magic) {
+        case PCAP_MAGIC:
+            m->units = 1000000;
+            break;
+        case PCAP_MAGIC_SWAPPED:
+            m->units = 1000000;
+            m->swapped = 1;
+            break;
+        case PCAP_MAGIC_NSEC:
+            m->units = 1000000000;
+            break;
+        case PCAP_MAGIC_NSEC_SWAPPED:
+            m->units = 1000000000;
+            m->swapped = 1;
+            break;
+        case PCAPNG_BLOCK_SHB:
+            m->ng = 1;
+            break;
+        default:
+            PcapFileMmapClose(m);
+            return -2;
+    }
+
+    if (m->ng) {
+        /* read the section and interface blocks up to the first other
+         * block, so the link type is known */
+        while (map->len - m->off >= 12) {
+            uint32_t type = PcapFileMmapU32(m, map->data + m->off);
+            if (m->off != 0 && type != PCAPNG_BLOCK_SHB && type != PCAPNG_BLOCK_IDB)
+                break;
+
+            struct pcap_pkthdr h;
+            uint8_t *pkt;
+            if (PcapFileMmapNgBlock(m, &h, &pkt) < 0) {
+                PcapFileMmapClose(m);
+                return -1;
+            }
+        }
+        if (m->if_cnt == 0) {
+            snprintf(m->err, sizeof(m->err), "%s: no interface block", file);
+            PcapFileMmapClose(m);
+            return -1;
+        }
+    } else {
+        m->snaplen = PcapFileMmapU32(m, map->data + 16);
+        m->datalink = PcapFileMmapLinktype(PcapFileMmapU32(m, map->data + 20));
+        m->off = PCAP_FILE_HDR_LEN;
+    }
+
+    PcapFileMmapReadahead(m);
+    return 0;
+}
+
+/**
+ *  \brief Get the next packet of a mapped file
+ *
+ *  \param h set to the record's header
+ *  \param pkt set to the record's data in the mapping
+ *
+ *  \retval 1 packet
+ *  \retval 0 end of file
+ *  \retval -1 corrupt or truncated file, m->err is set
+ */
+int PcapFileMmapNext(PcapFileMmap *m, struct pcap_pkthdr *h, uint8_t **pkt)
+{
+    PcapFileMap *map = m->map;
+
+    if (m->ng) {
+        int r;
+        do {
+            r = PcapFileMmapNgBlock(m, h, pkt);
+        } while (r == 2);
+
+        PcapFileMmapReadahead(m);
+        return r;
+    }
+
+    uint64_t left = map->len - m->off;
+    if (left == 0)
+        return 0;
+    if (left < PCAP_REC_HDR_LEN) {
+        snprintf(m->err, sizeof(m->err), "truncated dump file; tried to read "
+                "%u header bytes, only got %"PRIu64, PCAP_REC_HDR_LEN, left);
+        return -1;
+    }
+
+    uint8_t *rec = map->data + m->off;
+    uint32_t caplen = PcapFileMmapU32(m, rec + 8);
+    if (caplen > PCAP_FILE_MMAP_MAX_CAPLEN) {
+        snprintf(m->err, sizeof(m->err), "invalid packet capture length "
+                "%"PRIu32, caplen);
+        return -1;
+    }
+    if (caplen > left - PCAP_REC_HDR_LEN) {
+        snprintf(m->err, sizeof(m->err), "truncated dump file; tried to read "
+                "%"PRIu32" captured bytes, only got %"PRIu64, caplen,
+                left - PCAP_REC_HDR_LEN);
+        return -1;
+    }
+
+    h->ts.tv_sec = PcapFileMmapU32(m, rec);
+    h->ts.tv_usec = PcapFileMmapU32(m, rec + 4);
+    if (m->units == 1000000000)
+        h->ts.tv_usec /= 1000;
+    h->caplen = caplen;
+    h->len = PcapFileMmapU32(m, rec + 12);
+    *pkt = rec + PCAP_REC_HDR_LEN;
+
+    m->off += PCAP_REC_HDR_LEN + caplen;
+    PcapFileMmapReadahead(m);
+    return 1;
+}
+
+/**
+ *  \brief Drop the reader's reference to the mapping
+ *
+ *  The mapping goes once the last packet pointing into it is released.
+ */
+void PcapFileMmapClose(PcapFileMmap *m)
+{
+    if (m->map != NULL) {
+        PcapFileMapDeref(m->map);
+        m->map = NULL;
+    }
+    if (m->if_units != NULL) {
+        SCFree(m->if_units);
+        m->if_units = NULL;
+    }
+    m->if_cnt = 0;
+}
+
+#ifdef UNITTESTS
+
+static int PcapFileMmapTestWrite(const char *name, const uint8_t *buf, size_t len)
+{
+    FILE *fp = fopen(name, "w");
+    if (fp == NULL)
+        return -1;
+    if (fwrite(buf, 1, len, fp) != len) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+/** \test classic pcap in both byte orders and with nsec timestamps,
+ *        the packet data points into the mapping and stays until the
+ *        last packet reference is dropped */
+static int PcapFileMmapTest01(void)
+{
+    char name[] = "/tmp/suricata-pcap-mmap-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    /* little endian, usec, ethernet, 2 records */
+    uint8_t le[] = {
+        0xd4, 0xc3, 0xb2, 0xa1, 0x02, 0x00, 0x04, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xff, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00,
+        /* ts 100.5, caplen 4, len 60 */
+        0x64, 0x00, 0x00, 0x00, 0x20, 0xa1, 0x07, 0x00,
+        0x04, 0x00, 0x00, 0x00, 0x3c, 0x00, 0x00, 0x00,
+        0xde, 0xad, 0xbe, 0xef,
+        /* ts 101.0, caplen 0 */
+        0x65, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    };
+    /* big endian, nsec, raw ip (101), 1 record */
+    uint8_t be[] = {
+        0xa1, 0xb2, 0x3c, 0x4d, 0x00, 0x02, 0x00, 0x04,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x65,
+        /* ts 7.000002500 */
+        0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x09, 0xc4,
+        0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02,
+        0x45, 0x00,
+    };
+    PcapFileMmap m;
+    PcapFileMap *map = NULL;
+    struct pcap_pkthdr h;
+    uint8_t *pkt = NULL;
+    int result = 0;
+
+    /* the arrays are in file order, so one of them is in the byte
+     * order of the host and the other one is swapped */
+    if (PcapFileMmapTestWrite(name, le, sizeof(le)) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (m.datalink != DLT_EN10MB || m.snaplen != 65535 || m.units != 1000000)
+        goto close;
+
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1)
+        goto close;
+    if (h.ts.tv_sec != 100 || h.ts.tv_usec != 500000 || h.caplen != 4 ||
+        h.len != 60 || memcmp(pkt, "\xde\xad\xbe\xef", 4) != 0)
+        goto close;
+
+    /* keep a packet reference past the close */
+    map = m.map;
+    PcapFileMapRef(map);
+
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || h.ts.tv_sec != 101 ||
+        h.caplen != 0)
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 0)
+        goto close;
+    PcapFileMmapClose(&m);
+
+    if (memcmp(map->data + 40, "\xde\xad\xbe\xef", 4) != 0)
+        goto end;
+    PcapFileMapDeref(map);
+    map = NULL;
+
+    if (PcapFileMmapTestWrite(name, be, sizeof(be)) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (m.datalink != DLT_RAW || m.snaplen != 65535 || m.units != 1000000000)
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || h.ts.tv_sec != 7 ||
+        h.ts.tv_usec != 2 || h.caplen != 2 || pkt[0] != 0x45)
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 0)
+        goto close;
+
+    result = 1;
+close:
+    PcapFileMmapClose(&m);
+end:
+    if (map != NULL)
+        PcapFileMapDeref(map);
+    unlink(name);
+    return result;
+}
+
+/** \test truncated and corrupt files, and files left to libpcap */
+static int PcapFileMmapTest02(void)
+{
+    char name[] = "/tmp/suricata-pcap-mmap-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    uint8_t buf[PCAP_FILE_HDR_LEN + PCAP_REC_HDR_LEN + 4];
+    uint32_t v;
+    PcapFileMmap m;
+    struct pcap_pkthdr h;
+    uint8_t *pkt = NULL;
+    int result = 0;
+
+    memset(buf, 0x00, sizeof(buf));
+    v = PCAP_MAGIC;
+    memcpy(buf, &v, 4);
+    v = 1;
+    memcpy(buf + 20, &v, 4);
+
+    /* caplen past the end of the file */
+    v = 8;
+    memcpy(buf + PCAP_FILE_HDR_LEN + 8, &v, 4);
+    if (PcapFileMmapTestWrite(name, buf, sizeof(buf)) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (PcapFileMmapNext(&m, &h, &pkt) != -1 ||
+        strstr(m.err, "truncated") == NULL) {
+        PcapFileMmapClose(&m);
+        goto end;
+    }
+    PcapFileMmapClose(&m);
+
+    /* caplen above the max */
+    v = PCAP_FILE_MMAP_MAX_CAPLEN + 1;
+    memcpy(buf + PCAP_FILE_HDR_LEN + 8, &v, 4);
+    if (PcapFileMmapTestWrite(name, buf, sizeof(buf)) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (PcapFileMmapNext(&m, &h, &pkt) != -1) {
+        PcapFileMmapClose(&m);
+        goto end;
+    }
+    PcapFileMmapClose(&m);
+
+    /* half a record header */
+    if (PcapFileMmapTestWrite(name, buf, PCAP_FILE_HDR_LEN + 8) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (PcapFileMmapNext(&m, &h, &pkt) != -1) {
+        PcapFileMmapClose(&m);
+        goto end;
+    }
+    PcapFileMmapClose(&m);
+
+    /* unknown magic and short files go to libpcap */
+    memset(buf, 0x00, 4);
+    if (PcapFileMmapTestWrite(name, buf, sizeof(buf)) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != -2)
+        goto end;
+    if (PcapFileMmapTestWrite(name, buf, 10) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != -2)
+        goto end;
+
+    if (PcapFileMmapOpen(&m, "/nonexistent/file.pcap") != -1)
+        goto end;
+
+    result = 1;
+end:
+    unlink(name);
+    return result;
+}
+
+static size_t PcapFileMmapTestBlock(uint8_t *buf, uint32_t type,
+        const uint8_t *body, uint32_t len)
+{
+    uint32_t blen = 12 + ((len + 3) & ~3);
+
+    memset(buf, 0x00, blen);
+    memcpy(buf, &type, 4);
+    memcpy(buf + 4, &blen, 4);
+    memcpy(buf + 8, body, len);
+    memcpy(buf + blen - 4, &blen, 4);
+    return blen;
+}
+
+/** \test pcapng in host byte order: interface timestamp resolution,
+ *        enhanced and simple packet blocks, unknown blocks skipped */
+static int PcapFileMmapTest03(void)
+{
+    char name[] = "/tmp/suricata-pcap-mmap-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    uint8_t buf[512];
+    uint8_t body[64];
+    size_t len = 0;
+    uint32_t v;
+    uint16_t s;
+    PcapFileMmap m;
+    struct pcap_pkthdr h;
+    uint8_t *pkt = NULL;
+    int result = 0;
+
+    /* section header */
+    memset(body, 0x00, sizeof(body));
+    v = PCAPNG_BOM;
+    memcpy(body, &v, 4);
+    s = 1;
+    memcpy(body + 4, &s, 2);
+    memset(body + 8, 0xff, 8);
+    len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_SHB, body, 16);
+
+    /* interface, ethernet, snaplen 3, if_tsresol 9 */
+    memset(body, 0x00, sizeof(body));
+    s = 1;
+    memcpy(body, &s, 2);
+    v = 3;
+    memcpy(body + 4, &v, 4);
+    s = PCAPNG_OPT_TSRESOL;
+    memcpy(body + 8, &s, 2);
+    s = 1;
+    memcpy(body + 10, &s, 2);
+    body[12] = 9;
+    len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_IDB, body, 20);
+
+    /* enhanced packet: ts 5.000001000 in nsec, 3 bytes */
+    memset(body, 0x00, sizeof(body));
+    uint64_t ts = 5000001000ULL;
+    v = (uint32_t)(ts >> 32);
+    memcpy(body + 4, &v, 4);
+    v = (uint32_t)ts;
+    memcpy(body + 8, &v, 4);
+    v = 3;
+    memcpy(body + 12, &v, 4);
+    v = 100;
+    memcpy(body + 16, &v, 4);
+    memcpy(body + 20, "abc", 3);
+    len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_EPB, body, 23);
+
+    /* unknown block */
+    memset(body, 0x00, sizeof(body));
+    len += PcapFileMmapTestBlock(buf + len, 0x0bad, body, 8);
+
+    /* simple packet, cut to the snaplen */
+    memset(body, 0x00, sizeof(body));
+    v = 5;
+    memcpy(body, &v, 4);
+    memcpy(body + 4, "vwxyz", 5);
+    len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_SPB, body, 9);
+
+    if (PcapFileMmapTestWrite(name, buf, len) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (!m.ng || m.datalink != DLT_EN10MB || m.if_cnt != 1 ||
+        m.if_units[0] != 1000000000)
+        goto close;
+
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || h.ts.tv_sec != 5 ||
+        h.ts.tv_usec != 1 || h.caplen != 3 || h.len != 100 ||
+        memcmp(pkt, "abc", 3) != 0)
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || h.caplen != 3 ||
+        h.len != 5 || memcmp(pkt, "vwx", 3) != 0)
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 0)
+        goto close;
+    PcapFileMmapClose(&m);
+
+    /* packet of an interface that wasn't described */
+    v = 1;
+    memcpy(buf + 28 + 32 + 8, &v, 4);
+    if (PcapFileMmapTestWrite(name, buf, len) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (PcapFileMmapNext(&m, &h, &pkt) != -1)
+        goto close;
+
+    result = 1;
+close:
+    PcapFileMmapClose(&m);
+end:
+    unlink(name);
+    return result;
+}
+
+/** \test pcapng with two sections: the interfaces of the second section
+ *        are numbered from 0 again and need the link type of the first */
+static int PcapFileMmapTest04(void)
+{
+    char name[] = "/tmp/suricata-pcap-mmap-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+        return 0;
+    close(fd);
+
+    uint8_t buf[512];
+    uint8_t body[64];
+    size_t len = 0;
+    size_t idb2_off = 0;
+    uint32_t v;
+    uint16_t s;
+    PcapFileMmap m;
+    struct pcap_pkthdr h;
+    uint8_t *pkt = NULL;
+    int result = 0;
+
+    for (int i = 0; i < 2; i++) {
+        /* section header */
+        memset(body, 0x00, sizeof(body));
+        v = PCAPNG_BOM;
+        memcpy(body, &v, 4);
+        s = 1;
+        memcpy(body + 4, &s, 2);
+        memset(body + 8, 0xff, 8);
+        len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_SHB, body, 16);
+
+        /* interface, ethernet */
+        if (i == 1)
+            idb2_off = len;
+        memset(body, 0x00, sizeof(body));
+        s = 1;
+        memcpy(body, &s, 2);
+        len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_IDB, body, 8);
+
+        /* enhanced packet of interface 0 */
+        memset(body, 0x00, sizeof(body));
+        v = 1;
+        memcpy(body + 12, &v, 4);
+        memcpy(body + 16, &v, 4);
+        body[20] = 'a' + i;
+        len += PcapFileMmapTestBlock(buf + len, PCAPNG_BLOCK_EPB, body, 21);
+    }
+
+    if (PcapFileMmapTestWrite(name, buf, len) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || pkt[0] != 'a')
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || pkt[0] != 'b' ||
+        m.datalink != DLT_EN10MB)
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 0)
+        goto close;
+    PcapFileMmapClose(&m);
+
+    /* second section on raw ip */
+    s = PCAP_LINKTYPE_RAW;
+    memcpy(buf + idb2_off + 8, &s, 2);
+    if (PcapFileMmapTestWrite(name, buf, len) != 0)
+        goto end;
+    if (PcapFileMmapOpen(&m, name) != 0)
+        goto end;
+    if (PcapFileMmapNext(&m, &h, &pkt) != 1 || pkt[0] != 'a')
+        goto close;
+    if (PcapFileMmapNext(&m, &h, &pkt) != -1 ||
+        strstr(m.err, "link types") == NULL || m.datalink != DLT_EN10MB)
+        goto close;
+
+    result = 1;
+close:
+    PcapFileMmapClose(&m);
+end:
+    unlink(name);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void PcapFileMmapRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("PcapFileMmapTest01", PcapFileMmapTest01, 1);
+    UtRegisterTest("PcapFileMmapTest02", PcapFileMmapTest02, 1);
+    UtRegisterTest("PcapFileMmapTest03", PcapFileMmapTest03, 1);
+    UtRegisterTest("PcapFileMmapTest04", PcapFileMmapTest04, 1);
+#endif /* UNITTESTS */
+}
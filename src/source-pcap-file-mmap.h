@@ -0,0 +1,87 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * mmap based reader for pcap and pcapng files.
+ */
+
+#ifndef __SOURCE_PCAP_FILE_MMAP_H__
+#define __SOURCE_PCAP_FILE_MMAP_H__
+
+#include "util-atomic.h"
+
+/** records larger than this are considered corrupt, as in libpcap */
+#define PCAP_FILE_MMAP_MAX_CAPLEN   262144
+
+/** size of the readahead window */
+#define PCAP_FILE_MMAP_WINDOW       (4 * 1024 * 1024)
+
+/**
+ * \brief Mapping of a pcap file.
+ *
+ * Packets point into the mapping, so it stays until the reader and all
+ * packets are done with it.
+ */
+typedef struct PcapFileMap_ {
+    uint8_t *data;
+    uint64_t len;
+    /** one reference for the reader, one per packet */
+    SC_ATOMIC_DECLARE(unsigned int, refcnt);
+} PcapFileMap;
+
+typedef struct PcapFileMmap_ {
+    PcapFileMap *map;
+    /** offset of the next record or block */
+    uint64_t off;
+    /** readahead has been issued up to here */
+    uint64_t ra_off;
+
+    int datalink;
+    uint32_t snaplen;
+    /** file is in the other byte order */
+    uint8_t swapped;
+    /** file is pcapng */
+    uint8_t ng;
+    /** datalink is set by a pcapng interface, over all sections */
+    uint8_t datalink_set;
+
+    /** timestamp units per second of a classic pcap file (usec or nsec),
+     *  or of each pcapng interface */
+    uint64_t units;
+    uint64_t *if_units;
+    uint32_t if_cnt;
+
+    char err[128];
+} PcapFileMmap;
+
+int PcapFileMmapOpen(PcapFileMmap *, const char *);
+int PcapFileMmapNext(PcapFileMmap *, struct pcap_pkthdr *, uint8_t **);
+void PcapFileMmapClose(PcapFileMmap *);
+
+/** \brief take a reference to the mapping for a packet */
+static inline void PcapFileMapRef(PcapFileMap *map)
+{
+    (void) SC_ATOMIC_ADD(map->refcnt, 1);
+}
+
+void PcapFileMapDeref(PcapFileMap *);
+
+void PcapFileMmapRegisterTests(void);
+
+#endif /* __SOURCE_PCAP_FILE_MMAP_H__ */
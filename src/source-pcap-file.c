@@ -31,6 +31,7 @@
 #include "threadvars.h"
 #include "tm-queuehandlers.h"
 #include "source-pcap-file.h"
+#include "source-pcap-file-mmap.h"
 #include "util-time.h"
 #include "util-debug.h"
 #include "conf.h"
@@ -44,6 +45,9 @@
 #include "runmode-unix-socket.h"
 #include "util-checksum.h"
 #include "util-atomic.h"
+#include "util-unittest.h"
+
+#include <dirent.h>
 
 #ifdef __SC_CUDA_SUPPORT__
 
@@ -62,16 +66,22 @@ extern int max_pending_packets;
 
 //static int pcap_max_read_packets = 0;
 
+typedef int (*PcapFileDecoderFunc)(ThreadVars *, DecodeThreadVars *, Packet *, u_int8_t *, u_int16_t, PacketQueue *);
+
 typedef struct PcapFileGlobalVars_ {
-    pcap_t *pcap_handle;
-    int (*Decoder)(ThreadVars *, DecodeThreadVars *, Packet *, u_int8_t *, u_int16_t, PacketQueue *);
-    int datalink;
-    struct bpf_program filter;
-    uint64_t cnt; /** packet counter */
-    ChecksumValidationMode conf_checksum_mode;
-    ChecksumValidationMode checksum_mode;
+    /** packets sampled by all readers for the checksum auto mode */
+    SC_ATOMIC_DECLARE(uint64_t, cnt);
     SC_ATOMIC_DECLARE(unsigned int, invalid_checksums);
 
+    /** readers still reading, the last one to finish stops the engine.
+     *  Protected by readers_lock, as are the fields below. */
+    SCMutex readers_lock;
+    uint16_t readers;
+    /** shards of the readers by shard id, for the throughput report */
+    PcapFileShard *shards[TIME_DOMAIN_MAX];
+    /** time the first reader started reading */
+    struct timeval start;
+
 } PcapFileGlobalVars;
 
 /** max packets < 65536 */
@@ -80,7 +90,7 @@ typedef struct PcapFileGlobalVars_ {
 typedef struct PcapFileThreadVars_
 {
     /* counters */
-    uint32_t pkts;
+    uint64_t pkts;
     uint64_t bytes;
 
     ThreadVars *tv;
@@ -91,6 +101,33 @@ typedef struct PcapFileThreadVars_
 
     uint8_t done;
     uint32_t errs;
+
+    /** files to read, owned by the reader */
+    PcapFileShard *shard;
+    /** file of the shard that is being read */
+    uint32_t file_idx;
+
+    pcap_t *pcap_handle;
+    /** mmap reader, the file is read with it if mmap.map is set */
+    PcapFileMmap mmap;
+    int datalink;
+    struct bpf_program filter;
+    /** filter is compiled for the mmap reader */
+    uint8_t filter_set;
+    char *bpf_string;
+    /** packet counter of the current file */
+    uint64_t cnt;
+    ChecksumValidationMode conf_checksum_mode;
+    ChecksumValidationMode checksum_mode;
+
+    /** counters at the start of the current file, for the report */
+    uint64_t file_pkts;
+    uint64_t file_bytes;
+    struct timeval file_start;
+
+    /** packets read but not yet passed on to the next slots */
+    uint16_t batch_cnt;
+    Packet *batch[TM_PKT_BATCH_SIZE];
 } PcapFileThreadVars;
 
 static PcapFileGlobalVars pcap_g;
@@ -102,10 +139,17 @@ void ReceivePcapFileThreadExitStats(ThreadVars *, void *);
 TmEcode ReceivePcapFileThreadDeinit(ThreadVars *, void *);
 
 TmEcode DecodePcapFile(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
+TmEcode DecodePcapFileBatch(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
 TmEcode DecodePcapFileThreadInit(ThreadVars *, void *, void **);
+TmEcode DecodePcapFileThreadDeinit(ThreadVars *, void *);
+
+static void PcapFileRegisterTests(void);
 
 void TmModuleReceivePcapFileRegister (void) {
     memset(&pcap_g, 0x00, sizeof(pcap_g));
+    SC_ATOMIC_INIT(pcap_g.cnt);
+    SC_ATOMIC_INIT(pcap_g.invalid_checksums);
+    SCMutexInit(&pcap_g.readers_lock, NULL);
 
     tmm_modules[TMM_RECEIVEPCAPFILE].name = "ReceivePcapFile";
     tmm_modules[TMM_RECEIVEPCAPFILE].ThreadInit = ReceivePcapFileThreadInit;
@@ -113,7 +157,7 @@ void TmModuleReceivePcapFileRegister (void) {
     tmm_modules[TMM_RECEIVEPCAPFILE].PktAcqLoop = ReceivePcapFileLoop;
     tmm_modules[TMM_RECEIVEPCAPFILE].ThreadExitPrintStats = ReceivePcapFileThreadExitStats;
     tmm_modules[TMM_RECEIVEPCAPFILE].ThreadDeinit = ReceivePcapFileThreadDeinit;
-    tmm_modules[TMM_RECEIVEPCAPFILE].RegisterTests = NULL;
+    tmm_modules[TMM_RECEIVEPCAPFILE].RegisterTests = PcapFileRegisterTests;
     tmm_modules[TMM_RECEIVEPCAPFILE].cap_flags = 0;
     tmm_modules[TMM_RECEIVEPCAPFILE].flags = TM_FLAG_RECEIVE_TM;
 }
@@ -122,13 +166,587 @@ void TmModuleDecodePcapFileRegister (void) {
     tmm_modules[TMM_DECODEPCAPFILE].name = "DecodePcapFile";
     tmm_modules[TMM_DECODEPCAPFILE].ThreadInit = DecodePcapFileThreadInit;
     tmm_modules[TMM_DECODEPCAPFILE].Func = DecodePcapFile;
+    tmm_modules[TMM_DECODEPCAPFILE].FuncBatch = DecodePcapFileBatch;
     tmm_modules[TMM_DECODEPCAPFILE].ThreadExitPrintStats = NULL;
-    tmm_modules[TMM_DECODEPCAPFILE].ThreadDeinit = NULL;
+    tmm_modules[TMM_DECODEPCAPFILE].ThreadDeinit = DecodePcapFileThreadDeinit;
     tmm_modules[TMM_DECODEPCAPFILE].RegisterTests = NULL;
     tmm_modules[TMM_DECODEPCAPFILE].cap_flags = 0;
     tmm_modules[TMM_DECODEPCAPFILE].flags = TM_FLAG_DECODE_TM;
 }
 
+/**
+ *  \brief Create a shard for a single file, read on the engine clock
+ */
+PcapFileShard *PcapFileShardNew(const char *file)
+{
+    PcapFileShard *shard = SCMalloc(sizeof(PcapFileShard));
+    if (unlikely(shard == NULL))
+        return NULL;
+    memset(shard, 0x00, sizeof(PcapFileShard));
+
+    if (file != NULL && PcapFileShardAddFile(shard, file) != 0) {
+        PcapFileShardFree(shard);
+        return NULL;
+    }
+    return shard;
+}
+
+/**
+ *  \brief Append a file to a shard
+ *
+ *  \retval 0 ok
+ *  \retval -1 out of memory
+ */
+int PcapFileShardAddFile(PcapFileShard *shard, const char *file)
+{
+    char **files = SCRealloc(shard->files, (shard->cnt + 1) * sizeof(char *));
+    if (unlikely(files == NULL))
+        return -1;
+    shard->files = files;
+
+    PcapFileStats *stats = SCRealloc(shard->stats,
+            (shard->cnt + 1) * sizeof(PcapFileStats));
+    if (unlikely(stats == NULL))
+        return -1;
+    shard->stats = stats;
+
+    shard->files[shard->cnt] = SCStrdup(file);
+    if (unlikely(shard->files[shard->cnt] == NULL))
+        return -1;
+    memset(&shard->stats[shard->cnt], 0x00, sizeof(PcapFileStats));
+    shard->cnt++;
+    return 0;
+}
+
+void PcapFileShardFree(PcapFileShard *shard)
+{
+    if (shard == NULL)
+        return;
+
+    uint32_t i;
+    for (i = 0; i < shard->cnt; i++) {
+        SCFree(shard->files[i]);
+    }
+    if (shard->files != NULL)
+        SCFree(shard->files);
+    if (shard->stats != NULL)
+        SCFree(shard->stats);
+    SCFree(shard);
+}
+
+typedef struct PcapFileListEntry_ {
+    char *name;
+    uint64_t size;
+} PcapFileListEntry;
+
+static int PcapFileListEntryCompare(const void *a, const void *b)
+{
+    return strcmp(((const PcapFileListEntry *)a)->name,
+                  ((const PcapFileListEntry *)b)->name);
+}
+
+/** \internal
+ *  \brief List the regular files of a directory, sorted by name
+ *
+ *  Rotated captures carry a sequence number or a timestamp in the name,
+ *  so the name order is the time order. Hidden files are skipped.
+ *
+ *  \retval cnt number of files, -1 on error
+ */
+static int PcapFileListDir(const char *path, PcapFileListEntry **list)
+{
+    PcapFileListEntry *entries = NULL;
+    uint32_t cnt = 0;
+    struct dirent *de;
+
+    DIR *d = opendir(path);
+    if (d == NULL) {
+        SCLogError(SC_ERR_FOPEN, "opening pcap directory \"%s\": %s",
+                path, strerror(errno));
+        return -1;
+    }
+
+    while ((de = readdir(d)) != NULL) {
+        char name[PATH_MAX];
+        struct stat st;
+
+        if (de->d_name[0] == '.')
+            continue;
+
+        if (snprintf(name, sizeof(name), "%s/%s", path, de->d_name) >= (int)sizeof(name))
+            continue;
+        if (stat(name, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        PcapFileListEntry *ptr = SCRealloc(entries, (cnt + 1) * sizeof(PcapFileListEntry));
+        if (unlikely(ptr == NULL))
+            goto error;
+        entries = ptr;
+
+        entries[cnt].name = SCStrdup(name);
+        if (unlikely(entries[cnt].name == NULL))
+            goto error;
+        entries[cnt].size = (uint64_t)st.st_size;
+        cnt++;
+    }
+    closedir(d);
+
+    if (cnt > 0)
+        qsort(entries, cnt, sizeof(PcapFileListEntry), PcapFileListEntryCompare);
+    *list = entries;
+    return (int)cnt;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "listing pcap directory \"%s\" failed", path);
+    closedir(d);
+    while (cnt > 0) {
+        SCFree(entries[--cnt].name);
+    }
+    if (entries != NULL)
+        SCFree(entries);
+    return -1;
+}
+
+/** \internal
+ *  \brief Split a time ordered list of files into contiguous shards of
+ *         about the same number of bytes
+ *
+ *  Each shard gets at least one file, so shards must not exceed cnt.
+ *  Shard i reads the files first[i] up to first[i + 1].
+ */
+static void PcapFileShardsSplit(const uint64_t *sizes, uint32_t cnt,
+        uint16_t shards, uint32_t *first)
+{
+    uint64_t total = 0, acc = 0;
+    uint32_t i = 0;
+    uint16_t s;
+
+    for (i = 0; i < cnt; i++)
+        total += sizes[i];
+
+    i = 0;
+    first[0] = 0;
+    for (s = 1; s < shards; s++) {
+        uint64_t target = (total / shards) * s;
+
+        acc += sizes[i++];
+        /* take the next file as long as most of it is below the target
+         * and the remaining shards still get a file each */
+        while (i < cnt - (shards - s) && acc + sizes[i] / 2 < target) {
+            acc += sizes[i++];
+        }
+        first[s] = i;
+    }
+    first[shards] = cnt;
+}
+
+/**
+ *  \brief Create the shards for the multi reader mode
+ *
+ *  A directory is split into contiguous shards of its files sorted by
+ *  name, so every reader processes a time range of its own, with the
+ *  files of its shard in order. Each reader gets a time domain of its
+ *  own if there is more than one.
+ *
+ *  \param path pcap file or directory of pcap files
+ *  \param readers number of readers, lowered if there are less files
+ *
+ *  \retval shards array of *readers shards, NULL on error
+ */
+PcapFileShard **PcapFileShardsBuild(const char *path, uint16_t *readers)
+{
+    PcapFileListEntry *list = NULL;
+    PcapFileShard **shards = NULL;
+    uint64_t *sizes = NULL;
+    uint32_t *first = NULL;
+    struct stat st;
+    int cnt;
+    uint32_t i;
+    uint16_t s;
+
+    if (stat(path, &st) != 0) {
+        SCLogError(SC_ERR_FOPEN, "pcap path \"%s\": %s", path, strerror(errno));
+        return NULL;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        shards = SCMalloc(sizeof(PcapFileShard *));
+        if (unlikely(shards == NULL))
+            return NULL;
+        shards[0] = PcapFileShardNew(path);
+        if (shards[0] == NULL) {
+            SCFree(shards);
+            return NULL;
+        }
+        *readers = 1;
+        return shards;
+    }
+
+    cnt = PcapFileListDir(path, &list);
+    if (cnt <= 0) {
+        if (cnt == 0)
+            SCLogError(SC_ERR_FOPEN, "no pcap files in \"%s\"", path);
+        return NULL;
+    }
+
+    if (*readers == 0)
+        *readers = 1;
+    if (*readers > TIME_DOMAIN_MAX - 1)
+        *readers = TIME_DOMAIN_MAX - 1;
+    if (*readers > (uint32_t)cnt)
+        *readers = (uint16_t)cnt;
+
+    sizes = SCMalloc(cnt * sizeof(uint64_t));
+    first = SCMalloc((*readers + 1) * sizeof(uint32_t));
+    shards = SCMalloc(*readers * sizeof(PcapFileShard *));
+    if (unlikely(sizes == NULL || first == NULL || shards == NULL))
+        goto error;
+    memset(shards, 0x00, *readers * sizeof(PcapFileShard *));
+
+    for (i = 0; i < (uint32_t)cnt; i++)
+        sizes[i] = list[i].size;
+    PcapFileShardsSplit(sizes, (uint32_t)cnt, *readers, first);
+
+    for (s = 0; s < *readers; s++) {
+        shards[s] = PcapFileShardNew(NULL);
+        if (unlikely(shards[s] == NULL))
+            goto error;
+        shards[s]->id = s;
+        shards[s]->time_domain = (*readers > 1) ? (uint8_t)(s + 1) : 0;
+
+        for (i = first[s]; i < first[s + 1]; i++) {
+            if (PcapFileShardAddFile(shards[s], list[i].name) != 0)
+                goto error;
+        }
+        SCLogInfo("pcap reader %"PRIu16": %"PRIu32" files, from %s",
+                s + 1, shards[s]->cnt, shards[s]->files[0]);
+    }
+
+    for (i = 0; i < (uint32_t)cnt; i++)
+        SCFree(list[i].name);
+    SCFree(list);
+    SCFree(sizes);
+    SCFree(first);
+    return shards;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "setting up the pcap readers failed");
+    if (shards != NULL) {
+        for (s = 0; s < *readers; s++)
+            PcapFileShardFree(shards[s]);
+        SCFree(shards);
+    }
+    for (i = 0; i < (uint32_t)cnt; i++)
+        SCFree(list[i].name);
+    SCFree(list);
+    if (sizes != NULL)
+        SCFree(sizes);
+    if (first != NULL)
+        SCFree(first);
+    return NULL;
+}
+
+static PcapFileDecoderFunc PcapFileGetDecoder(int datalink)
+{
+    switch (datalink) {
+        case LINKTYPE_LINUX_SLL:
+            return DecodeSll;
+        case LINKTYPE_ETHERNET:
+            return DecodeEthernet;
+        case LINKTYPE_PPP:
+            return DecodePPP;
+        case LINKTYPE_RAW:
+            return DecodeRaw;
+        default:
+            return NULL;
+    }
+}
+
+/** \internal
+ *  \brief Compile the bpf filter for the mmap reader, which applies it
+ *         to the records itself
+ *
+ *  \retval 0 filter is compiled
+ *  \retval -1 filter is invalid
+ *  \retval -2 this libpcap can't filter outside of a handle
+ */
+static int PcapFileMmapSetFilter(PcapFileThreadVars *ptv)
+{
+#if LIBPCAP_VERSION_MAJOR == 1
+    int snaplen = ptv->mmap.snaplen ? (int)ptv->mmap.snaplen : 65535;
+    pcap_t *dead = pcap_open_dead(ptv->mmap.datalink, snaplen);
+    if (dead == NULL) {
+        SCLogError(SC_ERR_BPF, "could not set up the bpf filter");
+        return -1;
+    }
+
+    if (pcap_compile(dead, &ptv->filter, ptv->bpf_string, 1, 0) < 0) {
+        SCLogError(SC_ERR_BPF,"bpf compilation error %s",pcap_geterr(dead));
+        pcap_close(dead);
+        return -1;
+    }
+    pcap_close(dead);
+    ptv->filter_set = 1;
+    return 0;
+#else
+    return -2;
+#endif
+}
+
+/** \internal
+ *  \brief Release the open file, whichever reader it is read with
+ */
+static void PcapFileRelease(PcapFileThreadVars *ptv)
+{
+    if (ptv->pcap_handle != NULL) {
+        pcap_close(ptv->pcap_handle);
+        ptv->pcap_handle = NULL;
+    }
+    if (ptv->mmap.map != NULL)
+        PcapFileMmapClose(&ptv->mmap);
+    if (ptv->filter_set) {
+        pcap_freecode(&ptv->filter);
+        ptv->filter_set = 0;
+    }
+}
+
+/**
+ *  \brief Get the file a packet was read from, for the multi reader
+ *         runmode
+ *
+ *  The readers of the multi runmode log into the same outputs, so the
+ *  records of their files are interleaved. Tunnel packets report the
+ *  file of their root. Pseudo packets, e.g. of flow timeouts, aren't
+ *  read from a file.
+ *
+ *  \retval file name or NULL if the packet doesn't come from one of
+ *          several readers
+ */
+const char *PcapFileGetFilename(const Packet *p)
+{
+    const Packet *rp = p->root ? p->root : p;
+
+    /* only the readers of the multi runmode have a time domain */
+    if (rp->time_domain == 0 || rp->pkt_src != PKT_SRC_WIRE)
+        return NULL;
+    return rp->pcap_v.file;
+}
+
+/** \internal
+ *  \brief Open the current file of the shard
+ *
+ *  \retval TM_ECODE_OK file is open
+ *  \retval TM_ECODE_FAILED file can't be read
+ */
+static TmEcode PcapFileOpen(PcapFileThreadVars *ptv)
+{
+    char errbuf[PCAP_ERRBUF_SIZE] = "";
+    char *file = ptv->shard->files[ptv->file_idx];
+
+    SCLogInfo("reading pcap file %s", file);
+
+    if (ptv->shard->mmap) {
+        int r = PcapFileMmapOpen(&ptv->mmap, file);
+        if (r == 0 && ptv->bpf_string != NULL) {
+            r = PcapFileMmapSetFilter(ptv);
+            if (r != 0)
+                PcapFileMmapClose(&ptv->mmap);
+        }
+        if (r == -1) {
+            if (ptv->mmap.err[0] != '\0')
+                SCLogError(SC_ERR_FOPEN, "%s", ptv->mmap.err);
+            return TM_ECODE_FAILED;
+        } else if (r == 0) {
+            ptv->datalink = ptv->mmap.datalink;
+            goto opened;
+        }
+        SCLogDebug("%s is read with libpcap", file);
+    }
+
+    ptv->pcap_handle = pcap_open_offline(file, errbuf);
+    if (ptv->pcap_handle == NULL) {
+        SCLogError(SC_ERR_FOPEN, "%s\n", errbuf);
+        return TM_ECODE_FAILED;
+    }
+
+    if (ptv->bpf_string != NULL) {
+        if(pcap_compile(ptv->pcap_handle,&ptv->filter,ptv->bpf_string,1,0) < 0) {
+            SCLogError(SC_ERR_BPF,"bpf compilation error %s",pcap_geterr(ptv->pcap_handle));
+            goto error;
+        }
+
+        if(pcap_setfilter(ptv->pcap_handle,&ptv->filter) < 0) {
+            SCLogError(SC_ERR_BPF,"could not set bpf filter %s",pcap_geterr(ptv->pcap_handle));
+            pcap_freecode(&ptv->filter);
+            goto error;
+        }
+        pcap_freecode(&ptv->filter);
+    }
+
+    ptv->datalink = pcap_datalink(ptv->pcap_handle);
+opened:
+    SCLogDebug("datalink %" PRId32 "", ptv->datalink);
+
+    if (PcapFileGetDecoder(ptv->datalink) == NULL) {
+        SCLogError(SC_ERR_UNIMPLEMENTED, "datalink type %" PRId32 " not "
+                  "(yet) supported in module PcapFile.\n", ptv->datalink);
+        goto error;
+    }
+
+    ptv->cnt = 0;
+    ptv->file_pkts = ptv->pkts;
+    ptv->file_bytes = ptv->bytes;
+    gettimeofday(&ptv->file_start, NULL);
+    return TM_ECODE_OK;
+
+error:
+    PcapFileRelease(ptv);
+    return TM_ECODE_FAILED;
+}
+
+/** \internal
+ *  \brief Close the current file and record its numbers for the report
+ */
+static void PcapFileClose(PcapFileThreadVars *ptv)
+{
+    struct timeval now;
+
+    if (ptv->pcap_handle == NULL && ptv->mmap.map == NULL)
+        return;
+
+    PcapFileRelease(ptv);
+
+    gettimeofday(&now, NULL);
+    PcapFileStats *stats = &ptv->shard->stats[ptv->file_idx];
+    stats->pkts = ptv->pkts - ptv->file_pkts;
+    stats->bytes = ptv->bytes - ptv->file_bytes;
+    stats->usecs = (uint64_t)(now.tv_sec - ptv->file_start.tv_sec) * 1000000 +
+        (now.tv_usec - ptv->file_start.tv_usec);
+}
+
+/** \internal
+ *  \brief Open the next file of the shard, skipping files that can't be
+ *         read
+ *
+ *  \retval TM_ECODE_OK next file is open
+ *  \retval TM_ECODE_DONE no files left
+ */
+static TmEcode PcapFileOpenNext(PcapFileThreadVars *ptv)
+{
+    while (ptv->file_idx + 1 < ptv->shard->cnt) {
+        ptv->file_idx++;
+        if (PcapFileOpen(ptv) == TM_ECODE_OK)
+            return TM_ECODE_OK;
+        ptv->errs++;
+    }
+    return TM_ECODE_DONE;
+}
+
+static void PcapFileLogRate(const char *what, uint64_t pkts, uint64_t bytes,
+        uint64_t usecs)
+{
+    double secs = usecs / 1000000.0;
+    if (secs <= 0.0)
+        secs = 0.000001;
+
+    SCLogInfo("%s: %"PRIu64" packets, %"PRIu64" bytes in %.3fs, "
+              "%.0f pkts/s, %.1f Mbit/s", what, pkts, bytes, secs,
+              pkts / secs, (bytes * 8) / secs / 1000000.0);
+}
+
+/** \internal
+ *  \brief Throughput report, logged by the last reader to finish
+ *
+ *  Files are listed in shard order, so in the order of the directory.
+ *  Must be called with readers_lock held.
+ */
+static void PcapFileReport(void)
+{
+    uint64_t pkts = 0, bytes = 0;
+    uint32_t files = 0;
+    uint16_t readers = 0;
+    struct timeval now;
+    int s;
+
+    for (s = 0; s < TIME_DOMAIN_MAX; s++) {
+        PcapFileShard *shard = pcap_g.shards[s];
+        uint32_t i;
+
+        if (shard == NULL)
+            continue;
+        readers++;
+
+        for (i = 0; i < shard->cnt; i++) {
+            PcapFileLogRate(shard->files[i], shard->stats[i].pkts,
+                    shard->stats[i].bytes, shard->stats[i].usecs);
+            pkts += shard->stats[i].pkts;
+            bytes += shard->stats[i].bytes;
+        }
+        files += shard->cnt;
+    }
+
+    gettimeofday(&now, NULL);
+    uint64_t usecs = (uint64_t)(now.tv_sec - pcap_g.start.tv_sec) * 1000000 +
+        (now.tv_usec - pcap_g.start.tv_usec);
+
+    char what[64];
+    snprintf(what, sizeof(what), "%"PRIu32" pcap files, %"PRIu16" readers",
+            files, readers);
+    PcapFileLogRate(what, pkts, bytes, usecs);
+}
+
+/** \internal
+ *  \brief The reader is done, the last reader to finish stops the engine
+ *         or, in unix socket mode, hands control back to the socket.
+ */
+static TmEcode PcapFileReaderDone(PcapFileThreadVars *ptv)
+{
+    TimeDomainRelease(ptv->shard->time_domain);
+
+    SCMutexLock(&pcap_g.readers_lock);
+    int last = (--pcap_g.readers == 0);
+    if (last)
+        PcapFileReport();
+    SCMutexUnlock(&pcap_g.readers_lock);
+
+    if (!last) {
+        SCLogInfo("pcap reader %"PRIu16" done, waiting for the other readers",
+                ptv->shard->id + 1);
+    } else if (! RunModeUnixSocketIsActive()) {
+        EngineStop();
+    } else {
+        UnixSocketPcapFile(TM_ECODE_DONE);
+    }
+    return TM_ECODE_DONE;
+}
+
+/**
+ *  \brief pass the packets of the batch on to the next slots
+ */
+static void PcapFileFlushBatch(PcapFileThreadVars *ptv)
+{
+    uint16_t cnt = ptv->batch_cnt;
+
+    ptv->batch_cnt = 0;
+    if (TmThreadsSlotProcessPktBatch(ptv->tv, ptv->slot, ptv->batch, cnt) != TM_ECODE_OK) {
+        ptv->cb_result = TM_ECODE_FAILED;
+    }
+}
+
+/**
+ *  \brief Release a packet that points into a mapped pcap file
+ *
+ *  Packets keep this release function when they are recycled, so it
+ *  also handles packets that don't point into a mapping.
+ */
+static void PcapFileMmapReleasePacket(Packet *p)
+{
+    if (p->pcap_v.relptr != NULL) {
+        PcapFileMapDeref((PcapFileMap *)p->pcap_v.relptr);
+        p->pcap_v.relptr = NULL;
+    }
+    PacketFreeOrRelease(p);
+}
+
 void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt) {
     SCEnter();
 
@@ -144,39 +762,87 @@ void PcapFileCallbackLoop(char *user, struct pcap_pkthdr *h, u_char *pkt) {
     p->ts.tv_sec = h->ts.tv_sec;
     p->ts.tv_usec = h->ts.tv_usec;
     SCLogDebug("p->ts.tv_sec %"PRIuMAX"", (uintmax_t)p->ts.tv_sec);
-    p->datalink = pcap_g.datalink;
-    p->pcap_cnt = ++pcap_g.cnt;
+    p->datalink = ptv->datalink;
+    p->pcap_cnt = ++ptv->cnt;
+    p->time_domain = ptv->shard->time_domain;
+    /* the shard outlives the packet, it's logged by this thread */
+    p->pcap_v.file = ptv->shard->time_domain ?
+        ptv->shard->files[ptv->file_idx] : NULL;
 
     ptv->pkts++;
     ptv->bytes += h->caplen;
 
-    if (unlikely(PacketCopyData(p, pkt, h->caplen))) {
+    if (ptv->mmap.map != NULL) {
+        /* point into the mapping, the packet holds a reference to it */
+        if (unlikely(PacketSetData(p, pkt, h->caplen))) {
+            TmqhOutputPacketpool(ptv->tv, p);
+            PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
+            SCReturn;
+        }
+        PcapFileMapRef(ptv->mmap.map);
+        p->pcap_v.relptr = ptv->mmap.map;
+        p->ReleasePacket = PcapFileMmapReleasePacket;
+    } else if (unlikely(PacketCopyData(p, pkt, h->caplen))) {
         TmqhOutputPacketpool(ptv->tv, p);
         PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
         SCReturn;
     }
 
     /* We only check for checksum disable */
-    if (pcap_g.checksum_mode == CHECKSUM_VALIDATION_DISABLE) {
+    if (ptv->checksum_mode == CHECKSUM_VALIDATION_DISABLE) {
         p->flags |= PKT_IGNORE_CHECKSUM;
-    } else if (pcap_g.checksum_mode == CHECKSUM_VALIDATION_AUTO) {
-        if (ChecksumAutoModeCheck(ptv->pkts, p->pcap_cnt,
+    } else if (ptv->checksum_mode == CHECKSUM_VALIDATION_AUTO &&
+               ptv->pkts <= CHECKSUM_SAMPLE_COUNT) {
+        /* only the first packets of each reader are sampled, so the
+         * readers don't share a counter for the whole run */
+        uint64_t cnt = SC_ATOMIC_ADD(pcap_g.cnt, 1);
+        if (ChecksumAutoModeCheck((uint32_t)ptv->pkts, (unsigned int)cnt,
                                   SC_ATOMIC_GET(pcap_g.invalid_checksums))) {
-            pcap_g.checksum_mode = CHECKSUM_VALIDATION_DISABLE;
+            ptv->checksum_mode = CHECKSUM_VALIDATION_DISABLE;
             p->flags |= PKT_IGNORE_CHECKSUM;
         }
     }
 
     PACKET_PROFILING_TMM_END(p, TMM_RECEIVEPCAPFILE);
 
-    if (TmThreadsSlotProcessPkt(ptv->tv, ptv->slot, p) != TM_ECODE_OK) {
-        pcap_breakloop(pcap_g.pcap_handle);
-        ptv->cb_result = TM_ECODE_FAILED;
+    ptv->batch[ptv->batch_cnt++] = p;
+    if (ptv->batch_cnt == TM_PKT_BATCH_SIZE) {
+        PcapFileFlushBatch(ptv);
+        if (ptv->cb_result == TM_ECODE_FAILED && ptv->pcap_handle != NULL)
+            pcap_breakloop(ptv->pcap_handle);
     }
 
     SCReturn;
 }
 
+/** \internal
+ *  \brief pcap_dispatch for the mmap reader
+ *
+ *  \retval n packets read, records dropped by the filter not counted
+ *  \retval 0 end of file
+ *  \retval -1 error, ptv->mmap.err is set
+ */
+static int PcapFileMmapDispatch(PcapFileThreadVars *ptv, int cnt)
+{
+    struct pcap_pkthdr h;
+    uint8_t *pkt;
+    int n = 0;
+
+    while (n < cnt && ptv->cb_result != TM_ECODE_FAILED) {
+        int r = PcapFileMmapNext(&ptv->mmap, &h, &pkt);
+        if (r <= 0)
+            return (n > 0) ? n : r;
+
+#if LIBPCAP_VERSION_MAJOR == 1
+        if (ptv->filter_set && pcap_offline_filter(&ptv->filter, &h, pkt) == 0)
+            continue;
+#endif
+        PcapFileCallbackLoop((char *)ptv, &h, pkt);
+        n++;
+    }
+    return n;
+}
+
 /**
  *  \brief Main PCAP file reading Loop function
  */
@@ -192,6 +858,11 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
     ptv->slot = s->slot_next;
     ptv->cb_result = TM_ECODE_OK;
 
+    SCMutexLock(&pcap_g.readers_lock);
+    if (pcap_g.start.tv_sec == 0)
+        gettimeofday(&pcap_g.start, NULL);
+    SCMutexUnlock(&pcap_g.readers_lock);
+
     while (1) {
         if (suricata_ctl_flags & (SURICATA_STOP | SURICATA_KILL)) {
             SCReturnInt(TM_ECODE_OK);
@@ -206,43 +877,42 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
             }
         } while (packet_q_len == 0);
 
-        /* Right now we just support reading packets one at a time. */
-        r = pcap_dispatch(pcap_g.pcap_handle, (int)packet_q_len,
-                          (pcap_handler)PcapFileCallbackLoop, (u_char *)ptv);
+        /* the callback collects the packets in batches of
+         * TM_PKT_BATCH_SIZE before passing them on */
+        if (ptv->mmap.map != NULL)
+            r = PcapFileMmapDispatch(ptv, (int)packet_q_len);
+        else
+            r = pcap_dispatch(ptv->pcap_handle, (int)packet_q_len,
+                              (pcap_handler)PcapFileCallbackLoop, (u_char *)ptv);
+        /* pass on what's left of the last batch */
+        if (ptv->batch_cnt > 0)
+            PcapFileFlushBatch(ptv);
+
         if (unlikely(r == -1)) {
-            SCLogError(SC_ERR_PCAP_DISPATCH, "error code %" PRId32 " %s",
-                       r, pcap_geterr(pcap_g.pcap_handle));
+            SCLogError(SC_ERR_PCAP_DISPATCH, "error code %" PRId32 " %s", r,
+                       ptv->mmap.map ? ptv->mmap.err : pcap_geterr(ptv->pcap_handle));
             if (! RunModeUnixSocketIsActive()) {
                 /* in the error state we just kill the engine */
                 EngineKill();
                 SCReturnInt(TM_ECODE_FAILED);
             } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
-                UnixSocketPcapFile(TM_ECODE_DONE);
-                SCReturnInt(TM_ECODE_DONE);
+                PcapFileClose(ptv);
+                SCReturnInt(PcapFileReaderDone(ptv));
             }
         } else if (unlikely(r == 0)) {
             SCLogInfo("pcap file end of file reached (pcap err code %" PRId32 ")", r);
-            if (! RunModeUnixSocketIsActive()) {
-                EngineStop();
-            } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
-                UnixSocketPcapFile(TM_ECODE_DONE);
-                SCReturnInt(TM_ECODE_DONE);
-            }
-            break;
+            PcapFileClose(ptv);
+            if (PcapFileOpenNext(ptv) == TM_ECODE_OK)
+                continue;
+            SCReturnInt(PcapFileReaderDone(ptv));
         } else if (ptv->cb_result == TM_ECODE_FAILED) {
             SCLogError(SC_ERR_PCAP_DISPATCH, "Pcap callback PcapFileCallbackLoop failed");
             if (! RunModeUnixSocketIsActive()) {
                 EngineKill();
                 SCReturnInt(TM_ECODE_FAILED);
             } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
-                UnixSocketPcapFile(TM_ECODE_DONE);
-                SCReturnInt(TM_ECODE_DONE);
+                PcapFileClose(ptv);
+                SCReturnInt(PcapFileReaderDone(ptv));
             }
         }
         SCPerfSyncCountersIfSignalled(tv);
@@ -251,96 +921,84 @@ TmEcode ReceivePcapFileLoop(ThreadVars *tv, void *data, void *slot)
     SCReturnInt(TM_ECODE_OK);
 }
 
+/**
+ *  \brief Init a pcap file reader
+ *
+ *  \param initdata PcapFileShard with the files to read, owned by the
+ *                  reader from here on
+ */
 TmEcode ReceivePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data) {
     SCEnter();
     char *tmpbpfstring = NULL;
     char *tmpstring = NULL;
-    if (initdata == NULL) {
+    PcapFileShard *shard = (PcapFileShard *)initdata;
+    if (shard == NULL || shard->cnt == 0) {
         SCLogError(SC_ERR_INVALID_ARGUMENT, "error: initdata == NULL");
+        PcapFileShardFree(shard);
         SCReturnInt(TM_ECODE_FAILED);
     }
 
-    SCLogInfo("reading pcap file %s", (char *)initdata);
-
     PcapFileThreadVars *ptv = SCMalloc(sizeof(PcapFileThreadVars));
-    if (unlikely(ptv == NULL))
+    if (unlikely(ptv == NULL)) {
+        PcapFileShardFree(shard);
         SCReturnInt(TM_ECODE_FAILED);
-    memset(ptv, 0, sizeof(PcapFileThreadVars));
-
-    char errbuf[PCAP_ERRBUF_SIZE] = "";
-    pcap_g.pcap_handle = pcap_open_offline((char *)initdata, errbuf);
-    if (pcap_g.pcap_handle == NULL) {
-        SCLogError(SC_ERR_FOPEN, "%s\n", errbuf);
-        SCFree(ptv);
-        if (! RunModeUnixSocketIsActive()) {
-            return TM_ECODE_FAILED;
-        } else {
-            UnixSocketPcapFile(TM_ECODE_FAILED);
-            SCReturnInt(TM_ECODE_DONE);
-        }
     }
+    memset(ptv, 0, sizeof(PcapFileThreadVars));
+    ptv->shard = shard;
 
     if (ConfGet("bpf-filter", &tmpbpfstring) != 1) {
         SCLogDebug("could not get bpf or none specified");
     } else {
         SCLogInfo("using bpf-filter \"%s\"", tmpbpfstring);
+        ptv->bpf_string = tmpbpfstring;
+    }
 
-        if(pcap_compile(pcap_g.pcap_handle,&pcap_g.filter,tmpbpfstring,1,0) < 0) {
-            SCLogError(SC_ERR_BPF,"bpf compilation error %s",pcap_geterr(pcap_g.pcap_handle));
-            SCFree(ptv);
-            return TM_ECODE_FAILED;
+    /* the first file has to be readable, later ones are skipped if not */
+    while (PcapFileOpen(ptv) != TM_ECODE_OK) {
+        if (ptv->file_idx + 1 < shard->cnt) {
+            ptv->errs++;
+            ptv->file_idx++;
+            continue;
         }
-
-        if(pcap_setfilter(pcap_g.pcap_handle,&pcap_g.filter) < 0) {
-            SCLogError(SC_ERR_BPF,"could not set bpf filter %s",pcap_geterr(pcap_g.pcap_handle));
-            SCFree(ptv);
-            return TM_ECODE_FAILED;
+        PcapFileShardFree(shard);
+        SCFree(ptv);
+        if (! RunModeUnixSocketIsActive()) {
+            SCReturnInt(TM_ECODE_FAILED);
+        } else {
+            UnixSocketPcapFile(TM_ECODE_FAILED);
+            SCReturnInt(TM_ECODE_DONE);
         }
     }
 
-    pcap_g.datalink = pcap_datalink(pcap_g.pcap_handle);
-    SCLogDebug("datalink %" PRId32 "", pcap_g.datalink);
-
-    switch(pcap_g.datalink) {
-        case LINKTYPE_LINUX_SLL:
-            pcap_g.Decoder = DecodeSll;
-            break;
-        case LINKTYPE_ETHERNET:
-            pcap_g.Decoder = DecodeEthernet;
-            break;
-        case LINKTYPE_PPP:
-            pcap_g.Decoder = DecodePPP;
-            break;
-        case LINKTYPE_RAW:
-            pcap_g.Decoder = DecodeRaw;
-            break;
-
-        default:
-            SCLogError(SC_ERR_UNIMPLEMENTED, "datalink type %" PRId32 " not "
-                      "(yet) supported in module PcapFile.\n", pcap_g.datalink);
-            SCFree(ptv);
-            if (! RunModeUnixSocketIsActive()) {
-                SCReturnInt(TM_ECODE_FAILED);
-            } else {
-                pcap_close(pcap_g.pcap_handle);
-                pcap_g.pcap_handle = NULL;
-                UnixSocketPcapFile(TM_ECODE_DONE);
-                SCReturnInt(TM_ECODE_DONE);
-            }
-    }
-
     if (ConfGet("pcap-file.checksum-checks", &tmpstring) != 1) {
-        pcap_g.conf_checksum_mode = CHECKSUM_VALIDATION_AUTO;
+        ptv->conf_checksum_mode = CHECKSUM_VALIDATION_AUTO;
     } else {
         if (strcmp(tmpstring, "auto") == 0) {
-            pcap_g.conf_checksum_mode = CHECKSUM_VALIDATION_AUTO;
+            ptv->conf_checksum_mode = CHECKSUM_VALIDATION_AUTO;
         } else if (strcmp(tmpstring, "yes") == 0) {
-            pcap_g.conf_checksum_mode = CHECKSUM_VALIDATION_ENABLE;
+            ptv->conf_checksum_mode = CHECKSUM_VALIDATION_ENABLE;
         } else if (strcmp(tmpstring, "no") == 0) {
-            pcap_g.conf_checksum_mode = CHECKSUM_VALIDATION_DISABLE;
+            ptv->conf_checksum_mode = CHECKSUM_VALIDATION_DISABLE;
         }
     }
-    pcap_g.checksum_mode = pcap_g.conf_checksum_mode;
+    ptv->checksum_mode = ptv->conf_checksum_mode;
+
+    if (shard->time_domain != 0 && TimeDomainActivate(shard->time_domain) != 0) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "time domain %"PRIu8" of pcap "
+                "reader %"PRIu16" is in use", shard->time_domain, shard->id + 1);
+        PcapFileClose(ptv);
+        PcapFileShardFree(shard);
+        SCFree(ptv);
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    SCMutexLock(&pcap_g.readers_lock);
+    if (pcap_g.readers == 0) {
+        memset(&pcap_g.start, 0x00, sizeof(pcap_g.start));
+    }
+    pcap_g.readers++;
+    pcap_g.shards[shard->id] = shard;
+    SCMutexUnlock(&pcap_g.readers_lock);
 
     ptv->tv = tv;
     *data = (void *)ptv;
@@ -351,10 +1009,12 @@ void ReceivePcapFileThreadExitStats(ThreadVars *tv, void *data) {
     SCEnter();
     PcapFileThreadVars *ptv = (PcapFileThreadVars *)data;
 
-    if (pcap_g.conf_checksum_mode == CHECKSUM_VALIDATION_AUTO &&
-            pcap_g.cnt < CHECKSUM_SAMPLE_COUNT &&
+    /* the checksum sample is shared, so only the first reader reports */
+    if (ptv->shard->id == 0 &&
+            ptv->conf_checksum_mode == CHECKSUM_VALIDATION_AUTO &&
+            SC_ATOMIC_GET(pcap_g.cnt) < CHECKSUM_SAMPLE_COUNT &&
             SC_ATOMIC_GET(pcap_g.invalid_checksums)) {
-        uint64_t chrate = pcap_g.cnt / SC_ATOMIC_GET(pcap_g.invalid_checksums);
+        uint64_t chrate = SC_ATOMIC_GET(pcap_g.cnt) / SC_ATOMIC_GET(pcap_g.invalid_checksums);
         if (chrate < CHECKSUM_INVALID_RATIO)
             SCLogWarning(SC_ERR_INVALID_CHECKSUM,
                          "1/%" PRIu64 "th of packets have an invalid checksum,"
@@ -365,7 +1025,10 @@ void ReceivePcapFileThreadExitStats(ThreadVars *tv, void *data) {
             SCLogInfo("1/%" PRIu64 "th of packets have an invalid checksum",
                       chrate);
     }
-    SCLogNotice("Pcap-file module read %" PRIu32 " packets, %" PRIu64 " bytes", ptv->pkts, ptv->bytes);
+    SCLogNotice("Pcap-file module read %" PRIu64 " packets, %" PRIu64 " bytes", ptv->pkts, ptv->bytes);
+    if (ptv->errs > 0) {
+        SCLogWarning(SC_ERR_FOPEN, "%" PRIu32 " pcap files could not be read", ptv->errs);
+    }
     return;
 }
 
@@ -373,12 +1036,21 @@ TmEcode ReceivePcapFileThreadDeinit(ThreadVars *tv, void *data) {
     SCEnter();
     PcapFileThreadVars *ptv = (PcapFileThreadVars *)data;
     if (ptv) {
+        PcapFileRelease(ptv);
+
+        SCMutexLock(&pcap_g.readers_lock);
+        if (pcap_g.shards[ptv->shard->id] == ptv->shard)
+            pcap_g.shards[ptv->shard->id] = NULL;
+        SCMutexUnlock(&pcap_g.readers_lock);
+
+        PcapFileShardFree(ptv->shard);
         SCFree(ptv);
     }
     SCReturnInt(TM_ECODE_OK);
 }
 
-double prev_signaled_ts = 0;
+/** last time the flow manager was woken up, per time domain */
+static double prev_signaled_ts[TIME_DOMAIN_MAX];
 
 TmEcode DecodePcapFile(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq)
 {
@@ -404,17 +1076,22 @@ TmEcode DecodePcapFile(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, P
     SCPerfCounterSetUI64(dtv->counter_max_pkt_size, tv->sc_perf_pca, GET_PKT_LEN(p));
 
     double curr_ts = p->ts.tv_sec + p->ts.tv_usec / 1000.0;
-    if (curr_ts < prev_signaled_ts || (curr_ts - prev_signaled_ts) > 60.0) {
-        prev_signaled_ts = curr_ts;
+    double *prev_ts = &prev_signaled_ts[p->time_domain];
+    if (curr_ts < *prev_ts || (curr_ts - *prev_ts) > 60.0) {
+        *prev_ts = curr_ts;
         FlowWakeupFlowManagerThread();
     }
 
     /* update the engine time representation based on the timestamp
-     * of the packet. */
-    TimeSet(&p->ts);
+     * of the packet. Readers with a time domain of their own only move
+     * their own clock. */
+    TimeSetDomain(p->time_domain, &p->ts);
 
     /* call the decoder */
-    pcap_g.Decoder(tv, dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p), pq);
+    PcapFileDecoderFunc Decoder = PcapFileGetDecoder(p->datalink);
+    if (unlikely(Decoder == NULL))
+        SCReturnInt(TM_ECODE_OK);
+    Decoder(tv, dtv, p, GET_PKT_DATA(p), GET_PKT_LEN(p), pq);
 
 #ifdef DEBUG
     BUG_ON(p->pkt_src != PKT_SRC_WIRE && p->pkt_src != PKT_SRC_FFR_V2);
@@ -425,6 +1102,26 @@ TmEcode DecodePcapFile(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, P
     SCReturnInt(TM_ECODE_OK);
 }
 
+/**
+ *  \brief decode a batch of packets, prefetching the data of the
+ *         next packet while decoding the current one.
+ */
+TmEcode DecodePcapFileBatch(ThreadVars *tv, Packet **pkts, uint16_t n, void *data,
+                            PacketQueue *pq, PacketQueue *postpq)
+{
+    uint16_t i;
+
+    for (i = 0; i < n; i++) {
+        if (i + 1 < n)
+            prefetch(GET_PKT_DATA(pkts[i + 1]));
+
+        if (DecodePcapFile(tv, pkts[i], data, pq, postpq) == TM_ECODE_FAILED)
+            return TM_ECODE_FAILED;
+    }
+
+    return TM_ECODE_OK;
+}
+
 TmEcode DecodePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data)
 {
     SCEnter();
@@ -446,11 +1143,180 @@ TmEcode DecodePcapFileThreadInit(ThreadVars *tv, void *initdata, void **data)
     SCReturnInt(TM_ECODE_OK);
 }
 
+TmEcode DecodePcapFileThreadDeinit(ThreadVars *tv, void *data)
+{
+    if (data != NULL)
+        DecodeThreadVarsFree(tv, data);
+    SCReturnInt(TM_ECODE_OK);
+}
+
 
 void PcapIncreaseInvalidChecksum()
 {
     (void) SC_ATOMIC_ADD(pcap_g.invalid_checksums, 1);
 }
 
-/* eof */
+#ifdef UNITTESTS
+
+/** \test contiguous shards of about the same size, with at least one
+ *        file per shard */
+static int PcapFileShardsTest01(void)
+{
+    uint32_t first[5];
+
+    uint64_t equal[] = { 10, 10, 10, 10 };
+    PcapFileShardsSplit(equal, 4, 2, first);
+    if (first[0] != 0 || first[1] != 2 || first[2] != 4)
+        return 0;
+
+    PcapFileShardsSplit(equal, 4, 4, first);
+    if (first[0] != 0 || first[1] != 1 || first[2] != 2 ||
+        first[3] != 3 || first[4] != 4)
+        return 0;
+
+    /* a big first file is a shard of its own */
+    uint64_t big[] = { 100, 1, 1, 1 };
+    PcapFileShardsSplit(big, 4, 2, first);
+    if (first[1] != 1 || first[2] != 4)
+        return 0;
+
+    /* a big last file still leaves a file for the first shards */
+    uint64_t last[] = { 1, 1, 1, 100 };
+    PcapFileShardsSplit(last, 4, 3, first);
+    if (first[0] != 0 || first[1] != 2 || first[2] != 3 || first[3] != 4)
+        return 0;
+
+    /* empty files */
+    uint64_t empty[] = { 0, 0, 0 };
+    PcapFileShardsSplit(empty, 3, 3, first);
+    if (first[1] != 1 || first[2] != 2 || first[3] != 3)
+        return 0;
+
+    return 1;
+}
 
+/** \test a directory is split in name order, a file is a single shard */
+static int PcapFileShardsTest02(void)
+{
+    char dir[] = "/tmp/suricata-pcap-XXXXXX";
+    char path[PATH_MAX];
+    const char *names[] = { "c.pcap", "a.pcap", "b.pcap", ".hidden" };
+    PcapFileShard **shards = NULL;
+    uint16_t readers = 2;
+    int result = 0;
+    size_t i;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL)
+            goto end;
+        fputs("xxxxxxxx", fp);
+        fclose(fp);
+    }
+
+    shards = PcapFileShardsBuild(dir, &readers);
+    if (shards == NULL || readers != 2)
+        goto end;
+    if (shards[0]->cnt + shards[1]->cnt != 3)
+        goto end;
+    snprintf(path, sizeof(path), "%s/a.pcap", dir);
+    if (strcmp(shards[0]->files[0], path) != 0)
+        goto end;
+    snprintf(path, sizeof(path), "%s/c.pcap", dir);
+    if (strcmp(shards[1]->files[shards[1]->cnt - 1], path) != 0)
+        goto end;
+    if (shards[0]->time_domain != 1 || shards[1]->time_domain != 2 ||
+        shards[1]->id != 1)
+        goto end;
+    PcapFileShardFree(shards[0]);
+    PcapFileShardFree(shards[1]);
+    SCFree(shards);
+
+    /* more readers than files */
+    readers = 16;
+    shards = PcapFileShardsBuild(dir, &readers);
+    if (shards == NULL || readers != 3)
+        goto end;
+    for (i = 0; i < readers; i++)
+        PcapFileShardFree(shards[i]);
+    SCFree(shards);
+
+    readers = 4;
+    shards = PcapFileShardsBuild(path, &readers);
+    if (shards == NULL || readers != 1 || shards[0]->cnt != 1 ||
+        shards[0]->time_domain != 0)
+        goto end;
+
+    result = 1;
+end:
+    if (shards != NULL) {
+        for (i = 0; i < readers; i++)
+            PcapFileShardFree(shards[i]);
+        SCFree(shards);
+    }
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, names[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+    return result;
+}
+
+/** \test records of the multi reader runmode are tagged with their file,
+ *        other packets are not */
+static int PcapFileGetFilenameTest01(void)
+{
+    int result = 0;
+    Packet *p = SCCalloc(1, SIZE_OF_PACKET);
+    Packet *tp = SCCalloc(1, SIZE_OF_PACKET);
+    if (p == NULL || tp == NULL)
+        goto end;
+
+    /* single reader */
+    PKT_SET_SRC(p, PKT_SRC_WIRE);
+    p->pcap_v.file = "a.pcap";
+    if (PcapFileGetFilename(p) != NULL)
+        goto end;
+
+    p->time_domain = 2;
+    if (PcapFileGetFilename(p) == NULL ||
+        strcmp(PcapFileGetFilename(p), "a.pcap") != 0)
+        goto end;
+
+    /* tunnel packet, its own pcap vars are not set */
+    PKT_SET_SRC(tp, PKT_SRC_DECODER_GRE);
+    tp->root = p;
+    tp->time_domain = 2;
+    if (PcapFileGetFilename(tp) != p->pcap_v.file)
+        goto end;
+
+    /* flow timeout pseudo packet */
+    tp->root = NULL;
+    PKT_SET_SRC(tp, PKT_SRC_FFR_V2);
+    tp->pcap_v.file = "stale.pcap";
+    if (PcapFileGetFilename(tp) != NULL)
+        goto end;
+
+    result = 1;
+end:
+    SCFree(p);
+    SCFree(tp);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+static void PcapFileRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("PcapFileShardsTest01", PcapFileShardsTest01, 1);
+    UtRegisterTest("PcapFileShardsTest02", PcapFileShardsTest02, 1);
+    UtRegisterTest("PcapFileGetFilenameTest01", PcapFileGetFilenameTest01, 1);
+#endif /* UNITTESTS */
+}
+
+/* eof */
@@ -24,6 +24,39 @@
 #ifndef __SOURCE_PCAP_FILE_H__
 #define __SOURCE_PCAP_FILE_H__
 
+/** \brief numbers of a single pcap file, for the throughput report */
+typedef struct PcapFileStats_ {
+    uint64_t pkts;
+    uint64_t bytes;
+    /** time spent reading the file, in usecs */
+    uint64_t usecs;
+} PcapFileStats;
+
+/**
+ * \brief Files read by a single pcap file reader, one after the other.
+ *
+ * Passed to the ReceivePcapFile module as its initdata, the reader owns
+ * it from then on.
+ */
+typedef struct PcapFileShard_ {
+    char **files;
+    PcapFileStats *stats;
+    uint32_t cnt;
+    /** reader number, starting at 0 */
+    uint16_t id;
+    /** time domain of the reader, 0 to use the engine clock */
+    uint8_t time_domain;
+    /** read the files with the mmap reader, libpcap is used for files
+     *  it doesn't handle */
+    uint8_t mmap;
+} PcapFileShard;
+
+PcapFileShard *PcapFileShardNew(const char *);
+int PcapFileShardAddFile(PcapFileShard *, const char *);
+void PcapFileShardFree(PcapFileShard *);
+PcapFileShard **PcapFileShardsBuild(const char *, uint16_t *);
+const char *PcapFileGetFilename(const Packet *);
+
 void TmModuleReceivePcapFileRegister (void);
 void TmModuleDecodePcapFileRegister (void);
 
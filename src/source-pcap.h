@@ -39,6 +39,11 @@ char *PcapLiveGetDevice(int);
 /* per packet Pcap vars */
 typedef struct PcapPacketVars_
 {
+    /** mapping of the pcap file the packet points into, if any */
+    void *relptr;
+    /** file the packet was read from when several readers log into the
+     *  same outputs, see PcapFileGetFilename() */
+    const char *file;
 } PcapPacketVars;
 
 /** needs to be able to contain Windows adapter id's, so
@@ -86,6 +86,30 @@ static uint64_t segment_pool_cnt = 0;
 #endif
 /* index to the right pool for all packet sizes. */
 static uint16_t segment_pool_idx[65536]; /* O(1) lookups of the pool */
+
+/* Per thread segment caches ("magazines") in front of the global pools.
+ * A stream thread takes segments from and returns segments to its own
+ * cache without locking. The cache is refilled from and drained to the
+ * global pool in bulk, so the pool lock is taken once per batch instead
+ * of once per segment. Segments in a cache are accounted in ra_memuse
+ * just like the unused segments in the pool. */
+typedef struct TcpSegmentCacheClass_ {
+    TcpSegment *head;
+    uint32_t cnt;
+} TcpSegmentCacheClass;
+
+typedef struct TcpSegmentCache_ {
+    int num;                        /**< number of size classes */
+    TcpSegmentCacheClass *classes;  /**< one per segment pool */
+} TcpSegmentCache;
+
+/** max number of segments per size class in a thread cache, 0 disables */
+static uint32_t segment_thread_cache_size = 64;
+
+#ifdef TLS
+/** cache of the current thread, used when returning segments */
+static __thread TcpSegmentCache *segment_thread_cache = NULL;
+#endif
 static int check_overlap_different_data = 0;
 
 /* Memory use counter */
@@ -223,9 +247,114 @@ void TcpSegmentPoolCleanup(void *ptr) {
     return;
 }
 
+/**
+ *  \brief Get segments from the global pool into a thread cache
+ *
+ *  Takes up to half the cache size in a single lock period. Only the
+ *  first segment may be newly allocated by the pool, the rest is only
+ *  taken if the pool has spare segments. This way we don't allocate
+ *  more than before and the memcap behaviour is unchanged.
+ *
+ *  \param cache thread cache
+ *  \param idx size class / pool index
+ */
+static void StreamTcpSegmentCacheRefill(TcpSegmentCache *cache, uint16_t idx)
+{
+    TcpSegmentCacheClass *c = &cache->classes[idx];
+    uint32_t want = segment_thread_cache_size / 2;
+    if (want == 0)
+        want = 1;
+
+    SCMutexLock(&segment_pool_mutex[idx]);
+    do {
+        TcpSegment *seg = (TcpSegment *) PoolGet(segment_pool[idx]);
+        if (seg == NULL)
+            break;
+
+        seg->next = c->head;
+        c->head = seg;
+        c->cnt++;
+    } while (c->cnt < want && segment_pool[idx]->alloc_stack_size > 0);
+    SCMutexUnlock(&segment_pool_mutex[idx]);
+}
+
+/**
+ *  \brief Return segments from a thread cache to the global pool
+ *
+ *  \param cache thread cache
+ *  \param idx size class / pool index
+ *  \param keep number of segments to keep in the cache
+ */
+static void StreamTcpSegmentCacheDrain(TcpSegmentCache *cache, uint16_t idx,
+        uint32_t keep)
+{
+    TcpSegmentCacheClass *c = &cache->classes[idx];
+    if (c->cnt <= keep)
+        return;
+
+    SCMutexLock(&segment_pool_mutex[idx]);
+    while (c->cnt > keep) {
+        TcpSegment *seg = c->head;
+        c->head = seg->next;
+        c->cnt--;
+
+        seg->next = NULL;
+        PoolReturn(segment_pool[idx], (void *) seg);
+    }
+    SCMutexUnlock(&segment_pool_mutex[idx]);
+}
+
+/** \brief setup a segment cache for the calling thread
+ *
+ *  \retval cache or NULL if disabled or on alloc failure
+ */
+static TcpSegmentCache *StreamTcpSegmentCacheInit(void)
+{
+    if (segment_thread_cache_size == 0 || segment_pool_num == 0)
+        return NULL;
+
+    TcpSegmentCache *cache = SCMalloc(sizeof(TcpSegmentCache));
+    if (unlikely(cache == NULL))
+        return NULL;
+
+    cache->classes = SCMalloc(segment_pool_num * sizeof(TcpSegmentCacheClass));
+    if (unlikely(cache->classes == NULL)) {
+        SCFree(cache);
+        return NULL;
+    }
+    memset(cache->classes, 0x00, segment_pool_num * sizeof(TcpSegmentCacheClass));
+    cache->num = segment_pool_num;
+
+#ifdef TLS
+    segment_thread_cache = cache;
+#endif
+    return cache;
+}
+
+/** \brief return all segments of a thread cache to the pools and free it */
+static void StreamTcpSegmentCacheFree(TcpSegmentCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+#ifdef TLS
+    if (segment_thread_cache == cache)
+        segment_thread_cache = NULL;
+#endif
+
+    uint16_t idx;
+    for (idx = 0; idx < cache->num && idx < segment_pool_num; idx++) {
+        StreamTcpSegmentCacheDrain(cache, idx, 0);
+    }
+    SCFree(cache->classes);
+    SCFree(cache);
+}
+
 /**
  *  \brief Function to return the segment back to the pool.
  *
+ *  If the calling thread has a segment cache, the segment goes there.
+ *
  *  \param seg Segment which will be returned back to the pool.
  */
 void StreamTcpSegmentReturntoPool(TcpSegment *seg)
@@ -237,6 +366,26 @@ void StreamTcpSegmentReturntoPool(TcpSegment *seg)
     seg->prev = NULL;
 
     uint16_t idx = segment_pool_idx[seg->pool_size];
+
+#ifdef TLS
+    TcpSegmentCache *cache = segment_thread_cache;
+    if (cache != NULL && idx < cache->num) {
+        TcpSegmentCacheClass *c = &cache->classes[idx];
+        seg->next = c->head;
+        c->head = seg;
+        c->cnt++;
+
+        if (c->cnt > segment_thread_cache_size) {
+            StreamTcpSegmentCacheDrain(cache, idx, segment_thread_cache_size / 2);
+        }
+#ifdef DEBUG
+        SCMutexLock(&segment_pool_cnt_mutex);
+        segment_pool_cnt--;
+        SCMutexUnlock(&segment_pool_cnt_mutex);
+#endif
+        return;
+    }
+#endif
     SCMutexLock(&segment_pool_mutex[idx]);
     PoolReturn(segment_pool[idx], (void *) seg);
     SCLogDebug("segment_pool[%"PRIu16"]->empty_stack_size %"PRIu32"",
@@ -459,6 +608,21 @@ int StreamTcpReassemblyConfig(char quiet)
     }
     if (!quiet)
         SCLogInfo("stream.reassembly \"chunk-prealloc\": %u", stream_chunk_prealloc);
+
+    ConfNode *cache = ConfGetNode("stream.reassembly.segment-thread-cache");
+    if (cache) {
+        uint32_t cache_size = 0;
+        if (ByteExtractStringUint32(&cache_size, 10, strlen(cache->val), cache->val) == -1)
+        {
+            SCLogError(SC_ERR_INVALID_ARGUMENT, "segment-thread-cache of "
+                    "%s is invalid", cache->val);
+            return -1;
+        }
+        segment_thread_cache_size = cache_size;
+    }
+    if (!quiet)
+        SCLogInfo("stream.reassembly \"segment-thread-cache\": %u",
+                segment_thread_cache_size);
     StreamMsgQueuesInit(stream_chunk_prealloc);
     return 0;
 }
@@ -485,6 +649,18 @@ static uint32_t dbg_app_layer_gap_candidate;
 void StreamTcpReassembleFree(char quiet)
 {
     uint16_t u16 = 0;
+
+#ifdef TLS
+    /* return what our own thread cache holds before the pools go away */
+    if (segment_thread_cache != NULL) {
+        for (u16 = 0; u16 < segment_thread_cache->num &&
+                u16 < segment_pool_num; u16++) {
+            StreamTcpSegmentCacheDrain(segment_thread_cache, u16, 0);
+        }
+        segment_thread_cache = NULL;
+    }
+#endif
+
     for (u16 = 0; u16 < segment_pool_num; u16++) {
         SCMutexLock(&segment_pool_mutex[u16]);
 
@@ -513,6 +689,7 @@ void StreamTcpReassembleFree(char quiet)
     segment_pool = NULL;
     segment_pool_mutex = NULL;
     segment_pool_pktsizes = NULL;
+    segment_pool_num = 0;
 
     StreamMsgQueuesDeinit(quiet);
 
@@ -537,6 +714,7 @@ TcpReassemblyThreadCtx *StreamTcpReassembleInitThreadCtx(ThreadVars *tv)
     memset(ra_ctx, 0x00, sizeof(TcpReassemblyThreadCtx));
 
     ra_ctx->app_tctx = AppLayerGetCtxThread(tv);
+    ra_ctx->segment_cache = StreamTcpSegmentCacheInit();
 
     SCReturnPtr(ra_ctx, "TcpReassemblyThreadCtx");
 }
@@ -544,6 +722,7 @@ TcpReassemblyThreadCtx *StreamTcpReassembleInitThreadCtx(ThreadVars *tv)
 void StreamTcpReassembleFreeThreadCtx(TcpReassemblyThreadCtx *ra_ctx)
 {
     SCEnter();
+    StreamTcpSegmentCacheFree(ra_ctx->segment_cache);
     AppLayerDestroyCtxThread(ra_ctx->app_tctx);
     SCFree(ra_ctx);
     SCReturn;
@@ -3764,14 +3943,27 @@ TcpSegment* StreamTcpGetSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
     SCLogDebug("segment_pool_idx %" PRIu32 " for payload_len %" PRIu32 "",
                 idx, len);
 
-    SCMutexLock(&segment_pool_mutex[idx]);
-    TcpSegment *seg = (TcpSegment *) PoolGet(segment_pool[idx]);
+    TcpSegment *seg = NULL;
+    TcpSegmentCache *cache = ra_ctx->segment_cache;
+    if (cache != NULL && idx < cache->num) {
+        TcpSegmentCacheClass *c = &cache->classes[idx];
+        if (c->head == NULL)
+            StreamTcpSegmentCacheRefill(cache, idx);
+        if (c->head != NULL) {
+            seg = c->head;
+            c->head = seg->next;
+            c->cnt--;
+        }
+    } else {
+        SCMutexLock(&segment_pool_mutex[idx]);
+        seg = (TcpSegment *) PoolGet(segment_pool[idx]);
 
-    SCLogDebug("segment_pool[%u]->empty_stack_size %u, segment_pool[%u]->alloc_"
-               "list_size %u, alloc %u", idx, segment_pool[idx]->empty_stack_size,
-               idx, segment_pool[idx]->alloc_stack_size,
-               segment_pool[idx]->allocated);
-    SCMutexUnlock(&segment_pool_mutex[idx]);
+        SCLogDebug("segment_pool[%u]->empty_stack_size %u, segment_pool[%u]->alloc_"
+                   "list_size %u, alloc %u", idx, segment_pool[idx]->empty_stack_size,
+                   idx, segment_pool[idx]->alloc_stack_size,
+                   segment_pool[idx]->allocated);
+        SCMutexUnlock(&segment_pool_mutex[idx]);
+    }
 
     SCLogDebug("seg we return is %p", seg);
     if (seg == NULL) {
@@ -8942,6 +9134,72 @@ end:
 
 #endif /* UNITTESTS */
 
+/**
+ *  \test  Test that segments returned by a thread are reused from its
+ *         thread cache and that the cache is handed back to the pool
+ *         when the thread ctx is freed.
+ */
+static int StreamTcpReassembleSegmentCacheTest01(void)
+{
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    int ret = 0;
+
+    memset(&tv, 0x00, sizeof(tv));
+
+    StreamTcpUTInit(&ra_ctx);
+    if (ra_ctx->segment_cache == NULL) {
+        /* no cache, nothing to test */
+        ret = 1;
+        goto end;
+    }
+
+    uint64_t memuse = SC_ATOMIC_GET(ra_memuse);
+
+    TcpSegment *seg = StreamTcpGetSegment(&tv, ra_ctx, 100);
+    if (seg == NULL) {
+        printf("no segment: ");
+        goto end;
+    }
+    uint16_t idx = segment_pool_idx[100];
+
+    StreamTcpSegmentReturntoPool(seg);
+#ifdef TLS
+    if (ra_ctx->segment_cache->classes[idx].head != seg) {
+        printf("segment not returned to the thread cache: ");
+        goto end;
+    }
+
+    TcpSegment *seg2 = StreamTcpGetSegment(&tv, ra_ctx, 100);
+    if (seg2 != seg) {
+        printf("expected %p got %p: ", seg, seg2);
+        goto end;
+    }
+    StreamTcpSegmentReturntoPool(seg2);
+#endif
+
+    if (SC_ATOMIC_GET(ra_memuse) != memuse) {
+        printf("memuse changed %"PRIu64" != %"PRIu64": ",
+                (uint64_t)SC_ATOMIC_GET(ra_memuse), memuse);
+        goto end;
+    }
+
+    StreamTcpReassembleFreeThreadCtx(ra_ctx);
+    ra_ctx = NULL;
+
+    if (segment_pool[idx]->outstanding != 0) {
+        printf("segments missing from pool: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    if (ra_ctx != NULL)
+        StreamTcpReassembleFreeThreadCtx(ra_ctx);
+    StreamTcpFreeConfig(TRUE);
+    return ret;
+}
+
 /** \brief  The Function Register the Unit tests to test the reassembly engine
  *          for various OS policies.
  */
@@ -9010,6 +9268,8 @@ void StreamTcpReassembleRegisterTests(void) {
     UtRegisterTest("StreamTcpReassembleInsertTest02 -- insert with overlap", StreamTcpReassembleInsertTest02, 1);
     UtRegisterTest("StreamTcpReassembleInsertTest03 -- insert with overlap", StreamTcpReassembleInsertTest03, 1);
 
+    UtRegisterTest("StreamTcpReassembleSegmentCacheTest01 -- thread segment cache", StreamTcpReassembleSegmentCacheTest01, 1);
+
     StreamTcpInlineRegisterTests();
     StreamTcpUtilRegisterTests();
 #endif /* UNITTESTS */
@@ -35,6 +35,7 @@
 
 #include "flow.h"
 #include "flow-util.h"
+#include "flow-wheel.h"
 
 #include "conf.h"
 #include "conf-yaml-loader.h"
@@ -401,6 +402,12 @@ void StreamTcpInitConfig(char quiet)
         SCLogInfo("stream \"async-oneside\": %s", stream_config.async_oneside ? "enabled" : "disabled");
     }
 
+    ConfGetBool("stream.bypass", &stream_config.bypass);
+
+    if (!quiet) {
+        SCLogInfo("stream \"bypass\": %s", stream_config.bypass ? "enabled" : "disabled");
+    }
+
     int csum = 0;
 
     if ((ConfGetBool("stream.checksum-validation", &csum)) == 1) {
@@ -613,6 +620,15 @@ void StreamTcpInitConfig(char quiet)
 #endif
 }
 
+/** \brief check if sessions past the reassembly depth are bypassed
+ *  \retval 1 yes
+ *  \retval 0 no
+ */
+int StreamTcpBypassEnabled(void)
+{
+    return stream_config.bypass ? 1 : 0;
+}
+
 void StreamTcpFreeConfig(char quiet)
 {
     StreamTcpReassembleFree(quiet);
@@ -668,6 +684,10 @@ static void StreamTcpPacketSetState(Packet *p, TcpSession *ssn,
         return;
 
     ssn->state = state;
+
+    /* closing states have a shorter flow timeout */
+    if (flow_wheel != NULL && p->flow != NULL)
+        FlowWheelUpdate(flow_wheel, p->flow);
 }
 
 /**
@@ -4382,6 +4402,18 @@ int StreamTcpPacket (ThreadVars *tv, Packet *p, StreamTcpThread *stt,
              (ssn->server.flags & STREAMTCP_STREAM_FLAG_DEPTH_REACHED))
         {
             p->flags |= PKT_STREAM_NOPCAPLOG;
+
+            /* both directions are past the depth and all segments have
+             * been inspected: the rest of the session can be bypassed */
+            if (stream_config.bypass &&
+                (ssn->client.flags & STREAMTCP_STREAM_FLAG_DEPTH_REACHED) &&
+                (ssn->server.flags & STREAMTCP_STREAM_FLAG_DEPTH_REACHED) &&
+                ssn->client.seg_list == NULL && ssn->server.seg_list == NULL &&
+                !(p->flow->flags & FLOW_ACTION_DROP))
+            {
+                SCLogDebug("ssn %p: bypassing flow %p", ssn, p->flow);
+                p->flow->flags |= FLOW_BYPASSED;
+            }
         }
 
         /* encrypted packets */
@@ -5265,6 +5297,7 @@ Packet *StreamTcpPseudoSetup(Packet *parent, uint8_t *pkt, uint32_t len)
 
     PacketCopyData(p, pkt, len);
     p->recursion_level = parent->recursion_level + 1;
+    p->time_domain = parent->time_domain;
     p->ts.tv_sec = parent->ts.tv_sec;
     p->ts.tv_usec = parent->ts.tv_usec;
 
@@ -68,6 +68,7 @@ typedef struct TcpStreamCnf_ {
     uint32_t reassembly_inline_window;
     uint8_t flags;
     uint8_t max_synack_queued;
+    int bypass;                 /**< bypass sessions past depth */
 } TcpStreamCnf;
 
 typedef struct StreamTcpThread_ {
@@ -107,6 +108,7 @@ typedef struct StreamTcpThread_ {
 TcpStreamCnf stream_config;
 void TmModuleStreamTcpRegister (void);
 void StreamTcpInitConfig (char);
+int StreamTcpBypassEnabled(void);
 void StreamTcpFreeConfig(char);
 void StreamTcpRegisterTests (void);
 
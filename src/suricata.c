@@ -55,6 +55,7 @@
 #include "util-running-modes.h"
 
 #include "detect-engine.h"
+#include "detect-engine-prefilter.h"
 #include "detect-parse.h"
 #include "detect-fast-pattern.h"
 #include "detect-engine-tag.h"
@@ -122,6 +123,7 @@
 #include "flow-manager.h"
 #include "flow-var.h"
 #include "flow-bit.h"
+#include "util-var-name.h"
 #include "pkt-var.h"
 
 #include "host.h"
@@ -239,6 +241,13 @@ static void SignalHandlerSigterm(/*@unused@*/ int sig) {
     sigterm_count = 1;
     suricata_ctl_flags |= SURICATA_KILL;
 }
+#ifndef OS_WIN32
+/** \brief count the SIGHUP's, log files are reopened when they see the
+ *         count change. See LogFileCheckRotate(). */
+static void SignalHandlerSighup(/*@unused@*/ int sig) {
+    sighup_count++;
+}
+#endif
 
 void SignalHandlerSigusr2Disabled(int sig)
 {
@@ -1678,7 +1687,7 @@ static int InitSignalHandler(SCInstance *suri)
 
 #ifndef OS_WIN32
     /* SIGHUP is not implemented on WIN32 */
-    UtilSignalHandlerSetup(SIGHUP, SIG_IGN);
+    UtilSignalHandlerSetup(SIGHUP, SignalHandlerSighup);
 
     /* Try to get user/group to run suricata as if
        command line as not decide of that */
@@ -2011,6 +2020,7 @@ static int PostConfLoadedSetup(SCInstance *suri)
     AppLayerHtpNeedFileInspection();
 
     DetectEngineRegisterAppInspectionEngines();
+    DetectEngineRegisterPrefilterEngines();
 
     if (suri->rule_reload) {
         if (suri->sig_file != NULL)
@@ -2224,6 +2234,14 @@ int main(int argc, char **argv)
             UnixManagerRegisterCommand("iface-stat", LiveDeviceIfaceStat, NULL,
                                        UNIX_CMD_TAKE_ARGS);
             UnixManagerRegisterCommand("iface-list", LiveDeviceIfaceList, NULL, 0);
+#ifdef PROFILING
+            if (profiling_rules_enabled) {
+                UnixManagerRegisterCommand("rule-profile", SCProfilingRuleUnixTop,
+                                           NULL, UNIX_CMD_TAKE_ARGS);
+                UnixManagerRegisterCommand("rule-profile-reset",
+                                           SCProfilingRuleUnixReset, NULL, 0);
+            }
+#endif
 #endif
         }
         /* Spawn the flow manager thread */
@@ -2231,6 +2249,7 @@ int main(int argc, char **argv)
         StreamTcpInitConfig(STREAM_VERBOSE);
 
         SCPerfSpawnThreads();
+        OutputJsonFlushThreadSpawn();
     }
 
 #ifdef __SC_CUDA_SUPPORT__
@@ -2357,6 +2376,7 @@ int main(int argc, char **argv)
     if (global_de_ctx) {
         DetectEngineCtxFree(global_de_ctx);
     }
+    VariableNameFreeGlobalHash();
     AppLayerDeSetup();
 
     TagDestroyCtx();
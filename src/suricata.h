@@ -169,6 +169,9 @@ void GlobalInits();
 
 extern uint8_t suricata_ctl_flags;
 
+/** number of SIGHUP's received, log files are reopened on a change */
+extern volatile sig_atomic_t sighup_count;
+
 /* uppercase to lowercase conversion lookup table */
 uint8_t g_u8_lowercasetable[256];
 
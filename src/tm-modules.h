@@ -45,6 +45,11 @@ typedef struct TmModule_ {
     /** the packet processing function */
     TmEcode (*Func)(ThreadVars *, Packet *, void *, PacketQueue *, PacketQueue *);
 
+    /** optional function processing a batch of packets at once. Only used
+     *  by the leading slots of a thread (decoders), as the packets of a
+     *  batch go through the later slots one by one. */
+    TmEcode (*FuncBatch)(ThreadVars *, Packet **, uint16_t, void *, PacketQueue *, PacketQueue *);
+
     TmEcode (*PktAcqLoop)(ThreadVars *, void *, void *);
 
     /** global Init/DeInit */
@@ -35,6 +35,7 @@
 #include "tmqh-packetpool.h"
 #include "tmqh-flow.h"
 #include "tmqh-ringbuffer.h"
+#include "tmqh-flow-ring.h"
 
 void TmqhSetup (void) {
     memset(&tmqh_table, 0, sizeof(tmqh_table));
@@ -44,11 +45,13 @@ void TmqhSetup (void) {
     TmqhPacketpoolRegister();
     TmqhFlowRegister();
     TmqhRingBufferRegister();
+    TmqhFlowRingRegister();
 }
 
 /** \brief Clean up registration time allocs */
 void TmqhCleanup(void) {
     TmqhRingBufferDestroy();
+    TmqhFlowRingDestroy();
 }
 
 Tmqh* TmqhGetQueueHandlerByName(char *name) {
@@ -62,3 +65,14 @@ Tmqh* TmqhGetQueueHandlerByName(char *name) {
     return NULL;
 }
 
+/**
+ *  \brief get the number of packets queued for a queue id, including
+ *         packets held by queue handlers outside of trans_q.
+ *
+ *  \param id queue id
+ *
+ *  \retval len number of packets
+ */
+uint32_t TmqhQueueLen(uint16_t id) {
+    return trans_q[id].len + TmqhFlowRingQueueLenById(id);
+}
@@ -32,6 +32,7 @@ enum {
     TMQH_RINGBUFFER_MRSW,
     TMQH_RINGBUFFER_SRSW,
     TMQH_RINGBUFFER_SRMW,
+    TMQH_FLOW_RING,
 
     TMQH_SIZE,
 };
@@ -51,6 +52,7 @@ Tmqh tmqh_table[TMQH_SIZE];
 void TmqhSetup (void);
 void TmqhCleanup(void);
 Tmqh* TmqhGetQueueHandlerByName(char *name);
+uint32_t TmqhQueueLen(uint16_t id);
 
 #endif /* __TM_QUEUEHANDLERS_H__ */
 
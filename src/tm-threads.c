@@ -123,8 +123,9 @@ TmEcode TmDummyFunc(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Pack
 /* 1 slot functions */
 void *TmThreadsSlot1NoIn(void *td)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = (TmSlot *)tv->tm_slots;
@@ -232,8 +233,9 @@ void *TmThreadsSlot1NoIn(void *td)
 
 void *TmThreadsSlot1NoOut(void *td)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = (TmSlot *)tv->tm_slots;
@@ -267,6 +269,8 @@ void *TmThreadsSlot1NoOut(void *td)
     memset(&s->slot_pre_pq, 0, sizeof(PacketQueue));
     memset(&s->slot_post_pq, 0, sizeof(PacketQueue));
 
+    PacketPoolInitThread(tv, 0);
+
     tv->sc_perf_pca = SCPerfGetAllCountersArray(&tv->sc_perf_pctx);
     SCPerfAddToClubbedTMTable((tv->thread_group_name != NULL) ?
             tv->thread_group_name : tv->name, &tv->sc_perf_pctx);
@@ -301,6 +305,7 @@ void *TmThreadsSlot1NoOut(void *td)
         }
     } /* while (run) */
 
+    PacketPoolDeinitThread();
     TmThreadsSetFlag(tv, THV_RUNNING_DONE);
     TmThreadWaitForFlag(tv, THV_DEINIT);
 
@@ -324,8 +329,9 @@ void *TmThreadsSlot1NoOut(void *td)
 
 void *TmThreadsSlot1NoInOut(void *td)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = (TmSlot *)tv->tm_slots;
@@ -411,8 +417,9 @@ void *TmThreadsSlot1NoInOut(void *td)
 
 void *TmThreadsSlot1(void *td)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = (TmSlot *)tv->tm_slots;
@@ -450,6 +457,8 @@ void *TmThreadsSlot1(void *td)
     memset(&s->slot_post_pq, 0, sizeof(PacketQueue));
     SCMutexInit(&s->slot_post_pq.mutex_q, NULL);
 
+    PacketPoolInitThread(tv, 0);
+
     tv->sc_perf_pca = SCPerfGetAllCountersArray(&tv->sc_perf_pctx);
     SCPerfAddToClubbedTMTable((tv->thread_group_name != NULL) ?
             tv->thread_group_name : tv->name, &tv->sc_perf_pctx);
@@ -515,6 +524,7 @@ void *TmThreadsSlot1(void *td)
         }
     } /* while (run) */
 
+    PacketPoolDeinitThread();
     TmThreadsSetFlag(tv, THV_RUNNING_DONE);
     TmThreadWaitForFlag(tv, THV_DEINIT);
 
@@ -537,6 +547,41 @@ void *TmThreadsSlot1(void *td)
     return NULL;
 }
 
+/**
+ * \brief Process the packets a slot put in its pre pq through the
+ *        rest of the slots.
+ */
+static inline TmEcode TmThreadsSlotHandlePrePq(ThreadVars *tv, TmSlot *s)
+{
+    TmEcode r;
+    Packet *extra_p;
+
+    while (s->slot_pre_pq.top != NULL) {
+        extra_p = PacketDequeue(&s->slot_pre_pq);
+        if (unlikely(extra_p == NULL))
+            continue;
+
+        /* see if we need to process the packet */
+        if (s->slot_next != NULL) {
+            r = TmThreadsSlotVarRun(tv, extra_p, s->slot_next);
+            if (unlikely(r == TM_ECODE_FAILED)) {
+                TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+
+                SCMutexLock(&s->slot_post_pq.mutex_q);
+                TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
+                SCMutexUnlock(&s->slot_post_pq.mutex_q);
+
+                TmqhOutputPacketpool(tv, extra_p);
+                TmThreadsSetFlag(tv, THV_FAILED);
+                return TM_ECODE_FAILED;
+            }
+        }
+        tv->tmqh_out(tv, extra_p);
+    }
+
+    return TM_ECODE_OK;
+}
+
 /**
  * \brief Separate run function so we can call it recursively.
  *
@@ -547,7 +592,6 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
 {
     TmEcode r;
     TmSlot *s;
-    Packet *extra_p;
 
     for (s = slot; s != NULL; s = s->slot_next) {
         TmSlotFunc SlotFunc = SC_ATOMIC_GET(s->SlotFunc);
@@ -575,31 +619,171 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
         }
 
         /* handle new packets */
-        while (s->slot_pre_pq.top != NULL) {
-            extra_p = PacketDequeue(&s->slot_pre_pq);
-            if (unlikely(extra_p == NULL))
-                continue;
+        if (unlikely(TmThreadsSlotHandlePrePq(tv, s) == TM_ECODE_FAILED))
+            return TM_ECODE_FAILED;
+    }
+
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief Process the packets that a batch slot put in its pre pq for the
+ *        packets before the next packet of the batch.
+ *
+ * Packets a slot creates, like tunnel packets, have the packet they came
+ * from as root. They're processed right before that packet continues,
+ * as TmThreadsSlotVarRun would have done.
+ *
+ * \param next next packet of the batch or NULL for the last one
+ */
+static inline TmEcode TmThreadsSlotHandlePrePqBatch(ThreadVars *tv, TmSlot *s,
+        Packet **pkts, uint16_t n, uint16_t next)
+{
+    TmEcode r;
+    uint16_t i;
 
-            /* see if we need to process the packet */
-            if (s->slot_next != NULL) {
-                r = TmThreadsSlotVarRun(tv, extra_p, s->slot_next);
-                if (unlikely(r == TM_ECODE_FAILED)) {
-                    TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+    while (s->slot_pre_pq.bot != NULL) {
+        Packet *root = s->slot_pre_pq.bot->root;
+        for (i = next; root != NULL && i < n; i++) {
+            if (root == pkts[i])
+                return TM_ECODE_OK;
+        }
 
-                    SCMutexLock(&s->slot_post_pq.mutex_q);
-                    TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
-                    SCMutexUnlock(&s->slot_post_pq.mutex_q);
+        Packet *extra_p = PacketDequeue(&s->slot_pre_pq);
+        if (unlikely(extra_p == NULL))
+            continue;
 
-                    TmqhOutputPacketpool(tv, extra_p);
-                    TmThreadsSetFlag(tv, THV_FAILED);
-                    return TM_ECODE_FAILED;
-                }
+        if (s->slot_next != NULL) {
+            r = TmThreadsSlotVarRun(tv, extra_p, s->slot_next);
+            if (unlikely(r == TM_ECODE_FAILED)) {
+                TmqhOutputPacketpool(tv, extra_p);
+                return TM_ECODE_FAILED;
             }
-            tv->tmqh_out(tv, extra_p);
+        }
+        tv->tmqh_out(tv, extra_p);
+    }
+    return TM_ECODE_OK;
+}
+
+/**
+ * \brief Run a batch of packets through the slots.
+ *
+ * The leading slots of modules with a FuncBatch (decoders) get the
+ * whole batch in one call. From the first slot without one on, each
+ * packet runs through the rest of the slots by itself, in the order of
+ * the batch, so stream, detect and outputs see the packets exactly as
+ * with TmThreadsSlotVarRun. Packets the batch slots put in their pre pq
+ * are processed right before the packet they came from continues.
+ *
+ * The profiling ticks of a batch call are split evenly over the packets.
+ *
+ * \param pkts array of packets
+ * \param n number of packets in the array
+ */
+TmEcode TmThreadsSlotVarRunBatch(ThreadVars *tv, Packet **pkts, uint16_t n,
+                                 TmSlot *slot)
+{
+    TmEcode r = TM_ECODE_OK;
+    TmSlot *s;
+    uint16_t i;
+
+    for (s = slot; s != NULL; s = s->slot_next) {
+        TmSlotFunc SlotFunc = SC_ATOMIC_GET(s->SlotFunc);
+        PacketQueue *postpq = (s->id == 0) ? &s->slot_post_pq : NULL;
+
+        /* the dummy slot func replaces the module's func while the
+         * slot is disabled, so it takes precedence over the batch func */
+        if (s->SlotFuncBatch == NULL || SlotFunc == TmDummyFunc)
+            break;
+
+#ifdef PROFILING
+        uint64_t ticks = 0;
+#endif
+        PACKET_PROFILING_TMM_BATCH_START(ticks);
+        r = s->SlotFuncBatch(tv, pkts, n, SC_ATOMIC_GET(s->slot_data),
+                             &s->slot_pre_pq, postpq);
+        PACKET_PROFILING_TMM_BATCH_END(pkts, n, s->tm_id, ticks);
+
+        if (unlikely(r == TM_ECODE_FAILED))
+            goto error;
+    }
+    TmSlot *rest = s;
+
+    for (i = 0; i < n; i++) {
+        for (s = slot; s != rest; s = s->slot_next) {
+            if (s->slot_pre_pq.bot == NULL)
+                continue;
+            r = TmThreadsSlotHandlePrePqBatch(tv, s, pkts, n, i + 1);
+            if (unlikely(r == TM_ECODE_FAILED))
+                goto error;
+        }
+
+        if (rest != NULL) {
+            r = TmThreadsSlotVarRun(tv, pkts[i], rest);
+            if (unlikely(r == TM_ECODE_FAILED))
+                return TM_ECODE_FAILED;
         }
     }
 
     return TM_ECODE_OK;
+
+error:
+    /* Encountered error.  Return packets to packetpool and return */
+    TmqhReleasePacketsToPacketPool(&s->slot_pre_pq);
+
+    SCMutexLock(&s->slot_post_pq.mutex_q);
+    TmqhReleasePacketsToPacketPool(&s->slot_post_pq);
+    SCMutexUnlock(&s->slot_post_pq.mutex_q);
+
+    TmThreadsSetFlag(tv, THV_FAILED);
+    return TM_ECODE_FAILED;
+}
+
+/**
+ * \brief Batch version of TmThreadsSlotProcessPkt: process a batch of
+ *        packets through the rest of the functions (if any) and queue
+ *        them.
+ *
+ * On failure all packets of the batch are returned to the packet pool.
+ */
+TmEcode TmThreadsSlotProcessPktBatch(ThreadVars *tv, TmSlot *s, Packet **pkts,
+                                     uint16_t n)
+{
+    TmEcode r = TM_ECODE_OK;
+    uint16_t i;
+
+    if (n == 0)
+        return r;
+
+    if (s == NULL) {
+        for (i = 0; i < n; i++)
+            tv->tmqh_out(tv, pkts[i]);
+        return r;
+    }
+
+    if (TmThreadsSlotVarRunBatch(tv, pkts, n, s) == TM_ECODE_FAILED) {
+        for (i = 0; i < n; i++)
+            TmqhOutputPacketpool(tv, pkts[i]);
+
+        TmSlot *slot = s;
+        while (slot != NULL) {
+            SCMutexLock(&slot->slot_post_pq.mutex_q);
+            TmqhReleasePacketsToPacketPool(&slot->slot_post_pq);
+            SCMutexUnlock(&slot->slot_post_pq.mutex_q);
+
+            slot = slot->slot_next;
+        }
+        TmThreadsSetFlag(tv, THV_FAILED);
+        r = TM_ECODE_FAILED;
+
+    } else {
+        for (i = 0; i < n; i++)
+            tv->tmqh_out(tv, pkts[i]);
+
+        r = TmThreadsSlotProcessPostPq(tv, s);
+    }
+
+    return r;
 }
 
 /*
@@ -630,8 +814,9 @@ TmEcode TmThreadsSlotVarRun(ThreadVars *tv, Packet *p,
  */
 
 void *TmThreadsSlotPktAcqLoop(void *td) {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = tv->tm_slots;
@@ -687,6 +872,9 @@ void *TmThreadsSlotPktAcqLoop(void *td) {
         SCMutexInit(&slot->slot_post_pq.mutex_q, NULL);
     }
 
+    /* setup this thread's own packet pool if enabled */
+    PacketPoolInitThread(tv, 1);
+
     tv->sc_perf_pca = SCPerfGetAllCountersArray(&tv->sc_perf_pctx);
     SCPerfAddToClubbedTMTable((tv->thread_group_name != NULL) ?
             tv->thread_group_name : tv->name, &tv->sc_perf_pctx);
@@ -712,6 +900,7 @@ void *TmThreadsSlotPktAcqLoop(void *td) {
     }
     SCPerfSyncCounters(tv);
 
+    PacketPoolDeinitThread();
     TmThreadsSetFlag(tv, THV_RUNNING_DONE);
     TmThreadWaitForFlag(tv, THV_DEINIT);
 
@@ -743,8 +932,9 @@ void *TmThreadsSlotPktAcqLoop(void *td) {
  */
 void *TmThreadsSlotVar(void *td)
 {
-    /* block usr2.  usr2 to be handled by the main thread only */
+    /* block usr2 and hup.  they are handled by the main thread only */
     UtilSignalBlock(SIGUSR2);
+    UtilSignalBlock(SIGHUP);
 
     ThreadVars *tv = (ThreadVars *)td;
     TmSlot *s = (TmSlot *)tv->tm_slots;
@@ -791,6 +981,8 @@ void *TmThreadsSlotVar(void *td)
         SCMutexInit(&s->slot_post_pq.mutex_q, NULL);
     }
 
+    PacketPoolInitThread(tv, 0);
+
     tv->sc_perf_pca = SCPerfGetAllCountersArray(&tv->sc_perf_pctx);
     SCPerfAddToClubbedTMTable((tv->thread_group_name != NULL) ?
             tv->thread_group_name : tv->name, &tv->sc_perf_pctx);
@@ -859,6 +1051,7 @@ void *TmThreadsSlotVar(void *td)
     } /* while (run) */
     SCPerfSyncCounters(tv);
 
+    PacketPoolDeinitThread();
     TmThreadsSetFlag(tv, THV_RUNNING_DONE);
     TmThreadWaitForFlag(tv, THV_DEINIT);
 
@@ -983,6 +1176,7 @@ static inline TmSlot * _TmSlotSetFuncAppend(ThreadVars *tv, TmModule *tm, void *
     slot->slot_initdata = data;
     SC_ATOMIC_INIT(slot->SlotFunc);
     (void)SC_ATOMIC_SET(slot->SlotFunc, tm->Func);
+    slot->SlotFuncBatch = tm->FuncBatch;
     slot->PktAcqLoop = tm->PktAcqLoop;
     slot->SlotThreadExitPrintStats = tm->ThreadExitPrintStats;
     slot->SlotThreadDeinit = tm->ThreadDeinit;
@@ -1647,8 +1841,7 @@ void TmThreadKillThread(ThreadVars *tv)
          * packet acquire by now using TmThreadDisableReceiveThreads()*/
         if (!(strlen(tv->inq->name) == strlen("packetpool") &&
               strcasecmp(tv->inq->name, "packetpool") == 0)) {
-            PacketQueue *q = &trans_q[tv->inq->id];
-            while (q->len != 0) {
+            while (TmqhQueueLen(tv->inq->id) != 0) {
                 usleep(1000);
             }
         }
@@ -1752,8 +1945,7 @@ void TmThreadDisableThreadsWithTMS(uint8_t tm_flags)
                  * packet acquire by now using TmThreadDisableReceiveThreads()*/
                 if (!(strlen(tv->inq->name) == strlen("packetpool") &&
                       strcasecmp(tv->inq->name, "packetpool") == 0)) {
-                    PacketQueue *q = &trans_q[tv->inq->id];
-                    while (q->len != 0) {
+                    while (TmqhQueueLen(tv->inq->id) != 0) {
                         usleep(1000);
                     }
                 }
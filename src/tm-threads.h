@@ -34,6 +34,11 @@
 
 typedef TmEcode (*TmSlotFunc)(ThreadVars *, Packet *, void *, PacketQueue *,
                         PacketQueue *);
+typedef TmEcode (*TmSlotFuncBatch)(ThreadVars *, Packet **, uint16_t, void *,
+                        PacketQueue *, PacketQueue *);
+
+/** max number of packets a capture module hands to TmThreadsSlotProcessPktBatch */
+#define TM_PKT_BATCH_SIZE 32
 
 typedef struct TmSlot_ {
     /* the TV holding this slot */
@@ -41,6 +46,8 @@ typedef struct TmSlot_ {
 
     /* function pointers */
     SC_ATOMIC_DECLARE(TmSlotFunc, SlotFunc);
+    /* batch version of SlotFunc, NULL if the module has none */
+    TmSlotFuncBatch SlotFuncBatch;
 
     TmEcode (*PktAcqLoop)(ThreadVars *, void *, void *);
 
@@ -122,11 +129,52 @@ void TmThreadsUnsetFlag(ThreadVars *, uint16_t);
 void TmThreadWaitForFlag(ThreadVars *, uint16_t);
 
 TmEcode TmThreadsSlotVarRun (ThreadVars *tv, Packet *p, TmSlot *slot);
+TmEcode TmThreadsSlotVarRunBatch(ThreadVars *tv, Packet **pkts, uint16_t n, TmSlot *slot);
+TmEcode TmThreadsSlotProcessPktBatch(ThreadVars *tv, TmSlot *s, Packet **pkts, uint16_t n);
 
 ThreadVars *TmThreadsGetTVContainingSlot(TmSlot *);
 void TmThreadDisableThreadsWithTMS(uint8_t tm_flags);
 TmSlot *TmThreadGetFirstTmSlotForPartialPattern(const char *);
 
+/**
+ *  \brief Process the packets the slots put in their post pq.
+ */
+static inline TmEcode TmThreadsSlotProcessPostPq(ThreadVars *tv, TmSlot *s)
+{
+    TmEcode r = TM_ECODE_OK;
+
+    TmSlot *slot = s;
+    while (slot != NULL) {
+        if (slot->slot_post_pq.top != NULL) {
+            while (1) {
+                SCMutexLock(&slot->slot_post_pq.mutex_q);
+                Packet *extra_p = PacketDequeue(&slot->slot_post_pq);
+                SCMutexUnlock(&slot->slot_post_pq.mutex_q);
+
+                if (extra_p == NULL)
+                    break;
+
+                if (slot->slot_next != NULL) {
+                    r = TmThreadsSlotVarRun(tv, extra_p, slot->slot_next);
+                    if (r == TM_ECODE_FAILED) {
+                        SCMutexLock(&slot->slot_post_pq.mutex_q);
+                        TmqhReleasePacketsToPacketPool(&slot->slot_post_pq);
+                        SCMutexUnlock(&slot->slot_post_pq.mutex_q);
+
+                        TmqhOutputPacketpool(tv, extra_p);
+                        TmThreadsSetFlag(tv, THV_FAILED);
+                        break;
+                    }
+                }
+                tv->tmqh_out(tv, extra_p);
+            }
+        } /* if (slot->slot_post_pq.top != NULL) */
+        slot = slot->slot_next;
+    } /* while (slot != NULL) */
+
+    return r;
+}
+
 /**
  *  \brief Process the rest of the functions (if any) and queue.
  */
@@ -155,35 +203,7 @@ static inline TmEcode TmThreadsSlotProcessPkt(ThreadVars *tv, TmSlot *s, Packet
     } else {
         tv->tmqh_out(tv, p);
 
-        /* post process pq */
-        TmSlot *slot = s;
-        while (slot != NULL) {
-            if (slot->slot_post_pq.top != NULL) {
-                while (1) {
-                    SCMutexLock(&slot->slot_post_pq.mutex_q);
-                    Packet *extra_p = PacketDequeue(&slot->slot_post_pq);
-                    SCMutexUnlock(&slot->slot_post_pq.mutex_q);
-
-                    if (extra_p == NULL)
-                        break;
-
-                    if (slot->slot_next != NULL) {
-                        r = TmThreadsSlotVarRun(tv, extra_p, slot->slot_next);
-                        if (r == TM_ECODE_FAILED) {
-                            SCMutexLock(&slot->slot_post_pq.mutex_q);
-                            TmqhReleasePacketsToPacketPool(&slot->slot_post_pq);
-                            SCMutexUnlock(&slot->slot_post_pq.mutex_q);
-
-                            TmqhOutputPacketpool(tv, extra_p);
-                            TmThreadsSetFlag(tv, THV_FAILED);
-                            break;
-                        }
-                    }
-                    tv->tmqh_out(tv, extra_p);
-                }
-            } /* if (slot->slot_post_pq.top != NULL) */
-            slot = slot->slot_next;
-        } /* while (slot != NULL) */
+        r = TmThreadsSlotProcessPostPq(tv, s);
     }
 
     return r;
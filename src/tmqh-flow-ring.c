@@ -0,0 +1,553 @@
+/* Copyright (C) 2013 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * "flow-ring" queue handler. Alternative to the "flow" queue handler for
+ * autofp that doesn't take the queue mutex for every packet.
+ *
+ * Every output queue (detect thread) has one bounded single producer /
+ * single consumer ring per capture thread writing to it. A producer only
+ * writes the ring's tail, the consumer only writes the head, so no locks
+ * or atomic read-modify-write ops are needed. The consumer dequeues in
+ * batches of up to FLOW_RING_BATCH packets, taking them from all rings in
+ * a round robin fashion.
+ *
+ * If all rings are empty the consumer spins for a while and then goes to
+ * sleep on the queue's condition. The spin budget adapts: it grows when
+ * spinning found packets and shrinks when we had to sleep anyway.
+ * Producers only signal the condition if the consumer announced it's
+ * sleeping.
+ *
+ * The queue's regular PacketQueue (trans_q) is still checked, as some
+ * parts of the engine inject pseudo packets directly into it.
+ *
+ * Flows are assigned to queues by the "autofp-scheduler".
+ */
+
+#include "suricata.h"
+#include "packet-queue.h"
+#include "decode.h"
+#include "threads.h"
+#include "threadvars.h"
+#include "tmqh-flow.h"
+#include "tmqh-flow-ring.h"
+
+#include "tm-queuehandlers.h"
+#include "tmqh-packetpool.h"
+
+#include "counters.h"
+#include "util-optimize.h"
+#include "util-unittest.h"
+
+extern intmax_t max_pending_packets;
+
+/** max number of producers (capture threads) per queue */
+#define FLOW_RING_MAX_PRODUCERS     64
+/** max number of packets we take from the rings at once */
+#define FLOW_RING_BATCH             32
+/** min ring size, rings are sized after max-pending-packets */
+#define FLOW_RING_MIN_SIZE          1024
+
+/** spin budget limits for the consumer before going to sleep */
+#define FLOW_RING_SPIN_MIN          64
+#define FLOW_RING_SPIN_MAX          16384
+
+/* x86 doesn't reorder stores with other stores, or loads with other
+ * loads, so a compiler barrier is enough for the ring index updates. */
+#if defined(__x86_64__) || defined(__i386__)
+#define FLOW_RING_WMB() cc_barrier()
+#define FLOW_RING_RMB() cc_barrier()
+#define FLOW_RING_CPU_RELAX() __asm__ __volatile__("pause" ::: "memory")
+#else
+#define FLOW_RING_WMB() __sync_synchronize()
+#define FLOW_RING_RMB() __sync_synchronize()
+#define FLOW_RING_CPU_RELAX() cc_barrier()
+#endif
+/* full barrier, orders our ring update against the read of 'sleeping' */
+#define FLOW_RING_MB() __sync_synchronize()
+
+/** \brief single producer / single consumer ring */
+typedef struct TmqhFlowRing_ {
+    /* producer side */
+    volatile uint32_t tail;
+    uint32_t head_cache;    /**< last head value seen by the producer */
+    uint8_t pad0[CLS - (2 * sizeof(uint32_t))];
+
+    /* consumer side */
+    volatile uint32_t head;
+    uint8_t pad1[CLS - sizeof(uint32_t)];
+
+    uint32_t mask;
+    Packet **slots;
+} TmqhFlowRing;
+
+/** \brief all rings feeding into a single queue */
+typedef struct TmqhFlowRingQueue_ {
+    /** protects producer registration at thread setup */
+    SCMutex m;
+    volatile uint16_t nrings;
+    TmqhFlowRing *rings[FLOW_RING_MAX_PRODUCERS];
+
+    /** set by the consumer while it waits on the queue condition */
+    volatile int sleeping;
+
+    /* consumer only */
+    uint16_t rr_idx;
+    uint32_t spin;
+    uint16_t stash_idx;
+    uint16_t stash_cnt;
+    Packet *stash[FLOW_RING_BATCH];
+} TmqhFlowRingQueue;
+
+/** ring queues indexed by queue id, like trans_q */
+static TmqhFlowRingQueue *flow_ring_queues[256];
+
+Packet *TmqhInputFlowRing(ThreadVars *t);
+void TmqhInputFlowRingShutdownHandler(ThreadVars *);
+void TmqhOutputFlowRing(ThreadVars *t, Packet *p);
+void *TmqhOutputFlowRingSetupCtx(char *queue_str);
+void TmqhOutputFlowRingFreeCtx(void *ctx);
+
+void TmqhFlowRingRegister(void)
+{
+    tmqh_table[TMQH_FLOW_RING].name = "flow-ring";
+    tmqh_table[TMQH_FLOW_RING].InHandler = TmqhInputFlowRing;
+    tmqh_table[TMQH_FLOW_RING].InShutdownHandler = TmqhInputFlowRingShutdownHandler;
+    tmqh_table[TMQH_FLOW_RING].OutHandler = TmqhOutputFlowRing;
+    tmqh_table[TMQH_FLOW_RING].OutHandlerCtxSetup = TmqhOutputFlowRingSetupCtx;
+    tmqh_table[TMQH_FLOW_RING].OutHandlerCtxFree = TmqhOutputFlowRingFreeCtx;
+    tmqh_table[TMQH_FLOW_RING].RegisterTests = TmqhFlowRingRegisterTests;
+
+    memset(flow_ring_queues, 0x00, sizeof(flow_ring_queues));
+}
+
+void TmqhFlowRingDestroy(void)
+{
+    int i;
+    uint16_t r;
+
+    for (i = 0; i < 256; i++) {
+        TmqhFlowRingQueue *rq = flow_ring_queues[i];
+        if (rq == NULL)
+            continue;
+
+        for (r = 0; r < rq->nrings; r++) {
+            SCFree(rq->rings[r]->slots);
+            SCFree(rq->rings[r]);
+        }
+        SCMutexDestroy(&rq->m);
+        SCFree(rq);
+        flow_ring_queues[i] = NULL;
+    }
+}
+
+static inline uint32_t TmqhFlowRingLen(TmqhFlowRing *ring)
+{
+    return ring->tail - ring->head;
+}
+
+/**
+ * \brief get the number of packets in the rings of a queue, including
+ *        the packets the consumer took but didn't process yet.
+ */
+uint32_t TmqhFlowRingQueueLen(TmqhFlowRingQueue *rq)
+{
+    uint32_t len = 0;
+    uint16_t r;
+
+    if (rq == NULL)
+        return 0;
+
+    for (r = 0; r < rq->nrings; r++) {
+        len += TmqhFlowRingLen(rq->rings[r]);
+    }
+    len += (rq->stash_cnt - rq->stash_idx);
+    return len;
+}
+
+/**
+ * \brief get the number of packets in the rings of a queue by queue id.
+ *
+ * \retval len number of packets, 0 if the queue has no rings
+ */
+uint32_t TmqhFlowRingQueueLenById(uint16_t id)
+{
+    return TmqhFlowRingQueueLen(flow_ring_queues[id]);
+}
+
+static TmqhFlowRing *TmqhFlowRingAlloc(void)
+{
+    uint32_t size = FLOW_RING_MIN_SIZE;
+    while (size < (uint32_t)max_pending_packets)
+        size <<= 1;
+
+    TmqhFlowRing *ring = SCMalloc(sizeof(TmqhFlowRing));
+    if (unlikely(ring == NULL))
+        return NULL;
+    memset(ring, 0x00, sizeof(TmqhFlowRing));
+
+    ring->slots = SCMalloc(size * sizeof(Packet *));
+    if (unlikely(ring->slots == NULL)) {
+        SCFree(ring);
+        return NULL;
+    }
+    memset(ring->slots, 0x00, size * sizeof(Packet *));
+    ring->mask = size - 1;
+    return ring;
+}
+
+/**
+ * \brief add a producer ring to the queue with id 'id'
+ *
+ * \retval ring the new ring or NULL on error
+ */
+static TmqhFlowRing *TmqhFlowRingAddProducer(uint16_t id, TmqhFlowRingQueue **rq_out)
+{
+    TmqhFlowRingQueue *rq = flow_ring_queues[id];
+    if (rq == NULL) {
+        rq = SCMalloc(sizeof(TmqhFlowRingQueue));
+        if (unlikely(rq == NULL))
+            return NULL;
+        memset(rq, 0x00, sizeof(TmqhFlowRingQueue));
+        SCMutexInit(&rq->m, NULL);
+        rq->spin = FLOW_RING_SPIN_MIN;
+        flow_ring_queues[id] = rq;
+    }
+
+    SCMutexLock(&rq->m);
+    if (rq->nrings >= FLOW_RING_MAX_PRODUCERS) {
+        SCMutexUnlock(&rq->m);
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "too many producers for flow-ring "
+                "queue %u, max is %u", id, FLOW_RING_MAX_PRODUCERS);
+        return NULL;
+    }
+
+    TmqhFlowRing *ring = TmqhFlowRingAlloc();
+    if (ring == NULL) {
+        SCMutexUnlock(&rq->m);
+        return NULL;
+    }
+    rq->rings[rq->nrings] = ring;
+    FLOW_RING_WMB();
+    rq->nrings++;
+    SCMutexUnlock(&rq->m);
+
+    *rq_out = rq;
+    return ring;
+}
+
+/**
+ * \brief setup the queue handler ctx for a producer
+ *
+ * Uses the "flow" handler's ctx and adds a ring for this producer
+ * to each of the queues.
+ *
+ * \param queue_str comma separated string with output queue names
+ *
+ * \retval ctx queues handlers ctx or NULL in error
+ */
+void *TmqhOutputFlowRingSetupCtx(char *queue_str)
+{
+    TmqhFlowCtx *ctx = TmqhOutputFlowSetupCtx(queue_str);
+    if (ctx == NULL)
+        return NULL;
+
+    uint16_t i;
+    for (i = 0; i < ctx->size; i++) {
+        uint16_t id = (uint16_t)(ctx->queues[i].q - trans_q);
+
+        ctx->queues[i].ring = TmqhFlowRingAddProducer(id, &ctx->queues[i].ringq);
+        if (ctx->queues[i].ring == NULL) {
+            TmqhOutputFlowFreeCtx(ctx);
+            return NULL;
+        }
+    }
+
+    return (void *)ctx;
+}
+
+void TmqhOutputFlowRingFreeCtx(void *ctx)
+{
+    /* the rings are freed in TmqhFlowRingDestroy, as the consumer
+     * may still be draining them */
+    TmqhOutputFlowFreeCtx(ctx);
+}
+
+/**
+ * \brief wake up the consumer if it's waiting
+ */
+static inline void TmqhFlowRingWakeup(TmqhFlowRingQueue *rq, PacketQueue *q)
+{
+    FLOW_RING_MB();
+    if (rq->sleeping) {
+        SCMutexLock(&q->mutex_q);
+        SCCondSignal(&q->cond_q);
+        SCMutexUnlock(&q->mutex_q);
+    }
+}
+
+void TmqhOutputFlowRing(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowSelectQueue(ctx, p);
+
+    TmqhFlowRingQueue *rq = ctx->queues[qid].ringq;
+    TmqhFlowRing *ring = ctx->queues[qid].ring;
+
+    uint32_t tail = ring->tail;
+    if (unlikely(tail - ring->head_cache > ring->mask)) {
+        ring->head_cache = ring->head;
+
+        /* ring full: the consumer is behind, wait for it */
+        while (tail - ring->head_cache > ring->mask) {
+            TmqhFlowRingWakeup(rq, ctx->queues[qid].q);
+            usleep(1);
+            ring->head_cache = ring->head;
+        }
+    }
+
+    ring->slots[tail & ring->mask] = p;
+    FLOW_RING_WMB();
+    ring->tail = tail + 1;
+
+    TmqhFlowRingWakeup(rq, ctx->queues[qid].q);
+}
+
+/**
+ * \brief take a batch of packets from the rings into the stash
+ *
+ * \retval cnt number of packets taken
+ */
+static uint16_t TmqhFlowRingFill(TmqhFlowRingQueue *rq)
+{
+    uint16_t nrings = rq->nrings;
+    uint16_t cnt = 0;
+    uint16_t n;
+
+    FLOW_RING_RMB();
+
+    for (n = 0; n < nrings && cnt < FLOW_RING_BATCH; n++) {
+        if (rq->rr_idx >= nrings)
+            rq->rr_idx = 0;
+        TmqhFlowRing *ring = rq->rings[rq->rr_idx++];
+
+        uint32_t head = ring->head;
+        uint32_t tail = ring->tail;
+        FLOW_RING_RMB();
+
+        while (head != tail && cnt < FLOW_RING_BATCH) {
+            rq->stash[cnt++] = ring->slots[head & ring->mask];
+            head++;
+        }
+        /* make sure we read the slots before handing them back */
+        FLOW_RING_WMB();
+        ring->head = head;
+    }
+
+    rq->stash_idx = 0;
+    rq->stash_cnt = cnt;
+    return cnt;
+}
+
+static inline Packet *TmqhFlowRingStashGet(TmqhFlowRingQueue *rq)
+{
+    if (rq->stash_idx < rq->stash_cnt)
+        return rq->stash[rq->stash_idx++];
+    return NULL;
+}
+
+/**
+ * \brief get a packet from a queue that was directly enqueued into
+ *        trans_q, e.g. pseudo packets.
+ */
+static inline Packet *TmqhFlowRingGetFromQueue(PacketQueue *q)
+{
+    Packet *p = NULL;
+
+    if (q->len > 0) {
+        SCMutexLock(&q->mutex_q);
+        if (q->len > 0)
+            p = PacketDequeue(q);
+        SCMutexUnlock(&q->mutex_q);
+    }
+    return p;
+}
+
+Packet *TmqhInputFlowRing(ThreadVars *tv)
+{
+    PacketQueue *q = &trans_q[tv->inq->id];
+    TmqhFlowRingQueue *rq = flow_ring_queues[tv->inq->id];
+    Packet *p = NULL;
+    uint32_t i;
+
+    SCPerfSyncCountersIfSignalled(tv);
+
+    p = TmqhFlowRingGetFromQueue(q);
+    if (p != NULL)
+        return p;
+
+    /* no producers for this queue (yet) */
+    if (unlikely(rq == NULL)) {
+        SCMutexLock(&q->mutex_q);
+        if (q->len == 0)
+            SCCondWait(&q->cond_q, &q->mutex_q);
+        SCMutexUnlock(&q->mutex_q);
+        return TmqhFlowRingGetFromQueue(q);
+    }
+
+    p = TmqhFlowRingStashGet(rq);
+    if (p != NULL)
+        return p;
+
+    if (TmqhFlowRingFill(rq) > 0)
+        return TmqhFlowRingStashGet(rq);
+
+    /* spin for a bit before we go to sleep */
+    for (i = 0; i < rq->spin; i++) {
+        FLOW_RING_CPU_RELAX();
+
+        if (TmqhFlowRingFill(rq) > 0) {
+            if (rq->spin < FLOW_RING_SPIN_MAX)
+                rq->spin <<= 1;
+            return TmqhFlowRingStashGet(rq);
+        }
+        if (q->len > 0)
+            return TmqhFlowRingGetFromQueue(q);
+    }
+    if (rq->spin > FLOW_RING_SPIN_MIN)
+        rq->spin >>= 1;
+
+    /* hand back packets we hold for other threads' pools
+     * before going to sleep */
+    PacketPoolFlushPending();
+
+    SCMutexLock(&q->mutex_q);
+    rq->sleeping = 1;
+    FLOW_RING_MB();
+    if (TmqhFlowRingFill(rq) == 0 && q->len == 0) {
+        SCCondWait(&q->cond_q, &q->mutex_q);
+    }
+    rq->sleeping = 0;
+    if (q->len > 0)
+        p = PacketDequeue(q);
+    SCMutexUnlock(&q->mutex_q);
+
+    if (p != NULL)
+        return p;
+
+    p = TmqhFlowRingStashGet(rq);
+    if (p == NULL && TmqhFlowRingFill(rq) > 0)
+        p = TmqhFlowRingStashGet(rq);
+
+    /* may be NULL if we were woken up by a signal */
+    return p;
+}
+
+void TmqhInputFlowRingShutdownHandler(ThreadVars *tv)
+{
+    int i;
+
+    if (tv == NULL || tv->inq == NULL) {
+        return;
+    }
+
+    for (i = 0; i < (tv->inq->reader_cnt + tv->inq->writer_cnt); i++)
+        SCCondSignal(&trans_q[tv->inq->id].cond_q);
+}
+
+#ifdef UNITTESTS
+
+#include "tm-queues.h"
+
+static int TmqhFlowRingTest01(void)
+{
+    int retval = 0;
+    ThreadVars tv_out, tv_in;
+    Tmq tmq;
+    TmqhFlowCtx *fctx = NULL;
+    Packet *pkts[FLOW_RING_BATCH * 2];
+    int i;
+
+    memset(&tv_out, 0x00, sizeof(tv_out));
+    memset(&tv_in, 0x00, sizeof(tv_in));
+    memset(&tmq, 0x00, sizeof(tmq));
+    memset(pkts, 0x00, sizeof(pkts));
+
+    TmqResetQueues();
+    TmqhFlowRingDestroy();
+
+    fctx = TmqhOutputFlowRingSetupCtx("ringq1");
+    if (fctx == NULL)
+        goto end;
+    if (fctx->size != 1 || fctx->queues[0].ring == NULL)
+        goto end;
+
+    tv_out.outctx = fctx;
+    tmq.id = (uint16_t)(fctx->queues[0].q - trans_q);
+    tv_in.inq = &tmq;
+
+    for (i = 0; i < FLOW_RING_BATCH * 2; i++) {
+        pkts[i] = SCMalloc(sizeof(Packet));
+        if (pkts[i] == NULL)
+            goto end;
+        memset(pkts[i], 0x00, sizeof(Packet));
+        TmqhOutputFlowRing(&tv_out, pkts[i]);
+    }
+
+    if (TmqhFlowRingQueueLenById(tmq.id) != FLOW_RING_BATCH * 2) {
+        printf("expected %u packets in queue, got %u: ",
+                FLOW_RING_BATCH * 2, TmqhFlowRingQueueLenById(tmq.id));
+        goto end;
+    }
+
+    /* packets of a single producer come out in order */
+    for (i = 0; i < FLOW_RING_BATCH * 2; i++) {
+        Packet *p = TmqhInputFlowRing(&tv_in);
+        if (p != pkts[i]) {
+            printf("packet %d: expected %p got %p: ", i, pkts[i], p);
+            goto end;
+        }
+    }
+
+    if (TmqhFlowRingQueueLenById(tmq.id) != 0)
+        goto end;
+
+    retval = 1;
+end:
+    for (i = 0; i < FLOW_RING_BATCH * 2; i++) {
+        if (pkts[i] != NULL)
+            SCFree(pkts[i]);
+    }
+    if (fctx != NULL)
+        TmqhOutputFlowRingFreeCtx(fctx);
+    TmqhFlowRingDestroy();
+    TmqResetQueues();
+    return retval;
+}
+
+#endif /* UNITTESTS */
+
+void TmqhFlowRingRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("TmqhFlowRingTest01", TmqhFlowRingTest01, 1);
+#endif
+
+    return;
+}
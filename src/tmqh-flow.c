@@ -33,20 +33,34 @@
 #include "threads.h"
 #include "threadvars.h"
 #include "tmqh-flow.h"
+#include "tmqh-flow-ring.h"
 
 #include "tm-queuehandlers.h"
+#include "tmqh-packetpool.h"
 
 #include "conf.h"
 #include "util-unittest.h"
+#include "util-unittest-helper.h"
 
 Packet *TmqhInputFlow(ThreadVars *t);
 void TmqhOutputFlowHash(ThreadVars *t, Packet *p);
 void TmqhOutputFlowActivePackets(ThreadVars *t, Packet *p);
 void TmqhOutputFlowRoundRobin(ThreadVars *t, Packet *p);
+void TmqhOutputFlowToeplitz(ThreadVars *t, Packet *p);
+void TmqhOutputFlowHybrid(ThreadVars *t, Packet *p);
 void *TmqhOutputFlowSetupCtx(char *queue_str);
 void TmqhOutputFlowFreeCtx(void *ctx);
 void TmqhFlowRegisterTests(void);
 
+static int32_t TmqhFlowGetQidRoundRobin(TmqhFlowCtx *ctx, Packet *p);
+static int32_t TmqhFlowGetQidActivePackets(TmqhFlowCtx *ctx, Packet *p);
+static int32_t TmqhFlowGetQidHash(TmqhFlowCtx *ctx, Packet *p);
+static int32_t TmqhFlowGetQidToeplitz(TmqhFlowCtx *ctx, Packet *p);
+static int32_t TmqhFlowGetQidHybrid(TmqhFlowCtx *ctx, Packet *p);
+
+/** flow to queue selector as set by the autofp-scheduler */
+static int32_t (*TmqhFlowGetQid)(TmqhFlowCtx *, Packet *) = TmqhFlowGetQidActivePackets;
+
 void TmqhFlowRegister(void)
 {
     tmqh_table[TMQH_FLOW].name = "flow";
@@ -60,12 +74,23 @@ void TmqhFlowRegister(void)
         if (strcasecmp(scheduler, "round-robin") == 0) {
             SCLogInfo("AutoFP mode using \"Round Robin\" flow load balancer");
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowRoundRobin;
+            TmqhFlowGetQid = TmqhFlowGetQidRoundRobin;
         } else if (strcasecmp(scheduler, "active-packets") == 0) {
             SCLogInfo("AutoFP mode using \"Active Packets\" flow load balancer");
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowActivePackets;
+            TmqhFlowGetQid = TmqhFlowGetQidActivePackets;
         } else if (strcasecmp(scheduler, "hash") == 0) {
             SCLogInfo("AutoFP mode using \"Hash\" flow load balancer");
             tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowHash;
+            TmqhFlowGetQid = TmqhFlowGetQidHash;
+        } else if (strcasecmp(scheduler, "toeplitz") == 0) {
+            SCLogInfo("AutoFP mode using \"Toeplitz\" flow load balancer");
+            tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowToeplitz;
+            TmqhFlowGetQid = TmqhFlowGetQidToeplitz;
+        } else if (strcasecmp(scheduler, "hybrid") == 0) {
+            SCLogInfo("AutoFP mode using \"Hybrid\" flow load balancer");
+            tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowHybrid;
+            TmqhFlowGetQid = TmqhFlowGetQidHybrid;
         } else {
             SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry \"%s\" "
                        "for autofp-scheduler in conf.  Killing engine.",
@@ -75,6 +100,7 @@ void TmqhFlowRegister(void)
     } else {
         SCLogInfo("AutoFP mode using default \"Active Packets\" flow load balancer");
         tmqh_table[TMQH_FLOW].OutHandler = TmqhOutputFlowActivePackets;
+        TmqhFlowGetQid = TmqhFlowGetQidActivePackets;
     }
 
     return;
@@ -89,6 +115,10 @@ Packet *TmqhInputFlow(ThreadVars *tv)
 
     SCMutexLock(&q->mutex_q);
     if (q->len == 0) {
+        /* hand back packets we hold for other threads' pools
+         * before going to sleep */
+        PacketPoolFlushPending();
+
         /* if we have no packets in queue, wait... */
         SCCondWait(&q->cond_q, &q->mutex_q);
     }
@@ -206,16 +236,37 @@ void TmqhOutputFlowFreeCtx(void *ctx)
     int i;
     TmqhFlowCtx *fctx = (TmqhFlowCtx *)ctx;
 
+    uint64_t total = 0;
+    uint64_t max = 0;
+    double mean = 0.0;
+
+    for (i = 0; i < fctx->size; i++) {
+        uint64_t pkts = SC_ATOMIC_GET(fctx->queues[i].total_packets);
+        total += pkts;
+        if (pkts > max)
+            max = pkts;
+    }
+    if (fctx->size > 0)
+        mean = (double)total / (double)fctx->size;
+
     SCLogInfo("AutoFP - Total flow handler queues - %" PRIu16,
               fctx->size);
     for (i = 0; i < fctx->size; i++) {
-        SCLogInfo("AutoFP - Queue %-2"PRIu32 " - pkts: %-12"PRIu64" flows: %-12"PRIu64, i,
-                SC_ATOMIC_GET(fctx->queues[i].total_packets),
-                SC_ATOMIC_GET(fctx->queues[i].total_flows));
+        uint64_t pkts = SC_ATOMIC_GET(fctx->queues[i].total_packets);
+        /* load skew: deviation of the queue's packets from the mean */
+        double skew = (mean > 0.0) ? (((double)pkts - mean) * 100.0 / mean) : 0.0;
+
+        SCLogInfo("AutoFP - Queue %-2"PRIu32 " - pkts: %-12"PRIu64" flows: %-12"PRIu64
+                " skew: %+.1f%%", i, pkts,
+                SC_ATOMIC_GET(fctx->queues[i].total_flows), skew);
         SC_ATOMIC_DESTROY(fctx->queues[i].total_packets);
         SC_ATOMIC_DESTROY(fctx->queues[i].total_flows);
     }
 
+    if (mean > 0.0) {
+        SCLogInfo("AutoFP - Load skew - max/mean: %.2f", (double)max / mean);
+    }
+
     SCFree(fctx->queues);
 
     return;
@@ -224,15 +275,15 @@ void TmqhOutputFlowFreeCtx(void *ctx)
 /**
  * \brief select the queue to output in a round robin fashion.
  *
- * \param tv thread vars
+ * \param ctx flow queue handler ctx
  * \param p packet
+ *
+ * \retval qid queue index
  */
-void TmqhOutputFlowRoundRobin(ThreadVars *tv, Packet *p)
+static int32_t TmqhFlowGetQidRoundRobin(TmqhFlowCtx *ctx, Packet *p)
 {
     int32_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     /* if no flow we use the first queue,
      * should be rare */
     if (p->flow != NULL) {
@@ -254,27 +305,32 @@ void TmqhOutputFlowRoundRobin(ThreadVars *tv, Packet *p)
     }
     (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
 
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
+    return qid;
+}
 
-    return;
+/**
+ * \brief get the number of packets waiting in an output queue.
+ */
+static inline uint32_t TmqhFlowQueueLen(TmqhFlowMode *m)
+{
+    if (m->ringq != NULL)
+        return TmqhFlowRingQueueLen(m->ringq);
+
+    return m->q->len;
 }
 
 /**
  * \brief select the queue to output to based on queue lengths.
  *
- * \param tv thread vars
+ * \param ctx flow queue handler ctx
  * \param p packet
+ *
+ * \retval qid queue index
  */
-void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
+static int32_t TmqhFlowGetQidActivePackets(TmqhFlowCtx *ctx, Packet *p)
 {
     int32_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     /* if no flow we use the first queue,
      * should be rare */
     if (p->flow != NULL) {
@@ -283,10 +339,11 @@ void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
             uint16_t i = 0;
             int lowest_id = 0;
             TmqhFlowMode *queues = ctx->queues;
-            uint32_t lowest = queues[i].q->len;
+            uint32_t lowest = TmqhFlowQueueLen(&queues[i]);
             for (i = 1; i < ctx->size; i++) {
-                if (queues[i].q->len < lowest) {
-                    lowest = queues[i].q->len;
+                uint32_t len = TmqhFlowQueueLen(&queues[i]);
+                if (len < lowest) {
+                    lowest = len;
                     lowest_id = i;
                 }
             }
@@ -302,27 +359,21 @@ void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
     }
     (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
 
-    PacketQueue *q = ctx->queues[qid].q;
-    SCMutexLock(&q->mutex_q);
-    PacketEnqueue(q, p);
-    SCCondSignal(&q->cond_q);
-    SCMutexUnlock(&q->mutex_q);
-
-    return;
+    return qid;
 }
 
 /**
  * \brief select the queue to output based on address hash.
  *
- * \param tv thread vars.
- * \param p packet.
+ * \param ctx flow queue handler ctx
+ * \param p packet
+ *
+ * \retval qid queue index
  */
-void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
+static int32_t TmqhFlowGetQidHash(TmqhFlowCtx *ctx, Packet *p)
 {
     int32_t qid = 0;
 
-    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
-
     /* if no flow we use the first queue,
      * should be rare */
     if (p->flow != NULL) {
@@ -349,12 +400,254 @@ void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
     }
     (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
 
+    return qid;
+}
+
+/** symmetric Toeplitz key: the 16 bit 0x6d5a pattern makes the hash
+ *  the same for both directions of a flow (Woo & Park, 2012). Long
+ *  enough for an IPv6 address pair and ports. */
+static const uint8_t tmqh_flow_toeplitz_key[40] = {
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+    0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+};
+
+static uint32_t TmqhFlowToeplitzHash(const uint8_t *data, uint16_t len)
+{
+    const uint8_t *key = tmqh_flow_toeplitz_key;
+    uint32_t hash = 0;
+    uint32_t v = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) |
+                 ((uint32_t)key[2] << 8) | (uint32_t)key[3];
+    uint16_t i;
+    int b;
+
+    for (i = 0; i < len; i++) {
+        for (b = 7; b >= 0; b--) {
+            if (data[i] & (1 << b))
+                hash ^= v;
+            v <<= 1;
+            if (key[i + 4] & (1 << b))
+                v |= 1;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ * \brief get the symmetric Toeplitz hash of the packet's addresses
+ *        and ports, as network cards do for RSS.
+ *
+ * \param p packet
+ *
+ * \retval hash
+ */
+static uint32_t TmqhFlowPacketHash(Packet *p)
+{
+    uint8_t data[36];
+    uint16_t len = 0;
+    uint16_t sp = htons(p->sp);
+    uint16_t dp = htons(p->dp);
+
+    if (PKT_IS_IPV4(p)) {
+        memcpy(data, &p->src.addr_data32[0], 4);
+        memcpy(data + 4, &p->dst.addr_data32[0], 4);
+        len = 8;
+    } else if (PKT_IS_IPV6(p)) {
+        memcpy(data, p->src.addr_data32, 16);
+        memcpy(data + 16, p->dst.addr_data32, 16);
+        len = 32;
+    }
+    memcpy(data + len, &sp, 2);
+    memcpy(data + len + 2, &dp, 2);
+    len += 4;
+
+    return TmqhFlowToeplitzHash(data, len);
+}
+
+/**
+ * \brief select the queue to output based on the symmetric Toeplitz
+ *        hash of the 5 tuple.
+ *
+ * \param ctx flow queue handler ctx
+ * \param p packet
+ *
+ * \retval qid queue index
+ */
+static int32_t TmqhFlowGetQidToeplitz(TmqhFlowCtx *ctx, Packet *p)
+{
+    int32_t qid = 0;
+
+    /* if no flow we use the first queue,
+     * should be rare */
+    if (p->flow != NULL) {
+        qid = SC_ATOMIC_GET(p->flow->autofp_tmqh_flow_qid);
+        if (qid == -1) {
+            qid = TmqhFlowPacketHash(p) % ctx->size;
+            (void) SC_ATOMIC_SET(p->flow->autofp_tmqh_flow_qid, qid);
+            (void) SC_ATOMIC_ADD(ctx->queues[qid].total_flows, 1);
+        }
+    } else {
+        qid = ctx->last++;
+
+        if (ctx->last == ctx->size)
+            ctx->last = 0;
+    }
+    (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
+
+    return qid;
+}
+
+/** max number of packets the hashed queue of a new flow may have more
+ *  than the shortest queue before the hybrid scheduler picks the latter */
+#define TMQH_FLOW_HYBRID_SLACK  32
+
+/**
+ * \brief select the queue to output based on the Toeplitz hash, unless
+ *        that queue is backed up compared to the others.
+ *
+ * New flows go to their hashed queue, like with "toeplitz". If that
+ * queue has more than TMQH_FLOW_HYBRID_SLACK packets more than the
+ * shortest queue, the flow goes to the shortest queue instead, like with
+ * "active-packets". Either way the flow is pinned to the queue.
+ *
+ * \param ctx flow queue handler ctx
+ * \param p packet
+ *
+ * \retval qid queue index
+ */
+static int32_t TmqhFlowGetQidHybrid(TmqhFlowCtx *ctx, Packet *p)
+{
+    int32_t qid = 0;
+
+    /* if no flow we use the first queue,
+     * should be rare */
+    if (p->flow != NULL) {
+        qid = SC_ATOMIC_GET(p->flow->autofp_tmqh_flow_qid);
+        if (qid == -1) {
+            uint16_t i = 0;
+            int lowest_id = 0;
+            TmqhFlowMode *queues = ctx->queues;
+            uint32_t lowest = TmqhFlowQueueLen(&queues[i]);
+            for (i = 1; i < ctx->size; i++) {
+                uint32_t len = TmqhFlowQueueLen(&queues[i]);
+                if (len < lowest) {
+                    lowest = len;
+                    lowest_id = i;
+                }
+            }
+
+            qid = TmqhFlowPacketHash(p) % ctx->size;
+            if (TmqhFlowQueueLen(&queues[qid]) > lowest + TMQH_FLOW_HYBRID_SLACK)
+                qid = lowest_id;
+
+            (void) SC_ATOMIC_SET(p->flow->autofp_tmqh_flow_qid, qid);
+            (void) SC_ATOMIC_ADD(ctx->queues[qid].total_flows, 1);
+        }
+    } else {
+        qid = ctx->last++;
+
+        if (ctx->last == ctx->size)
+            ctx->last = 0;
+    }
+    (void) SC_ATOMIC_ADD(ctx->queues[qid].total_packets, 1);
+
+    return qid;
+}
+
+/**
+ * \brief select the output queue for a packet using the configured
+ *        autofp scheduler.
+ *
+ * \param ctx flow queue handler ctx
+ * \param p packet
+ *
+ * \retval qid queue index
+ */
+int32_t TmqhFlowSelectQueue(TmqhFlowCtx *ctx, Packet *p)
+{
+    return TmqhFlowGetQid(ctx, p);
+}
+
+static inline void TmqhFlowEnqueue(TmqhFlowCtx *ctx, int32_t qid, Packet *p)
+{
     PacketQueue *q = ctx->queues[qid].q;
     SCMutexLock(&q->mutex_q);
     PacketEnqueue(q, p);
     SCCondSignal(&q->cond_q);
     SCMutexUnlock(&q->mutex_q);
+}
+
+/**
+ * \brief output to the queue selected in a round robin fashion.
+ *
+ * \param tv thread vars
+ * \param p packet
+ */
+void TmqhOutputFlowRoundRobin(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidRoundRobin(ctx, p);
+    TmqhFlowEnqueue(ctx, qid, p);
+    return;
+}
+
+/**
+ * \brief output to the queue selected based on queue lengths.
+ *
+ * \param tv thread vars
+ * \param p packet
+ */
+void TmqhOutputFlowActivePackets(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidActivePackets(ctx, p);
+    TmqhFlowEnqueue(ctx, qid, p);
+    return;
+}
+
+/**
+ * \brief output to the queue selected based on address hash.
+ *
+ * \param tv thread vars.
+ * \param p packet.
+ */
+void TmqhOutputFlowHash(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidHash(ctx, p);
+    TmqhFlowEnqueue(ctx, qid, p);
+    return;
+}
 
+/**
+ * \brief output to the queue selected based on the Toeplitz hash.
+ *
+ * \param tv thread vars.
+ * \param p packet.
+ */
+void TmqhOutputFlowToeplitz(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidToeplitz(ctx, p);
+    TmqhFlowEnqueue(ctx, qid, p);
+    return;
+}
+
+/**
+ * \brief output to the queue selected based on the Toeplitz hash
+ *        and the queue lengths.
+ *
+ * \param tv thread vars.
+ * \param p packet.
+ */
+void TmqhOutputFlowHybrid(ThreadVars *tv, Packet *p)
+{
+    TmqhFlowCtx *ctx = (TmqhFlowCtx *)tv->outctx;
+    int32_t qid = TmqhFlowGetQidHybrid(ctx, p);
+    TmqhFlowEnqueue(ctx, qid, p);
     return;
 }
 
@@ -496,6 +789,51 @@ end:
     return retval;
 }
 
+/**
+ * \test the Toeplitz hash is symmetric and depends on the ports.
+ */
+static int TmqhFlowToeplitzTest01(void)
+{
+    int retval = 0;
+    Packet *p1 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP,
+            "192.168.1.5", "10.0.0.1", 41424, 80);
+    Packet *p2 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP,
+            "10.0.0.1", "192.168.1.5", 80, 41424);
+    Packet *p3 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP,
+            "192.168.1.5", "10.0.0.1", 41425, 80);
+    if (p1 == NULL || p2 == NULL || p3 == NULL)
+        goto end;
+
+    uint32_t h1 = TmqhFlowPacketHash(p1);
+    uint32_t h2 = TmqhFlowPacketHash(p2);
+    uint32_t h3 = TmqhFlowPacketHash(p3);
+
+    if (h1 != h2) {
+        printf("hash not symmetric: %08x != %08x: ", h1, h2);
+        goto end;
+    }
+    if (h1 == h3) {
+        printf("different source port, same hash %08x: ", h1);
+        goto end;
+    }
+
+    /* an all zero tuple hashes to 0 */
+    uint8_t zero[12];
+    memset(zero, 0x00, sizeof(zero));
+    if (TmqhFlowToeplitzHash(zero, sizeof(zero)) != 0)
+        goto end;
+
+    retval = 1;
+end:
+    if (p1 != NULL)
+        UTHFreePacket(p1);
+    if (p2 != NULL)
+        UTHFreePacket(p2);
+    if (p3 != NULL)
+        UTHFreePacket(p3);
+    return retval;
+}
+
 #endif /* UNITTESTS */
 
 void TmqhFlowRegisterTests(void)
@@ -504,6 +842,7 @@ void TmqhFlowRegisterTests(void)
     UtRegisterTest("TmqhOutputFlowSetupCtxTest01", TmqhOutputFlowSetupCtxTest01, 1);
     UtRegisterTest("TmqhOutputFlowSetupCtxTest02", TmqhOutputFlowSetupCtxTest02, 1);
     UtRegisterTest("TmqhOutputFlowSetupCtxTest03", TmqhOutputFlowSetupCtxTest03, 1);
+    UtRegisterTest("TmqhFlowToeplitzTest01", TmqhFlowToeplitzTest01, 1);
 #endif
 
     return;
@@ -26,6 +26,9 @@
 
 typedef struct TmqhFlowMode_ {
     PacketQueue *q;
+    /** "flow-ring" handler: the queue's rings and our own ring in it */
+    struct TmqhFlowRingQueue_ *ringq;
+    struct TmqhFlowRing_ *ring;
     SC_ATOMIC_DECLARE(uint64_t, total_packets);
     SC_ATOMIC_DECLARE(uint64_t, total_flows);
 } TmqhFlowMode;
@@ -45,4 +48,8 @@ typedef struct TmqhFlowCtx_ {
 void TmqhFlowRegister (void);
 void TmqhFlowRegisterTests(void);
 
+void *TmqhOutputFlowSetupCtx(char *queue_str);
+void TmqhOutputFlowFreeCtx(void *ctx);
+int32_t TmqhFlowSelectQueue(TmqhFlowCtx *, Packet *);
+
 #endif /* __TMQH_FLOW_H__ */
@@ -26,6 +26,12 @@
  * because every thread can return packets to the pool and multiple parts
  * of the code retrieve packets (Decode, Defrag) and these can run in their
  * own threads as well.
+ *
+ * Alternatively ("packet-pool-mode: per-thread") every packet processing
+ * thread owns a private pool. Packets are taken from and returned to it
+ * without any locking. Packets released by another thread (e.g. the
+ * detect threads in autofp) are handed back to their owner through a
+ * mutex protected return stack, in batches.
  */
 
 #include "suricata.h"
@@ -53,8 +59,362 @@
 #include "util-error.h"
 #include "util-profiling.h"
 #include "util-device.h"
+#include "conf.h"
+#include "counters.h"
 
 static RingBuffer16 *ringbuffer = NULL;
+
+/** packet pool modes */
+enum {
+    PKT_POOL_MODE_GLOBAL = 0,
+    PKT_POOL_MODE_PER_THREAD,
+};
+
+static int pkt_pool_mode = PKT_POOL_MODE_GLOBAL;
+
+/** packets per thread pool in per-thread mode */
+static intmax_t pkt_pool_thread_size = 0;
+
+/** max number of packets we batch up before handing them back to
+ *  the owning pool */
+#define PKT_POOL_MAX_PENDING_RETURN 32
+
+/** time to sleep in PacketPoolWait in per-thread mode (usec) */
+#define PKT_POOL_WAIT_USLEEP 5
+
+/** \brief stack of packets returned by other threads */
+typedef struct PktPoolLockedStack_ {
+    SCMutex mutex;
+    /** set by the owner when it ran out of packets, tells the
+     *  other threads to return their pending packets asap */
+    SC_ATOMIC_DECLARE(int, sync_now);
+    Packet *head;
+    uint32_t cnt;
+    /** set when the owning thread is gone, packets that come back
+     *  are freed instead of stacked */
+    int dead;
+    /** packets of a dead pool that are still in flight, the pool is
+     *  freed when the last one comes back */
+    uint32_t outstanding;
+} PktPoolLockedStack;
+
+/** \brief per thread packet pool */
+typedef struct PktPool_ {
+    /** free packets, only accessed by the owning thread */
+    Packet *head;
+    uint32_t cnt;
+    /** packets owned by this pool */
+    uint32_t total;
+
+    /** packets of another pool that we will return in one batch */
+    struct PktPool_ *pending_pool;
+    Packet *pending_head;
+    Packet *pending_tail;
+    uint32_t pending_cnt;
+
+    /** counters, updated by the owning thread only */
+    ThreadVars *tv;
+    uint16_t counter_cross_returns;
+    uint16_t counter_empty_stalls;
+
+    /** list of all pools, for cleanup at shutdown */
+    struct PktPool_ *next;
+
+    /** keep the return stack that other threads write to away from
+     *  the owner's cache line */
+    uint8_t pad[CLS];
+
+    /** packets returned to us by other threads */
+    PktPoolLockedStack return_stack;
+} PktPool;
+
+#ifdef TLS
+static __thread PktPool *thread_pkt_pool = NULL;
+#else
+static pthread_key_t pkt_pool_thread_key;
+static int pkt_pool_thread_key_init = 0;
+#endif
+
+static PktPool *pkt_pool_list = NULL;
+static SCMutex pkt_pool_list_lock = SCMUTEX_INITIALIZER;
+
+static inline PktPool *PacketPoolGetThreadPool(void)
+{
+#ifdef TLS
+    return thread_pkt_pool;
+#else
+    if (pkt_pool_thread_key_init == 0)
+        return NULL;
+    return (PktPool *)pthread_getspecific(pkt_pool_thread_key);
+#endif
+}
+
+static inline void PacketPoolSetThreadPool(PktPool *pool)
+{
+#ifdef TLS
+    thread_pkt_pool = pool;
+#else
+    if (pkt_pool_thread_key_init == 0)
+        return;
+    pthread_setspecific(pkt_pool_thread_key, pool);
+#endif
+}
+
+/** \brief move the packets other threads returned to us to our
+ *         own unlocked stack
+ *
+ *  \param pool our own pool
+ */
+static void PacketPoolGetReturnedPackets(PktPool *pool)
+{
+    SCMutexLock(&pool->return_stack.mutex);
+    Packet *p = pool->return_stack.head;
+    uint32_t cnt = pool->return_stack.cnt;
+    pool->return_stack.head = NULL;
+    pool->return_stack.cnt = 0;
+    SCMutexUnlock(&pool->return_stack.mutex);
+
+    if (p == NULL)
+        return;
+
+    if (pool->head == NULL) {
+        pool->head = p;
+    } else {
+        Packet *tail = p;
+        while (tail->next != NULL)
+            tail = tail->next;
+        tail->next = pool->head;
+        pool->head = p;
+    }
+    pool->cnt += cnt;
+}
+
+/** \brief free a linked list of packets */
+static void PacketPoolFreeList(Packet *p)
+{
+    while (p != NULL) {
+        Packet *next = p->next;
+        PACKET_CLEANUP(p);
+        SCFree(p);
+        p = next;
+    }
+}
+
+/** \brief unlink a pool from the pool list and free it
+ *
+ *  The pool must not hold any packets.
+ */
+static void PacketPoolFree(PktPool *pool)
+{
+    SCMutexLock(&pkt_pool_list_lock);
+    PktPool **pp = &pkt_pool_list;
+    while (*pp != NULL) {
+        if (*pp == pool) {
+            *pp = pool->next;
+            break;
+        }
+        pp = &(*pp)->next;
+    }
+    SCMutexUnlock(&pkt_pool_list_lock);
+
+    SCMutexDestroy(&pool->return_stack.mutex);
+    SC_ATOMIC_DESTROY(pool->return_stack.sync_now);
+    SCFree(pool);
+}
+
+/** \brief push a list of packets onto the return stack of their owner
+ *
+ *  If the owner is gone the packets are freed, and so is the pool once
+ *  all of its packets are back.
+ */
+static void PacketPoolPushReturnStack(PktPool *pool, Packet *head,
+        Packet *tail, uint32_t cnt)
+{
+    SCMutexLock(&pool->return_stack.mutex);
+    if (unlikely(pool->return_stack.dead)) {
+        pool->return_stack.outstanding -= cnt;
+        int release = (pool->return_stack.outstanding == 0);
+        SCMutexUnlock(&pool->return_stack.mutex);
+
+        tail->next = NULL;
+        PacketPoolFreeList(head);
+        if (release)
+            PacketPoolFree(pool);
+        return;
+    }
+    tail->next = pool->return_stack.head;
+    pool->return_stack.head = head;
+    pool->return_stack.cnt += cnt;
+    SC_ATOMIC_RESET(pool->return_stack.sync_now);
+    SCMutexUnlock(&pool->return_stack.mutex);
+}
+
+/** \brief return the packets we hold for another pool
+ *
+ *  Called by threads before they go idle, so that packets are not
+ *  held back from their owner.
+ */
+void PacketPoolFlushPending(void)
+{
+    PktPool *my_pool = PacketPoolGetThreadPool();
+    if (my_pool == NULL || my_pool->pending_pool == NULL)
+        return;
+
+    PacketPoolPushReturnStack(my_pool->pending_pool, my_pool->pending_head,
+            my_pool->pending_tail, my_pool->pending_cnt);
+
+    my_pool->pending_pool = NULL;
+    my_pool->pending_head = NULL;
+    my_pool->pending_tail = NULL;
+    my_pool->pending_cnt = 0;
+}
+
+/** \brief return a packet to the pool of another thread
+ *
+ *  Packets for the same pool are batched, the batch is handed over
+ *  when it's full or when the owner asks for it.
+ */
+static void PacketPoolReturnPacketToOwner(PktPool *my_pool, Packet *p)
+{
+    PktPool *pool = p->pool;
+
+    if (my_pool == NULL) {
+        /* thread without pool of it's own, return directly */
+        PacketPoolPushReturnStack(pool, p, p, 1);
+        return;
+    }
+
+    if (my_pool->tv != NULL && my_pool->tv->sc_perf_pca != NULL) {
+        SCPerfCounterIncr(my_pool->counter_cross_returns,
+                my_pool->tv->sc_perf_pca);
+    }
+
+    if (my_pool->pending_pool != NULL && my_pool->pending_pool != pool) {
+        PacketPoolFlushPending();
+    }
+
+    if (my_pool->pending_pool == NULL) {
+        p->next = NULL;
+        my_pool->pending_pool = pool;
+        my_pool->pending_head = p;
+        my_pool->pending_tail = p;
+        my_pool->pending_cnt = 1;
+    } else {
+        p->next = my_pool->pending_head;
+        my_pool->pending_head = p;
+        my_pool->pending_cnt++;
+    }
+
+    if (my_pool->pending_cnt >= PKT_POOL_MAX_PENDING_RETURN ||
+            SC_ATOMIC_GET(pool->return_stack.sync_now))
+    {
+        PacketPoolFlushPending();
+    }
+}
+
+/** \brief setup the packet pool for the calling thread
+ *
+ *  In per-thread mode this preallocates max-pending-packets packets
+ *  that are owned by this thread. In global mode this is a no-op.
+ *
+ *  \param tv thread vars, used to register the pool counters. Needs
+ *            to be called before the thread's counter array is set up.
+ *  \param prealloc if 0 the pool starts empty. Used for threads that
+ *                  don't acquire packets but do return them.
+ */
+void PacketPoolInitThread(ThreadVars *tv, int prealloc)
+{
+    if (pkt_pool_mode != PKT_POOL_MODE_PER_THREAD)
+        return;
+
+    if (PacketPoolGetThreadPool() != NULL)
+        return;
+
+    PktPool *pool = SCMalloc(sizeof(PktPool));
+    if (unlikely(pool == NULL)) {
+        SCLogError(SC_ERR_FATAL, "Fatal error encountered while allocating "
+                "the packet pool. Exiting...");
+        exit(EXIT_FAILURE);
+    }
+    memset(pool, 0x00, sizeof(PktPool));
+    SCMutexInit(&pool->return_stack.mutex, NULL);
+    SC_ATOMIC_INIT(pool->return_stack.sync_now);
+
+    if (tv != NULL) {
+        pool->tv = tv;
+        pool->counter_cross_returns = SCPerfTVRegisterCounter(
+                "packetpool.cross_thread_returns", tv,
+                SC_PERF_TYPE_UINT64, "NULL");
+        pool->counter_empty_stalls = SCPerfTVRegisterCounter(
+                "packetpool.empty_stalls", tv, SC_PERF_TYPE_UINT64, "NULL");
+    }
+
+    if (prealloc) {
+        intmax_t i = 0;
+        for (i = 0; i < pkt_pool_thread_size; i++) {
+            Packet *p = PacketGetFromAlloc();
+            if (unlikely(p == NULL)) {
+                SCLogError(SC_ERR_FATAL, "Fatal error encountered while "
+                        "allocating a packet. Exiting...");
+                exit(EXIT_FAILURE);
+            }
+            p->flags &= ~PKT_ALLOC;
+            p->ReleasePacket = PacketPoolReturnPacket;
+            p->pool = pool;
+            p->next = pool->head;
+            pool->head = p;
+            pool->cnt++;
+            pool->total++;
+        }
+        SCLogDebug("%s: preallocated %"PRIiMAX" packets", tv ? tv->name : "",
+                pkt_pool_thread_size);
+    }
+
+    SCMutexLock(&pkt_pool_list_lock);
+    pool->next = pkt_pool_list;
+    pkt_pool_list = pool;
+    SCMutexUnlock(&pkt_pool_list_lock);
+
+    PacketPoolSetThreadPool(pool);
+}
+
+/** \brief cleanup the thread's pool on thread exit
+ *
+ *  The free packets of the pool are freed right away. Packets that are
+ *  still in flight are freed as they come back, and the last one frees
+ *  the pool. This keeps threads that come and go, like the ones of the
+ *  unix socket mode, from piling up pools.
+ */
+void PacketPoolDeinitThread(void)
+{
+    PacketPoolFlushPending();
+
+    PktPool *pool = PacketPoolGetThreadPool();
+    if (pool == NULL)
+        return;
+    PacketPoolSetThreadPool(NULL);
+
+    SCMutexLock(&pool->return_stack.mutex);
+    Packet *returned = pool->return_stack.head;
+    uint32_t returned_cnt = pool->return_stack.cnt;
+    pool->return_stack.head = NULL;
+    pool->return_stack.cnt = 0;
+    pool->return_stack.dead = 1;
+    pool->return_stack.outstanding = pool->total - pool->cnt - returned_cnt;
+    int release = (pool->return_stack.outstanding == 0);
+    SCMutexUnlock(&pool->return_stack.mutex);
+
+    SCLogDebug("pool %p: %"PRIu32" packets in flight", pool,
+            pool->total - pool->cnt - returned_cnt);
+
+    PacketPoolFreeList(pool->head);
+    pool->head = NULL;
+    pool->cnt = 0;
+    PacketPoolFreeList(returned);
+
+    if (release)
+        PacketPoolFree(pool);
+}
 /**
  * \brief TmqhPacketpoolRegister
  * \initonly
@@ -77,15 +437,42 @@ void TmqhPacketpoolDestroy (void) {
 }
 
 int PacketPoolIsEmpty(void) {
-    return RingBufferIsEmpty(ringbuffer);
+    return (PacketPoolSize() == 0);
 }
 
 uint16_t PacketPoolSize(void) {
-    return RingBufferSize(ringbuffer);
+    if (pkt_pool_mode == PKT_POOL_MODE_GLOBAL)
+        return RingBufferSize(ringbuffer);
+
+    PktPool *my_pool = PacketPoolGetThreadPool();
+    if (my_pool == NULL)
+        return 0;
+
+    if (my_pool->head == NULL && my_pool->return_stack.head != NULL)
+        PacketPoolGetReturnedPackets(my_pool);
+
+    return (my_pool->cnt > 0xffff) ? 0xffff : (uint16_t)my_pool->cnt;
 }
 
 void PacketPoolWait(void) {
-    RingBufferWait(ringbuffer);
+    if (pkt_pool_mode == PKT_POOL_MODE_GLOBAL) {
+        RingBufferWait(ringbuffer);
+        return;
+    }
+
+    PktPool *my_pool = PacketPoolGetThreadPool();
+    if (my_pool == NULL)
+        return;
+
+    if (my_pool->head == NULL) {
+        if (my_pool->tv != NULL && my_pool->tv->sc_perf_pca != NULL) {
+            SCPerfCounterIncr(my_pool->counter_empty_stalls,
+                    my_pool->tv->sc_perf_pca);
+        }
+        /* ask the other threads to return what they hold for us */
+        (void)SC_ATOMIC_SET(my_pool->return_stack.sync_now, 1);
+        usleep(PKT_POOL_WAIT_USLEEP);
+    }
 }
 
 /** \brief a initialized packet
@@ -93,7 +480,7 @@ void PacketPoolWait(void) {
  *  \warning Use *only* at init, not at packet runtime
  */
 void PacketPoolStorePacket(Packet *p) {
-    if (RingBufferIsFull(ringbuffer)) {
+    if (pkt_pool_mode == PKT_POOL_MODE_GLOBAL && RingBufferIsFull(ringbuffer)) {
         exit(1);
     }
 
@@ -101,19 +488,42 @@ void PacketPoolStorePacket(Packet *p) {
      * onto the ring buffer. */
     p->flags &= ~PKT_ALLOC;
     p->ReleasePacket = PacketPoolReturnPacket;
+    p->pool = PacketPoolGetThreadPool();
+    if (p->pool != NULL)
+        p->pool->total++;
     PacketPoolReturnPacket(p);
 
-    SCLogDebug("buffersize %u", RingBufferSize(ringbuffer));
+    SCLogDebug("buffersize %u", PacketPoolSize());
 }
 
 /** \brief get a packet from the packet pool, but if the
  *         pool is empty, don't wait, just return NULL
  */
 Packet *PacketPoolGetPacket(void) {
-    if (RingBufferIsEmpty(ringbuffer))
+    if (pkt_pool_mode == PKT_POOL_MODE_GLOBAL) {
+        if (RingBufferIsEmpty(ringbuffer))
+            return NULL;
+
+        Packet *p = RingBufferMrMwGetNoWait(ringbuffer);
+        return p;
+    }
+
+    PktPool *my_pool = PacketPoolGetThreadPool();
+    if (my_pool == NULL)
         return NULL;
 
-    Packet *p = RingBufferMrMwGetNoWait(ringbuffer);
+    if (my_pool->head == NULL) {
+        if (my_pool->return_stack.head == NULL)
+            return NULL;
+        PacketPoolGetReturnedPackets(my_pool);
+        if (my_pool->head == NULL)
+            return NULL;
+    }
+
+    Packet *p = my_pool->head;
+    my_pool->head = p->next;
+    my_pool->cnt--;
+    p->next = NULL;
     return p;
 }
 
@@ -123,10 +533,61 @@ Packet *PacketPoolGetPacket(void) {
 void PacketPoolReturnPacket(Packet *p)
 {
     PACKET_RECYCLE(p);
-    RingBufferMrMwPut(ringbuffer, (void *)p);
+
+    if (pkt_pool_mode == PKT_POOL_MODE_GLOBAL) {
+        RingBufferMrMwPut(ringbuffer, (void *)p);
+        return;
+    }
+
+    if (unlikely(p->pool == NULL)) {
+        /* not owned by any pool, shouldn't happen */
+        PACKET_CLEANUP(p);
+        SCFree(p);
+        return;
+    }
+
+    PktPool *my_pool = PacketPoolGetThreadPool();
+    if (p->pool == my_pool) {
+        p->next = my_pool->head;
+        my_pool->head = p;
+        my_pool->cnt++;
+    } else {
+        PacketPoolReturnPacketToOwner(my_pool, p);
+    }
 }
 
 void PacketPoolInit(intmax_t max_pending_packets) {
+    char *mode = NULL;
+    if (ConfGet("packet-pool-mode", &mode) == 1 && mode != NULL) {
+        if (strcasecmp(mode, "per-thread") == 0) {
+            pkt_pool_mode = PKT_POOL_MODE_PER_THREAD;
+        } else if (strcasecmp(mode, "global") == 0) {
+            pkt_pool_mode = PKT_POOL_MODE_GLOBAL;
+        } else {
+            SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry \"%s\" "
+                    "for packet-pool-mode in conf. Killing engine.", mode);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (pkt_pool_mode == PKT_POOL_MODE_PER_THREAD) {
+#ifndef TLS
+        if (pkt_pool_thread_key_init == 0) {
+            if (pthread_key_create(&pkt_pool_thread_key, NULL) != 0) {
+                SCLogError(SC_ERR_FATAL, "Fatal error encountered while "
+                        "creating the packet pool thread key. Exiting...");
+                exit(EXIT_FAILURE);
+            }
+            pkt_pool_thread_key_init = 1;
+        }
+#endif
+        pkt_pool_thread_size = max_pending_packets;
+        SCLogInfo("packet pool in per-thread mode: %"PRIiMAX" packets per "
+                "capture thread. Memory per thread %"PRIuMAX"",
+                max_pending_packets, (uintmax_t)(max_pending_packets*SIZE_OF_PACKET));
+        return;
+    }
+
     /* pre allocate packets */
     SCLogDebug("preallocating packets... packet size %" PRIuMAX "", (uintmax_t)SIZE_OF_PACKET);
     int i = 0;
@@ -143,12 +604,32 @@ void PacketPoolInit(intmax_t max_pending_packets) {
 }
 
 void PacketPoolDestroy(void) {
+    SCMutexLock(&pkt_pool_list_lock);
+    PktPool *pool = pkt_pool_list;
+    while (pool != NULL) {
+        PktPool *next = pool->next;
+
+        PacketPoolFreeList(pool->head);
+        PacketPoolFreeList(pool->pending_head);
+        PacketPoolFreeList(pool->return_stack.head);
+        SCMutexDestroy(&pool->return_stack.mutex);
+        SC_ATOMIC_DESTROY(pool->return_stack.sync_now);
+        SCFree(pool);
+
+        pool = next;
+    }
+    pkt_pool_list = NULL;
+    SCMutexUnlock(&pkt_pool_list_lock);
+
+    PacketPoolSetThreadPool(NULL);
+
     if (ringbuffer == NULL) {
         return;
     }
 
     Packet *p = NULL;
-    while ((p = PacketPoolGetPacket()) != NULL) {
+    while (!RingBufferIsEmpty(ringbuffer) &&
+            (p = RingBufferMrMwGetNoWait(ringbuffer)) != NULL) {
         PACKET_CLEANUP(p);
         SCFree(p);
     }
@@ -161,6 +642,15 @@ Packet *TmqhInputPacketpool(ThreadVars *t)
 {
     Packet *p = NULL;
 
+    if (pkt_pool_mode == PKT_POOL_MODE_PER_THREAD) {
+        while (p == NULL && ringbuffer->shutdown == FALSE) {
+            p = PacketPoolGetPacket();
+            if (p == NULL)
+                PacketPoolWait();
+        }
+        return p;
+    }
+
     while (p == NULL && ringbuffer->shutdown == FALSE) {
         p = RingBufferMrMwGet(ringbuffer);
     }
@@ -36,5 +36,8 @@ void PacketPoolWait(void);
 void PacketPoolReturnPacket(Packet *p);
 void PacketPoolInit(intmax_t max_pending_packets);
 void PacketPoolDestroy(void);
+void PacketPoolInitThread(ThreadVars *, int);
+void PacketPoolDeinitThread(void);
+void PacketPoolFlushPending(void);
 
 #endif /* __TMQH_PACKETPOOL_H__ */
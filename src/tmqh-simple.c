@@ -30,6 +30,7 @@
 #include "threadvars.h"
 
 #include "tm-queuehandlers.h"
+#include "tmqh-packetpool.h"
 
 Packet *TmqhInputSimple(ThreadVars *t);
 void TmqhOutputSimple(ThreadVars *t, Packet *p);
@@ -51,6 +52,10 @@ Packet *TmqhInputSimple(ThreadVars *t)
     SCMutexLock(&q->mutex_q);
 
     if (q->len == 0) {
+        /* hand back packets we hold for other threads' pools
+         * before going to sleep */
+        PacketPoolFlushPending();
+
         /* if we have no packets in queue, wait... */
         SCCondWait(&q->cond_q, &q->mutex_q);
     }
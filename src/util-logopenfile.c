@@ -28,6 +28,7 @@
 #include <sys/un.h>
 
 #include "suricata-common.h" /* errno.h, string.h, etc. */
+#include "suricata.h"        /* sighup_count */
 #include "tm-modules.h"      /* LogFileCtx */
 #include "conf.h"            /* ConfNode, etc. */
 #include "output.h"          /* DEFAULT_LOG_* */
@@ -110,6 +111,41 @@ SCLogOpenFileFp(const char *path, const char *append_setting)
     return ret;
 }
 
+/** \brief open the regular file of a ctx and pick up its current size
+ *  \param log_ctx ctx with the path of the file in log_ctx->filename
+ *  \param append_setting open file with O_APPEND: "yes" or "no"
+ *  \retval 0 on success
+ *  \retval -1 on error
+ */
+static int SCLogFileOpen(LogFileCtx *log_ctx, const char *append_setting)
+{
+    struct stat st;
+
+    log_ctx->fp = SCLogOpenFileFp(log_ctx->filename, append_setting);
+    if (log_ctx->fp == NULL)
+        return -1;
+
+    if (fstat(fileno(log_ctx->fp), &st) == 0)
+        log_ctx->size_current = (uint64_t)st.st_size;
+    else
+        log_ctx->size_current = 0;
+
+    log_ctx->sighup_gen = sighup_count;
+    return 0;
+}
+
+/** \brief close and reopen the regular file of a ctx. On error the
+ *         records are dropped until the next rotation or SIGHUP. */
+static void SCLogFileReopen(LogFileCtx *log_ctx)
+{
+    if (log_ctx->fp != NULL) {
+        fclose(log_ctx->fp);
+        log_ctx->fp = NULL;
+    }
+
+    (void)SCLogFileOpen(log_ctx, "yes");
+}
+
 /** \brief open the indicated file remotely over PCIe to a host
  *  \param path filesystem path to open
  *  \param append_setting open file with O_APPEND: "yes" or "no"
@@ -180,6 +216,13 @@ SCConfLogOpenGeneric(ConfNode *conf,
     if (append == NULL)
         append = DEFAULT_LOG_MODE_APPEND;
 
+    if (log_ctx->threaded && strcasecmp(filetype, DEFAULT_LOG_FILETYPE) != 0) {
+        SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "%s: threaded mode "
+                   "is only supported for the \"%s\" filetype", conf->name,
+                   DEFAULT_LOG_FILETYPE);
+        return -1;
+    }
+
     // Now, what have we been asked to open?
     if (strcasecmp(filetype, "unix_stream") == 0) {
         log_ctx->fp = SCLogOpenUnixSocketFp(log_path, SOCK_STREAM);
@@ -190,9 +233,17 @@ SCConfLogOpenGeneric(ConfNode *conf,
         if (log_ctx->fp == NULL)
             return -1; // Error already logged by Open...Fp routine
     } else if (strcasecmp(filetype, DEFAULT_LOG_FILETYPE) == 0) {
-        log_ctx->fp = SCLogOpenFileFp(log_path, append);
-        if (log_ctx->fp == NULL)
-            return -1; // Error already logged by Open...Fp routine
+        log_ctx->filename = SCStrdup(log_path);
+        if (unlikely(log_ctx->filename == NULL))
+            return -1;
+        if (strcasecmp(append, "yes") == 0)
+            log_ctx->flags |= LOGFILE_APPEND;
+
+        /* in threaded mode the threads open their own shards */
+        if (!log_ctx->threaded) {
+            if (SCLogFileOpen(log_ctx, append) < 0)
+                return -1; // Error already logged by Open...Fp routine
+        }
     } else if (strcasecmp(filetype, "pcie") == 0) {
         log_ctx->pcie_fp = SCLogOpenPcieFp(log_ctx, log_path, append);
         if (log_ctx->pcie_fp == NULL)
@@ -205,8 +256,8 @@ SCConfLogOpenGeneric(ConfNode *conf,
                    conf->name);
     }
 
-    SCLogInfo("%s output device (%s) initialized: %s", conf->name, filetype,
-              filename);
+    SCLogInfo("%s output device (%s%s) initialized: %s", conf->name, filetype,
+              log_ctx->threaded ? ", threaded" : "", filename);
 
     return 0;
 }
@@ -242,6 +293,13 @@ int LogFileFreeCtx(LogFileCtx *lf_ctx)
         SCReturnInt(0);
     }
 
+    /* shards that weren't released by their threads */
+    while (lf_ctx->shards != NULL) {
+        LogFileCtx *shard = lf_ctx->shards;
+        lf_ctx->shards = shard->shard_next;
+        LogFileFreeCtx(shard);
+    }
+
     if (lf_ctx->fp != NULL) {
         SCMutexLock(&lf_ctx->fp_mutex);
         lf_ctx->Close(lf_ctx);
@@ -260,3 +318,129 @@ int LogFileFreeCtx(LogFileCtx *lf_ctx)
 
     SCReturnInt(1);
 }
+
+/** \brief get the shard of a threaded ctx for the calling thread
+ *
+ *  The first call from a thread opens "<filename>.<n>", n counting the
+ *  shards from 1. Other loggers in the same thread share the shard, so
+ *  the sequence numbers of a shard follow the order in which its thread
+ *  logged the records.
+ *
+ *  \param parent threaded ctx set up by SCConfLogOpenGeneric()
+ *  \retval shard ctx to write to, or NULL on error
+ */
+LogFileCtx *LogFileGetThreadShard(LogFileCtx *parent)
+{
+    unsigned long tid = SCGetThreadIdLong();
+    char path[PATH_MAX];
+    LogFileCtx *shard;
+
+    SCMutexLock(&parent->fp_mutex);
+    for (shard = parent->shards; shard != NULL; shard = shard->shard_next) {
+        if (shard->shard_tid == tid) {
+            shard->shard_refcnt++;
+            goto end;
+        }
+    }
+
+    shard = LogFileNewCtx();
+    if (unlikely(shard == NULL))
+        goto end;
+
+    shard->shard_id = ++parent->shard_cnt;
+    snprintf(path, sizeof(path), "%s.%"PRIu32, parent->filename,
+             shard->shard_id);
+    shard->filename = SCStrdup(path);
+    if (unlikely(shard->filename == NULL) ||
+        SCLogFileOpen(shard, (parent->flags & LOGFILE_APPEND) ? "yes" : "no") < 0)
+    {
+        LogFileFreeCtx(shard);
+        shard = NULL;
+        goto end;
+    }
+
+    shard->size_limit = parent->size_limit;
+    shard->parent = parent;
+    shard->shard_tid = tid;
+    shard->shard_refcnt = 1;
+    shard->shard_next = parent->shards;
+    parent->shards = shard;
+
+    SCLogInfo("thread %lu logging to %s", tid, path);
+end:
+    SCMutexUnlock(&parent->fp_mutex);
+    return shard;
+}
+
+/** \brief release a shard, closing it when the last logger of its
+ *         thread is done with it
+ */
+void LogFileReleaseThreadShard(LogFileCtx *shard)
+{
+    LogFileCtx *parent = shard->parent;
+    LogFileCtx **prev;
+
+    SCMutexLock(&parent->fp_mutex);
+    if (--shard->shard_refcnt > 0) {
+        SCMutexUnlock(&parent->fp_mutex);
+        return;
+    }
+
+    for (prev = &parent->shards; *prev != NULL; prev = &(*prev)->shard_next) {
+        if (*prev == shard) {
+            *prev = shard->shard_next;
+            break;
+        }
+    }
+    SCMutexUnlock(&parent->fp_mutex);
+
+    LogFileFreeCtx(shard);
+}
+
+/** \brief rotate or reopen the regular file of a ctx before writing to it
+ *
+ *  The file is reopened if a SIGHUP came in since it was opened, so it can
+ *  be moved away by logrotate and friends. If writing len bytes would take
+ *  it over size_limit, it's renamed to "<filename>.<seconds since epoch>"
+ *  and a new file is started.
+ *
+ *  The caller has to hold fp_mutex. Other types of ctx are left alone.
+ *
+ *  \param log_ctx ctx about to be written to
+ *  \param len number of bytes about to be written
+ */
+void LogFileCheckRotate(LogFileCtx *log_ctx, uint64_t len)
+{
+    if (log_ctx->filename == NULL)
+        return;
+
+    int gen = sighup_count;
+    if (log_ctx->sighup_gen != gen) {
+        log_ctx->sighup_gen = gen;
+        SCLogFileReopen(log_ctx);
+    } else if (log_ctx->size_limit > 0 && log_ctx->size_current > 0 &&
+               log_ctx->size_current + len > log_ctx->size_limit)
+    {
+        char rotated[PATH_MAX];
+        unsigned long now = (unsigned long)time(NULL);
+        uint32_t i = 0;
+
+        snprintf(rotated, sizeof(rotated), "%s.%lu", log_ctx->filename, now);
+        /* more than one rotation in a second */
+        while (access(rotated, F_OK) == 0 && ++i < 1000) {
+            snprintf(rotated, sizeof(rotated), "%s.%lu.%"PRIu32,
+                     log_ctx->filename, now, i);
+        }
+
+        if (rename(log_ctx->filename, rotated) != 0) {
+            SCLogWarning(SC_ERR_FOPEN, "Error rotating \"%s\" to \"%s\": %s",
+                         log_ctx->filename, rotated, strerror(errno));
+            /* keep writing to the current file, try again at the limit */
+            log_ctx->size_current = 0;
+        } else {
+            SCLogFileReopen(log_ctx);
+        }
+    }
+
+    log_ctx->size_current += len;
+}
@@ -61,15 +61,41 @@ typedef struct LogFileCtx_ {
     uint64_t alerts;
     /* flag to avoid multiple threads printing the same stats */
     uint8_t flags;
+
+    /** 1 if every thread writes to its own file, see LogFileGetThreadShard() */
+    int threaded;
+    /** value of sighup_count when the file was opened */
+    int sighup_gen;
+
+    /** shards of a threaded ctx, protected by fp_mutex */
+    struct LogFileCtx_ *shards;
+    uint32_t shard_cnt;
+
+    /** shard fields: the threaded ctx it belongs to, the thread that
+     *  owns it and the number of loggers of that thread using it */
+    struct LogFileCtx_ *parent;
+    struct LogFileCtx_ *shard_next;
+    unsigned long shard_tid;
+    uint32_t shard_id;
+    uint32_t shard_refcnt;
+
+    /** sequence number of the last record written to the shard. Only
+     *  the owning thread updates it. */
+    uint64_t seq;
 } LogFileCtx;
 
 /* flags for LogFileCtx */
 #define LOGFILE_HEADER_WRITTEN 0x01
 #define LOGFILE_ALERTS_PRINTED 0x02
+#define LOGFILE_APPEND         0x04
 
 LogFileCtx *LogFileNewCtx(void);
 int LogFileFreeCtx(LogFileCtx *);
 
 int SCConfLogOpenGeneric(ConfNode *conf, LogFileCtx *, const char *);
 
+LogFileCtx *LogFileGetThreadShard(LogFileCtx *);
+void LogFileReleaseThreadShard(LogFileCtx *);
+void LogFileCheckRotate(LogFileCtx *, uint64_t);
+
 #endif /* __UTIL_LOGOPENFILE_H__ */
@@ -0,0 +1,1409 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ *         Aho-corasick MPM with a compressed state table.
+ *
+ *         Like "ac" this uses a delta table, so there is exactly one table
+ *         lookup per input byte. The table is compressed in two ways:
+ *
+ *         - Alphabet compression: every byte that is used in a pattern gets
+ *           its own class, all other bytes share class 0. Upper case is
+ *           folded into lower case in the translate table, so the search
+ *           doesn't need a separate tolower step. Rows have alphabet_size
+ *           entries instead of 256.
+ *         - Banded rows: most states fail back close to the root, so their
+ *           rows are mostly identical to the row of the root state. Per
+ *           state only the band of the row between the first and the last
+ *           entry that differ from the root row is stored. Lookups outside
+ *           of the band use the root row.
+ *
+ *         Transitions are always 32 bit, the top bit flags that the next
+ *         state has output.
+ *
+ *         For large rulesets this uses a small fraction of the memory "ac"
+ *         uses, at the cost of a compare and an extra (mostly cached) load
+ *         per byte.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+
+#include "conf.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+#include "util-memcmp.h"
+#include "util-mpm-ac-band.h"
+#include "util-memcpy.h"
+#include "util-cpu.h"
+
+void SCACBandInitCtx(MpmCtx *);
+void SCACBandInitThreadCtx(MpmCtx *, MpmThreadCtx *, uint32_t);
+void SCACBandDestroyCtx(MpmCtx *);
+void SCACBandDestroyThreadCtx(MpmCtx *, MpmThreadCtx *);
+int SCACBandAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                         uint32_t, uint32_t, uint8_t);
+int SCACBandAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                         uint32_t, uint32_t, uint8_t);
+int SCACBandPreparePatterns(MpmCtx *mpm_ctx);
+uint32_t SCACBandSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+void SCACBandPrintInfo(MpmCtx *mpm_ctx);
+void SCACBandPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
+void SCACBandRegisterTests(void);
+
+/* a placeholder to denote a failure transition in the goto table */
+#define SC_AC_BAND_FAIL (-1)
+/* size of the hash table used to speed up pattern insertions initially */
+#define INIT_HASH_SIZE 65536
+
+#define SC_AC_BAND_GOTO(ctx, state, c) \
+    (ctx)->goto_table[(size_t)(state) * (ctx)->alphabet_size + (c)]
+
+/**
+ * \internal
+ * \brief Creates a hash of the pattern.  We use it for the hashing process
+ *        during the initial pattern insertion time, to cull duplicate sigs.
+ *
+ * \param pat    Pointer to the pattern.
+ * \param patlen Pattern length.
+ *
+ * \retval hash A 32 bit unsigned hash.
+ */
+static inline uint32_t SCACBandInitHashRaw(uint8_t *pat, uint16_t patlen)
+{
+    uint32_t hash = patlen * pat[0];
+    if (patlen > 1)
+        hash += pat[1];
+
+    return (hash % INIT_HASH_SIZE);
+}
+
+/**
+ * \internal
+ * \brief Looks up a pattern by pattern id.
+ *
+ * \param ctx    Pointer to the AC ctx.
+ * \param pat    Pointer to the pattern.
+ * \param patlen Pattern length.
+ * \param pid    Pattern id.
+ *
+ * \retval p the pattern or NULL if it wasn't added yet.
+ */
+static inline SCACBandPattern *SCACBandInitHashLookup(SCACBandCtx *ctx,
+        uint8_t *pat, uint16_t patlen, uint32_t pid)
+{
+    uint32_t hash = SCACBandInitHashRaw(pat, patlen);
+
+    if (ctx->init_hash == NULL) {
+        return NULL;
+    }
+
+    SCACBandPattern *t = ctx->init_hash[hash];
+    for ( ; t != NULL; t = t->next) {
+        if (t->id == pid)
+            return t;
+    }
+
+    return NULL;
+}
+
+static inline SCACBandPattern *SCACBandAllocPattern(MpmCtx *mpm_ctx)
+{
+    SCACBandPattern *p = SCMalloc(sizeof(SCACBandPattern));
+    if (unlikely(p == NULL)) {
+        exit(EXIT_FAILURE);
+    }
+    memset(p, 0, sizeof(SCACBandPattern));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCACBandPattern);
+
+    return p;
+}
+
+static inline void SCACBandFreePattern(MpmCtx *mpm_ctx, SCACBandPattern *p)
+{
+    if (p == NULL)
+        return;
+
+    if (p->ci != NULL) {
+        SCFree(p->ci);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    if (p->original_pat != NULL) {
+        SCFree(p->original_pat);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    SCFree(p);
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCACBandPattern);
+}
+
+static inline void SCACBandInitHashAdd(SCACBandCtx *ctx, SCACBandPattern *p)
+{
+    uint32_t hash = SCACBandInitHashRaw(p->original_pat, p->len);
+
+    p->next = ctx->init_hash[hash];
+    ctx->init_hash[hash] = p;
+}
+
+/**
+ * \internal
+ * \brief Add a pattern to the mpm-ac-band context.
+ *
+ * \param mpm_ctx Mpm context.
+ * \param pat     Pointer to the pattern.
+ * \param patlen  Length of the pattern.
+ * \param pid     Pattern id
+ * \param sid     Signature id (internal id).
+ * \param flags   Pattern's MPM_PATTERN_* flags.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+static int SCACBandAddPattern(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                              uint16_t offset, uint16_t depth, uint32_t pid,
+                              uint32_t sid, uint8_t flags)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+
+    SCLogDebug("Adding pattern for ctx %p, patlen %"PRIu16" and pid %" PRIu32,
+               ctx, patlen, pid);
+
+    if (patlen == 0) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "pattern length 0");
+        return 0;
+    }
+
+    if (ctx->init_hash == NULL) {
+        SCLogError(SC_ERR_INVALID_ARGUMENTS, "adding pattern to an already "
+                   "prepared mpm ctx");
+        return -1;
+    }
+
+    /* check if we have already inserted this pattern */
+    SCACBandPattern *p = SCACBandInitHashLookup(ctx, pat, patlen, pid);
+    if (p != NULL)
+        return 0;
+
+    /* p will never be NULL */
+    p = SCACBandAllocPattern(mpm_ctx);
+
+    p->len = patlen;
+    p->flags = flags;
+    p->id = pid;
+
+    p->original_pat = SCMalloc(patlen);
+    if (p->original_pat == NULL)
+        goto error;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += patlen;
+    memcpy(p->original_pat, pat, patlen);
+
+    p->ci = SCMalloc(patlen);
+    if (p->ci == NULL)
+        goto error;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += patlen;
+    memcpy_tolower(p->ci, pat, patlen);
+
+    /* put in the pattern hash */
+    SCACBandInitHashAdd(ctx, p);
+
+    mpm_ctx->pattern_cnt++;
+
+    if (mpm_ctx->maxlen < patlen)
+        mpm_ctx->maxlen = patlen;
+
+    if (mpm_ctx->minlen == 0) {
+        mpm_ctx->minlen = patlen;
+    } else {
+        if (mpm_ctx->minlen > patlen)
+            mpm_ctx->minlen = patlen;
+    }
+
+    /* we need the max pat id */
+    if (pid > ctx->max_pat_id)
+        ctx->max_pat_id = pid;
+
+    return 0;
+
+error:
+    SCACBandFreePattern(mpm_ctx, p);
+    return -1;
+}
+
+/**
+ * \internal
+ * \brief Set up the compressed alphabet.
+ *
+ * Every (lower case) byte used by a pattern gets a class, starting at 1.
+ * Bytes not in any pattern can only lead to the transitions of the root
+ * state, so they all share class 0.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+static void SCACBandPrepareAlphabet(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    uint8_t class[256];
+    uint32_t i, u;
+
+    memset(class, 0, sizeof(class));
+
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        SCACBandPattern *p = ctx->parray[i];
+        for (u = 0; u < p->len; u++) {
+            class[p->ci[u]] = 1;
+        }
+    }
+
+    /* patterns are lower cased, so we can't run out of classes */
+    ctx->alphabet_size = 1;
+    for (u = 0; u < 256; u++) {
+        if (class[u])
+            class[u] = ctx->alphabet_size++;
+    }
+
+    for (u = 0; u < 256; u++) {
+        ctx->translate_table[u] = class[u8_tolower((uint8_t)u)];
+    }
+
+    SCLogDebug("alphabet size %u", ctx->alphabet_size);
+}
+
+/**
+ * \internal
+ * \brief Initialize a new state in the goto and output tables.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ *
+ * \retval The state id, of the newly created state.
+ */
+static inline int32_t SCACBandInitNewState(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    void *ptmp;
+    uint16_t c;
+
+    if (ctx->state_count == ctx->goto_table_states) {
+        uint32_t states = ctx->goto_table_states ? ctx->goto_table_states * 2 : 256;
+
+        ptmp = SCRealloc(ctx->goto_table,
+                         (size_t)states * ctx->alphabet_size * sizeof(int32_t));
+        if (ptmp == NULL) {
+            SCFree(ctx->goto_table);
+            ctx->goto_table = NULL;
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        ctx->goto_table = ptmp;
+
+        ptmp = SCRealloc(ctx->output_table, states * sizeof(SCACBandOutputTable));
+        if (ptmp == NULL) {
+            SCFree(ctx->output_table);
+            ctx->output_table = NULL;
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        ctx->output_table = ptmp;
+
+        ctx->goto_table_states = states;
+    }
+
+    /* set all transitions for the newly assigned state as FAIL transitions */
+    for (c = 0; c < ctx->alphabet_size; c++) {
+        SC_AC_BAND_GOTO(ctx, ctx->state_count, c) = SC_AC_BAND_FAIL;
+    }
+    memset(ctx->output_table + ctx->state_count, 0, sizeof(SCACBandOutputTable));
+
+    if (ctx->state_count == SC_AC_BAND_STATE_MASK) {
+        SCLogError(SC_ERR_AHO_CORASICK, "max states reached");
+        exit(EXIT_FAILURE);
+    }
+
+    return ctx->state_count++;
+}
+
+/**
+ * \internal
+ * \brief Adds a pid to the output table for a state.
+ *
+ * \param state   The state to whose output table we should add the pid.
+ * \param pid     The pattern id to add.
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+static void SCACBandSetOutputState(int32_t state, uint32_t pid, MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    SCACBandOutputTable *output_state = &ctx->output_table[state];
+    uint32_t i = 0;
+    void *ptmp;
+
+    for (i = 0; i < output_state->no_of_entries; i++) {
+        if (output_state->pids[i] == pid)
+            return;
+    }
+
+    ptmp = SCRealloc(output_state->pids,
+                     (output_state->no_of_entries + 1) * sizeof(uint32_t));
+    if (ptmp == NULL) {
+        SCFree(output_state->pids);
+        output_state->pids = NULL;
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    output_state->pids = ptmp;
+
+    output_state->pids[output_state->no_of_entries++] = pid;
+}
+
+/**
+ * \internal
+ * \brief Club the output data from 2 states and store it in the 1st state.
+ *        dst_state_data = {dst_state_data} UNION {src_state_data}
+ */
+static inline void SCACBandClubOutputStates(int32_t dst_state, int32_t src_state,
+                                            MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    uint32_t i = 0;
+
+    for (i = 0; i < ctx->output_table[src_state].no_of_entries; i++) {
+        SCACBandSetOutputState(dst_state, ctx->output_table[src_state].pids[i],
+                               mpm_ctx);
+    }
+}
+
+/**
+ * \internal
+ * \brief Add a pattern to the goto table.
+ *
+ * \param pattern     Pointer to the (lower cased) pattern.
+ * \param pattern_len Pattern length.
+ * \param pid         The pattern id, that corresponds to this pattern.
+ * \param mpm_ctx     Pointer to the mpm context.
+ */
+static inline void SCACBandEnter(uint8_t *pattern, uint16_t pattern_len,
+                                 uint32_t pid, MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    int32_t state = 0;
+    int32_t newstate = 0;
+    uint16_t i = 0;
+
+    /* walk down the trie till we have a match for the pattern prefix */
+    for (i = 0; i < pattern_len; i++) {
+        uint8_t c = ctx->translate_table[pattern[i]];
+        if (SC_AC_BAND_GOTO(ctx, state, c) == SC_AC_BAND_FAIL)
+            break;
+        state = SC_AC_BAND_GOTO(ctx, state, c);
+    }
+
+    /* add the non-matching pattern suffix to the trie, from the last state
+     * we left off */
+    for (; i < pattern_len; i++) {
+        /* may realloc the goto table */
+        newstate = SCACBandInitNewState(mpm_ctx);
+        SC_AC_BAND_GOTO(ctx, state, ctx->translate_table[pattern[i]]) = newstate;
+        state = newstate;
+    }
+
+    /* add this pattern id, to the output table of the last state, where the
+     * pattern ends in the trie */
+    SCACBandSetOutputState(state, pid, mpm_ctx);
+}
+
+/**
+ * \internal
+ * \brief Append a state's row to the band table.
+ *
+ * The root row is stored in full. For other states only the part of the
+ * row that differs from the root row is stored.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param state   The state the row belongs to.
+ * \param row     alphabet_size transitions.
+ */
+static void SCACBandAddRow(MpmCtx *mpm_ctx, uint32_t state, uint32_t *row)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    SCACBandState *s = &ctx->states[state];
+    uint32_t lo = 0;
+    uint32_t hi = (uint32_t)ctx->alphabet_size - 1;
+
+    if (state != 0) {
+        while (lo < ctx->alphabet_size && row[lo] == ctx->band_table[lo])
+            lo++;
+        if (lo == ctx->alphabet_size) {
+            /* same row as the root state */
+            s->base = 0;
+            s->lo = 0;
+            s->cnt = 0;
+            return;
+        }
+        while (row[hi] == ctx->band_table[hi])
+            hi--;
+    }
+
+    uint32_t cnt = hi - lo + 1;
+    if (ctx->band_table_size + cnt > ctx->band_table_alloc) {
+        uint32_t size = ctx->band_table_alloc ? ctx->band_table_alloc : 4096;
+        while (size < ctx->band_table_size + cnt)
+            size *= 2;
+
+        void *ptmp = SCRealloc(ctx->band_table, size * sizeof(uint32_t));
+        if (ptmp == NULL) {
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
+        ctx->band_table = ptmp;
+        ctx->band_table_alloc = size;
+    }
+
+    memcpy(ctx->band_table + ctx->band_table_size, row + lo,
+           cnt * sizeof(uint32_t));
+    s->base = ctx->band_table_size;
+    s->lo = (uint16_t)lo;
+    s->cnt = (uint16_t)cnt;
+    ctx->band_table_size += cnt;
+}
+
+/**
+ * \internal
+ * \brief Get the next state from the band table.
+ */
+static inline uint32_t SCACBandNextState(const SCACBandCtx *ctx, uint32_t state,
+                                         uint8_t c)
+{
+    const SCACBandState *s = &ctx->states[state & SC_AC_BAND_STATE_MASK];
+    uint32_t d = (uint32_t)c - s->lo;
+
+    if (d < s->cnt)
+        return ctx->band_table[s->base + d];
+    return ctx->band_table[c];
+}
+
+static inline uint32_t SCACBandTransition(SCACBandCtx *ctx, int32_t state)
+{
+    if (ctx->output_table[state].no_of_entries != 0)
+        return (uint32_t)state | SC_AC_BAND_OUTPUT_FLAG;
+    return (uint32_t)state;
+}
+
+/**
+ * \internal
+ * \brief Create the failure table and the banded delta table.
+ *
+ * States are handled in BFS order. The failure state of a state is less
+ * deep, so its row is in the band table before we need it to fill the
+ * failure transitions of the state's own row.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+static void SCACBandCreateTables(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    uint32_t head = 0, tail = 0;
+    uint16_t c;
+
+    int32_t *queue = SCMalloc(ctx->state_count * sizeof(int32_t));
+    uint32_t *row = SCMalloc(ctx->alphabet_size * sizeof(uint32_t));
+    ctx->failure_table = SCMalloc(ctx->state_count * sizeof(int32_t));
+    ctx->states = SCMalloc(ctx->state_count * sizeof(SCACBandState));
+    if (queue == NULL || row == NULL || ctx->failure_table == NULL ||
+        ctx->states == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->failure_table, 0, ctx->state_count * sizeof(int32_t));
+    memset(ctx->states, 0, ctx->state_count * sizeof(SCACBandState));
+
+    /* the root row: the depth 1 states fail to the root */
+    for (c = 0; c < ctx->alphabet_size; c++) {
+        int32_t temp_state = SC_AC_BAND_GOTO(ctx, 0, c);
+        if (temp_state != 0)
+            queue[tail++] = temp_state;
+        row[c] = SCACBandTransition(ctx, temp_state);
+    }
+    SCACBandAddRow(mpm_ctx, 0, row);
+
+    while (head < tail) {
+        int32_t r_state = queue[head++];
+        int32_t f_state = ctx->failure_table[r_state];
+
+        for (c = 0; c < ctx->alphabet_size; c++) {
+            int32_t temp_state = SC_AC_BAND_GOTO(ctx, r_state, c);
+            if (temp_state == SC_AC_BAND_FAIL)
+                continue;
+
+            queue[tail++] = temp_state;
+
+            int32_t state = f_state;
+            while (SC_AC_BAND_GOTO(ctx, state, c) == SC_AC_BAND_FAIL)
+                state = ctx->failure_table[state];
+            ctx->failure_table[temp_state] = SC_AC_BAND_GOTO(ctx, state, c);
+            SCACBandClubOutputStates(temp_state,
+                                     ctx->failure_table[temp_state], mpm_ctx);
+        }
+
+        /* outputs of the children are complete now, build the row */
+        for (c = 0; c < ctx->alphabet_size; c++) {
+            int32_t temp_state = SC_AC_BAND_GOTO(ctx, r_state, c);
+            if (temp_state != SC_AC_BAND_FAIL)
+                row[c] = SCACBandTransition(ctx, temp_state);
+            else
+                row[c] = SCACBandNextState(ctx, f_state, (uint8_t)c);
+        }
+        SCACBandAddRow(mpm_ctx, r_state, row);
+    }
+
+    SCFree(row);
+    SCFree(queue);
+}
+
+static inline void SCACBandInsertCaseSensitiveEntriesForPatterns(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    uint32_t state = 0;
+    uint32_t k = 0;
+
+    for (state = 0; state < ctx->state_count; state++) {
+        for (k = 0; k < ctx->output_table[state].no_of_entries; k++) {
+            if (ctx->pid_pat_list[ctx->output_table[state].pids[k]].cs != NULL) {
+                ctx->output_table[state].pids[k] &= 0x0000FFFF;
+                ctx->output_table[state].pids[k] |= 1 << 16;
+            }
+        }
+    }
+}
+
+/**
+ * \internal
+ * \brief Size in bytes the "ac" state table would have for this ctx.
+ */
+static uint64_t SCACBandFullTableSize(SCACBandCtx *ctx)
+{
+    uint64_t size = (ctx->state_count < 32767) ? sizeof(uint16_t) : sizeof(uint32_t);
+    return (uint64_t)ctx->state_count * 256 * size;
+}
+
+/**
+ * \brief Process the patterns and prepare the state table.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+static inline void SCACBandPrepareStateTable(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    /* create the 0th state in the goto table and output_table */
+    SCACBandInitNewState(mpm_ctx);
+
+    /* create the goto table */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        SCACBandEnter(ctx->parray[i]->ci, ctx->parray[i]->len,
+                      ctx->parray[i]->id, mpm_ctx);
+    }
+    for (i = 0; i < ctx->alphabet_size; i++) {
+        if (SC_AC_BAND_GOTO(ctx, 0, i) == SC_AC_BAND_FAIL)
+            SC_AC_BAND_GOTO(ctx, 0, i) = 0;
+    }
+
+    /* create the failure table and the compressed state table */
+    SCACBandCreateTables(mpm_ctx);
+
+    SCACBandInsertCaseSensitiveEntriesForPatterns(mpm_ctx);
+
+    /* we don't need these anymore */
+    SCFree(ctx->goto_table);
+    ctx->goto_table = NULL;
+    ctx->goto_table_states = 0;
+    SCFree(ctx->failure_table);
+    ctx->failure_table = NULL;
+
+    /* give back what we over allocated */
+    void *ptmp = SCRealloc(ctx->band_table, ctx->band_table_size * sizeof(uint32_t));
+    if (ptmp != NULL) {
+        ctx->band_table = ptmp;
+        ctx->band_table_alloc = ctx->band_table_size;
+    }
+
+    mpm_ctx->memory_cnt += 2;
+    mpm_ctx->memory_size += ctx->state_count * sizeof(SCACBandState) +
+                            ctx->band_table_size * sizeof(uint32_t);
+
+    SCLogDebug("ctx %p: %"PRIu32" patterns, %"PRIu32" states, alphabet %"PRIu16
+               ", state table %"PRIuMAX" bytes (\"ac\" would use %"PRIu64")",
+               ctx, mpm_ctx->pattern_cnt, ctx->state_count, ctx->alphabet_size,
+               (uintmax_t)(ctx->state_count * sizeof(SCACBandState) +
+                           ctx->band_table_size * sizeof(uint32_t)),
+               SCACBandFullTableSize(ctx));
+}
+
+/**
+ * \brief Process the patterns added to the mpm, and create the internal tables.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+int SCACBandPreparePatterns(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+
+    if (mpm_ctx->pattern_cnt == 0 || ctx->init_hash == NULL) {
+        SCLogDebug("no patterns supplied to this mpm_ctx");
+        return 0;
+    }
+
+    /* alloc the pattern array */
+    ctx->parray = (SCACBandPattern **)SCMalloc(mpm_ctx->pattern_cnt *
+                                               sizeof(SCACBandPattern *));
+    if (ctx->parray == NULL)
+        goto error;
+    memset(ctx->parray, 0, mpm_ctx->pattern_cnt * sizeof(SCACBandPattern *));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(SCACBandPattern *));
+
+    /* populate it with the patterns in the hash */
+    uint32_t i = 0, p = 0;
+    for (i = 0; i < INIT_HASH_SIZE; i++) {
+        SCACBandPattern *node = ctx->init_hash[i], *nnode = NULL;
+        while(node != NULL) {
+            nnode = node->next;
+            node->next = NULL;
+            ctx->parray[p++] = node;
+            node = nnode;
+        }
+    }
+
+    /* we no longer need the hash, so free it's memory */
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    /* handle no case patterns */
+    ctx->pid_pat_list = SCMalloc((ctx->max_pat_id + 1) * sizeof(SCACBandPatternList));
+    if (ctx->pid_pat_list == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->pid_pat_list, 0, (ctx->max_pat_id + 1) * sizeof(SCACBandPatternList));
+
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (!(ctx->parray[i]->flags & MPM_PATTERN_FLAG_NOCASE)) {
+            ctx->pid_pat_list[ctx->parray[i]->id].cs = SCMalloc(ctx->parray[i]->len);
+            if (ctx->pid_pat_list[ctx->parray[i]->id].cs == NULL) {
+                SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(ctx->pid_pat_list[ctx->parray[i]->id].cs,
+                   ctx->parray[i]->original_pat, ctx->parray[i]->len);
+            ctx->pid_pat_list[ctx->parray[i]->id].patlen = ctx->parray[i]->len;
+        }
+    }
+
+    SCACBandPrepareAlphabet(mpm_ctx);
+
+    /* prepare the state table required by AC */
+    SCACBandPrepareStateTable(mpm_ctx);
+
+    /* free all the stored patterns */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (ctx->parray[i] != NULL) {
+            SCACBandFreePattern(mpm_ctx, ctx->parray[i]);
+        }
+    }
+    SCFree(ctx->parray);
+    ctx->parray = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACBandPattern *));
+
+    return 0;
+
+error:
+    return -1;
+}
+
+/**
+ * \brief Init the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param matchsize      We don't need this.
+ */
+void SCACBandInitThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                           uint32_t matchsize)
+{
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+
+    mpm_thread_ctx->ctx = SCMalloc(sizeof(SCACBandThreadCtx));
+    if (mpm_thread_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_thread_ctx->ctx, 0, sizeof(SCACBandThreadCtx));
+    mpm_thread_ctx->memory_cnt++;
+    mpm_thread_ctx->memory_size += sizeof(SCACBandThreadCtx);
+}
+
+/**
+ * \brief Initialize the AC context.
+ *
+ * \param mpm_ctx       Mpm context.
+ */
+void SCACBandInitCtx(MpmCtx *mpm_ctx)
+{
+    if (mpm_ctx->ctx != NULL)
+        return;
+
+    mpm_ctx->ctx = SCMalloc(sizeof(SCACBandCtx));
+    if (mpm_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_ctx->ctx, 0, sizeof(SCACBandCtx));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCACBandCtx);
+
+    /* initialize the hash we use to speed up pattern insertions */
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    ctx->init_hash = SCMalloc(sizeof(SCACBandPattern *) * INIT_HASH_SIZE);
+    if (ctx->init_hash == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->init_hash, 0, sizeof(SCACBandPattern *) * INIT_HASH_SIZE);
+}
+
+/**
+ * \brief Destroy the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ */
+void SCACBandDestroyThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
+{
+    SCACBandPrintSearchStats(mpm_thread_ctx);
+
+    if (mpm_thread_ctx->ctx != NULL) {
+        SCFree(mpm_thread_ctx->ctx);
+        mpm_thread_ctx->ctx = NULL;
+        mpm_thread_ctx->memory_cnt--;
+        mpm_thread_ctx->memory_size -= sizeof(SCACBandThreadCtx);
+    }
+}
+
+/**
+ * \brief Destroy the mpm context.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+void SCACBandDestroyCtx(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    if (ctx == NULL)
+        return;
+
+    if (ctx->init_hash != NULL) {
+        uint32_t i;
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            SCACBandPattern *node = ctx->init_hash[i], *nnode = NULL;
+            while (node != NULL) {
+                nnode = node->next;
+                SCACBandFreePattern(mpm_ctx, node);
+                node = nnode;
+            }
+        }
+        SCFree(ctx->init_hash);
+        ctx->init_hash = NULL;
+    }
+
+    if (ctx->parray != NULL) {
+        uint32_t i;
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            if (ctx->parray[i] != NULL) {
+                SCACBandFreePattern(mpm_ctx, ctx->parray[i]);
+            }
+        }
+
+        SCFree(ctx->parray);
+        ctx->parray = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACBandPattern *));
+    }
+
+    if (ctx->goto_table != NULL)
+        SCFree(ctx->goto_table);
+    if (ctx->failure_table != NULL)
+        SCFree(ctx->failure_table);
+
+    if (ctx->states != NULL) {
+        SCFree(ctx->states);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= ctx->state_count * sizeof(SCACBandState);
+    }
+    if (ctx->band_table != NULL) {
+        SCFree(ctx->band_table);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= ctx->band_table_size * sizeof(uint32_t);
+    }
+
+    if (ctx->output_table != NULL) {
+        uint32_t state;
+        for (state = 0; state < ctx->state_count; state++) {
+            if (ctx->output_table[state].pids != NULL) {
+                SCFree(ctx->output_table[state].pids);
+            }
+        }
+        SCFree(ctx->output_table);
+    }
+
+    if (ctx->pid_pat_list != NULL) {
+        int i;
+        for (i = 0; i < (ctx->max_pat_id + 1); i++) {
+            if (ctx->pid_pat_list[i].cs != NULL)
+                SCFree(ctx->pid_pat_list[i].cs);
+        }
+        SCFree(ctx->pid_pat_list);
+    }
+
+    SCFree(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCACBandCtx);
+}
+
+/**
+ * \brief The aho corasick search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACBandSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                        PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+    int i = 0;
+    int matches = 0;
+
+    if (ctx->state_count == 0)
+        return 0;
+
+    SCACBandPatternList *pid_pat_list = ctx->pid_pat_list;
+    const uint8_t *translate_table = ctx->translate_table;
+    const SCACBandState *states = ctx->states;
+    const uint32_t *band_table = ctx->band_table;
+    register uint32_t state = 0;
+
+    for (i = 0; i < buflen; i++) {
+        uint8_t c = translate_table[buf[i]];
+        const SCACBandState *s = &states[state & SC_AC_BAND_STATE_MASK];
+        uint32_t d = (uint32_t)c - s->lo;
+
+        state = (d < s->cnt) ? band_table[s->base + d] : band_table[c];
+        if (state & SC_AC_BAND_OUTPUT_FLAG) {
+            uint32_t no_of_entries = ctx->output_table[state & SC_AC_BAND_STATE_MASK].no_of_entries;
+            uint32_t *pids = ctx->output_table[state & SC_AC_BAND_STATE_MASK].pids;
+            uint32_t k;
+            for (k = 0; k < no_of_entries; k++) {
+                uint32_t pid = pids[k] & 0x0000FFFF;
+                if (pids[k] & 0xFFFF0000) {
+                    if (SCMemcmp(pid_pat_list[pid].cs,
+                                 buf + i - pid_pat_list[pid].patlen + 1,
+                                 pid_pat_list[pid].patlen) != 0) {
+                        continue;
+                    }
+                }
+                if (!(pmq->pattern_id_bitarray[pid / 8] & (1 << (pid % 8)))) {
+                    pmq->pattern_id_bitarray[pid / 8] |= (1 << (pid % 8));
+                    pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pid;
+                }
+                matches++;
+            }
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * \brief Add a case insensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCACBandAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                         uint16_t offset, uint16_t depth, uint32_t pid,
+                         uint32_t sid, uint8_t flags)
+{
+    flags |= MPM_PATTERN_FLAG_NOCASE;
+    return SCACBandAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+/**
+ * \brief Add a case sensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCACBandAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                         uint16_t offset, uint16_t depth, uint32_t pid,
+                         uint32_t sid, uint8_t flags)
+{
+    return SCACBandAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+void SCACBandPrintSearchStats(MpmThreadCtx *mpm_thread_ctx)
+{
+#ifdef SC_AC_BAND_COUNTERS
+    SCACBandThreadCtx *ctx = (SCACBandThreadCtx *)mpm_thread_ctx->ctx;
+    printf("AC Band Thread Search stats (ctx %p)\n", ctx);
+    printf("Total calls: %" PRIu32 "\n", ctx->total_calls);
+    printf("Total matches: %" PRIu64 "\n", ctx->total_matches);
+#endif /* SC_AC_BAND_COUNTERS */
+}
+
+void SCACBandPrintInfo(MpmCtx *mpm_ctx)
+{
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx->ctx;
+
+    printf("MPM AC Band Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf(" Sizeof:\n");
+    printf("  MpmCtx           %" PRIuMAX "\n", (uintmax_t)sizeof(MpmCtx));
+    printf("  SCACBandCtx:     %" PRIuMAX "\n", (uintmax_t)sizeof(SCACBandCtx));
+    printf("  SCACBandPattern  %" PRIuMAX "\n", (uintmax_t)sizeof(SCACBandPattern));
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("Total states in the state table:    %" PRIu32 "\n", ctx->state_count);
+    printf("Alphabet size:                      %" PRIu16 "\n", ctx->alphabet_size);
+    printf("Band table entries:                 %" PRIu32 "\n", ctx->band_table_size);
+    printf("State table size:                   %" PRIuMAX " bytes\n",
+           (uintmax_t)(ctx->state_count * sizeof(SCACBandState) +
+                       ctx->band_table_size * sizeof(uint32_t)));
+    printf("Uncompressed (\"ac\") table size:     %" PRIu64 " bytes\n",
+           SCACBandFullTableSize(ctx));
+    printf("\n");
+}
+
+/************************** Mpm Registration ***************************/
+
+/**
+ * \brief Register the aho-corasick mpm with the compressed state table.
+ */
+void MpmACBandRegister(void)
+{
+    mpm_table[MPM_AC_BAND].name = "ac-band";
+    mpm_table[MPM_AC_BAND].max_pattern_length = 0;
+
+    mpm_table[MPM_AC_BAND].InitCtx = SCACBandInitCtx;
+    mpm_table[MPM_AC_BAND].InitThreadCtx = SCACBandInitThreadCtx;
+    mpm_table[MPM_AC_BAND].DestroyCtx = SCACBandDestroyCtx;
+    mpm_table[MPM_AC_BAND].DestroyThreadCtx = SCACBandDestroyThreadCtx;
+    mpm_table[MPM_AC_BAND].AddPattern = SCACBandAddPatternCS;
+    mpm_table[MPM_AC_BAND].AddPatternNocase = SCACBandAddPatternCI;
+    mpm_table[MPM_AC_BAND].Prepare = SCACBandPreparePatterns;
+    mpm_table[MPM_AC_BAND].Search = SCACBandSearch;
+    mpm_table[MPM_AC_BAND].Cleanup = NULL;
+    mpm_table[MPM_AC_BAND].PrintCtx = SCACBandPrintInfo;
+    mpm_table[MPM_AC_BAND].PrintThreadCtx = SCACBandPrintSearchStats;
+    mpm_table[MPM_AC_BAND].RegisterUnittests = SCACBandRegisterTests;
+    mpm_table[MPM_AC_BAND].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+static int SCACBandTest01(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC_BAND);
+    SCACBandInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    /* 1 match */
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    /* 1 match */
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"bcde", 4, 0, 0, 1, 0, 0);
+    /* no match */
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"fghjxyz", 7, 0, 0, 2, 0, 0);
+    PmqSetup(&pmq, 3);
+
+    SCACBandPreparePatterns(&mpm_ctx);
+
+    char *buf = "abcdefghjiklmnopqrstuvwxyz";
+    uint32_t cnt = SCACBandSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                                  (uint8_t *)buf, strlen(buf));
+
+    if (cnt == 2)
+        result = 1;
+    else
+        printf("2 != %" PRIu32 " ",cnt);
+
+    SCACBandDestroyCtx(&mpm_ctx);
+    SCACBandDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/** \test outputs of the failure states, the classic he/she/his/hers */
+static int SCACBandTest02(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC_BAND);
+    SCACBandInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"he", 2, 0, 0, 0, 0, 0);
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"she", 3, 0, 0, 1, 0, 0);
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"his", 3, 0, 0, 2, 0, 0);
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"hers", 4, 0, 0, 3, 0, 0);
+    PmqSetup(&pmq, 4);
+
+    SCACBandPreparePatterns(&mpm_ctx);
+
+    char *buf = "ushers";
+    uint32_t cnt = SCACBandSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                                  (uint8_t *)buf, strlen(buf));
+
+    if (cnt != 3) {
+        printf("3 != %" PRIu32 " ",cnt);
+        goto end;
+    }
+    if (pmq.pattern_id_array_cnt != 3 || pmq.pattern_id_bitarray[0] != 0x0b) {
+        printf("unexpected pattern ids: cnt %u bits %02x ",
+               pmq.pattern_id_array_cnt, pmq.pattern_id_bitarray[0]);
+        goto end;
+    }
+
+    result = 1;
+end:
+    SCACBandDestroyCtx(&mpm_ctx);
+    SCACBandDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/** \test case sensitive and nocase patterns */
+static int SCACBandTest03(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC_BAND);
+    SCACBandInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    /* no match, case differs */
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"ABCD", 4, 0, 0, 0, 0, 0);
+    /* 1 match */
+    MpmAddPatternCI(&mpm_ctx, (uint8_t *)"BCDE", 4, 0, 0, 1, 0, 0);
+    /* 1 match */
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"Fgh", 3, 0, 0, 2, 0, 0);
+    PmqSetup(&pmq, 3);
+
+    SCACBandPreparePatterns(&mpm_ctx);
+
+    char *buf = "abcdeFghjiklmnopqrstuvwxyz";
+    uint32_t cnt = SCACBandSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                                  (uint8_t *)buf, strlen(buf));
+
+    if (cnt == 2)
+        result = 1;
+    else
+        printf("2 != %" PRIu32 " ",cnt);
+
+    SCACBandDestroyCtx(&mpm_ctx);
+    SCACBandDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/** \test alphabet compression: unused bytes share class 0, case is folded */
+static int SCACBandTest04(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_AC_BAND);
+    SCACBandInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"Abc", 3, 0, 0, 0, 0, 0);
+    MpmAddPatternCI(&mpm_ctx, (uint8_t *)"\x00\xff", 2, 0, 0, 1, 0, 0);
+
+    SCACBandPreparePatterns(&mpm_ctx);
+
+    SCACBandCtx *ctx = (SCACBandCtx *)mpm_ctx.ctx;
+    if (ctx->alphabet_size != 6) {
+        printf("alphabet size %u, expected 6: ", ctx->alphabet_size);
+        goto end;
+    }
+    if (ctx->translate_table['a'] == 0 ||
+        ctx->translate_table['a'] != ctx->translate_table['A']) {
+        printf("'a' and 'A' not in the same class: ");
+        goto end;
+    }
+    if (ctx->translate_table[0x00] == 0 || ctx->translate_table[0xff] == 0 ||
+        ctx->translate_table['d'] != 0 || ctx->translate_table['D'] != 0) {
+        printf("bad classes: ");
+        goto end;
+    }
+    /* the root row is stored in full */
+    if (ctx->states[0].cnt != ctx->alphabet_size) {
+        printf("root row not stored in full: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    SCACBandDestroyCtx(&mpm_ctx);
+    SCACBandDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    return result;
+}
+
+#define SC_AC_BAND_TEST_BUFLEN 65535
+
+static uint32_t SCACBandTestRand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+/**
+ * \internal
+ * \brief Add pseudo random patterns and make a buffer to search.
+ *
+ * \param alphabet restrict the patterns and buffer to the first
+ *                 'alphabet' bytes starting at 'a', to get lots of
+ *                 failure transitions and overlapping matches.
+ */
+static void SCACBandTestSetup(MpmCtx *mpm_ctx, uint32_t seed, uint32_t patterns,
+                              uint32_t alphabet, uint8_t *buf, uint32_t buflen)
+{
+    uint8_t pat[16];
+    uint32_t i, u;
+
+    for (i = 0; i < patterns; i++) {
+        uint16_t len = 2 + SCACBandTestRand(&seed) % (sizeof(pat) - 2);
+        for (u = 0; u < len; u++) {
+            pat[u] = 'a' + SCACBandTestRand(&seed) % alphabet;
+            if (SCACBandTestRand(&seed) % 8 == 0)
+                pat[u] = toupper(pat[u]);
+        }
+        if (i % 2)
+            MpmAddPatternCI(mpm_ctx, pat, len, 0, 0, i, 0, 0);
+        else
+            MpmAddPatternCS(mpm_ctx, pat, len, 0, 0, i, 0, 0);
+    }
+
+    for (i = 0; i < buflen; i++) {
+        buf[i] = 'a' + SCACBandTestRand(&seed) % alphabet;
+        if (SCACBandTestRand(&seed) % 8 == 0)
+            buf[i] = toupper(buf[i]);
+    }
+}
+
+/** \test results have to be the same as "ac"'s on a larger pattern set */
+static int SCACBandTest05(void)
+{
+    int result = 0;
+    MpmCtx ac_ctx, band_ctx;
+    MpmThreadCtx ac_thread_ctx, band_thread_ctx;
+    PatternMatcherQueue ac_pmq, band_pmq;
+    uint32_t patterns = 3000;
+
+    uint8_t *buf = SCMalloc(SC_AC_BAND_TEST_BUFLEN);
+    if (buf == NULL)
+        return 0;
+
+    memset(&ac_ctx, 0, sizeof(MpmCtx));
+    memset(&band_ctx, 0, sizeof(MpmCtx));
+    MpmInitCtx(&ac_ctx, MPM_AC);
+    MpmInitCtx(&band_ctx, MPM_AC_BAND);
+    mpm_table[MPM_AC].InitThreadCtx(&ac_ctx, &ac_thread_ctx, 0);
+    mpm_table[MPM_AC_BAND].InitThreadCtx(&band_ctx, &band_thread_ctx, 0);
+
+    SCACBandTestSetup(&ac_ctx, 1234, patterns, 6, buf, SC_AC_BAND_TEST_BUFLEN);
+    SCACBandTestSetup(&band_ctx, 1234, patterns, 6, buf, SC_AC_BAND_TEST_BUFLEN);
+    PmqSetup(&ac_pmq, patterns);
+    PmqSetup(&band_pmq, patterns);
+
+    mpm_table[MPM_AC].Prepare(&ac_ctx);
+    mpm_table[MPM_AC_BAND].Prepare(&band_ctx);
+
+    uint32_t ac_cnt = mpm_table[MPM_AC].Search(&ac_ctx, &ac_thread_ctx,
+            &ac_pmq, buf, SC_AC_BAND_TEST_BUFLEN);
+    uint32_t band_cnt = mpm_table[MPM_AC_BAND].Search(&band_ctx, &band_thread_ctx,
+            &band_pmq, buf, SC_AC_BAND_TEST_BUFLEN);
+
+    if (ac_cnt == 0 || ac_cnt != band_cnt) {
+        printf("ac %u matches, ac-band %u: ", ac_cnt, band_cnt);
+        goto end;
+    }
+    if (ac_pmq.pattern_id_array_cnt != band_pmq.pattern_id_array_cnt ||
+        memcmp(ac_pmq.pattern_id_bitarray, band_pmq.pattern_id_bitarray,
+               ac_pmq.pattern_id_bitarray_size) != 0) {
+        printf("pattern id mismatch (%u vs %u): ", ac_pmq.pattern_id_array_cnt,
+               band_pmq.pattern_id_array_cnt);
+        goto end;
+    }
+    if (band_ctx.memory_size >= ac_ctx.memory_size) {
+        printf("ac-band uses %u bytes, ac %u: ", band_ctx.memory_size,
+               ac_ctx.memory_size);
+        goto end;
+    }
+
+    result = 1;
+end:
+    mpm_table[MPM_AC].DestroyCtx(&ac_ctx);
+    mpm_table[MPM_AC_BAND].DestroyCtx(&band_ctx);
+    mpm_table[MPM_AC].DestroyThreadCtx(&ac_ctx, &ac_thread_ctx);
+    mpm_table[MPM_AC_BAND].DestroyThreadCtx(&band_ctx, &band_thread_ctx);
+    PmqFree(&ac_pmq);
+    PmqFree(&band_pmq);
+    SCFree(buf);
+    return result;
+}
+
+#define SC_AC_BAND_BENCH_RUNS 32
+
+/**
+ * \test memory use and search speed of ac, ac-bs and ac-band on the same
+ *       pattern set. Fails only if the match counts differ.
+ */
+static int SCACBandTest06(void)
+{
+    uint16_t types[] = { MPM_AC, MPM_AC_BS, MPM_AC_BAND };
+    uint32_t cnt[3];
+    uint32_t patterns = 2000;
+    int result = 0;
+    int t, r;
+
+    uint8_t *buf = SCMalloc(SC_AC_BAND_TEST_BUFLEN);
+    if (buf == NULL)
+        return 0;
+
+    for (t = 0; t < 3; t++) {
+        MpmCtx mpm_ctx;
+        MpmThreadCtx mpm_thread_ctx;
+        PatternMatcherQueue pmq;
+
+        memset(&mpm_ctx, 0, sizeof(MpmCtx));
+        MpmInitCtx(&mpm_ctx, types[t]);
+        mpm_table[types[t]].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+        SCACBandTestSetup(&mpm_ctx, 4321, patterns, 26, buf, SC_AC_BAND_TEST_BUFLEN);
+        PmqSetup(&pmq, patterns);
+
+        uint64_t ticks = UtilCpuGetTicks();
+        mpm_table[types[t]].Prepare(&mpm_ctx);
+        uint64_t prepare_ticks = UtilCpuGetTicks() - ticks;
+
+        ticks = UtilCpuGetTicks();
+        for (r = 0; r < SC_AC_BAND_BENCH_RUNS; r++) {
+            PmqReset(&pmq);
+            cnt[t] = mpm_table[types[t]].Search(&mpm_ctx, &mpm_thread_ctx,
+                    &pmq, buf, SC_AC_BAND_TEST_BUFLEN);
+        }
+        uint64_t search_ticks = (UtilCpuGetTicks() - ticks) / SC_AC_BAND_BENCH_RUNS;
+
+        SCLogInfo("%s: %u patterns, %u bytes, prepare %"PRIu64" ticks, "
+                  "search %"PRIu64" ticks/64k, %u matches",
+                  mpm_table[types[t]].name, mpm_ctx.pattern_cnt,
+                  mpm_ctx.memory_size, prepare_ticks, search_ticks, cnt[t]);
+
+        mpm_table[types[t]].DestroyCtx(&mpm_ctx);
+        mpm_table[types[t]].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+        PmqFree(&pmq);
+    }
+
+    if (cnt[0] != cnt[1] || cnt[0] != cnt[2]) {
+        printf("match counts differ: %u %u %u: ", cnt[0], cnt[1], cnt[2]);
+        goto end;
+    }
+
+    result = 1;
+end:
+    SCFree(buf);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void SCACBandRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("SCACBandTest01", SCACBandTest01, 1);
+    UtRegisterTest("SCACBandTest02", SCACBandTest02, 1);
+    UtRegisterTest("SCACBandTest03", SCACBandTest03, 1);
+    UtRegisterTest("SCACBandTest04", SCACBandTest04, 1);
+    UtRegisterTest("SCACBandTest05", SCACBandTest05, 1);
+    UtRegisterTest("SCACBandTest06", SCACBandTest06, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,116 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Aho-corasick with a compressed alphabet and banded state rows.
+ */
+
+#ifndef __UTIL_MPM_AC_BAND__H__
+#define __UTIL_MPM_AC_BAND__H__
+
+/* set in a transition if the next state has output */
+#define SC_AC_BAND_OUTPUT_FLAG  0x80000000
+#define SC_AC_BAND_STATE_MASK   0x7FFFFFFF
+
+typedef struct SCACBandPattern_ {
+    /* length of the pattern */
+    uint16_t len;
+    /* flags decribing the pattern */
+    uint8_t flags;
+    /* holds the original pattern that was added */
+    uint8_t *original_pat;
+    /* case INsensitive */
+    uint8_t *ci;
+    /* pattern id */
+    uint32_t id;
+
+    struct SCACBandPattern_ *next;
+} SCACBandPattern;
+
+typedef struct SCACBandPatternList_ {
+    uint8_t *cs;
+    uint16_t patlen;
+} SCACBandPatternList;
+
+typedef struct SCACBandOutputTable_ {
+    /* list of pattern sids */
+    uint32_t *pids;
+    /* no of entries we have in pids */
+    uint32_t no_of_entries;
+} SCACBandOutputTable;
+
+/**
+ * \brief A state's row in the delta table.
+ *
+ * Only the band [lo, lo + cnt) of the row that differs from the row of
+ * the root state is stored, starting at band_table[base]. All other
+ * transitions are the ones of the root state.
+ */
+typedef struct SCACBandState_ {
+    uint32_t base;
+    uint16_t lo;
+    uint16_t cnt;
+} SCACBandState;
+
+typedef struct SCACBandCtx_ {
+    /* hash used during ctx initialization */
+    SCACBandPattern **init_hash;
+
+    /* pattern arrays.  We need this only during the goto table creation phase */
+    SCACBandPattern **parray;
+
+    /* no of states used by ac */
+    uint32_t state_count;
+
+    /* byte to alphabet class map. Bytes not used by any pattern map to
+     * class 0, upper case is folded into lower case. */
+    uint8_t translate_table[256];
+    /* no of classes in the compressed alphabet, incl. class 0 */
+    uint16_t alphabet_size;
+
+    /* per state band descriptors */
+    SCACBandState *states;
+    /* the bands of all states. The root row is stored in full first */
+    uint32_t *band_table;
+    /* entries used in and allocated for band_table */
+    uint32_t band_table_size;
+    uint32_t band_table_alloc;
+
+    /* goto_table and failure table.  Needed to create the bands.  Will be
+     * freed, once we have created them. goto_table has alphabet_size
+     * entries per state. */
+    int32_t *goto_table;
+    uint32_t goto_table_states;
+    int32_t *failure_table;
+    SCACBandOutputTable *output_table;
+    SCACBandPatternList *pid_pat_list;
+
+    uint16_t max_pat_id;
+} SCACBandCtx;
+
+typedef struct SCACBandThreadCtx_ {
+    /* the total calls we make to the search function */
+    uint32_t total_calls;
+    /* the total patterns that we ended up matching against */
+    uint64_t total_matches;
+} SCACBandThreadCtx;
+
+void MpmACBandRegister(void);
+
+#endif /* __UTIL_MPM_AC_BAND__H__ */
@@ -71,6 +71,9 @@ int SCACBSAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
 int SCACBSPreparePatterns(MpmCtx *mpm_ctx);
 uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                     PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+uint32_t SCACBSSearchContinue(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                              MpmSearchState *st, PatternMatcherQueue *pmq,
+                              uint8_t *buf, uint32_t buflen);
 void SCACBSPrintInfo(MpmCtx *mpm_ctx);
 void SCACBSPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
 void SCACBSRegisterTests(void);
@@ -108,10 +111,14 @@ void MpmACBSRegister(void)
     mpm_table[MPM_AC_BS].AddPatternNocase = SCACBSAddPatternCI;
     mpm_table[MPM_AC_BS].Prepare = SCACBSPreparePatterns;
     mpm_table[MPM_AC_BS].Search = SCACBSSearch;
+    mpm_table[MPM_AC_BS].SearchStart = MpmSearchStateStart;
+    mpm_table[MPM_AC_BS].SearchContinue = SCACBSSearchContinue;
+    mpm_table[MPM_AC_BS].SearchEnd = MpmSearchStateEnd;
     mpm_table[MPM_AC_BS].Cleanup = NULL;
     mpm_table[MPM_AC_BS].PrintCtx = SCACBSPrintInfo;
     mpm_table[MPM_AC_BS].PrintThreadCtx = SCACBSPrintSearchStats;
     mpm_table[MPM_AC_BS].RegisterUnittests = SCACBSRegisterTests;
+    mpm_table[MPM_AC_BS].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 
     return;
 }
@@ -955,6 +962,7 @@ static inline void SCACBSCreateModDeltaTable(MpmCtx *mpm_ctx)
         }
         memset(ctx->state_table_mod, 0, size);
 
+        ctx->state_table_mod_size = size;
         mpm_ctx->memory_cnt++;
         mpm_ctx->memory_size += size;
 
@@ -1030,6 +1038,7 @@ static inline void SCACBSCreateModDeltaTable(MpmCtx *mpm_ctx)
         }
         memset(ctx->state_table_mod, 0, size);
 
+        ctx->state_table_mod_size = size;
         mpm_ctx->memory_cnt++;
         mpm_ctx->memory_size += size;
 
@@ -1135,6 +1144,266 @@ static inline void SCACBSPrepareStateTable(MpmCtx *mpm_ctx)
     return;
 }
 
+/** \internal
+ *  \brief header of the mpm cache entry of an ac-bs ctx
+ *
+ *  It's followed by the modified state table, the offset of every state
+ *  in it, the output table entry counts, the pids of all output table
+ *  entries, the cs pattern lengths per pid and the cs patterns.
+ */
+typedef struct SCACBSCacheHeader_ {
+    uint32_t state_count;
+    uint32_t max_pat_id;
+    uint32_t pid_cnt;
+    uint32_t cs_len;
+    uint32_t mod_size;
+} SCACBSCacheHeader;
+
+/** \internal
+ *  \brief Build the mpm cache key of a ctx from its pattern array
+ *
+ *  \retval 1 key built
+ *  \retval 0 ctx is not cached
+ */
+static int SCACBSCacheKey(MpmCtx *mpm_ctx, MpmCacheKey *key)
+{
+    SCACBSCtx *ctx = (SCACBSCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    if (!MpmCacheEnabled())
+        return 0;
+
+    if (MpmCacheKeyInit(key, mpm_ctx->mpm_type) < 0)
+        return 0;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (MpmCacheKeyAddPattern(key, ctx->parray[i]->original_pat,
+                    ctx->parray[i]->len, ctx->parray[i]->flags,
+                    ctx->parray[i]->id) < 0) {
+            MpmCacheKeyFree(key);
+            return 0;
+        }
+    }
+    if (MpmCacheKeyFinish(key) < 0) {
+        MpmCacheKeyFree(key);
+        return 0;
+    }
+    return 1;
+}
+
+/** \internal
+ *  \brief Store the prepared tables of a ctx in the mpm cache
+ */
+static void SCACBSCacheStore(MpmCtx *mpm_ctx, const MpmCacheKey *key)
+{
+    SCACBSCtx *ctx = (SCACBSCtx *)mpm_ctx->ctx;
+    SCACBSCacheHeader hdr;
+    MpmCacheBuffer b;
+    uint32_t state, i;
+    int r = 0;
+
+    memset(&b, 0, sizeof(b));
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.state_count = ctx->state_count;
+    hdr.max_pat_id = ctx->max_pat_id;
+    hdr.mod_size = ctx->state_table_mod_size;
+    for (state = 0; state < ctx->state_count; state++)
+        hdr.pid_cnt += ctx->output_table[state].no_of_entries;
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++)
+        hdr.cs_len += ctx->pid_pat_list[i].patlen;
+
+    uint32_t *offsets = SCMalloc(ctx->state_count * sizeof(uint32_t));
+    uint32_t *counts = SCMalloc(ctx->state_count * sizeof(uint32_t));
+    uint32_t *pids = SCMalloc((hdr.pid_cnt + 1) * sizeof(uint32_t));
+    uint16_t *patlens = SCMalloc((ctx->max_pat_id + 1) * sizeof(uint16_t));
+    uint8_t *cs = SCMalloc(hdr.cs_len + 1);
+    if (offsets == NULL || counts == NULL || pids == NULL ||
+        patlens == NULL || cs == NULL) {
+        r = -1;
+        goto end;
+    }
+
+    uint32_t p = 0;
+    for (state = 0; state < ctx->state_count; state++) {
+        offsets[state] = (uint32_t)(ctx->state_table_mod_pointers[state] -
+                                    ctx->state_table_mod);
+        counts[state] = ctx->output_table[state].no_of_entries;
+        memcpy(pids + p, ctx->output_table[state].pids,
+               counts[state] * sizeof(uint32_t));
+        p += counts[state];
+    }
+    uint32_t c = 0;
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++) {
+        patlens[i] = ctx->pid_pat_list[i].patlen;
+        if (patlens[i] > 0)
+            memcpy(cs + c, ctx->pid_pat_list[i].cs, patlens[i]);
+        c += patlens[i];
+    }
+
+    r |= MpmCacheBufferAdd(&b, &hdr, sizeof(hdr));
+    r |= MpmCacheBufferAdd(&b, ctx->state_table_mod, hdr.mod_size);
+    r |= MpmCacheBufferAdd(&b, offsets, ctx->state_count * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, counts, ctx->state_count * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, pids, hdr.pid_cnt * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, patlens, (ctx->max_pat_id + 1) * sizeof(uint16_t));
+    r |= MpmCacheBufferAdd(&b, cs, hdr.cs_len);
+
+end:
+    if (r == 0)
+        (void)MpmCacheStore(mpm_ctx->mpm_type, key, &b);
+    if (offsets != NULL)
+        SCFree(offsets);
+    if (counts != NULL)
+        SCFree(counts);
+    if (pids != NULL)
+        SCFree(pids);
+    if (patlens != NULL)
+        SCFree(patlens);
+    if (cs != NULL)
+        SCFree(cs);
+    MpmCacheBufferFree(&b);
+}
+
+/** \internal
+ *  \brief Get element i of a modified state table record */
+static inline uint32_t SCACBSCacheModElem(const uint8_t *rec, uint32_t w, uint32_t i)
+{
+    if (w == sizeof(uint16_t))
+        return ((const uint16_t *)rec)[i];
+    return ((const uint32_t *)rec)[i];
+}
+
+/** \internal
+ *  \brief Check that every state has a complete record in the modified
+ *         state table, that only leads to valid states
+ */
+static int SCACBSCacheCheckModTable(const uint8_t *mod, uint32_t mod_size,
+        const uint32_t *offsets, uint32_t state_count)
+{
+    uint32_t w = (state_count < 32767) ? sizeof(uint16_t) : sizeof(uint32_t);
+    uint32_t mask = (state_count < 32767) ? 0x7FFF : 0x00FFFFFF;
+    uint32_t state, i;
+
+    for (state = 0; state < state_count; state++) {
+        uint32_t off = offsets[state];
+        if (off % w != 0 || off >= mod_size)
+            return -1;
+
+        const uint8_t *rec = mod + off;
+        uint32_t avail = (mod_size - off) / w;
+        uint32_t n = SCACBSCacheModElem(rec, w, 0);
+        /* state 0 has all 256 states and no ascii codes */
+        uint32_t first = (state == 0) ? 1 : 1 + n;
+        if (n > 256 || (state == 0 && n != 256) || first + n > avail)
+            return -1;
+
+        for (i = 0; i < n; i++) {
+            if ((SCACBSCacheModElem(rec, w, first + i) & mask) >= state_count)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief Set up a ctx from its mpm cache entry
+ *
+ *  The modified state table, the pids and the cs patterns point into the
+ *  mapped entry. The entry is checked so that a search can't go out of
+ *  bounds.
+ *
+ *  \retval 0 ctx loaded
+ *  \retval -1 no usable entry, ctx untouched
+ */
+static int SCACBSCacheLoad(MpmCtx *mpm_ctx, const MpmCacheKey *key)
+{
+    SCACBSCtx *ctx = (SCACBSCtx *)mpm_ctx->ctx;
+    MpmCacheMap map;
+    MpmCacheReader r;
+    SCACBSOutputTable *output_table = NULL;
+    SCACBSPatternList *pid_pat_list = NULL;
+    uint8_t **mod_pointers = NULL;
+    uint32_t state, i, p, c;
+
+    if (MpmCacheLoad(mpm_ctx->mpm_type, key, &map, &r) == 0)
+        return -1;
+
+    const SCACBSCacheHeader *hdr = MpmCacheRead(&r, sizeof(SCACBSCacheHeader));
+    if (hdr == NULL || hdr->state_count == 0 || hdr->state_count > 0x00FFFFFF ||
+        hdr->max_pat_id != ctx->max_pat_id)
+        goto reject;
+    uint32_t state_count = hdr->state_count;
+    uint32_t npids = (uint32_t)ctx->max_pat_id + 1;
+
+    const uint8_t *mod = MpmCacheRead(&r, hdr->mod_size);
+    const uint32_t *offsets = MpmCacheRead(&r, state_count * sizeof(uint32_t));
+    const uint32_t *counts = MpmCacheRead(&r, state_count * sizeof(uint32_t));
+    const uint32_t *pids = MpmCacheRead(&r, (uint64_t)hdr->pid_cnt * sizeof(uint32_t));
+    const uint16_t *patlens = MpmCacheRead(&r, npids * sizeof(uint16_t));
+    const uint8_t *cs = MpmCacheRead(&r, hdr->cs_len);
+    if (mod == NULL || offsets == NULL || counts == NULL || pids == NULL ||
+        patlens == NULL || cs == NULL)
+        goto reject;
+
+    if (SCACBSCacheCheckModTable(mod, hdr->mod_size, offsets, state_count) < 0)
+        goto reject;
+
+    output_table = SCMalloc(state_count * sizeof(SCACBSOutputTable));
+    pid_pat_list = SCMalloc(npids * sizeof(SCACBSPatternList));
+    mod_pointers = SCMalloc(state_count * sizeof(uint8_t *));
+    if (output_table == NULL || pid_pat_list == NULL || mod_pointers == NULL)
+        goto reject;
+
+    for (i = 0, c = 0; i < npids; i++) {
+        if (patlens[i] > hdr->cs_len - c)
+            goto reject;
+        pid_pat_list[i].patlen = patlens[i];
+        pid_pat_list[i].cs = patlens[i] ? (uint8_t *)cs + c : NULL;
+        c += patlens[i];
+    }
+    if (c != hdr->cs_len)
+        goto reject;
+
+    for (state = 0, p = 0; state < state_count; state++) {
+        if (counts[state] > hdr->pid_cnt - p)
+            goto reject;
+        output_table[state].no_of_entries = counts[state];
+        output_table[state].pids = counts[state] ? (uint32_t *)pids + p : NULL;
+        for (i = 0; i < counts[state]; i++) {
+            uint32_t pid = pids[p + i] & 0x0000FFFF;
+            if (pid >= npids)
+                goto reject;
+            if ((pids[p + i] & 0xFFFF0000) && pid_pat_list[pid].cs == NULL)
+                goto reject;
+        }
+        p += counts[state];
+
+        mod_pointers[state] = (uint8_t *)mod + offsets[state];
+    }
+    if (p != hdr->pid_cnt)
+        goto reject;
+
+    ctx->state_count = state_count;
+    ctx->state_table_mod = (uint8_t *)mod;
+    ctx->state_table_mod_size = hdr->mod_size;
+    ctx->state_table_mod_pointers = mod_pointers;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += hdr->mod_size;
+    ctx->output_table = output_table;
+    ctx->pid_pat_list = pid_pat_list;
+    ctx->cache_map = map;
+    return 0;
+
+reject:
+    if (output_table != NULL)
+        SCFree(output_table);
+    if (pid_pat_list != NULL)
+        SCFree(pid_pat_list);
+    if (mod_pointers != NULL)
+        SCFree(mod_pointers);
+    MpmCacheReject(&map);
+    return -1;
+}
+
 /**
  * \brief Process the patterns added to the mpm, and create the internal tables.
  *
@@ -1177,6 +1446,14 @@ int SCACBSPreparePatterns(MpmCtx *mpm_ctx)
     /* the memory consumed by a single state in our goto table */
     ctx->single_state_size = sizeof(int32_t) * 256;
 
+    /* use the tables of an earlier build of the same pattern set */
+    MpmCacheKey key;
+    int cache = SCACBSCacheKey(mpm_ctx, &key);
+    if (cache && SCACBSCacheLoad(mpm_ctx, &key) == 0) {
+        MpmCacheKeyFree(&key);
+        goto free_patterns;
+    }
+
     /* handle no case patterns */
     ctx->pid_pat_list = SCMalloc((ctx->max_pat_id + 1)* sizeof(SCACBSPatternList));
     if (ctx->pid_pat_list == NULL) {
@@ -1201,6 +1478,12 @@ int SCACBSPreparePatterns(MpmCtx *mpm_ctx)
     /* prepare the state table required by AC */
     SCACBSPrepareStateTable(mpm_ctx);
 
+    if (cache) {
+        SCACBSCacheStore(mpm_ctx, &key);
+        MpmCacheKeyFree(&key);
+    }
+
+free_patterns:
     /* free all the stored patterns.  Should save us a good 100-200 mbs */
     for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
         if (ctx->parray[i] != NULL) {
@@ -1344,9 +1627,12 @@ void SCACBSDestroyCtx(MpmCtx *mpm_ctx)
                                  sizeof(SC_AC_BS_STATE_TYPE_U32) * 256);
     }
 
+    /* tables loaded from the mpm cache point into the mapped entry */
+    int mapped = (ctx->cache_map.addr != NULL);
+
     if (ctx->output_table != NULL) {
         uint32_t state_count;
-        for (state_count = 0; state_count < ctx->state_count; state_count++) {
+        for (state_count = 0; !mapped && state_count < ctx->state_count; state_count++) {
             if (ctx->output_table[state_count].pids != NULL) {
                 SCFree(ctx->output_table[state_count].pids);
             }
@@ -1356,7 +1642,7 @@ void SCACBSDestroyCtx(MpmCtx *mpm_ctx)
 
     if (ctx->pid_pat_list != NULL) {
         int i;
-        for (i = 0; i < (ctx->max_pat_id + 1); i++) {
+        for (i = 0; !mapped && i < (ctx->max_pat_id + 1); i++) {
             if (ctx->pid_pat_list[i].cs != NULL)
                 SCFree(ctx->pid_pat_list[i].cs);
         }
@@ -1364,7 +1650,8 @@ void SCACBSDestroyCtx(MpmCtx *mpm_ctx)
     }
 
     if (ctx->state_table_mod != NULL) {
-        SCFree(ctx->state_table_mod);
+        if (!mapped)
+            SCFree(ctx->state_table_mod);
         ctx->state_table_mod = NULL;
     }
 
@@ -1373,6 +1660,8 @@ void SCACBSDestroyCtx(MpmCtx *mpm_ctx)
         ctx->state_table_mod_pointers = NULL;
     }
 
+    MpmCacheUnmap(&ctx->cache_map);
+
     SCFree(mpm_ctx->ctx);
     mpm_ctx->memory_cnt--;
     mpm_ctx->memory_size -= sizeof(SCACBSCtx);
@@ -1381,32 +1670,30 @@ void SCACBSDestroyCtx(MpmCtx *mpm_ctx)
 }
 
 /**
- * \brief The aho corasick search function.
+ * \brief Search a buffer, or a chunk of data in a resumable search.
  *
- * \param mpm_ctx        Pointer to the mpm context.
- * \param mpm_thread_ctx Pointer to the mpm thread context.
- * \param pmq            Pointer to the Pattern Matcher Queue to hold
- *                       search matches.
- * \param buf            Buffer to be searched.
- * \param buflen         Buffer length.
+ * \param ctx    Pointer to the ac-bs ctx.
+ * \param pmq    Pointer to the Pattern Matcher Queue to hold search matches.
+ * \param st     State of the resumable search or NULL for a single buffer.
+ * \param state  In: state to start in, out: state after the buffer.
+ * \param buf    Buffer to be searched.
+ * \param buflen Buffer length.
  *
  * \retval matches Match count.
  */
-uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
-                    PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+static inline uint32_t SCACBSSearchBuffer(SCACBSCtx *ctx, PatternMatcherQueue *pmq,
+        MpmSearchState *st, uint32_t *state_inout, uint8_t *buf, uint32_t buflen)
 {
-    SCACBSCtx *ctx = (SCACBSCtx *)mpm_ctx->ctx;
-    int i = 0;
-    int matches = 0;
+    uint32_t i = 0;
+    uint32_t matches = 0;
     uint8_t buf_local;
 
     /* \todo tried loop unrolling with register var, with no perf increase.  Need
      * to dig deeper */
-    /* \todo Change it for stateful MPM.  Supply the state using mpm_thread_ctx */
     SCACBSPatternList *pid_pat_list = ctx->pid_pat_list;
 
     if (ctx->state_count < 32767) {
-        register SC_AC_BS_STATE_TYPE_U16 state = 0;
+        register SC_AC_BS_STATE_TYPE_U16 state = (SC_AC_BS_STATE_TYPE_U16)*state_inout;
         uint16_t no_of_entries;
         uint16_t *ascii_codes;
         uint16_t **state_table_mod_pointers = (uint16_t **)ctx->state_table_mod_pointers;
@@ -1458,9 +1745,14 @@ uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 uint32_t k;
                 for (k = 0; k < no_of_entries; k++) {
                     if (pids[k] & 0xFFFF0000) {
-                        if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
-                                     buf + i - pid_pat_list[pids[k] & 0x0000FFFF].patlen + 1,
-                                     pid_pat_list[pids[k] & 0x0000FFFF].patlen) != 0) {
+                        uint16_t patlen = pid_pat_list[pids[k] & 0x0000FFFF].patlen;
+                        if (st != NULL && i + 1 < patlen) {
+                            /* match started in an earlier chunk */
+                            if (MpmSearchStateVerify(st, pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                                     patlen, buf, i + 1) != 0)
+                                continue;
+                        } else if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                     buf + i - patlen + 1, patlen) != 0) {
                             /* inside loop */
                             continue;
                         }
@@ -1485,9 +1777,10 @@ uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 }
             }
         } /* for (i = 0; i < buflen; i++) */
+        *state_inout = state;
 
     } else {
-        register SC_AC_BS_STATE_TYPE_U32 state = 0;
+        register SC_AC_BS_STATE_TYPE_U32 state = *state_inout;
         uint32_t no_of_entries;
         uint32_t *ascii_codes;
         uint32_t **state_table_mod_pointers = (uint32_t **)ctx->state_table_mod_pointers;
@@ -1539,9 +1832,14 @@ uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 uint32_t k;
                 for (k = 0; k < no_of_entries; k++) {
                     if (pids[k] & 0xFFFF0000) {
-                        if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
-                                     buf + i - pid_pat_list[pids[k] & 0x0000FFFF].patlen + 1,
-                                     pid_pat_list[pids[k] & 0x0000FFFF].patlen) != 0) {
+                        uint16_t patlen = pid_pat_list[pids[k] & 0x0000FFFF].patlen;
+                        if (st != NULL && i + 1 < patlen) {
+                            /* match started in an earlier chunk */
+                            if (MpmSearchStateVerify(st, pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                                     patlen, buf, i + 1) != 0)
+                                continue;
+                        } else if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                     buf + i - patlen + 1, patlen) != 0) {
                             /* inside loop */
                             continue;
                         }
@@ -1566,11 +1864,56 @@ uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 }
             }
         } /* for (i = 0; i < buflen; i++) */
+        *state_inout = state;
     }
 
     return matches;
 }
 
+/**
+ * \brief The aho corasick search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACBSSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                    PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    uint32_t state = 0;
+    return SCACBSSearchBuffer((SCACBSCtx *)mpm_ctx->ctx, pmq, NULL, &state,
+                              buf, buflen);
+}
+
+/**
+ * \brief Search the next chunk of data in a resumable search.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param st             Search state, set up by SearchStart.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Chunk to be searched.
+ * \param buflen         Chunk length.
+ *
+ * \retval matches Match count in this chunk.
+ */
+uint32_t SCACBSSearchContinue(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                              MpmSearchState *st, PatternMatcherQueue *pmq,
+                              uint8_t *buf, uint32_t buflen)
+{
+    uint32_t matches = SCACBSSearchBuffer((SCACBSCtx *)mpm_ctx->ctx, pmq, st,
+                                          &st->state, buf, buflen);
+    MpmSearchStateUpdate(st, buf, buflen);
+    st->matches += matches;
+    return matches;
+}
+
 /**
  * \brief Add a case insensitive pattern.  Although we have different calls for
  *        adding case sensitive and insensitive patterns, we make a single call
@@ -2715,6 +3058,136 @@ end:
     return result;
 }
 
+/** \test resumable search: chunks larger than 64k, patterns straddling
+ *        chunks, case sensitive verification across chunks */
+static int SCACBSTest31(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    MpmSearchState st;
+    static uint8_t buf[100000];
+    uint8_t *small = (uint8_t *)"xxabcdxxwxyzxx";
+    uint32_t cnt = 0;
+    uint32_t u;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    memset(&st, 0, sizeof(st));
+    MpmInitCtx(&mpm_ctx, MPM_AC_BS);
+    SCACBSInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    MpmAddPatternCI(&mpm_ctx, (uint8_t *)"efgh", 4, 0, 0, 1, 0, 0);
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"wxyz", 4, 0, 0, 2, 0, 0);
+    PmqSetup(&pmq, 3);
+
+    SCACBSPreparePatterns(&mpm_ctx);
+
+    memset(buf, '.', sizeof(buf));
+    memcpy(buf + 69998, "abcd", 4);
+    memcpy(buf + 80000, "wxYz", 4);
+    memcpy(buf + 99990, "EfGh", 4);
+
+    if (mpm_table[MPM_AC_BS].SearchStart(&mpm_ctx, &mpm_thread_ctx, &st) != 0)
+        goto end;
+    cnt += mpm_table[MPM_AC_BS].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+            buf, 70000);
+    cnt += mpm_table[MPM_AC_BS].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+            buf + 70000, 10002);
+    cnt += mpm_table[MPM_AC_BS].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+            buf + 80002, sizeof(buf) - 80002);
+    if (cnt != 2 || mpm_table[MPM_AC_BS].SearchEnd(&mpm_ctx, &mpm_thread_ctx, &st) != 2 ||
+        st.offset != sizeof(buf)) {
+        printf("2 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+    if (pmq.pattern_id_array_cnt != 2 || (pmq.pattern_id_bitarray[0] & 0x04)) {
+        printf("wrong pmq: ");
+        goto end;
+    }
+
+    /* one byte chunks */
+    PmqReset(&pmq);
+    if (mpm_table[MPM_AC_BS].SearchStart(&mpm_ctx, &mpm_thread_ctx, &st) != 0)
+        goto end;
+    for (u = 0; u < strlen((char *)small); u++) {
+        mpm_table[MPM_AC_BS].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+                small + u, 1);
+    }
+    cnt = mpm_table[MPM_AC_BS].SearchEnd(&mpm_ctx, &mpm_thread_ctx, &st);
+    if (cnt != 2 || pmq.pattern_id_bitarray[0] != 0x05) {
+        printf("2 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MpmSearchStateFree(&st);
+    SCACBSDestroyCtx(&mpm_ctx);
+    SCACBSDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/** \test a ctx loaded from the mpm cache finds the same matches as the
+ *        ctx that was stored */
+static int SCACBSTest32(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/mpm-ac-bs-cache-test.XXXXXX";
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    uint32_t cnt[2] = { 0, 0 }, hits, misses, stores;
+    int loaded[2] = { 0, 0 };
+    int i;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    MpmCacheSetDir(dir);
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+
+    char *buf = "abcdEFGhijklmnopqrstuvwxyzABCD";
+
+    for (i = 0; i < 2; i++) {
+        memset(&mpm_ctx, 0, sizeof(MpmCtx));
+        memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+        MpmInitCtx(&mpm_ctx, MPM_AC_BS);
+        SCACBSInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+        MpmAddPatternCI(&mpm_ctx, (uint8_t *)"efgh", 4, 0, 0, 1, 0, 0);
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"ABCD", 4, 0, 0, 2, 0, 0);
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"xyZ", 3, 0, 0, 3, 0, 0);
+        PmqSetup(&pmq, 4);
+
+        SCACBSPreparePatterns(&mpm_ctx);
+        loaded[i] = (((SCACBSCtx *)mpm_ctx.ctx)->cache_map.addr != NULL);
+
+        cnt[i] = SCACBSSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                            (uint8_t *)buf, strlen(buf));
+
+        SCACBSDestroyCtx(&mpm_ctx);
+        SCACBSDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+        PmqFree(&pmq);
+    }
+
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+    if (cnt[0] == 3 && cnt[1] == 3 && !loaded[0] && loaded[1] &&
+        hits == 1 && misses == 1 && stores == 1)
+        result = 1;
+    else
+        printf("cnt %"PRIu32"/%"PRIu32" loaded %d/%d hits %"PRIu32" misses "
+               "%"PRIu32" stores %"PRIu32" ", cnt[0], cnt[1], loaded[0],
+               loaded[1], hits, misses, stores);
+
+    MpmCacheSetDir(NULL);
+    MpmCacheTestRemoveDir(dir);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SCACBSRegisterTests(void)
@@ -2751,6 +3224,8 @@ void SCACBSRegisterTests(void)
     UtRegisterTest("SCACBSTest28", SCACBSTest28, 1);
     UtRegisterTest("SCACBSTest29", SCACBSTest29, 1);
     UtRegisterTest("SCACBSTest30", SCACBSTest30, 1);
+    UtRegisterTest("SCACBSTest31", SCACBSTest31, 1);
+    UtRegisterTest("SCACBSTest32", SCACBSTest32, 1);
 #endif
 
     return;
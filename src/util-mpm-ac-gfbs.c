@@ -106,6 +106,7 @@ void MpmACGfbsRegister(void)
     mpm_table[MPM_AC_GFBS].PrintCtx = SCACGfbsPrintInfo;
     mpm_table[MPM_AC_GFBS].PrintThreadCtx = SCACGfbsPrintSearchStats;
     mpm_table[MPM_AC_GFBS].RegisterUnittests = SCACGfbsRegisterTests;
+    mpm_table[MPM_AC_GFBS].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 
     return;
 }
@@ -758,6 +759,7 @@ static inline void SCACGfbsCreateModGotoTable(MpmCtx *mpm_ctx)
         memset(ctx->goto_table_mod, 0, size);
         //printf("size- %d\n", size);
 
+        ctx->goto_table_mod_size = size;
         mpm_ctx->memory_cnt++;
         mpm_ctx->memory_size += size;
 
@@ -837,6 +839,7 @@ static inline void SCACGfbsCreateModGotoTable(MpmCtx *mpm_ctx)
         }
         memset(ctx->goto_table_mod, 0, size);
 
+        ctx->goto_table_mod_size = size;
         mpm_ctx->memory_cnt++;
         mpm_ctx->memory_size += size;
 
@@ -1006,6 +1009,271 @@ static inline void SCACGfbsPrepareStateTable(MpmCtx *mpm_ctx)
     return;
 }
 
+/** \internal
+ *  \brief header of the mpm cache entry of an ac-gfbs ctx
+ *
+ *  It's followed by the modified goto table, the offset of every state
+ *  in it, the output table entry counts, the pids of all output table
+ *  entries, the cs pattern lengths per pid and the cs patterns.
+ */
+typedef struct SCACGfbsCacheHeader_ {
+    uint32_t state_count;
+    uint32_t max_pat_id;
+    uint32_t pid_cnt;
+    uint32_t cs_len;
+    uint32_t mod_size;
+} SCACGfbsCacheHeader;
+
+/** \internal
+ *  \brief Build the mpm cache key of a ctx from its pattern array
+ *
+ *  \retval 1 key built
+ *  \retval 0 ctx is not cached
+ */
+static int SCACGfbsCacheKey(MpmCtx *mpm_ctx, MpmCacheKey *key)
+{
+    SCACGfbsCtx *ctx = (SCACGfbsCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    if (!MpmCacheEnabled())
+        return 0;
+
+    if (MpmCacheKeyInit(key, mpm_ctx->mpm_type) < 0)
+        return 0;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (MpmCacheKeyAddPattern(key, ctx->parray[i]->original_pat,
+                    ctx->parray[i]->len, ctx->parray[i]->flags,
+                    ctx->parray[i]->id) < 0) {
+            MpmCacheKeyFree(key);
+            return 0;
+        }
+    }
+    if (MpmCacheKeyFinish(key) < 0) {
+        MpmCacheKeyFree(key);
+        return 0;
+    }
+    return 1;
+}
+
+/** \internal
+ *  \brief Store the prepared tables of a ctx in the mpm cache
+ */
+static void SCACGfbsCacheStore(MpmCtx *mpm_ctx, const MpmCacheKey *key)
+{
+    SCACGfbsCtx *ctx = (SCACGfbsCtx *)mpm_ctx->ctx;
+    SCACGfbsCacheHeader hdr;
+    MpmCacheBuffer b;
+    uint32_t state, i;
+    int r = 0;
+
+    memset(&b, 0, sizeof(b));
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.state_count = ctx->state_count;
+    hdr.max_pat_id = ctx->max_pat_id;
+    hdr.mod_size = ctx->goto_table_mod_size;
+    for (state = 0; state < ctx->state_count; state++)
+        hdr.pid_cnt += ctx->output_table[state].no_of_entries;
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++)
+        hdr.cs_len += ctx->pid_pat_list[i].patlen;
+
+    uint32_t *offsets = SCMalloc(ctx->state_count * sizeof(uint32_t));
+    uint32_t *counts = SCMalloc(ctx->state_count * sizeof(uint32_t));
+    uint32_t *pids = SCMalloc((hdr.pid_cnt + 1) * sizeof(uint32_t));
+    uint16_t *patlens = SCMalloc((ctx->max_pat_id + 1) * sizeof(uint16_t));
+    uint8_t *cs = SCMalloc(hdr.cs_len + 1);
+    if (offsets == NULL || counts == NULL || pids == NULL ||
+        patlens == NULL || cs == NULL) {
+        r = -1;
+        goto end;
+    }
+
+    uint32_t p = 0;
+    for (state = 0; state < ctx->state_count; state++) {
+        offsets[state] = (uint32_t)(ctx->goto_table_mod_pointers[state] -
+                                    ctx->goto_table_mod);
+        counts[state] = ctx->output_table[state].no_of_entries;
+        memcpy(pids + p, ctx->output_table[state].pids,
+               counts[state] * sizeof(uint32_t));
+        p += counts[state];
+    }
+    uint32_t c = 0;
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++) {
+        patlens[i] = ctx->pid_pat_list[i].patlen;
+        if (patlens[i] > 0)
+            memcpy(cs + c, ctx->pid_pat_list[i].cs, patlens[i]);
+        c += patlens[i];
+    }
+
+    r |= MpmCacheBufferAdd(&b, &hdr, sizeof(hdr));
+    r |= MpmCacheBufferAdd(&b, ctx->goto_table_mod, hdr.mod_size);
+    r |= MpmCacheBufferAdd(&b, offsets, ctx->state_count * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, counts, ctx->state_count * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, pids, hdr.pid_cnt * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, patlens, (ctx->max_pat_id + 1) * sizeof(uint16_t));
+    r |= MpmCacheBufferAdd(&b, cs, hdr.cs_len);
+
+end:
+    if (r == 0)
+        (void)MpmCacheStore(mpm_ctx->mpm_type, key, &b);
+    if (offsets != NULL)
+        SCFree(offsets);
+    if (counts != NULL)
+        SCFree(counts);
+    if (pids != NULL)
+        SCFree(pids);
+    if (patlens != NULL)
+        SCFree(patlens);
+    if (cs != NULL)
+        SCFree(cs);
+    MpmCacheBufferFree(&b);
+}
+
+/** \internal
+ *  \brief Get element i of a modified goto table record */
+static inline uint32_t SCACGfbsCacheModElem(const uint8_t *rec, uint32_t w, uint32_t i)
+{
+    if (w == sizeof(uint16_t))
+        return ((const uint16_t *)rec)[i];
+    return ((const uint32_t *)rec)[i];
+}
+
+/** \internal
+ *  \brief Check that every state has a complete record in the modified
+ *         goto table, that only leads to valid states
+ */
+static int SCACGfbsCacheCheckModTable(const uint8_t *mod, uint32_t mod_size,
+        const uint32_t *offsets, uint32_t state_count)
+{
+    uint32_t w = (state_count < 32767) ? sizeof(uint16_t) : sizeof(uint32_t);
+    uint32_t mask = (state_count < 32767) ? 0x7FFF : 0x00FFFFFF;
+    uint32_t state, i;
+
+    for (state = 0; state < state_count; state++) {
+        uint32_t off = offsets[state];
+        if (off % w != 0 || off >= mod_size)
+            return -1;
+
+        const uint8_t *rec = mod + off;
+        uint32_t avail = (mod_size - off) / w;
+        if (avail < 2)
+            return -1;
+        uint32_t n = SCACGfbsCacheModElem(rec, w, 0);
+        uint32_t failure = SCACGfbsCacheModElem(rec, w, 1);
+        /* the ascii codes are bytes, padded to a full element. State 0
+         * has all 256 states and no ascii codes */
+        uint32_t first = (state == 0) ? 2 : 2 + (n + w - 1) / w;
+        if (n > 256 || (state == 0 && n != 256) || first + n > avail ||
+            (failure & mask) >= state_count)
+            return -1;
+
+        for (i = 0; i < n; i++) {
+            if ((SCACGfbsCacheModElem(rec, w, first + i) & mask) >= state_count)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+/** \internal
+ *  \brief Set up a ctx from its mpm cache entry
+ *
+ *  The modified goto table, the pids and the cs patterns point into the
+ *  mapped entry. The entry is checked so that a search can't go out of
+ *  bounds.
+ *
+ *  \retval 0 ctx loaded
+ *  \retval -1 no usable entry, ctx untouched
+ */
+static int SCACGfbsCacheLoad(MpmCtx *mpm_ctx, const MpmCacheKey *key)
+{
+    SCACGfbsCtx *ctx = (SCACGfbsCtx *)mpm_ctx->ctx;
+    MpmCacheMap map;
+    MpmCacheReader r;
+    SCACGfbsOutputTable *output_table = NULL;
+    SCACGfbsPatternList *pid_pat_list = NULL;
+    uint8_t **mod_pointers = NULL;
+    uint32_t state, i, p, c;
+
+    if (MpmCacheLoad(mpm_ctx->mpm_type, key, &map, &r) == 0)
+        return -1;
+
+    const SCACGfbsCacheHeader *hdr = MpmCacheRead(&r, sizeof(SCACGfbsCacheHeader));
+    if (hdr == NULL || hdr->state_count == 0 || hdr->state_count > 0x00FFFFFF ||
+        hdr->max_pat_id != ctx->max_pat_id)
+        goto reject;
+    uint32_t state_count = hdr->state_count;
+    uint32_t npids = (uint32_t)ctx->max_pat_id + 1;
+
+    const uint8_t *mod = MpmCacheRead(&r, hdr->mod_size);
+    const uint32_t *offsets = MpmCacheRead(&r, state_count * sizeof(uint32_t));
+    const uint32_t *counts = MpmCacheRead(&r, state_count * sizeof(uint32_t));
+    const uint32_t *pids = MpmCacheRead(&r, (uint64_t)hdr->pid_cnt * sizeof(uint32_t));
+    const uint16_t *patlens = MpmCacheRead(&r, npids * sizeof(uint16_t));
+    const uint8_t *cs = MpmCacheRead(&r, hdr->cs_len);
+    if (mod == NULL || offsets == NULL || counts == NULL || pids == NULL ||
+        patlens == NULL || cs == NULL)
+        goto reject;
+
+    if (SCACGfbsCacheCheckModTable(mod, hdr->mod_size, offsets, state_count) < 0)
+        goto reject;
+
+    output_table = SCMalloc(state_count * sizeof(SCACGfbsOutputTable));
+    pid_pat_list = SCMalloc(npids * sizeof(SCACGfbsPatternList));
+    mod_pointers = SCMalloc(state_count * sizeof(uint8_t *));
+    if (output_table == NULL || pid_pat_list == NULL || mod_pointers == NULL)
+        goto reject;
+
+    for (i = 0, c = 0; i < npids; i++) {
+        if (patlens[i] > hdr->cs_len - c)
+            goto reject;
+        pid_pat_list[i].patlen = patlens[i];
+        pid_pat_list[i].cs = patlens[i] ? (uint8_t *)cs + c : NULL;
+        c += patlens[i];
+    }
+    if (c != hdr->cs_len)
+        goto reject;
+
+    for (state = 0, p = 0; state < state_count; state++) {
+        if (counts[state] > hdr->pid_cnt - p)
+            goto reject;
+        output_table[state].no_of_entries = counts[state];
+        output_table[state].pids = counts[state] ? (uint32_t *)pids + p : NULL;
+        for (i = 0; i < counts[state]; i++) {
+            uint32_t pid = pids[p + i] & 0x0000FFFF;
+            if (pid >= npids)
+                goto reject;
+            if ((pids[p + i] & 0xFFFF0000) && pid_pat_list[pid].cs == NULL)
+                goto reject;
+        }
+        p += counts[state];
+
+        mod_pointers[state] = (uint8_t *)mod + offsets[state];
+    }
+    if (p != hdr->pid_cnt)
+        goto reject;
+
+    ctx->state_count = state_count;
+    ctx->goto_table_mod = (uint8_t *)mod;
+    ctx->goto_table_mod_size = hdr->mod_size;
+    ctx->goto_table_mod_pointers = mod_pointers;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += hdr->mod_size;
+    ctx->output_table = output_table;
+    ctx->pid_pat_list = pid_pat_list;
+    ctx->cache_map = map;
+    return 0;
+
+reject:
+    if (output_table != NULL)
+        SCFree(output_table);
+    if (pid_pat_list != NULL)
+        SCFree(pid_pat_list);
+    if (mod_pointers != NULL)
+        SCFree(mod_pointers);
+    MpmCacheReject(&map);
+    return -1;
+}
+
 /**
  * \brief Process the patterns added to the mpm, and create the internal tables.
  *
@@ -1048,6 +1316,14 @@ int SCACGfbsPreparePatterns(MpmCtx *mpm_ctx)
     /* the memory consumed by a single state in our goto table */
     //ctx->single_state_size = sizeof(int32_t) * 256;
 
+    /* use the tables of an earlier build of the same pattern set */
+    MpmCacheKey key;
+    int cache = SCACGfbsCacheKey(mpm_ctx, &key);
+    if (cache && SCACGfbsCacheLoad(mpm_ctx, &key) == 0) {
+        MpmCacheKeyFree(&key);
+        goto free_patterns;
+    }
+
     /* handle no case patterns */
     ctx->pid_pat_list = SCMalloc((ctx->max_pat_id + 1)* sizeof(SCACGfbsPatternList));
     if (ctx->pid_pat_list == NULL) {
@@ -1072,6 +1348,12 @@ int SCACGfbsPreparePatterns(MpmCtx *mpm_ctx)
     /* prepare the state table required by AC */
     SCACGfbsPrepareStateTable(mpm_ctx);
 
+    if (cache) {
+        SCACGfbsCacheStore(mpm_ctx, &key);
+        MpmCacheKeyFree(&key);
+    }
+
+free_patterns:
     /* free all the stored patterns.  Should save us a good 100-200 mbs */
     for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
         if (ctx->parray[i] != NULL) {
@@ -1200,8 +1482,12 @@ void SCACGfbsDestroyCtx(MpmCtx *mpm_ctx)
         mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACGfbsPattern *));
     }
 
+    /* tables loaded from the mpm cache point into the mapped entry */
+    int mapped = (ctx->cache_map.addr != NULL);
+
     if (ctx->goto_table_mod != NULL) {
-        SCFree(ctx->goto_table_mod);
+        if (!mapped)
+            SCFree(ctx->goto_table_mod);
         ctx->goto_table_mod = NULL;
 
         mpm_ctx->memory_cnt--;
@@ -1223,7 +1509,7 @@ void SCACGfbsDestroyCtx(MpmCtx *mpm_ctx)
 
     if (ctx->output_table != NULL) {
         int32_t state_count;
-        for (state_count = 0; state_count < ctx->state_count; state_count++) {
+        for (state_count = 0; !mapped && state_count < ctx->state_count; state_count++) {
             if (ctx->output_table[state_count].pids != NULL) {
                 SCFree(ctx->output_table[state_count].pids);
             }
@@ -1233,13 +1519,15 @@ void SCACGfbsDestroyCtx(MpmCtx *mpm_ctx)
 
     if (ctx->pid_pat_list != NULL) {
         int i;
-        for (i = 0; i < (ctx->max_pat_id + 1); i++) {
+        for (i = 0; !mapped && i < (ctx->max_pat_id + 1); i++) {
             if (ctx->pid_pat_list[i].cs != NULL)
                 SCFree(ctx->pid_pat_list[i].cs);
         }
         SCFree(ctx->pid_pat_list);
     }
 
+    MpmCacheUnmap(&ctx->cache_map);
+
     SCFree(mpm_ctx->ctx);
     mpm_ctx->memory_cnt--;
     mpm_ctx->memory_size -= sizeof(SCACGfbsCtx);
@@ -2635,6 +2923,63 @@ end:
     return result;
 }
 
+/** \test a ctx loaded from the mpm cache finds the same matches as the
+ *        ctx that was stored */
+static int SCACGfbsTest30(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/mpm-ac-gfbs-cache-test.XXXXXX";
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    uint32_t cnt[2] = { 0, 0 }, hits, misses, stores;
+    int loaded[2] = { 0, 0 };
+    int i;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    MpmCacheSetDir(dir);
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+
+    char *buf = "abcdEFGhijklmnopqrstuvwxyzABCD";
+
+    for (i = 0; i < 2; i++) {
+        memset(&mpm_ctx, 0, sizeof(MpmCtx));
+        memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+        MpmInitCtx(&mpm_ctx, MPM_AC_GFBS);
+        SCACGfbsInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+        MpmAddPatternCI(&mpm_ctx, (uint8_t *)"efgh", 4, 0, 0, 1, 0, 0);
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"ABCD", 4, 0, 0, 2, 0, 0);
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"xyZ", 3, 0, 0, 3, 0, 0);
+        PmqSetup(&pmq, 4);
+
+        SCACGfbsPreparePatterns(&mpm_ctx);
+        loaded[i] = (((SCACGfbsCtx *)mpm_ctx.ctx)->cache_map.addr != NULL);
+
+        cnt[i] = SCACGfbsSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                            (uint8_t *)buf, strlen(buf));
+
+        SCACGfbsDestroyCtx(&mpm_ctx);
+        SCACGfbsDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+        PmqFree(&pmq);
+    }
+
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+    if (cnt[0] == 3 && cnt[1] == 3 && !loaded[0] && loaded[1] &&
+        hits == 1 && misses == 1 && stores == 1)
+        result = 1;
+    else
+        printf("cnt %"PRIu32"/%"PRIu32" loaded %d/%d hits %"PRIu32" misses "
+               "%"PRIu32" stores %"PRIu32" ", cnt[0], cnt[1], loaded[0],
+               loaded[1], hits, misses, stores);
+
+    MpmCacheSetDir(NULL);
+    MpmCacheTestRemoveDir(dir);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SCACGfbsRegisterTests(void)
@@ -2670,6 +3015,7 @@ void SCACGfbsRegisterTests(void)
     UtRegisterTest("SCACGfbsTest27", SCACGfbsTest27, 1);
     UtRegisterTest("SCACGfbsTest28", SCACGfbsTest28, 1);
     UtRegisterTest("SCACGfbsTest29", SCACGfbsTest29, 1);
+    UtRegisterTest("SCACGfbsTest30", SCACGfbsTest30, 1);
 #endif
 
     return;
@@ -22,6 +22,8 @@
  *
  */
 
+#include "util-mpm-cache.h"
+
 #define SC_AC_GFBS_STATE_TYPE_U16 uint16_t
 #define SC_AC_GFBS_STATE_TYPE_U32 uint32_t
 
@@ -79,6 +81,7 @@ typedef struct SCACGfbsCtx_ {
     /* the modified goto_table */
     uint8_t *goto_table_mod;
     uint8_t **goto_table_mod_pointers;
+    uint32_t goto_table_mod_size;
 
     /* goto_table, failure table and output table.  Needed to create state_table.
      * Will be freed, once we have created the goto_table_mod */
@@ -90,6 +93,10 @@ typedef struct SCACGfbsCtx_ {
     /* the size of each state */
     uint16_t single_state_size;
     uint16_t max_pat_id;
+
+    /* mpm cache entry the modified goto table, pids and cs patterns
+     * point into, if the ctx was loaded from the cache */
+    MpmCacheMap cache_map;
 } SCACGfbsCtx;
 
 typedef struct SCACGfbsThreadCtx_ {
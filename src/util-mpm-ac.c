@@ -80,6 +80,9 @@ int SCACAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
 int SCACPreparePatterns(MpmCtx *mpm_ctx);
 uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                     PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+uint32_t SCACSearchContinue(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                            MpmSearchState *st, PatternMatcherQueue *pmq,
+                            uint8_t *buf, uint32_t buflen);
 void SCACPrintInfo(MpmCtx *mpm_ctx);
 void SCACPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
 void SCACRegisterTests(void);
@@ -938,6 +941,234 @@ static inline void SCACPrepareStateTable(MpmCtx *mpm_ctx)
     return;
 }
 
+/** \internal
+ *  \brief header of the mpm cache entry of an ac ctx
+ *
+ *  It's followed by the state table, the output table entry counts, the
+ *  pids of all output table entries, the cs pattern lengths per pid and
+ *  the cs patterns.
+ */
+typedef struct SCACCacheHeader_ {
+    uint32_t state_count;
+    uint32_t max_pat_id;
+    uint32_t pid_cnt;
+    uint32_t cs_len;
+} SCACCacheHeader;
+
+/** \internal
+ *  \brief Build the mpm cache key of a ctx from its pattern array
+ *
+ *  \retval 1 key built
+ *  \retval 0 ctx is not cached
+ */
+static int SCACCacheKey(MpmCtx *mpm_ctx, MpmCacheKey *key)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    /* the cuda ctxs also need their tables on the device */
+    if (!MpmCacheEnabled() || mpm_ctx->mpm_type != MPM_AC ||
+        construct_both_16_and_32_state_tables)
+        return 0;
+
+    if (MpmCacheKeyInit(key, mpm_ctx->mpm_type) < 0)
+        return 0;
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (MpmCacheKeyAddPattern(key, ctx->parray[i]->original_pat,
+                    ctx->parray[i]->len, ctx->parray[i]->flags,
+                    ctx->parray[i]->id) < 0) {
+            MpmCacheKeyFree(key);
+            return 0;
+        }
+    }
+    if (MpmCacheKeyFinish(key) < 0) {
+        MpmCacheKeyFree(key);
+        return 0;
+    }
+    return 1;
+}
+
+/** \internal
+ *  \brief Store the prepared tables of a ctx in the mpm cache
+ */
+static void SCACCacheStore(MpmCtx *mpm_ctx, const MpmCacheKey *key)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    SCACCacheHeader hdr;
+    MpmCacheBuffer b;
+    uint32_t state, i;
+    int r = 0;
+
+    memset(&b, 0, sizeof(b));
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.state_count = ctx->state_count;
+    hdr.max_pat_id = ctx->max_pat_id;
+    for (state = 0; state < ctx->state_count; state++)
+        hdr.pid_cnt += ctx->output_table[state].no_of_entries;
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++)
+        hdr.cs_len += ctx->pid_pat_list[i].patlen;
+
+    r |= MpmCacheBufferAdd(&b, &hdr, sizeof(hdr));
+    if (ctx->state_count < 32767)
+        r |= MpmCacheBufferAdd(&b, ctx->state_table_u16,
+                ctx->state_count * sizeof(SC_AC_STATE_TYPE_U16) * 256);
+    else
+        r |= MpmCacheBufferAdd(&b, ctx->state_table_u32,
+                ctx->state_count * sizeof(SC_AC_STATE_TYPE_U32) * 256);
+
+    uint32_t *counts = SCMalloc(ctx->state_count * sizeof(uint32_t));
+    uint32_t *pids = SCMalloc((hdr.pid_cnt + 1) * sizeof(uint32_t));
+    uint16_t *patlens = SCMalloc((ctx->max_pat_id + 1) * sizeof(uint16_t));
+    uint8_t *cs = SCMalloc(hdr.cs_len + 1);
+    if (counts == NULL || pids == NULL || patlens == NULL || cs == NULL) {
+        r = -1;
+        goto end;
+    }
+
+    uint32_t p = 0;
+    for (state = 0; state < ctx->state_count; state++) {
+        counts[state] = ctx->output_table[state].no_of_entries;
+        memcpy(pids + p, ctx->output_table[state].pids,
+               counts[state] * sizeof(uint32_t));
+        p += counts[state];
+    }
+    uint32_t c = 0;
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++) {
+        patlens[i] = ctx->pid_pat_list[i].patlen;
+        if (patlens[i] > 0)
+            memcpy(cs + c, ctx->pid_pat_list[i].cs, patlens[i]);
+        c += patlens[i];
+    }
+
+    r |= MpmCacheBufferAdd(&b, counts, ctx->state_count * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, pids, hdr.pid_cnt * sizeof(uint32_t));
+    r |= MpmCacheBufferAdd(&b, patlens, (ctx->max_pat_id + 1) * sizeof(uint16_t));
+    r |= MpmCacheBufferAdd(&b, cs, hdr.cs_len);
+
+end:
+    if (r == 0)
+        (void)MpmCacheStore(mpm_ctx->mpm_type, key, &b);
+    if (counts != NULL)
+        SCFree(counts);
+    if (pids != NULL)
+        SCFree(pids);
+    if (patlens != NULL)
+        SCFree(patlens);
+    if (cs != NULL)
+        SCFree(cs);
+    MpmCacheBufferFree(&b);
+}
+
+/** \internal
+ *  \brief Set up a ctx from its mpm cache entry
+ *
+ *  The state table, the pids and the cs patterns point into the mapped
+ *  entry. The entry is checked so that a search can't go out of bounds.
+ *
+ *  \retval 0 ctx loaded
+ *  \retval -1 no usable entry, ctx untouched
+ */
+static int SCACCacheLoad(MpmCtx *mpm_ctx, const MpmCacheKey *key)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    MpmCacheMap map;
+    MpmCacheReader r;
+    SCACOutputTable *output_table = NULL;
+    SCACPatternList *pid_pat_list = NULL;
+    const void *table;
+    uint32_t state, i, p, c;
+    uint64_t table_size;
+
+    if (MpmCacheLoad(mpm_ctx->mpm_type, key, &map, &r) == 0)
+        return -1;
+
+    const SCACCacheHeader *hdr = MpmCacheRead(&r, sizeof(SCACCacheHeader));
+    if (hdr == NULL || hdr->state_count == 0 || hdr->state_count > 0x00FFFFFF ||
+        hdr->max_pat_id != ctx->max_pat_id)
+        goto reject;
+    uint32_t state_count = hdr->state_count;
+    uint32_t npids = (uint32_t)ctx->max_pat_id + 1;
+
+    if (state_count < 32767) {
+        table_size = (uint64_t)state_count * sizeof(SC_AC_STATE_TYPE_U16) * 256;
+        const SC_AC_STATE_TYPE_U16 *t = table = MpmCacheRead(&r, table_size);
+        if (t == NULL)
+            goto reject;
+        for (i = 0; i < state_count * 256; i++) {
+            if ((t[i] & 0x7FFF) >= state_count)
+                goto reject;
+        }
+    } else {
+        table_size = (uint64_t)state_count * sizeof(SC_AC_STATE_TYPE_U32) * 256;
+        const SC_AC_STATE_TYPE_U32 *t = table = MpmCacheRead(&r, table_size);
+        if (t == NULL)
+            goto reject;
+        for (i = 0; i < state_count * 256; i++) {
+            if ((t[i] & 0x00FFFFFF) >= state_count)
+                goto reject;
+        }
+    }
+
+    const uint32_t *counts = MpmCacheRead(&r, state_count * sizeof(uint32_t));
+    const uint32_t *pids = MpmCacheRead(&r, (uint64_t)hdr->pid_cnt * sizeof(uint32_t));
+    const uint16_t *patlens = MpmCacheRead(&r, npids * sizeof(uint16_t));
+    const uint8_t *cs = MpmCacheRead(&r, hdr->cs_len);
+    if (counts == NULL || pids == NULL || patlens == NULL || cs == NULL)
+        goto reject;
+
+    output_table = SCMalloc(state_count * sizeof(SCACOutputTable));
+    pid_pat_list = SCMalloc(npids * sizeof(SCACPatternList));
+    if (output_table == NULL || pid_pat_list == NULL)
+        goto reject;
+
+    for (i = 0, c = 0; i < npids; i++) {
+        if (patlens[i] > hdr->cs_len - c)
+            goto reject;
+        pid_pat_list[i].patlen = patlens[i];
+        pid_pat_list[i].cs = patlens[i] ? (uint8_t *)cs + c : NULL;
+        c += patlens[i];
+    }
+    if (c != hdr->cs_len)
+        goto reject;
+
+    for (state = 0, p = 0; state < state_count; state++) {
+        if (counts[state] > hdr->pid_cnt - p)
+            goto reject;
+        output_table[state].no_of_entries = counts[state];
+        output_table[state].pids = counts[state] ? (uint32_t *)pids + p : NULL;
+        for (i = 0; i < counts[state]; i++) {
+            uint32_t pid = pids[p + i] & 0x0000FFFF;
+            if (pid >= npids)
+                goto reject;
+            if ((pids[p + i] & 0xFFFF0000) && pid_pat_list[pid].cs == NULL)
+                goto reject;
+        }
+        p += counts[state];
+    }
+    if (p != hdr->pid_cnt)
+        goto reject;
+
+    ctx->state_count = state_count;
+    if (state_count < 32767)
+        ctx->state_table_u16 = (SC_AC_STATE_TYPE_U16 (*)[256])table;
+    else
+        ctx->state_table_u32 = (SC_AC_STATE_TYPE_U32 (*)[256])table;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += table_size;
+    ctx->output_table = output_table;
+    ctx->pid_pat_list = pid_pat_list;
+    ctx->cache_map = map;
+    return 0;
+
+reject:
+    if (output_table != NULL)
+        SCFree(output_table);
+    if (pid_pat_list != NULL)
+        SCFree(pid_pat_list);
+    MpmCacheReject(&map);
+    return -1;
+}
+
 /**
  * \brief Process the patterns added to the mpm, and create the internal tables.
  *
@@ -980,6 +1211,14 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
     /* the memory consumed by a single state in our goto table */
     ctx->single_state_size = sizeof(int32_t) * 256;
 
+    /* use the tables of an earlier build of the same pattern set */
+    MpmCacheKey key;
+    int cache = SCACCacheKey(mpm_ctx, &key);
+    if (cache && SCACCacheLoad(mpm_ctx, &key) == 0) {
+        MpmCacheKeyFree(&key);
+        goto free_patterns;
+    }
+
     /* handle no case patterns */
     ctx->pid_pat_list = SCMalloc((ctx->max_pat_id + 1)* sizeof(SCACPatternList));
     if (ctx->pid_pat_list == NULL) {
@@ -1004,6 +1243,11 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
     /* prepare the state table required by AC */
     SCACPrepareStateTable(mpm_ctx);
 
+    if (cache) {
+        SCACCacheStore(mpm_ctx, &key);
+        MpmCacheKeyFree(&key);
+    }
+
 #ifdef __SC_CUDA_SUPPORT__
     if (mpm_ctx->mpm_type == MPM_AC_CUDA) {
         int r = SCCudaMemAlloc(&ctx->state_table_u32_cuda,
@@ -1023,6 +1267,7 @@ int SCACPreparePatterns(MpmCtx *mpm_ctx)
     }
 #endif
 
+free_patterns:
     /* free all the stored patterns.  Should save us a good 100-200 mbs */
     for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
         if (ctx->parray[i] != NULL) {
@@ -1148,8 +1393,12 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
         mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACPattern *));
     }
 
+    /* tables loaded from the mpm cache point into the mapped entry */
+    int mapped = (ctx->cache_map.addr != NULL);
+
     if (ctx->state_table_u16 != NULL) {
-        SCFree(ctx->state_table_u16);
+        if (!mapped)
+            SCFree(ctx->state_table_u16);
         ctx->state_table_u16 = NULL;
 
         mpm_ctx->memory_cnt++;
@@ -1157,7 +1406,8 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
                                  sizeof(SC_AC_STATE_TYPE_U16) * 256);
     }
     if (ctx->state_table_u32 != NULL) {
-        SCFree(ctx->state_table_u32);
+        if (!mapped)
+            SCFree(ctx->state_table_u32);
         ctx->state_table_u32 = NULL;
 
         mpm_ctx->memory_cnt++;
@@ -1167,7 +1417,7 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
 
     if (ctx->output_table != NULL) {
         uint32_t state_count;
-        for (state_count = 0; state_count < ctx->state_count; state_count++) {
+        for (state_count = 0; !mapped && state_count < ctx->state_count; state_count++) {
             if (ctx->output_table[state_count].pids != NULL) {
                 SCFree(ctx->output_table[state_count].pids);
             }
@@ -1177,13 +1427,15 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
 
     if (ctx->pid_pat_list != NULL) {
         int i;
-        for (i = 0; i < (ctx->max_pat_id + 1); i++) {
+        for (i = 0; !mapped && i < (ctx->max_pat_id + 1); i++) {
             if (ctx->pid_pat_list[i].cs != NULL)
                 SCFree(ctx->pid_pat_list[i].cs);
         }
         SCFree(ctx->pid_pat_list);
     }
 
+    MpmCacheUnmap(&ctx->cache_map);
+
     SCFree(mpm_ctx->ctx);
     mpm_ctx->memory_cnt--;
     mpm_ctx->memory_size -= sizeof(SCACCtx);
@@ -1192,31 +1444,29 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
 }
 
 /**
- * \brief The aho corasick search function.
+ * \brief Search a buffer, or a chunk of data in a resumable search.
  *
- * \param mpm_ctx        Pointer to the mpm context.
- * \param mpm_thread_ctx Pointer to the mpm thread context.
- * \param pmq            Pointer to the Pattern Matcher Queue to hold
- *                       search matches.
- * \param buf            Buffer to be searched.
- * \param buflen         Buffer length.
+ * \param ctx    Pointer to the ac ctx.
+ * \param pmq    Pointer to the Pattern Matcher Queue to hold search matches.
+ * \param st     State of the resumable search or NULL for a single buffer.
+ * \param state  In: state to start in, out: state after the buffer.
+ * \param buf    Buffer to be searched.
+ * \param buflen Buffer length.
  *
  * \retval matches Match count.
  */
-uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
-                    PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+static inline uint32_t SCACSearchBuffer(SCACCtx *ctx, PatternMatcherQueue *pmq,
+        MpmSearchState *st, uint32_t *state_inout, uint8_t *buf, uint32_t buflen)
 {
-    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
-    int i = 0;
-    int matches = 0;
+    uint32_t i = 0;
+    uint32_t matches = 0;
 
     /* \todo tried loop unrolling with register var, with no perf increase.  Need
      * to dig deeper */
-    /* \todo Change it for stateful MPM.  Supply the state using mpm_thread_ctx */
     SCACPatternList *pid_pat_list = ctx->pid_pat_list;
 
     if (ctx->state_count < 32767) {
-        register SC_AC_STATE_TYPE_U16 state = 0;
+        register SC_AC_STATE_TYPE_U16 state = (SC_AC_STATE_TYPE_U16)*state_inout;
         SC_AC_STATE_TYPE_U16 (*state_table_u16)[256] = ctx->state_table_u16;
         for (i = 0; i < buflen; i++) {
             state = state_table_u16[state & 0x7FFF][u8_tolower(buf[i])];
@@ -1226,9 +1476,14 @@ uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 uint32_t k;
                 for (k = 0; k < no_of_entries; k++) {
                     if (pids[k] & 0xFFFF0000) {
-                        if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
-                                     buf + i - pid_pat_list[pids[k] & 0x0000FFFF].patlen + 1,
-                                     pid_pat_list[pids[k] & 0x0000FFFF].patlen) != 0) {
+                        uint16_t patlen = pid_pat_list[pids[k] & 0x0000FFFF].patlen;
+                        if (st != NULL && i + 1 < patlen) {
+                            /* match started in an earlier chunk */
+                            if (MpmSearchStateVerify(st, pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                                     patlen, buf, i + 1) != 0)
+                                continue;
+                        } else if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                     buf + i - patlen + 1, patlen) != 0) {
                             /* inside loop */
                             continue;
                         }
@@ -1253,9 +1508,10 @@ uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 }
             }
         } /* for (i = 0; i < buflen; i++) */
+        *state_inout = state;
 
     } else {
-        register SC_AC_STATE_TYPE_U32 state = 0;
+        register SC_AC_STATE_TYPE_U32 state = *state_inout;
         SC_AC_STATE_TYPE_U32 (*state_table_u32)[256] = ctx->state_table_u32;
         for (i = 0; i < buflen; i++) {
             state = state_table_u32[state & 0x00FFFFFF][u8_tolower(buf[i])];
@@ -1265,9 +1521,14 @@ uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 uint32_t k;
                 for (k = 0; k < no_of_entries; k++) {
                     if (pids[k] & 0xFFFF0000) {
-                        if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
-                                     buf + i - pid_pat_list[pids[k] & 0x0000FFFF].patlen + 1,
-                                     pid_pat_list[pids[k] & 0x0000FFFF].patlen) != 0) {
+                        uint16_t patlen = pid_pat_list[pids[k] & 0x0000FFFF].patlen;
+                        if (st != NULL && i + 1 < patlen) {
+                            /* match started in an earlier chunk */
+                            if (MpmSearchStateVerify(st, pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                                     patlen, buf, i + 1) != 0)
+                                continue;
+                        } else if (SCMemcmp(pid_pat_list[pids[k] & 0x0000FFFF].cs,
+                                     buf + i - patlen + 1, patlen) != 0) {
                             /* inside loop */
                             continue;
                         }
@@ -1292,11 +1553,56 @@ uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
                 }
             }
         } /* for (i = 0; i < buflen; i++) */
+        *state_inout = state;
     }
 
     return matches;
 }
 
+/**
+ * \brief The aho corasick search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                    PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    uint32_t state = 0;
+    return SCACSearchBuffer((SCACCtx *)mpm_ctx->ctx, pmq, NULL, &state,
+                            buf, buflen);
+}
+
+/**
+ * \brief Search the next chunk of data in a resumable search.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param st             Search state, set up by SearchStart.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Chunk to be searched.
+ * \param buflen         Chunk length.
+ *
+ * \retval matches Match count in this chunk.
+ */
+uint32_t SCACSearchContinue(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                            MpmSearchState *st, PatternMatcherQueue *pmq,
+                            uint8_t *buf, uint32_t buflen)
+{
+    uint32_t matches = SCACSearchBuffer((SCACCtx *)mpm_ctx->ctx, pmq, st,
+                                        &st->state, buf, buflen);
+    MpmSearchStateUpdate(st, buf, buflen);
+    st->matches += matches;
+    return matches;
+}
+
 /**
  * \brief Add a case insensitive pattern.  Although we have different calls for
  *        adding case sensitive and insensitive patterns, we make a single call
@@ -2106,10 +2412,14 @@ void MpmACRegister(void)
     mpm_table[MPM_AC].AddPatternNocase = SCACAddPatternCI;
     mpm_table[MPM_AC].Prepare = SCACPreparePatterns;
     mpm_table[MPM_AC].Search = SCACSearch;
+    mpm_table[MPM_AC].SearchStart = MpmSearchStateStart;
+    mpm_table[MPM_AC].SearchContinue = SCACSearchContinue;
+    mpm_table[MPM_AC].SearchEnd = MpmSearchStateEnd;
     mpm_table[MPM_AC].Cleanup = NULL;
     mpm_table[MPM_AC].PrintCtx = SCACPrintInfo;
     mpm_table[MPM_AC].PrintThreadCtx = SCACPrintSearchStats;
     mpm_table[MPM_AC].RegisterUnittests = SCACRegisterTests;
+    mpm_table[MPM_AC].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 
     return;
 }
@@ -2133,6 +2443,9 @@ void MpmACCudaRegister(void)
     mpm_table[MPM_AC_CUDA].AddPatternNocase = SCACAddPatternCI;
     mpm_table[MPM_AC_CUDA].Prepare = SCACPreparePatterns;
     mpm_table[MPM_AC_CUDA].Search = SCACSearch;
+    mpm_table[MPM_AC_CUDA].SearchStart = MpmSearchStateStart;
+    mpm_table[MPM_AC_CUDA].SearchContinue = SCACSearchContinue;
+    mpm_table[MPM_AC_CUDA].SearchEnd = MpmSearchStateEnd;
     mpm_table[MPM_AC_CUDA].Cleanup = NULL;
     mpm_table[MPM_AC_CUDA].PrintCtx = SCACPrintInfo;
     mpm_table[MPM_AC_CUDA].PrintThreadCtx = SCACPrintSearchStats;
@@ -3169,6 +3482,136 @@ end:
     return result;
 }
 
+/** \test resumable search: chunks larger than 64k, patterns straddling
+ *        chunks, case sensitive verification across chunks */
+static int SCACTest30(void)
+{
+    int result = 0;
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    MpmSearchState st;
+    static uint8_t buf[100000];
+    uint8_t *small = (uint8_t *)"xxabcdxxwxyzxx";
+    uint32_t cnt = 0;
+    uint32_t u;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    memset(&st, 0, sizeof(st));
+    MpmInitCtx(&mpm_ctx, MPM_AC);
+    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    MpmAddPatternCI(&mpm_ctx, (uint8_t *)"efgh", 4, 0, 0, 1, 0, 0);
+    MpmAddPatternCS(&mpm_ctx, (uint8_t *)"wxyz", 4, 0, 0, 2, 0, 0);
+    PmqSetup(&pmq, 3);
+
+    SCACPreparePatterns(&mpm_ctx);
+
+    memset(buf, '.', sizeof(buf));
+    memcpy(buf + 69998, "abcd", 4);
+    memcpy(buf + 80000, "wxYz", 4);
+    memcpy(buf + 99990, "EfGh", 4);
+
+    if (mpm_table[MPM_AC].SearchStart(&mpm_ctx, &mpm_thread_ctx, &st) != 0)
+        goto end;
+    cnt += mpm_table[MPM_AC].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+            buf, 70000);
+    cnt += mpm_table[MPM_AC].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+            buf + 70000, 10002);
+    cnt += mpm_table[MPM_AC].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+            buf + 80002, sizeof(buf) - 80002);
+    if (cnt != 2 || mpm_table[MPM_AC].SearchEnd(&mpm_ctx, &mpm_thread_ctx, &st) != 2 ||
+        st.offset != sizeof(buf)) {
+        printf("2 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+    if (pmq.pattern_id_array_cnt != 2 || (pmq.pattern_id_bitarray[0] & 0x04)) {
+        printf("wrong pmq: ");
+        goto end;
+    }
+
+    /* one byte chunks */
+    PmqReset(&pmq);
+    if (mpm_table[MPM_AC].SearchStart(&mpm_ctx, &mpm_thread_ctx, &st) != 0)
+        goto end;
+    for (u = 0; u < strlen((char *)small); u++) {
+        mpm_table[MPM_AC].SearchContinue(&mpm_ctx, &mpm_thread_ctx, &st, &pmq,
+                small + u, 1);
+    }
+    cnt = mpm_table[MPM_AC].SearchEnd(&mpm_ctx, &mpm_thread_ctx, &st);
+    if (cnt != 2 || pmq.pattern_id_bitarray[0] != 0x05) {
+        printf("2 != %" PRIu32 " ", cnt);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MpmSearchStateFree(&st);
+    SCACDestroyCtx(&mpm_ctx);
+    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+/** \test a ctx loaded from the mpm cache finds the same matches as the
+ *        ctx that was stored */
+static int SCACTest31(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/mpm-ac-cache-test.XXXXXX";
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    uint32_t cnt[2] = { 0, 0 }, hits, misses, stores;
+    int loaded[2] = { 0, 0 };
+    int i;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    MpmCacheSetDir(dir);
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+
+    char *buf = "abcdEFGhijklmnopqrstuvwxyzABCD";
+
+    for (i = 0; i < 2; i++) {
+        memset(&mpm_ctx, 0, sizeof(MpmCtx));
+        memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+        MpmInitCtx(&mpm_ctx, MPM_AC);
+        SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+        MpmAddPatternCI(&mpm_ctx, (uint8_t *)"efgh", 4, 0, 0, 1, 0, 0);
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"ABCD", 4, 0, 0, 2, 0, 0);
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)"xyZ", 3, 0, 0, 3, 0, 0);
+        PmqSetup(&pmq, 4);
+
+        SCACPreparePatterns(&mpm_ctx);
+        loaded[i] = (((SCACCtx *)mpm_ctx.ctx)->cache_map.addr != NULL);
+
+        cnt[i] = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                            (uint8_t *)buf, strlen(buf));
+
+        SCACDestroyCtx(&mpm_ctx);
+        SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+        PmqFree(&pmq);
+    }
+
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+    if (cnt[0] == 3 && cnt[1] == 3 && !loaded[0] && loaded[1] &&
+        hits == 1 && misses == 1 && stores == 1)
+        result = 1;
+    else
+        printf("cnt %"PRIu32"/%"PRIu32" loaded %d/%d hits %"PRIu32" misses "
+               "%"PRIu32" stores %"PRIu32" ", cnt[0], cnt[1], loaded[0],
+               loaded[1], hits, misses, stores);
+
+    MpmCacheSetDir(NULL);
+    MpmCacheTestRemoveDir(dir);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SCACRegisterTests(void)
@@ -3204,6 +3647,8 @@ void SCACRegisterTests(void)
     UtRegisterTest("SCACTest27", SCACTest27, 1);
     UtRegisterTest("SCACTest28", SCACTest28, 1);
     UtRegisterTest("SCACTest29", SCACTest29, 1);
+    UtRegisterTest("SCACTest30", SCACTest30, 1);
+    UtRegisterTest("SCACTest31", SCACTest31, 1);
 #endif
 
     return;
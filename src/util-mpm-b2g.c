@@ -95,6 +95,7 @@ void MpmB2gRegister (void) {
     mpm_table[MPM_B2G].PrintCtx = B2gPrintInfo;
     mpm_table[MPM_B2G].PrintThreadCtx = B2gPrintSearchStats;
     mpm_table[MPM_B2G].RegisterUnittests = B2gRegisterTests;
+    mpm_table[MPM_B2G].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 }
 
 #ifdef PRINTMATCH
@@ -92,6 +92,7 @@ void MpmB2gmRegister (void) {
     mpm_table[MPM_B2GM].PrintCtx = B2gmPrintInfo;
     mpm_table[MPM_B2GM].PrintThreadCtx = B2gmPrintSearchStats;
     mpm_table[MPM_B2GM].RegisterUnittests = B2gmRegisterTests;
+    mpm_table[MPM_B2GM].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 }
 
 #ifdef PRINTMATCH
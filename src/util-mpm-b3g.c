@@ -1213,6 +1213,7 @@ void MpmB3gRegister (void) {
     mpm_table[MPM_B3G].PrintCtx = B3gPrintInfo;
     mpm_table[MPM_B3G].PrintThreadCtx = B3gPrintSearchStats;
     mpm_table[MPM_B3G].RegisterUnittests = B3gRegisterTests;
+    mpm_table[MPM_B3G].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 }
 
 /*
@@ -0,0 +1,765 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * On disk cache of prepared mpm ctxs.
+ *
+ * A matcher that supports the cache builds a key from the patterns of a
+ * ctx before preparing it. The key is the mpm type followed by the
+ * patterns sorted on id, each with its flags. If the cache directory has
+ * an entry for the key, the matcher maps it and points its tables into
+ * the mapping instead of building them. Otherwise it builds the tables as
+ * usual and stores them under the key.
+ *
+ * An entry is a file named after the matcher and the 64 bit hash of the
+ * key. It holds a header, the full key, so that hash collisions are
+ * caught, and the body the matcher wrote. Entries are written to a temp
+ * file that is renamed into place, so concurrent builds never see a half
+ * written entry. The cache directory is as trusted as the rule files:
+ * matchers check the body for consistency but an entry can't be verified
+ * to be the automaton of its key.
+ *
+ * Loading an entry updates its mtime. Entries that weren't used for
+ * detect-engine.mpm-cache-max-age days are removed when the rules are
+ * loaded.
+ */
+
+#include "suricata-common.h"
+#include "util-mpm.h"
+#include "util-mpm-cache.h"
+
+#include "util-debug.h"
+#include "util-hash-lookup3.h"
+#include "util-unittest.h"
+
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <dirent.h>
+
+#define MPM_CACHE_MAGIC     "SCMPMC\0\0"
+/** written in host order, to catch entries from another architecture */
+#define MPM_CACHE_ENDIAN    0x01020304
+
+typedef struct MpmCacheHeader_ {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t ptr_size;
+    uint32_t key_len;
+    uint64_t hash;
+    uint64_t body_len;
+} MpmCacheHeader;
+
+#define MPM_CACHE_ALIGN(len) (((len) + 7) & ~((uint64_t)7))
+
+static char *mpm_cache_dir = NULL;
+
+static SCMutex mpm_cache_stats_lock = SCMUTEX_INITIALIZER;
+static uint32_t mpm_cache_hits = 0;
+static uint32_t mpm_cache_misses = 0;
+static uint32_t mpm_cache_stores = 0;
+
+/** \brief Set the cache directory, NULL disables the cache
+ *
+ *  The directory is created if it doesn't exist yet.
+ */
+void MpmCacheSetDir(const char *dir)
+{
+    /* rule reloads set it again */
+    if (dir != NULL && mpm_cache_dir != NULL && strcmp(dir, mpm_cache_dir) == 0)
+        return;
+
+    if (mpm_cache_dir != NULL) {
+        SCFree(mpm_cache_dir);
+        mpm_cache_dir = NULL;
+    }
+    if (dir == NULL)
+        return;
+
+    if (mkdir(dir, 0750) != 0 && errno != EEXIST) {
+        SCLogWarning(SC_ERR_OPENING_FILE, "can't create mpm cache directory "
+                "\"%s\": %s, cache disabled", dir, strerror(errno));
+        return;
+    }
+
+    mpm_cache_dir = SCStrdup(dir);
+    if (mpm_cache_dir == NULL)
+        return;
+    SCLogInfo("using mpm cache directory \"%s\"", mpm_cache_dir);
+}
+
+int MpmCacheEnabled(void)
+{
+    return (mpm_cache_dir != NULL);
+}
+
+/** \brief Remove the entries that weren't used for max_age seconds
+ *
+ *  Loading an entry updates its modification time, so the entries of the
+ *  rule sets in use stay. Left over temp files of interrupted stores are
+ *  removed as well.
+ *
+ *  \param max_age age in seconds, 0 to keep all entries
+ *
+ *  \retval cnt number of files removed
+ */
+uint32_t MpmCachePrune(uint64_t max_age)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    uint32_t cnt = 0;
+
+    if (mpm_cache_dir == NULL || max_age == 0)
+        return 0;
+
+    DIR *d = opendir(mpm_cache_dir);
+    if (d == NULL)
+        return 0;
+
+    time_t now = time(NULL);
+    while ((de = readdir(d)) != NULL) {
+        /* only touch our own files */
+        if (strstr(de->d_name, ".mpmc") == NULL)
+            continue;
+        if (snprintf(path, sizeof(path), "%s/%s", mpm_cache_dir,
+                     de->d_name) >= (int)sizeof(path))
+            continue;
+        if (lstat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (st.st_mtime > now || (uint64_t)(now - st.st_mtime) <= max_age)
+            continue;
+
+        if (unlink(path) == 0) {
+            SCLogDebug("removed unused mpm cache entry %s", path);
+            cnt++;
+        }
+    }
+    closedir(d);
+
+    if (cnt > 0)
+        SCLogInfo("removed %"PRIu32" unused mpm cache entries", cnt);
+    return cnt;
+}
+
+static int MpmCacheKeyAppend(MpmCacheKey *key, const void *data, uint32_t len)
+{
+    if (key->len + len > key->size) {
+        uint32_t size = key->size * 2;
+        while (size < key->len + len)
+            size *= 2;
+        uint8_t *ptmp = SCRealloc(key->buf, size);
+        if (ptmp == NULL)
+            return -1;
+        key->buf = ptmp;
+        key->size = size;
+    }
+    memcpy(key->buf + key->len, data, len);
+    key->len += len;
+    return 0;
+}
+
+/** \brief Start a key for a ctx of mpm_type
+ *
+ *  \retval 0 ok
+ *  \retval -1 error, nothing to free
+ */
+int MpmCacheKeyInit(MpmCacheKey *key, uint16_t mpm_type)
+{
+    memset(key, 0, sizeof(*key));
+
+    key->size = 4096;
+    key->buf = SCMalloc(key->size);
+    if (key->buf == NULL)
+        return -1;
+
+    uint32_t type = mpm_type;
+    if (MpmCacheKeyAppend(key, &type, sizeof(type)) < 0) {
+        MpmCacheKeyFree(key);
+        return -1;
+    }
+    return 0;
+}
+
+/** \brief Add a pattern to the key, in any order */
+int MpmCacheKeyAddPattern(MpmCacheKey *key, const uint8_t *pat, uint16_t len,
+        uint8_t flags, uint32_t id)
+{
+    if (key->rec_cnt == key->rec_size) {
+        uint32_t size = key->rec_size ? key->rec_size * 2 : 64;
+        MpmCacheKeyRec *ptmp = SCRealloc(key->recs, size * sizeof(MpmCacheKeyRec));
+        if (ptmp == NULL)
+            return -1;
+        key->recs = ptmp;
+        key->rec_size = size;
+    }
+    key->recs[key->rec_cnt].id = id;
+    key->recs[key->rec_cnt].off = key->len;
+    key->rec_cnt++;
+
+    if (MpmCacheKeyAppend(key, &id, sizeof(id)) < 0 ||
+        MpmCacheKeyAppend(key, &len, sizeof(len)) < 0 ||
+        MpmCacheKeyAppend(key, &flags, sizeof(flags)) < 0 ||
+        MpmCacheKeyAppend(key, pat, len) < 0)
+        return -1;
+    return 0;
+}
+
+static int MpmCacheKeyRecCmp(const void *a, const void *b)
+{
+    const MpmCacheKeyRec *ra = (const MpmCacheKeyRec *)a;
+    const MpmCacheKeyRec *rb = (const MpmCacheKeyRec *)b;
+
+    if (ra->id < rb->id)
+        return -1;
+    if (ra->id > rb->id)
+        return 1;
+    return 0;
+}
+
+/** \brief Put the patterns in id order and hash the key */
+int MpmCacheKeyFinish(MpmCacheKey *key)
+{
+    uint32_t hdr_len = sizeof(uint32_t);
+    uint32_t i;
+
+    qsort(key->recs, key->rec_cnt, sizeof(MpmCacheKeyRec), MpmCacheKeyRecCmp);
+
+    uint8_t *buf = SCMalloc(key->size);
+    if (buf == NULL)
+        return -1;
+    memcpy(buf, key->buf, hdr_len);
+
+    uint32_t len = hdr_len;
+    for (i = 0; i < key->rec_cnt; i++) {
+        const uint8_t *rec = key->buf + key->recs[i].off;
+        uint16_t patlen;
+        memcpy(&patlen, rec + sizeof(uint32_t), sizeof(patlen));
+
+        uint32_t rec_len = sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t) + patlen;
+        memcpy(buf + len, rec, rec_len);
+        len += rec_len;
+    }
+    BUG_ON(len != key->len);
+
+    SCFree(key->buf);
+    key->buf = buf;
+    SCFree(key->recs);
+    key->recs = NULL;
+    key->rec_cnt = key->rec_size = 0;
+
+    uint32_t h1 = 0, h2 = 0;
+    hashlittle2(key->buf, key->len, &h1, &h2);
+    key->hash = ((uint64_t)h1 << 32) | h2;
+    return 0;
+}
+
+void MpmCacheKeyFree(MpmCacheKey *key)
+{
+    if (key->buf != NULL)
+        SCFree(key->buf);
+    if (key->recs != NULL)
+        SCFree(key->recs);
+    memset(key, 0, sizeof(*key));
+}
+
+/** \brief Append data to a buffer, 8 byte aligned
+ *
+ *  Every piece of data starts at an 8 byte aligned offset of the body, so
+ *  the matcher can point into the mapping directly.
+ */
+int MpmCacheBufferAdd(MpmCacheBuffer *b, const void *data, uint64_t len)
+{
+    uint64_t need = b->len + MPM_CACHE_ALIGN(len);
+
+    if (need > b->size) {
+        uint64_t size = b->size ? b->size : 4096;
+        while (size < need)
+            size *= 2;
+        uint8_t *ptmp = SCRealloc(b->data, size);
+        if (ptmp == NULL)
+            return -1;
+        b->data = ptmp;
+        b->size = size;
+    }
+    if (len > 0)
+        memcpy(b->data + b->len, data, len);
+    memset(b->data + b->len + len, 0, MPM_CACHE_ALIGN(len) - len);
+    b->len = need;
+    return 0;
+}
+
+void MpmCacheBufferFree(MpmCacheBuffer *b)
+{
+    if (b->data != NULL)
+        SCFree(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+static int MpmCacheGetPath(uint16_t mpm_type, const MpmCacheKey *key,
+        char *path, size_t path_size)
+{
+    int r = snprintf(path, path_size, "%s/%s-%016"PRIx64".mpmc", mpm_cache_dir,
+            mpm_table[mpm_type].name, key->hash);
+    if (r < 0 || (size_t)r >= path_size)
+        return -1;
+    return 0;
+}
+
+static int MpmCacheWriteAll(int fd, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    while (len > 0) {
+        ssize_t r = write(fd, p, len);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+/** \brief Store the body of a prepared ctx under key
+ *
+ *  Failing to store is not an error for the caller, the ctx is prepared
+ *  anyway.
+ *
+ *  \retval 0 stored
+ *  \retval -1 not stored
+ */
+int MpmCacheStore(uint16_t mpm_type, const MpmCacheKey *key,
+        const MpmCacheBuffer *body)
+{
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX];
+    static const uint8_t pad[8] = { 0 };
+    MpmCacheHeader hdr;
+
+    if (mpm_cache_dir == NULL)
+        return -1;
+    if (MpmCacheGetPath(mpm_type, key, path, sizeof(path)) < 0)
+        return -1;
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path) >= (int)sizeof(tmp_path))
+        return -1;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MPM_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = MPM_CACHE_VERSION;
+    hdr.endian = MPM_CACHE_ENDIAN;
+    hdr.ptr_size = sizeof(void *);
+    hdr.key_len = key->len;
+    hdr.hash = key->hash;
+    hdr.body_len = body->len;
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        SCLogDebug("creating %s failed: %s", tmp_path, strerror(errno));
+        return -1;
+    }
+    if (MpmCacheWriteAll(fd, &hdr, sizeof(hdr)) < 0 ||
+        MpmCacheWriteAll(fd, key->buf, key->len) < 0 ||
+        MpmCacheWriteAll(fd, pad, MPM_CACHE_ALIGN(key->len) - key->len) < 0 ||
+        MpmCacheWriteAll(fd, body->data, body->len) < 0) {
+        SCLogWarning(SC_ERR_FWRITE, "writing mpm cache entry %s failed: %s",
+                tmp_path, strerror(errno));
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+
+    SCMutexLock(&mpm_cache_stats_lock);
+    mpm_cache_stores++;
+    SCMutexUnlock(&mpm_cache_stats_lock);
+    return 0;
+}
+
+static void MpmCacheCount(int hit)
+{
+    SCMutexLock(&mpm_cache_stats_lock);
+    if (hit)
+        mpm_cache_hits++;
+    else
+        mpm_cache_misses++;
+    SCMutexUnlock(&mpm_cache_stats_lock);
+}
+
+/** \brief Map the entry of key
+ *
+ *  On success the reader is set up over the body and the matcher owns
+ *  the mapping: it unmaps it through MpmCacheUnmap() when the ctx is
+ *  destroyed, or through MpmCacheReject() if the body turns out to be
+ *  unusable.
+ *
+ *  \retval 1 hit
+ *  \retval 0 miss
+ */
+int MpmCacheLoad(uint16_t mpm_type, const MpmCacheKey *key,
+        MpmCacheMap *map, MpmCacheReader *r)
+{
+    char path[PATH_MAX];
+    struct stat st;
+    void *addr = MAP_FAILED;
+    const MpmCacheHeader *hdr;
+    uint64_t body_off;
+    int fd;
+
+    memset(map, 0, sizeof(*map));
+    memset(r, 0, sizeof(*r));
+
+    if (mpm_cache_dir == NULL)
+        return 0;
+    if (MpmCacheGetPath(mpm_type, key, path, sizeof(path)) < 0)
+        goto miss;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        goto miss;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(MpmCacheHeader)) {
+        close(fd);
+        goto miss;
+    }
+    /* mark the entry as used for MpmCachePrune, best effort */
+    (void)futimens(fd, NULL);
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        goto miss;
+
+    hdr = (const MpmCacheHeader *)addr;
+    body_off = sizeof(MpmCacheHeader) + MPM_CACHE_ALIGN(hdr->key_len);
+    /* check the lengths against the file size before touching the key,
+     * without adding the body_len from the file to anything */
+    if (memcmp(hdr->magic, MPM_CACHE_MAGIC, sizeof(hdr->magic)) != 0 ||
+        hdr->version != MPM_CACHE_VERSION ||
+        hdr->endian != MPM_CACHE_ENDIAN ||
+        hdr->ptr_size != sizeof(void *) ||
+        hdr->hash != key->hash ||
+        hdr->key_len != key->len ||
+        body_off > (uint64_t)st.st_size ||
+        hdr->body_len != (uint64_t)st.st_size - body_off ||
+        memcmp((const uint8_t *)addr + sizeof(MpmCacheHeader), key->buf,
+               key->len) != 0) {
+        SCLogDebug("%s doesn't match its key", path);
+        munmap(addr, st.st_size);
+        goto miss;
+    }
+
+    map->addr = addr;
+    map->len = st.st_size;
+    r->data = (const uint8_t *)addr + body_off;
+    r->len = hdr->body_len;
+    r->off = 0;
+
+    MpmCacheCount(1);
+    return 1;
+
+miss:
+    MpmCacheCount(0);
+    return 0;
+}
+
+/** \brief Get the next len bytes of the body
+ *
+ *  \retval ptr 8 byte aligned data, or NULL if the body is too short
+ */
+const void *MpmCacheRead(MpmCacheReader *r, uint64_t len)
+{
+    if (len > r->len || r->off > r->len - len)
+        return NULL;
+
+    const void *ptr = r->data + r->off;
+    r->off += MPM_CACHE_ALIGN(len);
+    if (r->off > r->len)
+        r->off = r->len;
+    return ptr;
+}
+
+void MpmCacheUnmap(MpmCacheMap *map)
+{
+    if (map->addr != NULL) {
+        munmap(map->addr, map->len);
+        map->addr = NULL;
+        map->len = 0;
+    }
+}
+
+/** \brief Unmap an entry the matcher couldn't use, it counts as a miss */
+void MpmCacheReject(MpmCacheMap *map)
+{
+    SCLogDebug("rejecting mpm cache entry");
+
+    MpmCacheUnmap(map);
+
+    SCMutexLock(&mpm_cache_stats_lock);
+    mpm_cache_hits--;
+    mpm_cache_misses++;
+    SCMutexUnlock(&mpm_cache_stats_lock);
+}
+
+/** \brief Get the cache stats, optionally resetting them */
+void MpmCacheGetStats(uint32_t *hits, uint32_t *misses, uint32_t *stores,
+        int reset)
+{
+    SCMutexLock(&mpm_cache_stats_lock);
+    *hits = mpm_cache_hits;
+    *misses = mpm_cache_misses;
+    *stores = mpm_cache_stores;
+    if (reset) {
+        mpm_cache_hits = 0;
+        mpm_cache_misses = 0;
+        mpm_cache_stores = 0;
+    }
+    SCMutexUnlock(&mpm_cache_stats_lock);
+}
+
+#ifdef UNITTESTS
+
+/** \brief Remove a cache directory created by a test, with its entries */
+void MpmCacheTestRemoveDir(const char *dir)
+{
+    char path[PATH_MAX];
+    struct dirent *de;
+
+    DIR *d = opendir(dir);
+    if (d != NULL) {
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.')
+                continue;
+            if (snprintf(path, sizeof(path), "%s/%s", dir, de->d_name) < (int)sizeof(path))
+                unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/** \test key doesn't depend on the order the patterns are added in,
+ *        store and load round trip, mismatching key is a miss */
+static int MpmCacheTest01(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/mpm-cache-test.XXXXXX";
+    MpmCacheKey k1, k2, k3;
+    MpmCacheBuffer b;
+    MpmCacheMap map;
+    MpmCacheReader r;
+    uint32_t hits, misses, stores;
+    uint64_t v = 0x1122334455667788ULL;
+
+    memset(&b, 0, sizeof(b));
+    memset(&k1, 0, sizeof(k1));
+    memset(&k2, 0, sizeof(k2));
+    memset(&k3, 0, sizeof(k3));
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    MpmCacheSetDir(dir);
+    if (!MpmCacheEnabled())
+        goto end;
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+
+    if (MpmCacheKeyInit(&k1, MPM_AC) < 0 || MpmCacheKeyInit(&k2, MPM_AC) < 0 ||
+        MpmCacheKeyInit(&k3, MPM_AC) < 0)
+        goto end;
+    MpmCacheKeyAddPattern(&k1, (uint8_t *)"abc", 3, 0, 1);
+    MpmCacheKeyAddPattern(&k1, (uint8_t *)"de", 2, MPM_PATTERN_FLAG_NOCASE, 2);
+    MpmCacheKeyAddPattern(&k2, (uint8_t *)"de", 2, MPM_PATTERN_FLAG_NOCASE, 2);
+    MpmCacheKeyAddPattern(&k2, (uint8_t *)"abc", 3, 0, 1);
+    MpmCacheKeyAddPattern(&k3, (uint8_t *)"abc", 3, 0, 1);
+    MpmCacheKeyAddPattern(&k3, (uint8_t *)"de", 2, 0, 2);
+    if (MpmCacheKeyFinish(&k1) < 0 || MpmCacheKeyFinish(&k2) < 0 ||
+        MpmCacheKeyFinish(&k3) < 0)
+        goto end;
+
+    if (k1.len != k2.len || memcmp(k1.buf, k2.buf, k1.len) != 0 ||
+        k1.hash != k2.hash || k1.hash == k3.hash)
+        goto end;
+
+    if (MpmCacheLoad(MPM_AC, &k1, &map, &r) != 0)
+        goto end;
+
+    if (MpmCacheBufferAdd(&b, "xyz", 3) < 0 || MpmCacheBufferAdd(&b, &v, sizeof(v)) < 0)
+        goto end;
+    if (b.len != 16)
+        goto end;
+    if (MpmCacheStore(MPM_AC, &k1, &b) < 0)
+        goto end;
+
+    if (MpmCacheLoad(MPM_AC, &k2, &map, &r) != 1)
+        goto end;
+    const char *s = MpmCacheRead(&r, 3);
+    const uint64_t *pv = MpmCacheRead(&r, sizeof(v));
+    const void *past = MpmCacheRead(&r, 1);
+    if (s == NULL || memcmp(s, "xyz", 3) != 0 || pv == NULL || *pv != v ||
+        past != NULL) {
+        MpmCacheUnmap(&map);
+        goto end;
+    }
+    MpmCacheUnmap(&map);
+
+    if (MpmCacheLoad(MPM_AC, &k3, &map, &r) != 0)
+        goto end;
+
+    MpmCacheGetStats(&hits, &misses, &stores, 1);
+    if (hits != 1 || misses != 2 || stores != 1) {
+        printf("hits %u misses %u stores %u: ", hits, misses, stores);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MpmCacheKeyFree(&k1);
+    MpmCacheKeyFree(&k2);
+    MpmCacheKeyFree(&k3);
+    MpmCacheBufferFree(&b);
+    MpmCacheSetDir(NULL);
+    MpmCacheTestRemoveDir(dir);
+    return result;
+}
+
+/** \test truncated entry whose body_len only matches the file size after
+ *        wrapping around is a miss, and its key isn't read past the
+ *        end of the file */
+static int MpmCacheTest02(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/mpm-cache-test.XXXXXX";
+    char path[PATH_MAX];
+    MpmCacheKey k;
+    MpmCacheBuffer b;
+    MpmCacheMap map;
+    MpmCacheReader r;
+    MpmCacheHeader hdr;
+
+    memset(&b, 0, sizeof(b));
+    memset(&k, 0, sizeof(k));
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    MpmCacheSetDir(dir);
+
+    if (MpmCacheKeyInit(&k, MPM_AC) < 0 ||
+        MpmCacheKeyAddPattern(&k, (uint8_t *)"abc", 3, 0, 1) < 0 ||
+        MpmCacheKeyFinish(&k) < 0)
+        goto end;
+    if (MpmCacheBufferAdd(&b, "xyz", 3) < 0)
+        goto end;
+    if (MpmCacheStore(MPM_AC, &k, &b) < 0)
+        goto end;
+    if (MpmCacheGetPath(MPM_AC, &k, path, sizeof(path)) < 0)
+        goto end;
+
+    /* cut the file in the key, body_off + body_len == file size only
+     * after wrapping */
+    FILE *fp = fopen(path, "r+");
+    if (fp == NULL)
+        goto end;
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1) {
+        fclose(fp);
+        goto end;
+    }
+    hdr.body_len = (uint64_t)(sizeof(hdr) + 1) -
+                   (sizeof(MpmCacheHeader) + MPM_CACHE_ALIGN(hdr.key_len));
+    rewind(fp);
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+        fclose(fp);
+        goto end;
+    }
+    fclose(fp);
+    if (truncate(path, sizeof(hdr) + 1) != 0)
+        goto end;
+
+    if (MpmCacheLoad(MPM_AC, &k, &map, &r) != 0) {
+        MpmCacheUnmap(&map);
+        goto end;
+    }
+
+    result = 1;
+end:
+    MpmCacheKeyFree(&k);
+    MpmCacheBufferFree(&b);
+    MpmCacheSetDir(NULL);
+    MpmCacheTestRemoveDir(dir);
+    return result;
+}
+
+/** \test prune removes old entries and leaves other files alone */
+static int MpmCacheTest03(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/mpm-cache-test.XXXXXX";
+    char old_path[PATH_MAX];
+    char new_path[PATH_MAX];
+    char other_path[PATH_MAX];
+    struct timeval tv[2];
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    MpmCacheSetDir(dir);
+
+    snprintf(old_path, sizeof(old_path), "%s/ac-0000000000000001.mpmc", dir);
+    snprintf(new_path, sizeof(new_path), "%s/ac-0000000000000002.mpmc", dir);
+    snprintf(other_path, sizeof(other_path), "%s/other", dir);
+
+    const char *paths[] = { old_path, new_path, other_path };
+    for (int i = 0; i < 3; i++) {
+        FILE *fp = fopen(paths[i], "w");
+        if (fp == NULL)
+            goto end;
+        fclose(fp);
+    }
+
+    memset(&tv, 0, sizeof(tv));
+    tv[0].tv_sec = tv[1].tv_sec = time(NULL) - 3600;
+    if (utimes(old_path, tv) != 0 || utimes(other_path, tv) != 0)
+        goto end;
+
+    if (MpmCachePrune(60) != 1)
+        goto end;
+    if (access(old_path, F_OK) == 0 || access(new_path, F_OK) != 0 ||
+        access(other_path, F_OK) != 0)
+        goto end;
+
+    result = 1;
+end:
+    MpmCacheSetDir(NULL);
+    MpmCacheTestRemoveDir(dir);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void MpmCacheRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("MpmCacheTest01", MpmCacheTest01, 1);
+    UtRegisterTest("MpmCacheTest02", MpmCacheTest02, 1);
+    UtRegisterTest("MpmCacheTest03", MpmCacheTest03, 1);
+#endif /* UNITTESTS */
+}
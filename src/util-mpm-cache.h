@@ -0,0 +1,104 @@
+/* Copyright (C) 2014 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * On disk cache of prepared mpm ctxs.
+ */
+
+#ifndef __UTIL_MPM_CACHE_H__
+#define __UTIL_MPM_CACHE_H__
+
+/** bump when the layout of a cache entry changes, for any matcher */
+#define MPM_CACHE_VERSION   1
+
+typedef struct MpmCacheKeyRec_ {
+    uint32_t id;
+    /** offset of the pattern record in the key buf */
+    uint32_t off;
+} MpmCacheKeyRec;
+
+/**
+ * \brief Key of a cache entry: the mpm type and the pattern set, with
+ *        the patterns sorted on id.
+ */
+typedef struct MpmCacheKey_ {
+    uint8_t *buf;
+    uint32_t len;
+    uint32_t size;
+    /** pattern records in buf, sorted by MpmCacheKeyFinish() */
+    MpmCacheKeyRec *recs;
+    uint32_t rec_cnt;
+    uint32_t rec_size;
+    uint64_t hash;
+} MpmCacheKey;
+
+/** \brief Buffer a matcher serializes its ctx into */
+typedef struct MpmCacheBuffer_ {
+    uint8_t *data;
+    uint64_t len;
+    uint64_t size;
+} MpmCacheBuffer;
+
+/** \brief Reader over the body of a mapped cache entry */
+typedef struct MpmCacheReader_ {
+    const uint8_t *data;
+    uint64_t len;
+    uint64_t off;
+} MpmCacheReader;
+
+/** \brief Mapping of a cache entry, owned by the mpm ctx it was loaded in */
+typedef struct MpmCacheMap_ {
+    void *addr;
+    size_t len;
+} MpmCacheMap;
+
+/** days an unused entry is kept in the cache dir */
+#define MPM_CACHE_DEFAULT_MAX_AGE   30
+
+void MpmCacheSetDir(const char *dir);
+int MpmCacheEnabled(void);
+uint32_t MpmCachePrune(uint64_t max_age);
+
+int MpmCacheKeyInit(MpmCacheKey *key, uint16_t mpm_type);
+int MpmCacheKeyAddPattern(MpmCacheKey *key, const uint8_t *pat, uint16_t len,
+        uint8_t flags, uint32_t id);
+int MpmCacheKeyFinish(MpmCacheKey *key);
+void MpmCacheKeyFree(MpmCacheKey *key);
+
+int MpmCacheBufferAdd(MpmCacheBuffer *b, const void *data, uint64_t len);
+void MpmCacheBufferFree(MpmCacheBuffer *b);
+int MpmCacheStore(uint16_t mpm_type, const MpmCacheKey *key,
+        const MpmCacheBuffer *body);
+
+int MpmCacheLoad(uint16_t mpm_type, const MpmCacheKey *key,
+        MpmCacheMap *map, MpmCacheReader *r);
+const void *MpmCacheRead(MpmCacheReader *r, uint64_t len);
+void MpmCacheUnmap(MpmCacheMap *map);
+void MpmCacheReject(MpmCacheMap *map);
+
+void MpmCacheGetStats(uint32_t *hits, uint32_t *misses, uint32_t *stores,
+        int reset);
+
+#ifdef UNITTESTS
+void MpmCacheTestRemoveDir(const char *dir);
+#endif
+
+void MpmCacheRegisterTests(void);
+
+#endif /* __UTIL_MPM_CACHE_H__ */
@@ -1439,6 +1439,7 @@ void MpmWuManberRegister (void) {
     mpm_table[MPM_WUMANBER].PrintCtx = WmPrintInfo;
     mpm_table[MPM_WUMANBER].PrintThreadCtx = WmPrintSearchStats;
     mpm_table[MPM_WUMANBER].RegisterUnittests = WmRegisterTests;
+    mpm_table[MPM_WUMANBER].flags |= MPM_FLAG_PREPARE_THREAD_SAFE;
 
     /* create table for O(1) lowercase conversion lookup */
     uint8_t c = 0;
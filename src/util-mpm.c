@@ -36,6 +36,7 @@
 #include "util-mpm-ac.h"
 #include "util-mpm-ac-gfbs.h"
 #include "util-mpm-ac-bs.h"
+#include "util-mpm-ac-band.h"
 #include "util-mpm-ac-tile.h"
 #include "util-hashlist.h"
 
@@ -443,11 +444,15 @@ int PmqSetup(PatternMatcherQueue *pmq, uint32_t patmaxid) {
         /* lookup bitarray */
         pmq->pattern_id_bitarray_size = (patmaxid / 8) + 1;
 
-        pmq->pattern_id_bitarray = SCMalloc(pmq->pattern_id_bitarray_size);
+        /* followed by a few spare bytes, so the AVX2 prefilter can
+         * read the bitarray 32 bits at a time at any offset */
+        pmq->pattern_id_bitarray = SCMalloc(pmq->pattern_id_bitarray_size +
+                                            sizeof(uint32_t));
         if (pmq->pattern_id_bitarray == NULL) {
             SCReturnInt(-1);
         }
-        memset(pmq->pattern_id_bitarray, 0, pmq->pattern_id_bitarray_size);
+        memset(pmq->pattern_id_bitarray, 0, pmq->pattern_id_bitarray_size +
+                                            sizeof(uint32_t));
 
         SCLogDebug("pmq->pattern_id_array %p, pmq->pattern_id_bitarray %p",
                 pmq->pattern_id_array, pmq->pattern_id_bitarray);
@@ -561,6 +566,106 @@ void PmqFree(PatternMatcherQueue *pmq) {
     PmqCleanup(pmq);
 }
 
+/** \brief Start a resumable search
+ *
+ *  Shared SearchStart of the mpms supporting resumable searches. Resets
+ *  the search state and makes sure it can hold the tail needed for the
+ *  longest pattern of the mpm ctx.
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+int MpmSearchStateStart(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        MpmSearchState *st)
+{
+    uint32_t keep = mpm_ctx->maxlen > 0 ? mpm_ctx->maxlen - 1 : 0;
+
+    if (keep > st->tail_size) {
+        uint8_t *ptmp = SCRealloc(st->tail, keep);
+        if (unlikely(ptmp == NULL))
+            return -1;
+        st->tail = ptmp;
+        st->tail_size = keep;
+    }
+
+    st->state = 0;
+    st->matches = 0;
+    st->offset = 0;
+    st->tail_len = 0;
+    st->tail_keep = keep;
+    return 0;
+}
+
+/** \brief End a resumable search
+ *
+ *  \retval matches match count of the whole search
+ */
+uint32_t MpmSearchStateEnd(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        MpmSearchState *st)
+{
+    return st->matches;
+}
+
+/** \brief Free the memory held by a search state */
+void MpmSearchStateFree(MpmSearchState *st)
+{
+    if (st->tail != NULL)
+        SCFree(st->tail);
+    memset(st, 0, sizeof(*st));
+}
+
+/** \brief Verify a case sensitive match that starts in an earlier chunk
+ *
+ *  \param pat pattern
+ *  \param patlen pattern length
+ *  \param buf current chunk
+ *  \param end length of the part of the pattern in buf, so the match ends
+ *             at buf[end - 1]. Smaller than patlen.
+ *
+ *  \retval 0 match
+ *  \retval 1 no match
+ */
+int MpmSearchStateVerify(const MpmSearchState *st, const uint8_t *pat,
+        uint16_t patlen, const uint8_t *buf, uint32_t end)
+{
+    uint32_t need = patlen - end;
+
+    if (need > st->tail_len)
+        return 1;
+    if (memcmp(pat, st->tail + st->tail_len - need, need) != 0)
+        return 1;
+    if (memcmp(pat + need, buf, end) != 0)
+        return 1;
+    return 0;
+}
+
+/** \brief Update the search state's tail and offset after a chunk
+ *
+ *  \param buf chunk that was searched
+ *  \param len chunk length
+ */
+void MpmSearchStateUpdate(MpmSearchState *st, const uint8_t *buf, uint32_t len)
+{
+    uint32_t keep = st->tail_keep;
+
+    st->offset += len;
+    if (keep == 0)
+        return;
+
+    if (len >= keep) {
+        memcpy(st->tail, buf + len - keep, keep);
+        st->tail_len = keep;
+    } else {
+        uint32_t old = st->tail_len;
+        if (old + len > keep)
+            old = keep - len;
+
+        memmove(st->tail, st->tail + st->tail_len - old, old);
+        memcpy(st->tail + old, buf, len);
+        st->tail_len = old + len;
+    }
+}
+
 void MpmInitThreadCtx(MpmThreadCtx *mpm_thread_ctx, uint16_t matcher, uint32_t max_id) {
     mpm_table[matcher].InitThreadCtx(NULL, mpm_thread_ctx, max_id);
 }
@@ -582,6 +687,7 @@ void MpmTableSetup(void) {
     MpmACBSRegister();
     MpmACGfbsRegister();
     MpmACTileRegister();
+    MpmACBandRegister();
 #ifdef __SC_CUDA_SUPPORT__
     MpmACCudaRegister();
 #endif /* __SC_CUDA_SUPPORT__ */
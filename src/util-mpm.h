@@ -72,6 +72,8 @@ enum {
     MPM_AC_GFBS,
     MPM_AC_BS,
     MPM_AC_TILE,
+    /* aho-corasick with a compressed state table */
+    MPM_AC_BAND,
     /* table size */
     MPM_TABLE_SIZE,
 };
@@ -108,6 +110,24 @@ typedef struct PatternMatcherQueue_ {
     uint32_t pattern_id_bitarray_size; /**< size in bytes */
 } PatternMatcherQueue;
 
+/** \brief State of a resumable search over data that is passed to the
+ *         mpm in chunks. Owned by the caller, one per search in progress,
+ *         and reused over searches. Zero it before the first use.
+ *
+ *  The last maxlen - 1 bytes of the data searched so far are kept, so
+ *  that case sensitive patterns that straddle a chunk boundary can be
+ *  verified. */
+typedef struct MpmSearchState_ {
+    uint32_t state;         /**< state of the automaton */
+    uint32_t matches;       /**< matches so far */
+    uint64_t offset;        /**< bytes searched so far */
+
+    uint8_t *tail;          /**< last bytes of the data searched so far */
+    uint32_t tail_len;      /**< bytes in tail */
+    uint32_t tail_keep;     /**< bytes to keep: the mpm ctx's maxlen - 1 */
+    uint32_t tail_size;     /**< size of the tail buffer */
+} MpmSearchState;
+
 typedef struct MpmCtx_ {
     void *ctx;
     uint16_t mpm_type;
@@ -158,6 +178,9 @@ typedef struct MpmCtxFactoryContainer_ {
 /** one byte pattern (used in b2g) */
 #define MPM_PATTERN_ONE_BYTE        0x10
 
+/** Prepare can run on different ctxs at the same time */
+#define MPM_FLAG_PREPARE_THREAD_SAFE    0x01
+
 typedef struct MpmTableElmt_ {
     char *name;
     uint8_t max_pattern_length;
@@ -181,6 +204,17 @@ typedef struct MpmTableElmt_ {
     int  (*AddPatternNocase)(struct MpmCtx_ *, uint8_t *, uint16_t, uint16_t, uint16_t, uint32_t, uint32_t, uint8_t);
     int  (*Prepare)(struct MpmCtx_ *);
     uint32_t (*Search)(struct MpmCtx_ *, struct MpmThreadCtx_ *, PatternMatcherQueue *, uint8_t *, uint16_t);
+
+    /** resumable search, NULL if the mpm doesn't support it.
+     *
+     *  SearchStart resets a search state, SearchContinue searches the next
+     *  chunk of the data and returns the matches in it, SearchEnd returns
+     *  the matches of the whole search. Patterns that straddle chunks are
+     *  matched. Chunks may be larger than 64k.
+     */
+    int  (*SearchStart)(struct MpmCtx_ *, struct MpmThreadCtx_ *, MpmSearchState *);
+    uint32_t (*SearchContinue)(struct MpmCtx_ *, struct MpmThreadCtx_ *, MpmSearchState *, PatternMatcherQueue *, uint8_t *, uint32_t);
+    uint32_t (*SearchEnd)(struct MpmCtx_ *, struct MpmThreadCtx_ *, MpmSearchState *);
     void (*Cleanup)(struct MpmThreadCtx_ *);
     void (*PrintCtx)(struct MpmCtx_ *);
     void (*PrintThreadCtx)(struct MpmThreadCtx_ *);
@@ -235,6 +269,13 @@ void MpmFactoryDeRegisterAllMpmCtxProfiles(struct DetectEngineCtx_ *);
 int32_t MpmFactoryIsMpmCtxAvailable(struct DetectEngineCtx_ *, MpmCtx *);
 
 int PmqSetup(PatternMatcherQueue *, uint32_t);
+
+int MpmSearchStateStart(MpmCtx *, MpmThreadCtx *, MpmSearchState *);
+uint32_t MpmSearchStateEnd(MpmCtx *, MpmThreadCtx *, MpmSearchState *);
+void MpmSearchStateFree(MpmSearchState *);
+int MpmSearchStateVerify(const MpmSearchState *, const uint8_t *, uint16_t,
+        const uint8_t *, uint32_t);
+void MpmSearchStateUpdate(MpmSearchState *, const uint8_t *, uint32_t);
 void PmqMerge(PatternMatcherQueue *src, PatternMatcherQueue *dst);
 void PmqReset(PatternMatcherQueue *);
 void PmqCleanup(PatternMatcherQueue *);
@@ -48,5 +48,12 @@
  */
 #define hw_barrier() __sync_synchronize()
 
+/** Prefetch the cache line at addr for reading */
+#if CPPCHECK==1
+#define prefetch(addr)
+#else
+#define prefetch(addr) __builtin_prefetch((addr), 0, 3)
+#endif
+
 #endif /* __UTIL_OPTIMIZE_H__ */
 
@@ -22,6 +22,13 @@
  * \author Victor Julien <victor@inliniac.net>
  *
  * An API for rule profiling operations.
+ *
+ * Each detect thread keeps its own counters and a histogram of the ticks
+ * per rule check, updated without locking. The threads' data is merged
+ * into the detect ctx when they exit and dumped at shutdown. The live
+ * data of the current ruleset can also be queried and reset over the
+ * unix socket. A reset bumps a generation number, each thread clears its
+ * own data when it sees the new generation.
  */
 
 #include "suricata-common.h"
@@ -35,6 +42,7 @@
 #include "util-byte.h"
 #include "util-profiling.h"
 #include "util-profiling-locks.h"
+#include "unix-manager.h"
 
 #ifdef PROFILING
 
@@ -42,6 +50,9 @@
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
+/** number of log2 buckets of the ticks histogram */
+#define SC_PROFILE_RULE_HIST_SIZE   32
+
 /**
  * Extra data for rule profiling.
  */
@@ -54,13 +65,20 @@ typedef struct SCProfileData_ {
     uint64_t max;
     uint64_t ticks_match;
     uint64_t ticks_no_match;
+    /** checks per log2 of their ticks, the last bucket takes the rest */
+    uint64_t hist[SC_PROFILE_RULE_HIST_SIZE];
 } SCProfileData;
 
 typedef struct SCProfileDetectCtx_ {
     uint32_t size;
     uint32_t id;
+    /** data of the threads that exited */
     SCProfileData *data;
     pthread_mutex_t data_m;
+    /** threads still running, protected by data_m */
+    DetectEngineThreadCtx *threads;
+    /** generation of the data, bumped by a reset */
+    uint32_t reset_gen;
 } SCProfileDetectCtx;
 
 /**
@@ -79,6 +97,8 @@ typedef struct SCProfileSummary_ {
     uint64_t max;
     uint64_t ticks_match;
     uint64_t ticks_no_match;
+    uint64_t p50;
+    uint64_t p99;
 } SCProfileSummary;
 
 extern int profiling_output_to_file;
@@ -105,6 +125,12 @@ static int profiling_rules_sort_order = SC_PROFILING_RULES_SORT_BY_TICKS;
  */
 static uint32_t profiling_rules_limit = UINT32_MAX;
 
+/**
+ * Ctx of the last loaded ruleset, used by the unix socket commands.
+ */
+static SCProfileDetectCtx *profiling_rules_ctx = NULL;
+static pthread_mutex_t profiling_rules_ctx_m = PTHREAD_MUTEX_INITIALIZER;
+
 void SCProfilingRulesGlobalInit(void) {
     ConfNode *conf;
     const char *val;
@@ -263,62 +289,67 @@ SCProfileSummarySortByMaxTicks(const void *a, const void *b)
 }
 
 /**
- * \brief Dump rule profiling information to file
+ * \brief Get a percentile of the ticks per check from the histogram.
  *
- * \param de_ctx The active DetectEngineCtx, used to get at the loaded rules.
+ * The value is interpolated within the log2 bucket it falls in.
  */
-void
-SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
+static uint64_t
+SCProfileDataPercentile(const SCProfileData *d, uint32_t pct)
 {
-    uint32_t i;
-    FILE *fp;
-
-    if (rules_ctx == NULL)
-        return;
-
-    struct timeval tval;
-    struct tm *tms;
-    if (profiling_output_to_file == 1) {
-        fp = fopen(profiling_file_name, profiling_file_mode);
+    uint64_t total = 0;
+    int i;
 
-        if (fp == NULL) {
-            SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", profiling_file_name,
-                    strerror(errno));
-            return;
+    for (i = 0; i < SC_PROFILE_RULE_HIST_SIZE; i++)
+        total += d->hist[i];
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (total * pct + 99) / 100;
+    uint64_t cum = 0;
+    for (i = 0; i < SC_PROFILE_RULE_HIST_SIZE; i++) {
+        if (d->hist[i] > 0 && cum + d->hist[i] >= rank) {
+            uint64_t lo = (i == 0) ? 0 : (1ULL << i);
+            uint64_t hi = (i == SC_PROFILE_RULE_HIST_SIZE - 1) ?
+                d->max : (1ULL << (i + 1));
+            if (hi < lo)
+                hi = lo;
+            return lo + (uint64_t)((long double)(hi - lo) *
+                    (long double)(rank - cum) / (long double)d->hist[i]);
         }
-    } else {
-       fp = stdout;
-    }
-
-    int summary_size = sizeof(SCProfileSummary) * rules_ctx->size;
-    SCProfileSummary *summary = SCMalloc(summary_size);
-    if (unlikely(summary == NULL)) {
-        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory for profiling summary");
-        return;
+        cum += d->hist[i];
     }
+    return d->max;
+}
 
-    uint32_t count = rules_ctx->size;
+/**
+ * \brief Fill and sort the summary of the rules' profiling data.
+ *
+ * \retval total_ticks ticks of all rules
+ */
+static uint64_t
+SCProfilingRuleBuildSummary(const SCProfileData *data, uint32_t count,
+        SCProfileSummary *summary)
+{
     uint64_t total_ticks = 0;
+    uint32_t i;
 
-    SCLogInfo("Dumping profiling data for %u rules.", count);
-
-    memset(summary, 0, summary_size);
+    memset(summary, 0, sizeof(SCProfileSummary) * count);
     for (i = 0; i < count; i++) {
-        summary[i].sid = rules_ctx->data[i].sid;
-        summary[i].rev = rules_ctx->data[i].rev;
-        summary[i].gid = rules_ctx->data[i].gid;
+        summary[i].sid = data[i].sid;
+        summary[i].rev = data[i].rev;
+        summary[i].gid = data[i].gid;
 
-        summary[i].ticks = rules_ctx->data[i].ticks_match + rules_ctx->data[i].ticks_no_match;
-        summary[i].checks = rules_ctx->data[i].checks;
+        summary[i].ticks = data[i].ticks_match + data[i].ticks_no_match;
+        summary[i].checks = data[i].checks;
 
         if (summary[i].ticks > 0) {
             summary[i].avgticks = (long double)summary[i].ticks / (long double)summary[i].checks;
         }
 
-        summary[i].matches = rules_ctx->data[i].matches;
-        summary[i].max = rules_ctx->data[i].max;
-        summary[i].ticks_match = rules_ctx->data[i].ticks_match;
-        summary[i].ticks_no_match = rules_ctx->data[i].ticks_no_match;
+        summary[i].matches = data[i].matches;
+        summary[i].max = data[i].max;
+        summary[i].ticks_match = data[i].ticks_match;
+        summary[i].ticks_no_match = data[i].ticks_no_match;
         if (summary[i].ticks_match > 0) {
             summary[i].avgticks_match = (long double)summary[i].ticks_match /
                 (long double)summary[i].matches;
@@ -328,6 +359,8 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
             summary[i].avgticks_no_match = (long double)summary[i].ticks_no_match /
                 ((long double)summary[i].checks - (long double)summary[i].matches);
         }
+        summary[i].p50 = SCProfileDataPercentile(&data[i], 50);
+        summary[i].p99 = SCProfileDataPercentile(&data[i], 99);
         total_ticks += summary[i].ticks;
     }
 
@@ -362,6 +395,50 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
             break;
     }
 
+    return total_ticks;
+}
+
+/**
+ * \brief Dump rule profiling information to file
+ *
+ * \param de_ctx The active DetectEngineCtx, used to get at the loaded rules.
+ */
+void
+SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
+{
+    uint32_t i;
+    FILE *fp;
+
+    if (rules_ctx == NULL)
+        return;
+
+    struct timeval tval;
+    struct tm *tms;
+    if (profiling_output_to_file == 1) {
+        fp = fopen(profiling_file_name, profiling_file_mode);
+
+        if (fp == NULL) {
+            SCLogError(SC_ERR_FOPEN, "failed to open %s: %s", profiling_file_name,
+                    strerror(errno));
+            return;
+        }
+    } else {
+       fp = stdout;
+    }
+
+    SCProfileSummary *summary = SCMalloc(sizeof(SCProfileSummary) * rules_ctx->size);
+    if (unlikely(summary == NULL)) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory for profiling summary");
+        return;
+    }
+
+    uint32_t count = rules_ctx->size;
+    uint64_t total_ticks = 0;
+
+    SCLogInfo("Dumping profiling data for %u rules.", count);
+
+    total_ticks = SCProfilingRuleBuildSummary(rules_ctx->data, count, summary);
+
     gettimeofday(&tval, NULL);
     struct tm local_tm;
     tms = SCLocalTime(tval.tv_sec, &local_tm);
@@ -373,7 +450,7 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
             tms->tm_hour,tms->tm_min, tms->tm_sec);
     fprintf(fp, "  ----------------------------------------------"
             "----------------------------\n");
-    fprintf(fp, "   %-8s %-12s %-8s %-8s %-12s %-6s %-8s %-8s %-11s %-11s %-11s %-11s\n", "Num", "Rule", "Gid", "Rev", "Ticks", "%", "Checks", "Matches", "Max Ticks", "Avg Ticks", "Avg Match", "Avg No Match");
+    fprintf(fp, "   %-8s %-12s %-8s %-8s %-12s %-6s %-8s %-8s %-11s %-11s %-11s %-14s %-11s %-11s\n", "Num", "Rule", "Gid", "Rev", "Ticks", "%", "Checks", "Matches", "Max Ticks", "Avg Ticks", "Avg Match", "Avg No Match", "P50 Ticks", "P99 Ticks");
     fprintf(fp, "  -------- "
         "------------ "
         "-------- "
@@ -386,6 +463,8 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
         "----------- "
         "----------- "
         "-------------- "
+        "----------- "
+        "----------- "
         "\n");
     for (i = 0; i < MIN(count, profiling_rules_limit); i++) {
 
@@ -398,7 +477,7 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
         double percent = (long double)summary[i].ticks /
             (long double)total_ticks * 100;
         fprintf(fp,
-            "  %-8"PRIu32" %-12u %-8"PRIu32" %-8"PRIu32" %-12"PRIu64" %-6.2f %-8"PRIu64" %-8"PRIu64" %-11"PRIu64" %-11.2f %-11.2f %-11.2f\n",
+            "  %-8"PRIu32" %-12u %-8"PRIu32" %-8"PRIu32" %-12"PRIu64" %-6.2f %-8"PRIu64" %-8"PRIu64" %-11"PRIu64" %-11.2f %-11.2f %-14.2f %-11"PRIu64" %-11"PRIu64"\n",
             i + 1,
             summary[i].sid,
             summary[i].gid,
@@ -410,7 +489,9 @@ SCProfilingRuleDump(SCProfileDetectCtx *rules_ctx)
             summary[i].max,
             summary[i].avgticks,
             summary[i].avgticks_match,
-            summary[i].avgticks_no_match);
+            summary[i].avgticks_no_match,
+            summary[i].p50,
+            summary[i].p99);
     }
 
     fprintf(fp,"\n");
@@ -432,6 +513,34 @@ SCProfilingRegisterRuleCounter(SCProfileDetectCtx *ctx)
     return ctx->id++;
 }
 
+/** \internal
+ *  \brief Get the histogram bucket of a check's ticks
+ */
+static inline int SCProfileTicksBucket(uint64_t ticks)
+{
+    if (ticks < 2)
+        return 0;
+    int b = 63 - __builtin_clzll(ticks);
+    return (b < SC_PROFILE_RULE_HIST_SIZE) ? b : SC_PROFILE_RULE_HIST_SIZE - 1;
+}
+
+/** \internal
+ *  \brief Clear the counters of profiling data, keeping the rule ids
+ */
+static void SCProfileDataClear(SCProfileData *data, uint32_t size)
+{
+    uint32_t i;
+    for (i = 0; i < size; i++) {
+        uint32_t sid = data[i].sid;
+        uint32_t gid = data[i].gid;
+        uint32_t rev = data[i].rev;
+        memset(&data[i], 0x00, sizeof(SCProfileData));
+        data[i].sid = sid;
+        data[i].gid = gid;
+        data[i].rev = rev;
+    }
+}
+
 /**
  * \brief Update a rule counter.
  *
@@ -443,6 +552,14 @@ void
 SCProfilingRuleUpdateCounter(DetectEngineThreadCtx *det_ctx, uint16_t id, uint64_t ticks, int match)
 {
     if (det_ctx != NULL && det_ctx->rule_perf_data != NULL && det_ctx->rule_perf_data_size > id) {
+        /* start over after a reset */
+        uint32_t gen = det_ctx->de_ctx->profile_ctx->reset_gen;
+        if (unlikely(det_ctx->rule_perf_gen != gen)) {
+            memset(det_ctx->rule_perf_data, 0x00,
+                    sizeof(SCProfileData) * det_ctx->rule_perf_data_size);
+            det_ctx->rule_perf_gen = gen;
+        }
+
         SCProfileData *p = &det_ctx->rule_perf_data[id];
 
         p->checks++;
@@ -453,6 +570,7 @@ SCProfilingRuleUpdateCounter(DetectEngineThreadCtx *det_ctx, uint16_t id, uint64
             p->ticks_match += ticks;
         else
             p->ticks_no_match += ticks;
+        p->hist[SCProfileTicksBucket(ticks)]++;
     }
 }
 
@@ -473,6 +591,11 @@ SCProfileDetectCtx *SCProfilingRuleInitCtx(void) {
 
 void SCProfilingRuleDestroyCtx(SCProfileDetectCtx *ctx) {
     if (ctx != NULL) {
+        pthread_mutex_lock(&profiling_rules_ctx_m);
+        if (profiling_rules_ctx == ctx)
+            profiling_rules_ctx = NULL;
+        pthread_mutex_unlock(&profiling_rules_ctx_m);
+
         SCProfilingRuleDump(ctx);
         if (ctx->data != NULL)
             SCFree(ctx->data);
@@ -489,8 +612,38 @@ void SCProfilingRuleThreadSetup(SCProfileDetectCtx *ctx, DetectEngineThreadCtx *
     if (a != NULL) {
         memset(a, 0x00, sizeof(SCProfileData) * ctx->size);
 
+        pthread_mutex_lock(&ctx->data_m);
         det_ctx->rule_perf_data = a;
         det_ctx->rule_perf_data_size = ctx->size;
+        det_ctx->rule_perf_gen = ctx->reset_gen;
+        det_ctx->rule_perf_next = ctx->threads;
+        ctx->threads = det_ctx;
+        pthread_mutex_unlock(&ctx->data_m);
+    }
+}
+
+/** \internal
+ *  \brief Add a thread's data to the merged data
+ *
+ *  The thread may still be updating its data, so the result is a close
+ *  approximation. Data from before the last reset is skipped.
+ */
+static void SCProfilingRuleThreadMergeData(SCProfileDetectCtx *ctx, SCProfileData *data,
+        DetectEngineThreadCtx *det_ctx)
+{
+    if (det_ctx->rule_perf_gen != ctx->reset_gen)
+        return;
+
+    int i, b;
+    for (i = 0; i < det_ctx->rule_perf_data_size && (uint32_t)i < ctx->size; i++) {
+        data[i].checks += det_ctx->rule_perf_data[i].checks;
+        data[i].matches += det_ctx->rule_perf_data[i].matches;
+        data[i].ticks_match += det_ctx->rule_perf_data[i].ticks_match;
+        data[i].ticks_no_match += det_ctx->rule_perf_data[i].ticks_no_match;
+        if (det_ctx->rule_perf_data[i].max > data[i].max)
+            data[i].max = det_ctx->rule_perf_data[i].max;
+        for (b = 0; b < SC_PROFILE_RULE_HIST_SIZE; b++)
+            data[i].hist[b] += det_ctx->rule_perf_data[i].hist[b];
     }
 }
 
@@ -499,24 +652,27 @@ static void SCProfilingRuleThreadMerge(DetectEngineCtx *de_ctx, DetectEngineThre
         det_ctx == NULL || det_ctx->rule_perf_data == NULL)
         return;
 
-    int i;
-    for (i = 0; i < det_ctx->rule_perf_data_size; i++) {
-        de_ctx->profile_ctx->data[i].checks += det_ctx->rule_perf_data[i].checks;
-        de_ctx->profile_ctx->data[i].matches += det_ctx->rule_perf_data[i].matches;
-        de_ctx->profile_ctx->data[i].ticks_match += det_ctx->rule_perf_data[i].ticks_match;
-        de_ctx->profile_ctx->data[i].ticks_no_match += det_ctx->rule_perf_data[i].ticks_no_match;
-        if (det_ctx->rule_perf_data[i].max > de_ctx->profile_ctx->data[i].max)
-            de_ctx->profile_ctx->data[i].max = det_ctx->rule_perf_data[i].max;
-    }
+    SCProfilingRuleThreadMergeData(de_ctx->profile_ctx, de_ctx->profile_ctx->data, det_ctx);
 }
 
 void SCProfilingRuleThreadCleanup(DetectEngineThreadCtx *det_ctx) {
     if (det_ctx == NULL || det_ctx->de_ctx == NULL || det_ctx->rule_perf_data == NULL)
         return;
 
-    pthread_mutex_lock(&det_ctx->de_ctx->profile_ctx->data_m);
+    SCProfileDetectCtx *ctx = det_ctx->de_ctx->profile_ctx;
+    pthread_mutex_lock(&ctx->data_m);
     SCProfilingRuleThreadMerge(det_ctx->de_ctx, det_ctx);
-    pthread_mutex_unlock(&det_ctx->de_ctx->profile_ctx->data_m);
+
+    DetectEngineThreadCtx **t = &ctx->threads;
+    while (*t != NULL) {
+        if (*t == det_ctx) {
+            *t = det_ctx->rule_perf_next;
+            break;
+        }
+        t = &(*t)->rule_perf_next;
+    }
+    det_ctx->rule_perf_next = NULL;
+    pthread_mutex_unlock(&ctx->data_m);
 
     SCFree(det_ctx->rule_perf_data);
     det_ctx->rule_perf_data = NULL;
@@ -559,8 +715,150 @@ SCProfilingRuleInitCounters(DetectEngineCtx *de_ctx)
         }
     }
 
+    pthread_mutex_lock(&profiling_rules_ctx_m);
+    profiling_rules_ctx = de_ctx->profile_ctx;
+    pthread_mutex_unlock(&profiling_rules_ctx_m);
+
     SCLogInfo("Registered %"PRIu32" rule profiling counters.", count);
 }
 
+#ifdef BUILD_UNIX_SOCKET
+/**
+ * \brief Unix socket command returning the top rules of the live profile.
+ *
+ * The data of the exited and the running threads is merged on demand.
+ * Rules are sorted by the configured sort order.
+ *
+ * \param cmd arguments, "top" is the number of rules to return
+ */
+TmEcode SCProfilingRuleUnixTop(json_t *cmd, json_t *answer, void *data)
+{
+    SCEnter();
+    uint32_t top = 10;
+    uint32_t i;
+
+    json_t *jarg = json_object_get(cmd, "top");
+    if (jarg != NULL) {
+        if (!json_is_integer(jarg) || json_integer_value(jarg) <= 0) {
+            json_object_set_new(answer, "message",
+                    json_string("top is not a positive integer"));
+            SCReturnInt(TM_ECODE_FAILED);
+        }
+        top = (uint32_t)MIN(json_integer_value(jarg), UINT32_MAX);
+    }
+
+    pthread_mutex_lock(&profiling_rules_ctx_m);
+    SCProfileDetectCtx *ctx = profiling_rules_ctx;
+    if (ctx == NULL || ctx->data == NULL || ctx->size == 0) {
+        pthread_mutex_unlock(&profiling_rules_ctx_m);
+        json_object_set_new(answer, "message",
+                json_string("rule profiling is not active"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    uint32_t count = ctx->size;
+    SCProfileData *merged = SCMalloc(sizeof(SCProfileData) * count);
+    SCProfileSummary *summary = SCMalloc(sizeof(SCProfileSummary) * count);
+    if (unlikely(merged == NULL || summary == NULL)) {
+        pthread_mutex_unlock(&profiling_rules_ctx_m);
+        if (merged != NULL)
+            SCFree(merged);
+        if (summary != NULL)
+            SCFree(summary);
+        json_object_set_new(answer, "message",
+                json_string("internal error at memory allocation"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    pthread_mutex_lock(&ctx->data_m);
+    memcpy(merged, ctx->data, sizeof(SCProfileData) * count);
+    DetectEngineThreadCtx *det_ctx;
+    for (det_ctx = ctx->threads; det_ctx != NULL; det_ctx = det_ctx->rule_perf_next) {
+        SCProfilingRuleThreadMergeData(ctx, merged, det_ctx);
+    }
+    pthread_mutex_unlock(&ctx->data_m);
+    pthread_mutex_unlock(&profiling_rules_ctx_m);
+
+    uint64_t total_ticks = SCProfilingRuleBuildSummary(merged, count, summary);
+    SCFree(merged);
+
+    json_t *jdata = json_object();
+    json_t *jarray = json_array();
+    if (jdata == NULL || jarray == NULL) {
+        if (jdata != NULL)
+            json_decref(jdata);
+        if (jarray != NULL)
+            json_decref(jarray);
+        SCFree(summary);
+        json_object_set_new(answer, "message",
+                json_string("internal error at json object creation"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    for (i = 0; i < MIN(count, top); i++) {
+        /* rules without checks are sorted last */
+        if (summary[i].checks == 0)
+            break;
+
+        json_t *jrule = json_object();
+        if (jrule == NULL)
+            break;
+        json_object_set_new(jrule, "sid", json_integer(summary[i].sid));
+        json_object_set_new(jrule, "gid", json_integer(summary[i].gid));
+        json_object_set_new(jrule, "rev", json_integer(summary[i].rev));
+        json_object_set_new(jrule, "ticks", json_integer(summary[i].ticks));
+        json_object_set_new(jrule, "percent", json_real(total_ticks ?
+                    (double)summary[i].ticks / (double)total_ticks * 100 : 0));
+        json_object_set_new(jrule, "checks", json_integer(summary[i].checks));
+        json_object_set_new(jrule, "matches", json_integer(summary[i].matches));
+        json_object_set_new(jrule, "max_ticks", json_integer(summary[i].max));
+        json_object_set_new(jrule, "avg_ticks", json_real(summary[i].avgticks));
+        json_object_set_new(jrule, "avg_ticks_match",
+                json_real(summary[i].avgticks_match));
+        json_object_set_new(jrule, "avg_ticks_no_match",
+                json_real(summary[i].avgticks_no_match));
+        json_object_set_new(jrule, "p50_ticks", json_integer(summary[i].p50));
+        json_object_set_new(jrule, "p99_ticks", json_integer(summary[i].p99));
+        json_array_append_new(jarray, jrule);
+    }
+    SCFree(summary);
+
+    json_object_set_new(jdata, "count", json_integer(json_array_size(jarray)));
+    json_object_set_new(jdata, "rules", jarray);
+    json_object_set_new(answer, "message", jdata);
+    SCReturnInt(TM_ECODE_OK);
+}
+
+/**
+ * \brief Unix socket command resetting the live profile.
+ *
+ * The merged data of the exited threads is cleared right away. The
+ * running threads clear their own data on their next update.
+ */
+TmEcode SCProfilingRuleUnixReset(json_t *cmd, json_t *answer, void *data)
+{
+    SCEnter();
+
+    pthread_mutex_lock(&profiling_rules_ctx_m);
+    SCProfileDetectCtx *ctx = profiling_rules_ctx;
+    if (ctx == NULL) {
+        pthread_mutex_unlock(&profiling_rules_ctx_m);
+        json_object_set_new(answer, "message",
+                json_string("rule profiling is not active"));
+        SCReturnInt(TM_ECODE_FAILED);
+    }
+
+    pthread_mutex_lock(&ctx->data_m);
+    ctx->reset_gen++;
+    if (ctx->data != NULL)
+        SCProfileDataClear(ctx->data, ctx->size);
+    pthread_mutex_unlock(&ctx->data_m);
+    pthread_mutex_unlock(&profiling_rules_ctx_m);
+
+    json_object_set_new(answer, "message", json_string("rule profile reset"));
+    SCReturnInt(TM_ECODE_OK);
+}
+#endif /* BUILD_UNIX_SOCKET */
+
 #endif /* PROFILING */
 
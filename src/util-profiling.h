@@ -30,6 +30,10 @@
 #include "util-profiling-locks.h"
 #include "util-cpu.h"
 
+#ifdef BUILD_UNIX_SOCKET
+#include <jansson.h>
+#endif
+
 extern int profiling_rules_enabled;
 extern int profiling_packets_enabled;
 extern __thread int profiling_rules_entered;
@@ -156,6 +160,26 @@ PktProfiling *SCProfilePacketStart(void);
         }                                                           \
     }
 
+/** batch calls: the ticks of the call are split evenly over the packets */
+#define PACKET_PROFILING_TMM_BATCH_START(ticks)                     \
+    if (profiling_packets_enabled) {                                \
+        (ticks) = UtilCpuGetTicks();                                \
+    }
+
+#define PACKET_PROFILING_TMM_BATCH_END(pkts, n, id, ticks)          \
+    if (profiling_packets_enabled && (id) < TMM_SIZE && (n) > 0) {  \
+        uint64_t _per = (UtilCpuGetTicks() - (ticks)) / (n);        \
+        uint16_t _i;                                                \
+        for (_i = 0; _i < (n); _i++) {                              \
+            if ((pkts)[_i]->profile == NULL)                        \
+                continue;                                           \
+            (pkts)[_i]->profile->tmm[(id)].ticks_start =            \
+                (ticks) + _i * _per;                                \
+            (pkts)[_i]->profile->tmm[(id)].ticks_end =              \
+                (ticks) + (_i + 1) * _per;                          \
+        }                                                           \
+    }
+
 #define PACKET_PROFILING_RESET(p)                                   \
     if (profiling_packets_enabled && (p)->profile != NULL) {        \
         SCFree((p)->profile);                                       \
@@ -236,6 +260,10 @@ void SCProfilingRuleInitCounters(DetectEngineCtx *);
 void SCProfilingRuleUpdateCounter(DetectEngineThreadCtx *, uint16_t, uint64_t, int);
 void SCProfilingRuleThreadSetup(struct SCProfileDetectCtx_ *, DetectEngineThreadCtx *);
 void SCProfilingRuleThreadCleanup(DetectEngineThreadCtx *);
+#ifdef BUILD_UNIX_SOCKET
+TmEcode SCProfilingRuleUnixTop(json_t *, json_t *, void *);
+TmEcode SCProfilingRuleUnixReset(json_t *, json_t *, void *);
+#endif
 
 void SCProfilingKeywordsGlobalInit(void);
 void SCProfilingKeywordDestroyCtx(DetectEngineCtx *);//struct SCProfileKeywordDetectCtx_ *);
@@ -263,6 +291,8 @@ void SCProfilingDump(void);
 
 #define PACKET_PROFILING_TMM_START(p, id)
 #define PACKET_PROFILING_TMM_END(p, id)
+#define PACKET_PROFILING_TMM_BATCH_START(ticks)
+#define PACKET_PROFILING_TMM_BATCH_END(pkts, n, id, ticks)
 
 #define PACKET_PROFILING_RESET(p)
 
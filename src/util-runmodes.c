@@ -322,6 +322,32 @@ char *RunmodeAutoFpCreatePickupQueuesString(int n) {
     return queues;
 }
 
+/**
+ *  \brief get the queue handler to use between the capture and the
+ *         detect threads in autofp modes.
+ *
+ *  Set by "autofp-queue-handler" in the yaml, "flow" (default) or
+ *  "flow-ring".
+ *
+ *  \retval name queue handler name
+ */
+char *RunmodeAutoFpGetQueueHandler(void) {
+    char *handler = NULL;
+
+    if (ConfGet("autofp-queue-handler", &handler) != 1)
+        return "flow";
+
+    if (strcasecmp(handler, "flow") == 0) {
+        return "flow";
+    } else if (strcasecmp(handler, "flow-ring") == 0) {
+        return "flow-ring";
+    }
+
+    SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY, "Invalid entry \"%s\" "
+               "for autofp-queue-handler in conf.  Killing engine.", handler);
+    exit(EXIT_FAILURE);
+}
+
 /**
  *  \param de_ctx detection engine, can be NULL
  */
@@ -380,7 +406,7 @@ int RunModeSetLiveCaptureAutoFp(DetectEngineCtx *de_ctx,
             ThreadVars *tv_receive =
                 TmThreadCreatePacketHandler(thread_name,
                         "packetpool", "packetpool",
-                        queues, "flow", "pktacqloop");
+                        queues, RunmodeAutoFpGetQueueHandler(), "pktacqloop");
             if (tv_receive == NULL) {
                 SCLogError(SC_ERR_RUNMODE, "TmThreadsCreate failed");
                 exit(EXIT_FAILURE);
@@ -443,7 +469,7 @@ int RunModeSetLiveCaptureAutoFp(DetectEngineCtx *de_ctx,
                 ThreadVars *tv_receive =
                     TmThreadCreatePacketHandler(thread_name,
                             "packetpool", "packetpool",
-                            queues, "flow", "pktacqloop");
+                            queues, RunmodeAutoFpGetQueueHandler(), "pktacqloop");
                 if (tv_receive == NULL) {
                     SCLogError(SC_ERR_RUNMODE, "TmThreadsCreate failed");
                     exit(EXIT_FAILURE);
@@ -485,7 +511,7 @@ int RunModeSetLiveCaptureAutoFp(DetectEngineCtx *de_ctx,
         }
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(thread_name,
-                                        qname, "flow",
+                                        qname, RunmodeAutoFpGetQueueHandler(),
                                         "packetpool", "packetpool",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
@@ -966,7 +992,7 @@ int RunModeSetIPSAutoFp(DetectEngineCtx *de_ctx,
         ThreadVars *tv_receive =
             TmThreadCreatePacketHandler(thread_name,
                     "packetpool", "packetpool",
-                    queues, "flow", "pktacqloop");
+                    queues, RunmodeAutoFpGetQueueHandler(), "pktacqloop");
         if (tv_receive == NULL) {
             SCLogError(SC_ERR_RUNMODE, "TmThreadsCreate failed");
             exit(EXIT_FAILURE);
@@ -1006,7 +1032,7 @@ int RunModeSetIPSAutoFp(DetectEngineCtx *de_ctx,
         }
         ThreadVars *tv_detect_ncpu =
             TmThreadCreatePacketHandler(thread_name,
-                                        qname, "flow",
+                                        qname, RunmodeAutoFpGetQueueHandler(),
                                         "verdict-queue", "simple",
                                         "varslot");
         if (tv_detect_ncpu == NULL) {
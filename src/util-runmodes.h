@@ -75,5 +75,6 @@ int RunModeSetIPSWorker(DetectEngineCtx *de_ctx,
                         char *decode_mod_name);
 
 char *RunmodeAutoFpCreatePickupQueuesString(int n);
+char *RunmodeAutoFpGetQueueHandler(void);
 
 #endif /* __UTIL_RUNMODES_H__ */
@@ -29,16 +29,37 @@
 #include "detect.h"
 #include "threads.h"
 #include "util-debug.h"
+#include "util-time.h"
 
 static struct timeval current_time = { 0, 0 };
 //static SCMutex current_time_mutex = SCMUTEX_INITIALIZER;
 static SCSpinlock current_time_spinlock;
 static char live = TRUE;
 
+/** clock of a time domain, only written by the thread that owns it */
+typedef struct TimeDomain_ {
+    SCSpinlock lock;
+    struct timeval tv;
+    int active;
+} TimeDomain;
+
+static TimeDomain time_domains[TIME_DOMAIN_MAX];
+/** number of active time domains, protected by current_time_spinlock */
+static int time_domains_active = 0;
+
+static void TimeGetDomainsMin(struct timeval *);
+
 void TimeInit(void)
 {
     SCSpinInit(&current_time_spinlock, 0);
 
+    int i;
+    for (i = 0; i < TIME_DOMAIN_MAX; i++) {
+        memset(&time_domains[i], 0x00, sizeof(TimeDomain));
+        SCSpinInit(&time_domains[i].lock, 0);
+    }
+    time_domains_active = 0;
+
     /* Initialize Time Zone settings. */
     tzset();
 }
@@ -46,6 +67,11 @@ void TimeInit(void)
 void TimeDeinit(void)
 {
     SCSpinDestroy(&current_time_spinlock);
+
+    int i;
+    for (i = 0; i < TIME_DOMAIN_MAX; i++) {
+        SCSpinDestroy(&time_domains[i].lock);
+    }
 }
 
 void TimeModeSetLive(void)
@@ -100,13 +126,142 @@ void TimeGet(struct timeval *tv)
         SCSpinLock(&current_time_spinlock);
         tv->tv_sec = current_time.tv_sec;
         tv->tv_usec = current_time.tv_usec;
+        int domains = time_domains_active;
         SCSpinUnlock(&current_time_spinlock);
+
+        if (domains > 0)
+            TimeGetDomainsMin(tv);
     }
 
     SCLogDebug("time we got is %" PRIuMAX " sec, %" PRIuMAX " usec",
                (uintmax_t)tv->tv_sec, (uintmax_t)tv->tv_usec);
 }
 
+/**
+ *  \brief Activate a time domain
+ *
+ *  A time domain is a clock of its own, used by a reader that processes
+ *  its packets next to other readers with unrelated timestamps. The
+ *  domain is numbered from 1, domain 0 is the engine's own clock.
+ *
+ *  \retval 0 ok
+ *  \retval -1 invalid or already active domain
+ */
+int TimeDomainActivate(uint8_t domain)
+{
+    if (domain == 0 || domain >= TIME_DOMAIN_MAX)
+        return -1;
+
+    TimeDomain *d = &time_domains[domain];
+    SCSpinLock(&d->lock);
+    if (d->active) {
+        SCSpinUnlock(&d->lock);
+        return -1;
+    }
+    d->active = 1;
+    d->tv.tv_sec = 0;
+    d->tv.tv_usec = 0;
+    SCSpinUnlock(&d->lock);
+
+    SCSpinLock(&current_time_spinlock);
+    time_domains_active++;
+    SCSpinUnlock(&current_time_spinlock);
+    return 0;
+}
+
+/**
+ *  \brief Release a time domain once its reader is done
+ *
+ *  The clock of the domain is kept, so that the flows still in the hash
+ *  keep their timeouts, but it no longer holds back the engine clock.
+ */
+void TimeDomainRelease(uint8_t domain)
+{
+    if (domain == 0 || domain >= TIME_DOMAIN_MAX)
+        return;
+
+    TimeDomain *d = &time_domains[domain];
+    SCSpinLock(&d->lock);
+    int was_active = d->active;
+    d->active = 0;
+    SCSpinUnlock(&d->lock);
+
+    if (was_active) {
+        SCSpinLock(&current_time_spinlock);
+        time_domains_active--;
+        SCSpinUnlock(&current_time_spinlock);
+    }
+}
+
+/** \brief get the number of active time domains */
+int TimeDomainsActive(void)
+{
+    SCSpinLock(&current_time_spinlock);
+    int domains = time_domains_active;
+    SCSpinUnlock(&current_time_spinlock);
+    return domains;
+}
+
+/** \brief set the clock of a time domain, domain 0 sets the engine clock */
+void TimeSetDomain(uint8_t domain, struct timeval *tv)
+{
+    if (domain == 0) {
+        TimeSet(tv);
+        return;
+    }
+    if (live == TRUE || tv == NULL || domain >= TIME_DOMAIN_MAX)
+        return;
+
+    TimeDomain *d = &time_domains[domain];
+    SCSpinLock(&d->lock);
+    d->tv.tv_sec = tv->tv_sec;
+    d->tv.tv_usec = tv->tv_usec;
+    SCSpinUnlock(&d->lock);
+}
+
+/** \brief get the clock of a time domain, domain 0 gets the engine clock */
+void TimeGetDomain(uint8_t domain, struct timeval *tv)
+{
+    if (tv == NULL)
+        return;
+
+    if (domain == 0 || live == TRUE || domain >= TIME_DOMAIN_MAX) {
+        TimeGet(tv);
+        return;
+    }
+
+    TimeDomain *d = &time_domains[domain];
+    SCSpinLock(&d->lock);
+    tv->tv_sec = d->tv.tv_sec;
+    tv->tv_usec = d->tv.tv_usec;
+    SCSpinUnlock(&d->lock);
+}
+
+/** \internal
+ *  \brief get the clock of the active time domain that is furthest
+ *         behind, so that state shared between the domains is never
+ *         timed out early for one of them. Domains that haven't seen a
+ *         packet yet are skipped. tv is left alone if no domain has a
+ *         clock yet. */
+static void TimeGetDomainsMin(struct timeval *tv)
+{
+    struct timeval min = { 0, 0 };
+    int i;
+
+    for (i = 1; i < TIME_DOMAIN_MAX; i++) {
+        TimeDomain *d = &time_domains[i];
+        SCSpinLock(&d->lock);
+        if (d->active && d->tv.tv_sec != 0 &&
+            (min.tv_sec == 0 || timercmp(&d->tv, &min, <))) {
+            min = d->tv;
+        }
+        SCSpinUnlock(&d->lock);
+    }
+
+    if (min.tv_sec != 0)
+        *tv = min;
+}
+
 /** \brief increment the time in the engine
  *  \param tv_sec seconds to increment the time with */
 void TimeSetIncrementTime(uint32_t tv_sec)
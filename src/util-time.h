@@ -34,12 +34,21 @@ typedef struct SCTimeval32_ {
     uint32_t tv_usec;
 } SCTimeval32;
 
+/** max number of time domains, including the engine clock (domain 0) */
+#define TIME_DOMAIN_MAX 64
+
 void TimeInit(void);
 void TimeDeinit(void);
 
 void TimeSet(struct timeval *);
 void TimeGet(struct timeval *);
 
+int TimeDomainActivate(uint8_t);
+void TimeDomainRelease(uint8_t);
+int TimeDomainsActive(void);
+void TimeSetDomain(uint8_t, struct timeval *);
+void TimeGetDomain(uint8_t, struct timeval *);
+
 void TimeSetToCurrentTime(void);
 void TimeSetIncrementTime(uint32_t);
 
@@ -95,6 +95,75 @@ static void VariableNameFree(void *data) {
     SCFree(fn);
 }
 
+/** names of all rulesets loaded so far, with their idx. Flows keep their
+ *  vars and flowbits by idx, so a name keeps its idx over rule reloads
+ *  and an idx is never given to another name. */
+static HashListTable *g_variable_names = NULL;
+static uint16_t g_variable_names_idx = 0;
+static SCMutex g_variable_names_mutex = SCMUTEX_INITIALIZER;
+
+/** \internal
+ *  \brief Get the process wide idx of a name, a new name gets the next
+ *         free idx
+ *  \retval 0 in case of error
+ *  \retval _ the idx.
+ */
+static uint16_t VariableNameGetGlobalIdx(const VariableName *fn)
+{
+    uint16_t idx = 0;
+
+    SCMutexLock(&g_variable_names_mutex);
+    if (g_variable_names == NULL) {
+        g_variable_names = HashListTableInit(4096, VariableNameHash,
+                VariableNameCompare, VariableNameFree);
+        if (g_variable_names == NULL)
+            goto end;
+    }
+
+    VariableName *lookup_fn = (VariableName *)HashListTableLookup(g_variable_names, (void *)fn, 0);
+    if (lookup_fn != NULL) {
+        idx = lookup_fn->idx;
+        goto end;
+    }
+
+    if (g_variable_names_idx == UINT16_MAX) {
+        SCLogError(SC_ERR_INVALID_ARGUMENT, "too many variable names");
+        goto end;
+    }
+
+    VariableName *gfn = SCMalloc(sizeof(VariableName));
+    if (unlikely(gfn == NULL))
+        goto end;
+    memset(gfn, 0, sizeof(VariableName));
+    gfn->type = fn->type;
+    gfn->name = SCStrdup(fn->name);
+    if (gfn->name == NULL) {
+        VariableNameFree(gfn);
+        goto end;
+    }
+    gfn->idx = g_variable_names_idx + 1;
+    if (HashListTableAdd(g_variable_names, (void *)gfn, 0) != 0) {
+        VariableNameFree(gfn);
+        goto end;
+    }
+    idx = ++g_variable_names_idx;
+end:
+    SCMutexUnlock(&g_variable_names_mutex);
+    return idx;
+}
+
+/** \brief Free the process wide name table, at shutdown */
+void VariableNameFreeGlobalHash(void)
+{
+    SCMutexLock(&g_variable_names_mutex);
+    if (g_variable_names != NULL) {
+        HashListTableFree(g_variable_names);
+        g_variable_names = NULL;
+    }
+    g_variable_names_idx = 0;
+    SCMutexUnlock(&g_variable_names_mutex);
+}
+
 /** \brief Initialize the Name idx hash.
  *  \param de_ctx Ptr to the detection engine ctx.
  *  \retval -1 in case of error
@@ -125,6 +194,7 @@ void VariableNameFreeHash(DetectEngineCtx *de_ctx) {
 }
 
 /** \brief Get a name idx for a name. If the name is already used reuse the idx.
+ *         The idx is the same in every ruleset that uses the name.
  *  \param name nul terminated string with the name
  *  \param type variable type (DETECT_FLOWBITS, DETECT_PKTVAR, etc)
  *  \retval 0 in case of error
@@ -146,9 +216,13 @@ uint16_t VariableNameGetIdx(DetectEngineCtx *de_ctx, char *name, uint8_t type) {
 
     VariableName *lookup_fn = (VariableName *)HashListTableLookup(de_ctx->variable_names, (void *)fn, 0);
     if (lookup_fn == NULL) {
-        de_ctx->variable_names_idx++;
+        idx = fn->idx = VariableNameGetGlobalIdx(fn);
+        if (idx == 0)
+            goto error;
 
-        idx = fn->idx = de_ctx->variable_names_idx;
+        /* highest idx of this ruleset */
+        if (idx > de_ctx->variable_names_idx)
+            de_ctx->variable_names_idx = idx;
         HashListTableAdd(de_ctx->variable_names, (void *)fn, 0);
         HashListTableAdd(de_ctx->variable_idxs, (void *)fn, 0);
     } else {
@@ -40,4 +40,8 @@ typedef struct Vector_ {
 
 #endif /* defined(__SSE3__) */
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif /* defined(__AVX2__) */
+
 #endif /* __UTIL_VECTOR_H__ */